@@ -0,0 +1 @@
+libc := unknown
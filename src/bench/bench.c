@@ -0,0 +1,141 @@
+#include "bench.h"
+#include "macro.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <time.h>
+
+enum { NSEC_PER_SEC = 1000000000 };
+
+static enum bench_format bench_format = BENCH_FORMAT_TEXT;
+static char const *bench_filter;
+/* Overrides the sample count of every benchmark if non-zero */
+static size_t bench_nsamples;
+
+static int bench_compare(void const *a, void const *b) {
+    uint64_t const x = *(uint64_t const *)a;
+    uint64_t const y = *(uint64_t const *)b;
+    return (x > y) - (x < y);
+}
+
+static inline uint64_t bench_percentile(uint64_t const *sorted, size_t nsamples, unsigned percentile) {
+    size_t idx = (nsamples * percentile + 99) / 100;
+    return sorted[idx ? idx - 1 : 0];
+}
+
+void bench_configure(enum bench_format format, char const *filter, size_t nsamples) {
+    bench_format = format;
+    bench_filter = filter;
+    bench_nsamples = nsamples;
+}
+
+/* Benchmarks are selected by substring */
+bool bench_enabled(char const *name) {
+    return !bench_filter || strstr(name, bench_filter);
+}
+
+bool bench_any_enabled(char const *const *names, size_t nnames) {
+    for(size_t i = 0; i < nnames; i++) {
+        if(bench_enabled(names[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t bench_samples(size_t nsamples) {
+    return bench_nsamples ? bench_nsamples : nsamples;
+}
+
+uint64_t bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NSEC_PER_SEC + (uint64_t)ts.tv_nsec;
+}
+
+/* Times nsamples samples of batch calls to fn each, after a warmup.
+ * Batching amortizes the cost of reading the clock for operations
+ * taking no more than a few tens of ns */
+int bench_run(char const *name, bench_fn fn, void *data, size_t nsamples, unsigned batch) {
+    uint64_t *samples;
+    uint64_t start;
+    uint64_t samplestart;
+    int status = 0;
+
+    if(!bench_enabled(name)) {
+        return 0;
+    }
+
+    nsamples = bench_samples(nsamples);
+    samples = malloc(nsamples * sizeof(*samples));
+    if(!samples) {
+        fputs("Could not allocate samples\n", stderr);
+        return -1;
+    }
+
+    for(unsigned i = 0; i < BENCH_WARMUP && !status; i++) {
+        status = fn(data);
+    }
+
+    start = bench_now();
+    for(size_t i = 0; i < nsamples && !status; i++) {
+        samplestart = bench_now();
+        for(unsigned j = 0; j < batch; j++) {
+            status |= fn(data);
+        }
+        samples[i] = bench_now() - samplestart;
+    }
+
+    if(status) {
+        bench_report_status(name, "failed");
+    }
+    else {
+        bench_report(name, samples, nsamples, batch, bench_now() - start);
+    }
+
+    free(samples);
+    return status;
+}
+
+/* Each sample holds the time taken by batch operations */
+void bench_report(char const *name, uint64_t *samples, size_t nsamples, unsigned batch, uint64_t elapsed) {
+    uint64_t const nops = (uint64_t)nsamples * batch;
+    double opsps;
+
+    if(!nsamples) {
+        bench_report_status(name, "no samples");
+        return;
+    }
+
+    qsort(samples, nsamples, sizeof(*samples), bench_compare);
+    opsps = (double)nops * NSEC_PER_SEC / (double)(elapsed ? elapsed : 1);
+
+    if(bench_format == BENCH_FORMAT_JSON) {
+        printf("{\"name\":\"%s\",\"version\":\"%s\",\"ops\":%llu,\"ops_per_sec\":%.0f,"
+               "\"min_ns\":%.1f,\"median_ns\":%.1f,\"p99_ns\":%.1f,\"max_ns\":%.1f}\n",
+               name, STR_EXPAND(FAND_VERSION), (unsigned long long)nops, opsps,
+               (double)samples[0] / batch,
+               (double)bench_percentile(samples, nsamples, 50) / batch,
+               (double)bench_percentile(samples, nsamples, 99) / batch,
+               (double)samples[nsamples - 1] / batch);
+    }
+    else {
+        printf("%-36s %8llu ops %12.0f ops/s  median %10.3f us  p99 %10.3f us\n",
+               name, (unsigned long long)nops, opsps,
+               bench_percentile(samples, nsamples, 50) / 1000.0 / batch,
+               bench_percentile(samples, nsamples, 99) / 1000.0 / batch);
+    }
+    fflush(stdout);
+}
+
+void bench_report_status(char const *name, char const *status) {
+    if(bench_format == BENCH_FORMAT_JSON) {
+        printf("{\"name\":\"%s\",\"version\":\"%s\",\"status\":\"%s\"}\n", name, STR_EXPAND(FAND_VERSION), status);
+    }
+    else {
+        printf("%-36s %s\n", name, status);
+    }
+    fflush(stdout);
+}
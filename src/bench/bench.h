@@ -0,0 +1,29 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Untimed iterations preceding each benchmark */
+enum { BENCH_WARMUP = 256 };
+
+enum bench_format {
+    BENCH_FORMAT_TEXT,
+    /* One JSON object per line */
+    BENCH_FORMAT_JSON
+};
+
+/* One operation of a benchmark, non-zero on failure */
+typedef int(*bench_fn)(void *);
+
+void bench_configure(enum bench_format format, char const *filter, size_t nsamples);
+bool bench_enabled(char const *name);
+bool bench_any_enabled(char const *const *names, size_t nnames);
+size_t bench_samples(size_t nsamples);
+uint64_t bench_now(void);
+int bench_run(char const *name, bench_fn fn, void *data, size_t nsamples, unsigned batch);
+void bench_report(char const *name, uint64_t *samples, size_t nsamples, unsigned batch, uint64_t elapsed);
+void bench_report_status(char const *name, char const *status);
+
+#endif /* BENCH_H */
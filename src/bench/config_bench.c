@@ -0,0 +1,175 @@
+#include "bench.h"
+#include "cache.h"
+#include "cache_mock.h"
+#include "config.h"
+#include "config_bench.h"
+#include "fakesys.h"
+#include "filesystem.h"
+#include "macro.h"
+#include "mock.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#define CONFIG_BENCH_PATH "/tmp/_fand_bench.conf"
+#define CACHE_BENCH_ROOT "/tmp/_fand_bench_cache"
+/* Written by cache_write in test builds */
+#define CACHE_BENCH_FILE "/tmp/amdgpu-fand.cache"
+
+enum { CONFIG_BENCH_SAMPLES = 4096 };
+enum { CACHE_BENCH_SAMPLES = 4096 };
+
+/* The example configuration shipped with the daemon */
+static char const config_bench_contents[] =
+    "# Interval with which the fan speed is to be adjusted\n"
+    "interval = 2 # seconds\n"
+    "\n"
+    "sample_max_age = 0 # milliseconds\n"
+    "\n"
+    "# Hysteresis threshold\n"
+    "hysteresis = 3 # degrees celsius\n"
+    "\n"
+    "aggressive_throttle = true\n"
+    "fan_curve_offload = false\n"
+    "\n"
+    "# Temperature (deg celsius)- fan speed (percent) matrix\n"
+    "matrix=('50::5'\n"
+    "        '55::10'\n"
+    "        '65::30'\n"
+    "        '75::60'\n"
+    "        '80::100')\n"
+    "\n"
+    "matrix_card1=('40::20'\n"
+    "              '70::100')\n";
+
+static int config_bench_write(char const *path, void const *contents, size_t size) {
+    int fd = open(path, O_CREAT | O_TRUNC | O_WRONLY | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if(fd == -1) {
+        fprintf(stderr, "Could not create %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    if(write(fd, contents, size) != (ssize_t)size) {
+        fprintf(stderr, "Could not write %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    close(fd);
+    return 0;
+}
+
+static int config_bench_parse(void *data) {
+    return config_parse(CONFIG_BENCH_PATH, data);
+}
+
+static int config_bench_load(void *data) {
+    return config_load(CONFIG_BENCH_PATH, data);
+}
+
+void bench_config_parse(void) {
+    static char const *const names[] = { "config_parse/example", "config_load/unchanged" };
+    struct fand_config config = { 0 };
+    int logmask;
+
+    if(!bench_any_enabled(names, array_size(names))) {
+        return;
+    }
+
+    logmask = setlogmask(LOG_UPTO(LOG_ERR));
+
+    if(config_bench_write(CONFIG_BENCH_PATH, config_bench_contents, sizeof(config_bench_contents) - 1) == 0) {
+        bench_run(names[0], config_bench_parse, &config, CONFIG_BENCH_SAMPLES, 1);
+
+        /* Files modified within the last 100 ms are read again on every load */
+        nanosleep(&(struct timespec){ .tv_nsec = 150000000 }, 0);
+        bench_run(names[1], config_bench_load, &config, CONFIG_BENCH_SAMPLES, 1);
+    }
+
+    unlink(CONFIG_BENCH_PATH);
+    setlogmask(logmask);
+}
+
+static bool cache_bench_padded(void) {
+    return true;
+}
+
+static bool cache_bench_unpadded(void) {
+    return false;
+}
+
+/* Matches the check done outside of tests */
+static bool cache_bench_exists_in_sysfs(char const *file) {
+    char const *root = fsys_root();
+    size_t root_len = strlen(root);
+
+    return fsys_file_exists(file) && strncmp(file, root, root_len) == 0 && strncmp(file + root_len, "/sys/", 5) == 0;
+}
+
+static int cache_bench_load(void *data) {
+    (void)data;
+    return cache_load();
+}
+
+/* Caches the paths of every card of a synthetic tree */
+static int cache_bench_create(void) {
+    struct fakesys_card const card = { .temp = 50000, .pwm = 128 };
+
+    if(fakesys_create(CACHE_BENCH_ROOT, FAND_MAX_CARDS, &card) || fsys_set_root(CACHE_BENCH_ROOT)) {
+        return -1;
+    }
+
+    memset(&fand_cache, 0, sizeof(fand_cache));
+    for(unsigned i = 0; i < FAND_MAX_CARDS; i++) {
+        if(fakesys_attr_path(fand_cache.cards[i].pwm, sizeof(fand_cache.cards[i].pwm), fsys_root(), i, "pwm1") ||
+           fakesys_attr_path(fand_cache.cards[i].pwm_enable, sizeof(fand_cache.cards[i].pwm_enable), fsys_root(), i, "pwm1_enable") ||
+           fakesys_attr_path(fand_cache.cards[i].temp_input, sizeof(fand_cache.cards[i].temp_input), fsys_root(), i, "temp1_input")) {
+            return -1;
+        }
+        fand_cache.cards[i].card_idx = i;
+    }
+    fand_cache.ncards = FAND_MAX_CARDS;
+
+    return cache_write();
+}
+
+void bench_cache_load(void) {
+    static char const *const names[] = { "cache_load/8cards/memcpy", "cache_load/8cards/unpackf" };
+    int logmask;
+
+    if(!bench_any_enabled(names, array_size(names))) {
+        return;
+    }
+
+    logmask = setlogmask(LOG_UPTO(LOG_ERR));
+    mkdir(CACHE_BENCH_ROOT, S_IRWXU);
+
+    mock_guard {
+        mock_cache_file_exists_in_sysfs(cache_bench_exists_in_sysfs);
+        /* An unpadded cache is copied as a whole, a padded one unpacked field by field */
+        mock_cache_struct_is_padded(cache_bench_unpadded);
+
+        if(cache_bench_create() == 0) {
+            bench_run(names[0], cache_bench_load, 0, CACHE_BENCH_SAMPLES, 1);
+            mock_cache_struct_is_padded(cache_bench_padded);
+            bench_run(names[1], cache_bench_load, 0, CACHE_BENCH_SAMPLES, 1);
+        }
+        else {
+            bench_report_status(names[0], "failed");
+        }
+    }
+
+    fsys_set_root(0);
+    unlink(CACHE_BENCH_FILE);
+    fakesys_remove(CACHE_BENCH_ROOT, FAND_MAX_CARDS);
+    rmdir(CACHE_BENCH_ROOT);
+    setlogmask(logmask);
+}
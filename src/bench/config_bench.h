@@ -0,0 +1,7 @@
+#ifndef CONFIG_BENCH_H
+#define CONFIG_BENCH_H
+
+void bench_config_parse(void);
+void bench_cache_load(void);
+
+#endif /* CONFIG_BENCH_H */
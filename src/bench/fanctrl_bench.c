@@ -0,0 +1,117 @@
+#include "bench.h"
+#include "config.h"
+#include "fanctrl.h"
+#include "fanctrl_bench.h"
+#include "fanctrl_mock.h"
+#include "fandcfg.h"
+#include "hwmon_mock.h"
+#include "mock.h"
+#include "sensor_mock.h"
+
+#include <stdbool.h>
+
+#include <syslog.h>
+
+enum { FANCTRL_BENCH_SAMPLES = 16384 };
+/* Operations per sample */
+enum { FANCTRL_BENCH_BATCH = 16 };
+
+static struct fand_config fanctrl_bench_config = {
+    .throttle = true,
+    .matrix_rows = 5,
+    .hysteresis = 3,
+    .interval = 2,
+    .matrix = { 50, 5, 55, 10, 65, 30, 75, 60, 80, 100 }
+};
+
+/* I/O is mocked, only the work done by the control loop is timed */
+static unsigned fanctrl_bench_ncards;
+static int fanctrl_bench_temp;
+static unsigned long fanctrl_bench_pwms[FAND_MAX_CARDS];
+
+static int fanctrl_bench_open(void) {
+    return (int)fanctrl_bench_ncards;
+}
+
+static unsigned fanctrl_bench_card_index(unsigned card) {
+    return card;
+}
+
+static int fanctrl_bench_init_sensor(unsigned const *card_indices, unsigned ncards) {
+    (void)card_indices;
+    (void)ncards;
+    return 0;
+}
+
+static int fanctrl_bench_set_firmware_control(unsigned card, bool enable) {
+    (void)card;
+    (void)enable;
+    return -1;
+}
+
+/* Sweeps 30 to 89 degrees, crossing every threshold of the matrix */
+static int fanctrl_bench_get_temps(int *temps, unsigned ncards) {
+    fanctrl_bench_temp = fanctrl_bench_temp >= 89 ? 30 : fanctrl_bench_temp + 1;
+    for(unsigned i = 0; i < ncards; i++) {
+        temps[i] = fanctrl_bench_temp + (int)i;
+    }
+    return 0;
+}
+
+static int fanctrl_bench_write_pwms(unsigned const *cards, unsigned long const *pwms, int *status, unsigned n) {
+    for(unsigned i = 0; i < n; i++) {
+        fanctrl_bench_pwms[cards[i]] = pwms[i];
+        status[i] = 0;
+    }
+    return 0;
+}
+
+static int fanctrl_bench_read_pwms(unsigned const *cards, int *pwms, unsigned n) {
+    for(unsigned i = 0; i < n; i++) {
+        pwms[i] = (int)fanctrl_bench_pwms[cards[i]];
+    }
+    return 0;
+}
+
+static int fanctrl_bench_adjust(void *data) {
+    (void)data;
+    return fanctrl_adjust();
+}
+
+static void fanctrl_bench_run(char const *name, unsigned ncards) {
+    if(!bench_enabled(name)) {
+        return;
+    }
+
+    fanctrl_bench_ncards = ncards;
+    fanctrl_bench_temp = 30;
+
+    if(fanctrl_init() || fanctrl_configure(&fanctrl_bench_config)) {
+        bench_report_status(name, "failed");
+    }
+    else {
+        bench_run(name, fanctrl_bench_adjust, 0, FANCTRL_BENCH_SAMPLES, FANCTRL_BENCH_BATCH);
+    }
+
+    fanctrl_release();
+}
+
+void bench_fanctrl_adjust(void) {
+    /* hwmon_close warns as nothing was opened */
+    int logmask = setlogmask(LOG_UPTO(LOG_ERR));
+
+    mock_guard {
+        mock_hwmon_open(fanctrl_bench_open);
+        mock_hwmon_card_index(fanctrl_bench_card_index);
+        mock_hwmon_set_firmware_control(fanctrl_bench_set_firmware_control);
+        mock_hwmon_read_pwms(fanctrl_bench_read_pwms);
+        mock_hwmon_write_pwms(fanctrl_bench_write_pwms);
+        mock_sensor_init(fanctrl_bench_init_sensor);
+        mock_fanctrl_get_temps(fanctrl_bench_get_temps);
+
+        fanctrl_bench_run("fanctrl_adjust/1card", 1);
+        fanctrl_bench_run("fanctrl_adjust/8cards", FAND_MAX_CARDS);
+    }
+
+    setlogmask(logmask);
+}
@@ -0,0 +1,6 @@
+#ifndef FANCTRL_BENCH_H
+#define FANCTRL_BENCH_H
+
+void bench_fanctrl_adjust(void);
+
+#endif /* FANCTRL_BENCH_H */
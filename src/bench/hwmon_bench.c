@@ -0,0 +1,152 @@
+#include "bench.h"
+#include "fakesys.h"
+#include "file.h"
+#include "hwmon_bench.h"
+#include "macro.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <fcntl.h>
+#include <sys/types.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#define HWMON_BENCH_ROOT "/tmp/_fand_bench_sysfs"
+
+enum { HWMON_BENCH_CARDS = 16 };
+enum { HWMON_BENCH_TICKS = 16384 };
+enum { HWMON_BENCH_PATH_SIZE = 256 };
+
+/* The attributes touched by one control tick for every card */
+struct hwmon_bench_tree {
+    int temp_fds[HWMON_BENCH_CARDS];
+    int pwm_fds[HWMON_BENCH_CARDS];
+};
+
+static int hwmon_bench_attr(unsigned card, char const *name) {
+    char path[HWMON_BENCH_PATH_SIZE];
+    int fd;
+
+    if(fakesys_attr_path(path, sizeof(path), HWMON_BENCH_ROOT, card, name)) {
+        return -1;
+    }
+
+    fd = open(path, O_RDWR | O_CLOEXEC);
+    if(fd == -1) {
+        perror(path);
+    }
+
+    return fd;
+}
+
+/* Synthetic sysfs tree with a hwmon interface per card */
+static int hwmon_bench_create(struct hwmon_bench_tree *tree) {
+    struct fakesys_card const card = { .temp = 54000, .pwm = 128 };
+
+    for(unsigned i = 0; i < HWMON_BENCH_CARDS; i++) {
+        tree->temp_fds[i] = -1;
+        tree->pwm_fds[i] = -1;
+    }
+
+    if(fakesys_create(HWMON_BENCH_ROOT, HWMON_BENCH_CARDS, &card)) {
+        return -1;
+    }
+
+    for(unsigned i = 0; i < HWMON_BENCH_CARDS; i++) {
+        tree->temp_fds[i] = hwmon_bench_attr(i, "temp1_input");
+        tree->pwm_fds[i] = hwmon_bench_attr(i, "pwm1");
+        if(tree->temp_fds[i] == -1 || tree->pwm_fds[i] == -1) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static void hwmon_bench_destroy(struct hwmon_bench_tree *tree) {
+    for(unsigned i = 0; i < HWMON_BENCH_CARDS; i++) {
+        if(tree->temp_fds[i] != -1) {
+            close(tree->temp_fds[i]);
+        }
+        if(tree->pwm_fds[i] != -1) {
+            close(tree->pwm_fds[i]);
+        }
+    }
+
+    fakesys_remove(HWMON_BENCH_ROOT, HWMON_BENCH_CARDS);
+    rmdir(HWMON_BENCH_ROOT);
+}
+
+/* One attribute per syscall, as before batching */
+static int hwmon_bench_tick_single(void *data) {
+    struct hwmon_bench_tree const *tree = data;
+    unsigned long value;
+    int status = 0;
+
+    for(unsigned i = 0; i < HWMON_BENCH_CARDS; i++) {
+        status |= fdread_ulong(tree->temp_fds[i], &value);
+    }
+    for(unsigned i = 0; i < HWMON_BENCH_CARDS; i++) {
+        status |= fdwrite_ulong(tree->pwm_fds[i], 128 + i);
+    }
+    for(unsigned i = 0; i < HWMON_BENCH_CARDS; i++) {
+        status |= fdread_ulong(tree->pwm_fds[i], &value);
+    }
+
+    return status;
+}
+
+/* Temperatures, pwm writes and pwm read backs as three batches */
+static int hwmon_bench_tick_batch(void *data) {
+    struct hwmon_bench_tree const *tree = data;
+    struct fdio_ulong ops[HWMON_BENCH_CARDS];
+    int nfailed;
+
+    for(unsigned i = 0; i < HWMON_BENCH_CARDS; i++) {
+        ops[i].fd = tree->temp_fds[i];
+    }
+    nfailed = fdread_ulong_batch(ops, HWMON_BENCH_CARDS);
+
+    for(unsigned i = 0; i < HWMON_BENCH_CARDS; i++) {
+        ops[i] = (struct fdio_ulong){ .fd = tree->pwm_fds[i], .value = 128 + i };
+    }
+    nfailed += fdwrite_ulong_batch(ops, HWMON_BENCH_CARDS);
+    nfailed += fdread_ulong_batch(ops, HWMON_BENCH_CARDS);
+
+    return nfailed;
+}
+
+void bench_hwmon_io(void) {
+    static char const *const names[] = {
+        "hwmon_tick/16cards/single",
+        "hwmon_tick/16cards/batch_sync",
+        "hwmon_tick/16cards/batch_uring"
+    };
+    struct hwmon_bench_tree tree;
+    int logmask;
+
+    if(!bench_any_enabled(names, array_size(names))) {
+        return;
+    }
+
+    logmask = setlogmask(LOG_UPTO(LOG_ERR));
+
+    if(hwmon_bench_create(&tree) == 0) {
+        bench_run(names[0], hwmon_bench_tick_single, &tree, HWMON_BENCH_TICKS, 1);
+        bench_run(names[1], hwmon_bench_tick_batch, &tree, HWMON_BENCH_TICKS, 1);
+
+        if(bench_enabled(names[2])) {
+            if(fdbatch_init() == 0) {
+                bench_run(names[2], hwmon_bench_tick_batch, &tree, HWMON_BENCH_TICKS, 1);
+                fdbatch_close();
+            }
+            else {
+                bench_report_status(names[2], "unavailable");
+            }
+        }
+    }
+
+    hwmon_bench_destroy(&tree);
+    setlogmask(logmask);
+}
@@ -0,0 +1,6 @@
+#ifndef HWMON_BENCH_H
+#define HWMON_BENCH_H
+
+void bench_hwmon_io(void);
+
+#endif /* HWMON_BENCH_H */
@@ -0,0 +1,328 @@
+#include "bench.h"
+#include "config.h"
+#include "fanctrl_mock.h"
+#include "fandcfg.h"
+#include "ipc.h"
+#include "ipc_bench.h"
+#include "macro.h"
+#include "mock.h"
+#include "reactor.h"
+#include "serialize.h"
+#include "server.h"
+#include "strutils.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+
+enum { IPC_BENCH_REQUESTS = 16384 };
+enum { IPC_BENCH_CONNECT_RETRIES = 1000 };
+enum { IPC_BENCH_MAX_CLIENTS = 8 };
+/* Requests in flight on a pipelined session */
+enum { IPC_BENCH_DEPTH = 16 };
+
+static struct fand_config ipc_bench_config = {
+    .throttle = false,
+    .matrix_rows = 2,
+    .hysteresis = 3,
+    .interval = 2,
+    .matrix = { 30, 20, 80, 100 }
+};
+
+static int get_temp(unsigned card) {
+    (void)card;
+    return 60;
+}
+
+static int handle_connection(struct reactor_source *source, uint32_t events) {
+    (void)events;
+    return server_accept(source->data);
+}
+
+static void ipc_bench_serve(void) {
+    struct reactor_source source = {
+        .handler = handle_connection,
+        .data = &ipc_bench_config
+    };
+
+    /* Reap children of a forking server */
+    signal(SIGCHLD, SIG_IGN);
+    unlink(DAEMON_SERVER_SOCKET);
+
+    if(reactor_init() || server_init()) {
+        fputs("Could not start server\n", stderr);
+        _exit(1);
+    }
+
+    source.fd = server_fd();
+    if(reactor_add(&source, EPOLLIN)) {
+        _exit(1);
+    }
+
+    mock_guard {
+        mock_fanctrl_get_temp(get_temp);
+        while(reactor_dispatch(-1) != FAND_FATAL_ERR) { }
+    }
+
+    _exit(1);
+}
+
+static int ipc_bench_connect(void) {
+    union unsockaddr srvaddr;
+    int fd = socket(PF_UNIX, SOCK_STREAM, 0);
+    if(fd == -1) {
+        perror("socket");
+        return -1;
+    }
+
+    memset(&srvaddr, 0, sizeof(srvaddr));
+    srvaddr.addr_un.sun_family = AF_UNIX;
+    strscpy(srvaddr.addr_un.sun_path, DAEMON_SERVER_SOCKET, sizeof(srvaddr.addr_un.sun_path));
+
+    if(connect(fd, &srvaddr.addr, sizeof(srvaddr)) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/* Single-shot round trip on a fresh connection */
+static int ipc_bench_roundtrip(void) {
+    unsigned char rsp[IPC_MAX_MSG_LENGTH];
+    ipc_request request = ipc_req_temp;
+    ssize_t nrecv;
+
+    int fd = ipc_bench_connect();
+    if(fd == -1) {
+        perror("connect");
+        return -1;
+    }
+
+    if(send(fd, &request, sizeof(request), 0) != sizeof(request)) {
+        perror("send");
+        close(fd);
+        return -1;
+    }
+
+    nrecv = recv(fd, rsp, sizeof(rsp), 0);
+    close(fd);
+
+    if(nrecv <= 0) {
+        fputs("No response from server\n", stderr);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int ipc_bench_open_session(void) {
+    unsigned char rsp[IPC_MAX_MSG_LENGTH];
+    ipc_request request = ipc_req_session;
+    union unpack_result result;
+    ssize_t nrecv;
+
+    int fd = ipc_bench_connect();
+    if(fd == -1) {
+        perror("connect");
+        return -1;
+    }
+
+    if(send(fd, &request, sizeof(request), 0) != sizeof(request)) {
+        perror("send");
+        close(fd);
+        return -1;
+    }
+
+    nrecv = recv(fd, rsp, sizeof(rsp), 0);
+    if(nrecv <= 0 || unpack_session_rsp(rsp, (size_t)nrecv, &result) != ipc_rsp_ok) {
+        fputs("Could not open session\n", stderr);
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/* Sends depth requests in a single write and awaits all responses */
+static int ipc_bench_pipeline(int fd, unsigned depth) {
+    unsigned char frames[IPC_BENCH_DEPTH * IPC_MAX_FRAME_LENGTH];
+    unsigned char rsp[IPC_BENCH_DEPTH * IPC_MAX_MSG_LENGTH];
+    size_t framelen = 0;
+    size_t nrecv = 0;
+    size_t offset = 0;
+    unsigned nresponses = 0;
+    ssize_t nbytes;
+
+    for(unsigned i = 0; i < depth; i++) {
+        framelen += (size_t)pack_request(frames + framelen, sizeof(frames) - framelen, ipc_req_temp);
+    }
+
+    if(send(fd, frames, framelen, 0) != (ssize_t)framelen) {
+        perror("send");
+        return -1;
+    }
+
+    while(nresponses < depth) {
+        nbytes = recv(fd, rsp + nrecv, sizeof(rsp) - nrecv, 0);
+        if(nbytes <= 0) {
+            fputs("No response from server\n", stderr);
+            return -1;
+        }
+        nrecv += (size_t)nbytes;
+
+        /* Each response starts with its length */
+        while(offset < nrecv && rsp[offset] && offset + rsp[offset] <= nrecv) {
+            offset += rsp[offset];
+            ++nresponses;
+        }
+    }
+
+    return 0;
+}
+
+static int ipc_bench_wait_for_server(void) {
+    struct timespec delay = { .tv_nsec = 1000000 };
+    int fd;
+
+    for(unsigned i = 0; i < IPC_BENCH_CONNECT_RETRIES; i++) {
+        fd = ipc_bench_connect();
+        if(fd != -1) {
+            close(fd);
+            return 0;
+        }
+        nanosleep(&delay, 0);
+    }
+
+    fputs("Server did not come up\n", stderr);
+    return -1;
+}
+
+/* Issue nsamples round trips, storing the latency of each in samples.
+ * With a depth of 0, each request is sent on a new connection, otherwise
+ * a session is kept open and each sample covers depth pipelined requests */
+static int ipc_bench_client(uint64_t *samples, size_t nsamples, unsigned depth) {
+    uint64_t start;
+    int status = 0;
+    int fd = -1;
+
+    if(depth) {
+        fd = ipc_bench_open_session();
+        if(fd == -1) {
+            return -1;
+        }
+    }
+
+    for(size_t i = 0; i < BENCH_WARMUP + nsamples && !status; i++) {
+        start = bench_now();
+        status = depth ? ipc_bench_pipeline(fd, depth) : ipc_bench_roundtrip();
+        if(i >= BENCH_WARMUP) {
+            samples[i - BENCH_WARMUP] = bench_now() - start;
+        }
+    }
+
+    if(fd != -1) {
+        close(fd);
+    }
+
+    return status;
+}
+
+static void ipc_bench_run(char const *name, unsigned nclients, unsigned depth) {
+    pid_t clients[IPC_BENCH_MAX_CLIENTS];
+    unsigned nforked = 0;
+    unsigned const batch = depth ? depth : 1;
+    /* At least one sample per client */
+    size_t const per_client = (bench_samples(IPC_BENCH_REQUESTS) / batch + nclients - 1) / nclients;
+    size_t const nsamples = per_client * nclients;
+    uint64_t start;
+    int wstatus;
+    bool failed = false;
+
+    /* Clients are forked, samples are collected through a shared mapping */
+    uint64_t *samples = mmap(0, nsamples * sizeof(*samples), PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(samples == MAP_FAILED) {
+        perror("mmap");
+        return;
+    }
+
+    start = bench_now();
+    for(unsigned i = 0; i < nclients; i++) {
+        clients[i] = fork();
+        if(clients[i] == -1) {
+            perror("fork");
+            failed = true;
+            break;
+        }
+        if(!clients[i]) {
+            _exit(ipc_bench_client(&samples[i * per_client], per_client, depth) ? 1 : 0);
+        }
+        ++nforked;
+    }
+
+    for(unsigned i = 0; i < nforked; i++) {
+        if(waitpid(clients[i], &wstatus, 0) == -1 || !WIFEXITED(wstatus) || WEXITSTATUS(wstatus)) {
+            failed = true;
+        }
+    }
+
+    if(failed) {
+        bench_report_status(name, "failed");
+    }
+    else {
+        bench_report(name, samples, nsamples, batch, bench_now() - start);
+    }
+
+    munmap(samples, nsamples * sizeof(*samples));
+}
+
+void bench_ipc_roundtrip(void) {
+    static unsigned const nclients[] = { 1, IPC_BENCH_MAX_CLIENTS, 1, 1, IPC_BENCH_MAX_CLIENTS };
+    static unsigned const depths[] = { 0, 0, 1, IPC_BENCH_DEPTH, IPC_BENCH_DEPTH };
+    static char const *const names[] = {
+        "ipc_roundtrip_temp/1client", "ipc_roundtrip_temp/8clients",
+        "ipc_session_temp/1client",
+        "ipc_pipelined_temp/1client", "ipc_pipelined_temp/8clients"
+    };
+    pid_t server;
+
+    if(!bench_any_enabled(names, array_size(names))) {
+        return;
+    }
+
+    server = fork();
+    if(server == -1) {
+        perror("fork");
+        return;
+    }
+
+    if(!server) {
+        setlogmask(0);
+        ipc_bench_serve();
+    }
+
+    if(ipc_bench_wait_for_server() == 0) {
+        for(unsigned i = 0; i < array_size(nclients); i++) {
+            if(bench_enabled(names[i])) {
+                ipc_bench_run(names[i], nclients[i], depths[i]);
+            }
+        }
+    }
+
+    kill(server, SIGTERM);
+    waitpid(server, 0, 0);
+    unlink(DAEMON_SERVER_SOCKET);
+}
@@ -0,0 +1,6 @@
+#ifndef IPC_BENCH_H
+#define IPC_BENCH_H
+
+void bench_ipc_roundtrip(void);
+
+#endif /* IPC_BENCH_H */
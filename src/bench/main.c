@@ -0,0 +1,97 @@
+#include "bench.h"
+#include "config_bench.h"
+#include "fanctrl_bench.h"
+#include "hwmon_bench.h"
+#include "ipc_bench.h"
+#include "macro.h"
+#include "serialize_bench.h"
+#include "sha1_bench.h"
+
+#include <errno.h>
+#include <stdlib.h>
+
+#include <argp.h>
+
+char const *argp_program_version = "amdgpu-benchd " STR_EXPAND(FAND_VERSION) ;
+char const *argp_program_bug_address = "<vilhelm.engstrom@tuta.io>";
+
+static char doc[] = "amdgpu-benchd -- Micro-benchmarks of amdgpu-fand"
+                    "\vEach benchmark is preceded by an untimed warmup. The median and 99th\n"
+                    "percentile are per operation. With --json, one object is printed per\n"
+                    "benchmark, so results of different commits can be compared by name.";
+
+enum { BENCH_MAX_SAMPLES = 1 << 24 };
+
+static struct argp_option options[] = {
+    {"json",    'j', 0,         0, "Print results as JSON lines",                      0},
+    {"filter",  'f', "PATTERN", 0, "Run only benchmarks whose name contains PATTERN",  0},
+    {"samples", 'n', "N",       0, "Samples per benchmark, overriding the defaults",   0},
+    { 0 }
+};
+
+struct args {
+    enum bench_format format;
+    char const *filter;
+    size_t nsamples;
+};
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state) {
+    struct args *args = state->input;
+    unsigned long value;
+    char *end;
+
+    switch(key) {
+        case 'j':
+            args->format = BENCH_FORMAT_JSON;
+            break;
+        case 'f':
+            args->filter = arg;
+            break;
+        case 'n':
+            errno = 0;
+            value = strtoul(arg, &end, 10);
+            if(errno || end == arg || *end || !value || value > BENCH_MAX_SAMPLES) {
+                argp_error(state, "Invalid sample count %s", arg);
+            }
+            args->nsamples = value;
+            break;
+        case ARGP_KEY_ARG:
+            argp_usage(state);
+            break;
+        default:
+            return ARGP_ERR_UNKNOWN;
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    struct argp argp = {
+        options,
+        parse_opt,
+        0,
+        doc,
+        0,
+        0,
+        0
+    };
+
+    struct args args = {
+        .format = BENCH_FORMAT_TEXT,
+        .filter = 0,
+        .nsamples = 0
+    };
+
+    argp_parse(&argp, argc, argv, 0, 0, &args);
+    bench_configure(args.format, args.filter, args.nsamples);
+
+    bench_fanctrl_adjust();
+    bench_serialize();
+    bench_sha1();
+    bench_config_parse();
+    bench_cache_load();
+    bench_hwmon_io();
+    bench_ipc_roundtrip();
+
+    return 0;
+}
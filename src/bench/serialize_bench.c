@@ -0,0 +1,138 @@
+#include "bench.h"
+#include "fandcfg.h"
+#include "ipc.h"
+#include "macro.h"
+#include "serialize.h"
+#include "serialize_bench.h"
+
+#include <stdbool.h>
+
+#include <sys/types.h>
+
+enum { SERIALIZE_BENCH_SAMPLES = 16384 };
+/* Operations per sample */
+enum { SERIALIZE_BENCH_BATCH = 64 };
+
+struct serialize_bench_data {
+    unsigned char buffer[IPC_MAX_MSG_LENGTH];
+    unsigned char matrix[2 * MAX_TEMP_THRESHOLDS];
+    union unpack_result result;
+    /* Drop compiled formats before each operation */
+    bool cold;
+};
+
+struct serialize_bench_case {
+    char const *name;
+    bench_fn fn;
+    bool cold;
+};
+
+/* Same layout as a tick statistics response */
+static int serialize_bench_packf(void *data) {
+    struct serialize_bench_data *bench = data;
+    if(bench->cold) {
+        packf_flush();
+    }
+    return packf(bench->buffer, sizeof(bench->buffer), "%hhu%hhu%llu%llu%llu%llu",
+                 (unsigned char)34, (unsigned char)0, 86400ull, 3ull, 12ull, 4096ull) < 0;
+}
+
+static int serialize_bench_unpackf(void *data) {
+    struct serialize_bench_data *bench = data;
+    unsigned char len;
+    unsigned char rsp;
+    if(bench->cold) {
+        packf_flush();
+    }
+    return unpackf(bench->buffer, sizeof(bench->buffer), "%hhu%hhu%llu%llu%llu%llu",
+                   &len, &rsp, &bench->result.ticks.total, &bench->result.ticks.missed,
+                   &bench->result.ticks.late, &bench->result.ticks.max_lateness) < 0;
+}
+
+/* Formats of the packf tests */
+static int serialize_bench_packf_mixed(void *data) {
+    struct serialize_bench_data *bench = data;
+    if(bench->cold) {
+        packf_flush();
+    }
+    return packf(bench->buffer, sizeof(bench->buffer), "%hhu%hu%lld", 28, 32, 212ll) < 0;
+}
+
+static int serialize_bench_unpackf_mixed(void *data) {
+    struct serialize_bench_data *bench = data;
+    unsigned char hhu;
+    unsigned short hu;
+    long long lld;
+    if(bench->cold) {
+        packf_flush();
+    }
+    return unpackf(bench->buffer, sizeof(bench->buffer), "%hhu%hu%lld", &hhu, &hu, &lld) < 0;
+}
+
+static int serialize_bench_packf_repeat(void *data) {
+    struct serialize_bench_data *bench = data;
+    if(bench->cold) {
+        packf_flush();
+    }
+    return packf(bench->buffer, sizeof(bench->buffer), "%*hhu%d", 10u, bench->matrix, 30) < 0;
+}
+
+/* The same message packed from its compile-time layout */
+static int serialize_bench_pack_ticks(void *data) {
+    struct serialize_bench_data *bench = data;
+    return pack_ticks(bench->buffer, sizeof(bench->buffer), 86400ull, 3ull, 12ull, 4096ull) < 0;
+}
+
+static int serialize_bench_unpack_ticks(void *data) {
+    struct serialize_bench_data *bench = data;
+    return unpack_ticks(bench->buffer, sizeof(bench->buffer), &bench->result) < 0;
+}
+
+static int serialize_bench_pack_matrix(void *data) {
+    struct serialize_bench_data *bench = data;
+    return pack_matrix(bench->buffer, sizeof(bench->buffer), bench->matrix, MAX_TEMP_THRESHOLDS) < 0;
+}
+
+static int serialize_bench_unpack_matrix(void *data) {
+    struct serialize_bench_data *bench = data;
+    return unpack_matrix(bench->buffer, sizeof(bench->buffer), &bench->result) < 0;
+}
+
+/* Cold runs compile the format on every call, as it
+ * was interpreted before compiled formats were cached */
+static struct serialize_bench_case const serialize_bench_packf_cases[] = {
+    { "packf/ticks/cold",    serialize_bench_packf,          true  },
+    { "packf/ticks",         serialize_bench_packf,          false },
+    { "unpackf/ticks/cold",  serialize_bench_unpackf,        true  },
+    { "unpackf/ticks",       serialize_bench_unpackf,        false },
+    { "packf/mixed/cold",    serialize_bench_packf_mixed,    true  },
+    { "packf/mixed",         serialize_bench_packf_mixed,    false },
+    { "unpackf/mixed/cold",  serialize_bench_unpackf_mixed,  true  },
+    { "unpackf/mixed",       serialize_bench_unpackf_mixed,  false },
+    { "packf/repeat/cold",   serialize_bench_packf_repeat,   true  },
+    { "packf/repeat",        serialize_bench_packf_repeat,   false }
+};
+
+void bench_serialize(void) {
+    struct serialize_bench_data data = { .cold = false };
+
+    for(unsigned i = 0; i < MAX_TEMP_THRESHOLDS; i++) {
+        data.matrix[2 * i] = (unsigned char)(30 + 4 * i);
+        data.matrix[2 * i + 1] = (unsigned char)(6 * i);
+    }
+
+    /* Unpacking reuses the buffer packed before it */
+    for(unsigned i = 0; i < array_size(serialize_bench_packf_cases); i++) {
+        data.cold = serialize_bench_packf_cases[i].cold;
+        bench_run(serialize_bench_packf_cases[i].name, serialize_bench_packf_cases[i].fn, &data,
+                  SERIALIZE_BENCH_SAMPLES, SERIALIZE_BENCH_BATCH);
+    }
+
+    serialize_bench_pack_ticks(&data);
+    bench_run("pack_ticks/layout", serialize_bench_pack_ticks, &data, SERIALIZE_BENCH_SAMPLES, SERIALIZE_BENCH_BATCH);
+    bench_run("unpack_ticks/layout", serialize_bench_unpack_ticks, &data, SERIALIZE_BENCH_SAMPLES, SERIALIZE_BENCH_BATCH);
+
+    serialize_bench_pack_matrix(&data);
+    bench_run("pack_matrix/16rows", serialize_bench_pack_matrix, &data, SERIALIZE_BENCH_SAMPLES, SERIALIZE_BENCH_BATCH);
+    bench_run("unpack_matrix/16rows", serialize_bench_unpack_matrix, &data, SERIALIZE_BENCH_SAMPLES, SERIALIZE_BENCH_BATCH);
+}
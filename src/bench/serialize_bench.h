@@ -0,0 +1,6 @@
+#ifndef SERIALIZE_BENCH_H
+#define SERIALIZE_BENCH_H
+
+void bench_serialize(void);
+
+#endif /* SERIALIZE_BENCH_H */
@@ -0,0 +1,42 @@
+#include "bench.h"
+#include "sha1.h"
+#include "sha1_bench.h"
+
+enum { SHA1_BENCH_SAMPLES = 16384 };
+enum { SHA1_BENCH_SIZE = 4096 };
+
+struct sha1_bench_data {
+    sha1_ctx ctx;
+    unsigned char input[SHA1_BENCH_SIZE];
+};
+
+static int sha1_bench_update(void *data) {
+    struct sha1_bench_data *bench = data;
+    sha1_update(&bench->ctx, bench->input, sizeof(bench->input));
+    return 0;
+}
+
+/* Hash of a full input, as done for the cache */
+static int sha1_bench_digest(void *data) {
+    struct sha1_bench_data *bench = data;
+    unsigned char digest[SHA1_DIGESTSIZE];
+
+    sha1_init(&bench->ctx);
+    sha1_update(&bench->ctx, bench->input, sizeof(bench->input));
+    sha1_final(&bench->ctx, digest);
+    bench->input[0] = digest[0];
+
+    return 0;
+}
+
+void bench_sha1(void) {
+    static struct sha1_bench_data data;
+
+    for(unsigned i = 0; i < sizeof(data.input); i++) {
+        data.input[i] = (unsigned char)(i * 31);
+    }
+
+    sha1_init(&data.ctx);
+    bench_run("sha1_update/4KiB", sha1_bench_update, &data, SHA1_BENCH_SAMPLES, 1);
+    bench_run("sha1_digest/4KiB", sha1_bench_digest, &data, SHA1_BENCH_SAMPLES, 1);
+}
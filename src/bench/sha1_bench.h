@@ -0,0 +1,6 @@
+#ifndef SHA1_BENCH_H
+#define SHA1_BENCH_H
+
+void bench_sha1(void);
+
+#endif /* SHA1_BENCH_H */
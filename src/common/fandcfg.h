@@ -7,10 +7,12 @@
 #define DAEMON_WORKING_DIR "/tmp"
 #endif
 #define DAEMON_SERVER_SOCKET DAEMON_WORKING_DIR"/fand.sock"
+#define DAEMON_TELEMETRY_FILE DAEMON_WORKING_DIR"/fand.telemetry"
 
 
 enum { HWMON_PATH_SIZE = 256 };
 enum { MAX_TEMP_THRESHOLDS = 16 };
+enum { FAND_MAX_CARDS = 8 };
 enum { FAND_FATAL_ERR = -0x20 };
 enum { PWM_MIN = 0 };
 enum { PWM_MAX = 255 };
@@ -1,15 +1,20 @@
 #include "ipc.h"
 
-ipc_request ipc_valid_requests[4] = {
+ipc_request ipc_valid_requests[7] = {
     ipc_req_exit,
     ipc_req_speed,
     ipc_req_temp,
-    ipc_req_matrix
+    ipc_req_matrix,
+    ipc_req_ticks,
+    ipc_req_snapshot,
+    ipc_req_subscribe
 };
 
-struct ipc_pair ipc_request_map[4] = {
-    { "speed",       ipc_req_speed  },
-    { "temp",        ipc_req_temp   },
-    { "temperature", ipc_req_temp   },
-    { "matrix",      ipc_req_matrix }
+struct ipc_pair ipc_request_map[6] = {
+    { "speed",       ipc_req_speed    },
+    { "temp",        ipc_req_temp     },
+    { "temperature", ipc_req_temp     },
+    { "matrix",      ipc_req_matrix   },
+    { "ticks",       ipc_req_ticks    },
+    { "snapshot",    ipc_req_snapshot }
 };
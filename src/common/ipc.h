@@ -4,7 +4,9 @@
 #include <sys/socket.h>
 #include <sys/un.h>
 
-enum { IPC_MAX_MSG_LENGTH = 48 };
+enum { IPC_MAX_MSG_LENGTH = 128 };
+/* Longest request frame accepted on a session */
+enum { IPC_MAX_FRAME_LENGTH = 16 };
 
 typedef unsigned char ipc_request;
 typedef unsigned char ipc_response;
@@ -16,6 +18,12 @@ enum {
     ipc_req_speed,
     ipc_req_temp,
     ipc_req_matrix,
+    ipc_req_ticks,
+    /* Only valid as the first byte on a connection, switches it to framed requests */
+    ipc_req_session,
+    ipc_req_snapshot,
+    /* Turns the connection into a stream of one record per control tick */
+    ipc_req_subscribe,
     ipc_req_inval = 0xff
 };
 
@@ -34,7 +42,7 @@ union unsockaddr {
     struct sockaddr_un addr_un;
 };
 
-extern ipc_request ipc_valid_requests[4];
-extern struct ipc_pair ipc_request_map[4];
+extern ipc_request ipc_valid_requests[7];
+extern struct ipc_pair ipc_request_map[6];
 
 #endif /* IPC_H */
@@ -0,0 +1,101 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <sys/types.h>
+
+/* Fixed message layouts, expanded at compile time into straight-line
+ * pack and unpack functions. A layout lists its fields in wire order
+ * as an X-macro of (type, name) pairs, e.g.
+ *
+ *     #define LAYOUT_TICKS(X) X(unsigned long long, total) X(unsigned long long, missed)
+ *     LAYOUT_DEFINE(ticks, LAYOUT_TICKS)
+ *
+ * defines struct layout_ticks, its size on the wire, layout_size(ticks),
+ * as well as layout_pack_ticks and layout_unpack_ticks. The encoding is
+ * that of packf and unpackf with the corresponding format, each field
+ * copied in host byte order without padding.
+ *
+ * The functions take the offset at which to start and return the offset
+ * past the message, or -E2BIG if it does not fit. A negative offset is
+ * passed through, so that a message may be built by chaining calls and
+ * checking the result once */
+
+#define layout_size(name) layout_size_ ## name
+
+#define LAYOUT_FIELD_DECL(type, name) type name;
+#define LAYOUT_FIELD_SIZE(type, name) + sizeof(type)
+
+#define LAYOUT_FIELD_PACK(type, name)               \
+    memcpy(buffer, &msg->name, sizeof(type));       \
+    buffer += sizeof(type);
+
+#define LAYOUT_FIELD_UNPACK(type, name)             \
+    memcpy(&msg->name, buffer, sizeof(type));       \
+    buffer += sizeof(type);
+
+#define LAYOUT_DEFINE(name, fields)                                                                 \
+    struct layout_ ## name { fields(LAYOUT_FIELD_DECL) };                                           \
+    enum { layout_size(name) = 0 fields(LAYOUT_FIELD_SIZE) };                                       \
+                                                                                                    \
+    static inline ssize_t layout_pack_ ## name(unsigned char *restrict buffer, size_t bufsize,      \
+                                               ssize_t offset,                                      \
+                                               struct layout_ ## name const *restrict msg) {        \
+        if(offset < 0) {                                                                            \
+            return offset;                                                                          \
+        }                                                                                           \
+        if((size_t)offset > bufsize || bufsize - (size_t)offset < layout_size(name)) {              \
+            return -E2BIG;                                                                          \
+        }                                                                                           \
+        buffer += offset;                                                                           \
+        fields(LAYOUT_FIELD_PACK)                                                                   \
+        return offset + layout_size(name);                                                          \
+    }                                                                                               \
+                                                                                                    \
+    static inline ssize_t layout_unpack_ ## name(unsigned char const *restrict buffer,              \
+                                                 size_t bufsize, ssize_t offset,                    \
+                                                 struct layout_ ## name *restrict msg) {            \
+        if(offset < 0) {                                                                            \
+            return offset;                                                                          \
+        }                                                                                           \
+        if((size_t)offset > bufsize || bufsize - (size_t)offset < layout_size(name)) {              \
+            return -E2BIG;                                                                          \
+        }                                                                                           \
+        buffer += offset;                                                                           \
+        fields(LAYOUT_FIELD_UNPACK)                                                                 \
+        return offset + layout_size(name);                                                          \
+    }
+
+/* Compile-time check that the largest message built from layouts fits */
+#define LAYOUT_ASSERT_FITS(size, max) \
+    _Static_assert((size_t)(size) <= (size_t)(max), #size " exceeds " #max)
+
+/* Runs of bytes of variable length, such as the matrix */
+static inline ssize_t layout_pack_bytes(unsigned char *restrict buffer, size_t bufsize, ssize_t offset,
+                                        unsigned char const *restrict bytes, size_t nbytes) {
+    if(offset < 0) {
+        return offset;
+    }
+    if((size_t)offset > bufsize || bufsize - (size_t)offset < nbytes) {
+        return -E2BIG;
+    }
+    memcpy(&buffer[offset], bytes, nbytes);
+    return offset + (ssize_t)nbytes;
+}
+
+static inline ssize_t layout_unpack_bytes(unsigned char const *restrict buffer, size_t bufsize, ssize_t offset,
+                                          unsigned char *restrict bytes, size_t nbytes) {
+    if(offset < 0) {
+        return offset;
+    }
+    if((size_t)offset > bufsize || bufsize - (size_t)offset < nbytes) {
+        return -E2BIG;
+    }
+    memcpy(bytes, &buffer[offset], nbytes);
+    return offset + (ssize_t)nbytes;
+}
+
+#endif /* LAYOUT_H */
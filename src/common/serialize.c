@@ -1,10 +1,13 @@
 #include "ipc.h"
+#include "layout.h"
 #include "macro.h"
 #include "serialize.h"
 
 #include <errno.h>
+#include <limits.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 
 #define DFA_ACCEPT   0x1u
@@ -314,38 +317,187 @@ static int valist_strip_pointer(int fmttype, void **out,  va_list args, unsigned
     return 0;
 }
 
-ssize_t packf(unsigned char *restrict buffer, size_t bufsize, char const *restrict fmt, ...) {
+/* Formats are compiled once into a list of conversions, cached per
+ * thread by the address of the format. The contents are compared on
+ * lookup as well, formats need not be string literals */
+enum { PACKF_CACHE_SIZE = 16 };
+enum { PACKF_MAX_OPS = 16 };
+enum { PACKF_MAX_FMTLEN = 48 };
+
+/* A single conversion of a compiled format */
+struct packf_op {
+    /* FMT_* type of the conversion */
+    unsigned char type;
+    /* Size of a single value */
+    unsigned char width;
+    /* Preceded by a count, values are then passed by pointer */
+    bool repeat;
+};
+
+struct packf_program {
+    char const *fmt;
+    char text[PACKF_MAX_FMTLEN];
+    unsigned char nops;
+    struct packf_op ops[PACKF_MAX_OPS];
+};
+
+static _Thread_local struct packf_program packf_cache[PACKF_CACHE_SIZE];
+
+static int packf_compile(char const *restrict fmt, struct packf_program *restrict program) {
+    struct packf_op *op;
     int fmttype;
+
+    program->nops = 0;
+
+    while(*fmt) {
+        if(program->nops == PACKF_MAX_OPS || *fmt++ != '%') {
+            return -1;
+        }
+
+        op = &program->ops[program->nops++];
+        op->repeat = *fmt == '*';
+        fmt += op->repeat;
+
+        fmttype = dfa_simulate(fmt);
+        if(fmttype < 0) {
+            return -1;
+        }
+
+        op->type = (unsigned char)fmttype;
+        op->width = (unsigned char)dfa_valsize(fmttype);
+        fmt += dfa_fmtlen(fmttype);
+    }
+
+    return 0;
+}
+
+/* Returns the compiled program of fmt, or NULL if it cannot be
+ * compiled, in which case the format is interpreted instead */
+static struct packf_program const *packf_lookup(char const *fmt) {
+    struct packf_program *program = &packf_cache[((uintptr_t)fmt ^ ((uintptr_t)fmt >> 4)) % PACKF_CACHE_SIZE];
+    size_t len;
+
+    if(program->fmt == fmt && strcmp(program->text, fmt) == 0) {
+        return program;
+    }
+
+    program->fmt = 0;
+    len = strlen(fmt);
+    if(len >= sizeof(program->text) || packf_compile(fmt, program)) {
+        return 0;
+    }
+
+    memcpy(program->text, fmt, len + 1);
+    program->fmt = fmt;
+    return program;
+}
+
+/* Drops all compiled formats of the calling thread */
+void packf_flush(void) {
+    memset(packf_cache, 0, sizeof(packf_cache));
+}
+
+static ssize_t packf_run(struct packf_program const *restrict program, unsigned char *restrict buffer, size_t bufsize, va_list args) {
+    struct packf_op const *op;
     unsigned valsize;
     unsigned fmtlen;
     unsigned nrepeat;
-
     ssize_t nwritten = 0;
+    size_t nbytes;
 
     union {
         union packtype pv;
         void *pptr;
     } packval;
+    void *srcaddr;
+
+    for(unsigned i = 0; i < program->nops; i++) {
+        op = &program->ops[i];
+        nrepeat = op->repeat ? va_arg(args, unsigned) : 1u;
+
+        if(!nrepeat) {
+            return -1;
+        }
+
+        /* A count of 1 is passed by value, as with packf */
+        if(nrepeat == 1) {
+            valist_strip_integral(op->type, &packval.pv, args, &valsize, &fmtlen);
+            srcaddr = &packval.pv;
+        }
+        else {
+            valist_strip_pointer(op->type, &packval.pptr, args, &valsize, &fmtlen);
+            srcaddr = packval.pptr;
+        }
+
+        nbytes = (size_t)nrepeat * op->width;
+        if((size_t)nwritten + nbytes > bufsize) {
+            return -E2BIG;
+        }
+
+        memcpy(&buffer[nwritten], srcaddr, nbytes);
+        nwritten += nbytes;
+    }
+
+    return nwritten;
+}
+
+static ssize_t unpackf_run(struct packf_program const *restrict program, unsigned char const *restrict buffer, size_t bufsize, va_list args) {
+    struct packf_op const *op;
+    unsigned valsize;
+    unsigned fmtlen;
+    unsigned nrepeat;
+    ssize_t nread = 0;
+    size_t nbytes;
+    void *packval;
+
+    for(unsigned i = 0; i < program->nops; i++) {
+        op = &program->ops[i];
+        nrepeat = op->repeat ? va_arg(args, unsigned) : 1u;
+
+        if(!nrepeat) {
+            return -1;
+        }
+
+        valist_strip_pointer(op->type, &packval, args, &valsize, &fmtlen);
+
+        nbytes = (size_t)nrepeat * op->width;
+        if((size_t)nread + nbytes > bufsize) {
+            return -E2BIG;
+        }
+
+        memcpy(packval, &buffer[nread], nbytes);
+        nread += nbytes;
+    }
 
+    return nread;
+}
+
+static ssize_t packf_interpret(unsigned char *restrict buffer, size_t bufsize, char const *restrict fmt, va_list args) {
+    int fmttype;
+    unsigned valsize;
+    unsigned fmtlen;
+    unsigned nrepeat;
+
+    ssize_t nwritten = 0;
+
+    union {
+        union packtype pv;
+        void *pptr;
+    } packval;
     void *srcaddr;
     ssize_t nbytes;
 
-    va_list args;
-    va_start(args, fmt);
-
     while(*fmt) {
         nrepeat = 1u;
 
         if(*fmt++ != '%') {
-            nwritten = -1;
-            goto cleanup;
+            return -1;
         }
 
         if(*fmt == '*') {
             nrepeat = va_arg(args, unsigned);
             if(!nrepeat) {
-                nwritten = -1;
-                goto cleanup;
+                return -1;
             }
 
             ++fmt;
@@ -354,15 +506,13 @@ ssize_t packf(unsigned char *restrict buffer, size_t bufsize, char const *restri
         fmttype = dfa_simulate(fmt);
         if(nrepeat == 1) {
             if(valist_strip_integral(fmttype, &packval.pv, args, &valsize, &fmtlen) < 0) {
-                nwritten = -1;
-                goto cleanup;
+                return -1;
             }
             srcaddr = &packval.pv;
         }
         else {
             if(valist_strip_pointer(fmttype, &packval.pptr, args, &valsize, &fmtlen) < 0) {
-                nwritten = -1;
-                goto cleanup;
+                return -1;
             }
             srcaddr = packval.pptr;
         }
@@ -370,21 +520,17 @@ ssize_t packf(unsigned char *restrict buffer, size_t bufsize, char const *restri
         nbytes = nrepeat * valsize;
 
         if((size_t)nwritten + nbytes > bufsize) {
-            nwritten = -E2BIG;
-            goto cleanup;
+            return -E2BIG;
         }
         memcpy(&buffer[nwritten], srcaddr, nbytes);
         nwritten += nbytes;
         fmt += fmtlen;
-
     }
 
-cleanup:
-    va_end(args);
     return nwritten;
 }
 
-ssize_t unpackf(unsigned char const *restrict buffer, size_t bufsize, char const *restrict fmt, ...) {
+static ssize_t unpackf_interpret(unsigned char const *restrict buffer, size_t bufsize, char const *restrict fmt, va_list args) {
     int fmttype;
     unsigned fmtlen;
     unsigned valsize;
@@ -395,22 +541,17 @@ ssize_t unpackf(unsigned char const *restrict buffer, size_t bufsize, char const
     void *packval;
     ssize_t nbytes;
 
-    va_list args;
-    va_start(args, fmt);
-
     while(*fmt) {
         nrepeat = 1u;
 
         if(*fmt++ != '%') {
-            nread = -1;
-            goto cleanup;
+            return -1;
         }
 
         if(*fmt == '*') {
             nrepeat = va_arg(args, unsigned);
             if(!nrepeat) {
-                nread = -1;
-                goto cleanup;
+                return -1;
             }
 
             ++fmt;
@@ -418,15 +559,13 @@ ssize_t unpackf(unsigned char const *restrict buffer, size_t bufsize, char const
 
         fmttype = dfa_simulate(fmt);
         if(valist_strip_pointer(fmttype, &packval, args, &valsize, &fmtlen) < 0) {
-            nread = -1;
-            goto cleanup;
+            return -1;
         }
 
         nbytes = nrepeat * valsize;
 
         if((size_t)nread + nbytes > bufsize) {
-            nread = -E2BIG;
-            goto cleanup;
+            return -E2BIG;
         }
 
         memcpy(packval, &buffer[nread], nbytes);
@@ -434,40 +573,157 @@ ssize_t unpackf(unsigned char const *restrict buffer, size_t bufsize, char const
         fmt += fmtlen;
     }
 
-cleanup:
+    return nread;
+}
+
+ssize_t packf(unsigned char *restrict buffer, size_t bufsize, char const *restrict fmt, ...) {
+    struct packf_program const *program = packf_lookup(fmt);
+    ssize_t nwritten;
+
+    va_list args;
+    va_start(args, fmt);
+
+    nwritten = program ? packf_run(program, buffer, bufsize, args) :
+                         packf_interpret(buffer, bufsize, fmt, args);
+
+    va_end(args);
+    return nwritten;
+}
+
+ssize_t unpackf(unsigned char const *restrict buffer, size_t bufsize, char const *restrict fmt, ...) {
+    struct packf_program const *program = packf_lookup(fmt);
+    ssize_t nread;
+
+    va_list args;
+    va_start(args, fmt);
+
+    nread = program ? unpackf_run(program, buffer, bufsize, args) :
+                      unpackf_interpret(buffer, bufsize, fmt, args);
+
     va_end(args);
     return nread;
 }
 
+/* Wire layouts of the messages. Their pack and unpack functions are
+ * generated at compile time rather than going through packf, whose
+ * format is parsed on every call. The encoding is the same */
+#define LAYOUT_HEADER(X)                    \
+    X(unsigned char, len)                   \
+    X(ipc_response, rsp)
+
+#define LAYOUT_INT(X)                       \
+    X(int, value)
+
+#define LAYOUT_NROWS(X)                     \
+    X(unsigned char, nrows)
+
+#define LAYOUT_TICKS(X)                     \
+    X(unsigned long long, total)            \
+    X(unsigned long long, missed)           \
+    X(unsigned long long, late)             \
+    X(unsigned long long, max_lateness)
+
+/* Bit i of card_matrices is set if card i follows a card specific matrix */
+#define LAYOUT_SNAPSHOT(X)                  \
+    LAYOUT_TICKS(X)                         \
+    X(unsigned char, ncards)                \
+    X(unsigned char, card_matrices)
+
+#define LAYOUT_SNAPSHOT_CARD(X)             \
+    X(unsigned char, card_idx)              \
+    X(short, temp)                          \
+    X(short, pwm)                           \
+    X(signed char, speed)                   \
+    X(signed char, threshold)
+
+#define LAYOUT_RECORD(X)                    \
+    X(unsigned long long, tick)             \
+    X(unsigned char, ncards)
+
+#define LAYOUT_RECORD_CARD(X)               \
+    X(short, temp)                          \
+    X(short, pwm)                           \
+    X(signed char, threshold)
+
+#define LAYOUT_FRAME(X)                     \
+    X(unsigned char, len)                   \
+    X(ipc_request, request)
+
+LAYOUT_DEFINE(header, LAYOUT_HEADER)
+LAYOUT_DEFINE(int, LAYOUT_INT)
+LAYOUT_DEFINE(nrows, LAYOUT_NROWS)
+LAYOUT_DEFINE(ticks, LAYOUT_TICKS)
+LAYOUT_DEFINE(snapshot, LAYOUT_SNAPSHOT)
+LAYOUT_DEFINE(snapshot_card, LAYOUT_SNAPSHOT_CARD)
+LAYOUT_DEFINE(record, LAYOUT_RECORD)
+LAYOUT_DEFINE(record_card, LAYOUT_RECORD_CARD)
+LAYOUT_DEFINE(frame, LAYOUT_FRAME)
+
+/* The largest messages fit in a single one, and their length in a byte */
+LAYOUT_ASSERT_FITS(layout_size(header) + layout_size(snapshot) + FAND_MAX_CARDS * layout_size(snapshot_card) +
+                   layout_size(nrows) + 2 * MAX_TEMP_THRESHOLDS, IPC_MAX_MSG_LENGTH);
+LAYOUT_ASSERT_FITS(layout_size(header) + layout_size(record) + FAND_MAX_CARDS * layout_size(record_card), IPC_MAX_MSG_LENGTH);
+LAYOUT_ASSERT_FITS(layout_size(header) + layout_size(nrows) + 2 * MAX_TEMP_THRESHOLDS, IPC_MAX_MSG_LENGTH);
+LAYOUT_ASSERT_FITS(layout_size(frame), IPC_MAX_FRAME_LENGTH);
+LAYOUT_ASSERT_FITS(IPC_MAX_MSG_LENGTH, UCHAR_MAX);
+
+static inline ssize_t pack_header(unsigned char *restrict buffer, size_t bufsize, size_t len, ipc_response rsp) {
+    struct layout_header const header = { .len = (unsigned char)len, .rsp = rsp };
+    return layout_pack_header(buffer, bufsize, 0, &header);
+}
+
+/* Error responses carry the errno value in place of the payload */
+static ssize_t unpack_error(unsigned char const *restrict buffer, size_t bufsize, ssize_t offset, union unpack_result *restrict result) {
+    struct layout_int error;
+
+    offset = layout_unpack_int(buffer, bufsize, offset, &error);
+    if(offset >= 0) {
+        result->error = error.value;
+    }
+
+    return offset;
+}
+
+/* The length leading a response covers all of it */
+static inline ssize_t unpack_status(ssize_t rsplen, struct layout_header const *header) {
+    return rsplen < 0 || rsplen != header->len ? -1 : header->rsp;
+}
+
+static ssize_t pack_int(unsigned char *restrict buffer, size_t bufsize, ipc_response rsp, int value) {
+    struct layout_int const payload = { .value = value };
+    ssize_t rsplen = pack_header(buffer, bufsize, layout_size(header) + layout_size(int), rsp);
+
+    return layout_pack_int(buffer, bufsize, rsplen, &payload);
+}
+
 static ssize_t unpack_int(unsigned char const *restrict buffer, size_t bufsize, union unpack_result *restrict result) {
-    unsigned char len;
-    ipc_response rsp;
-    ssize_t rsplen = unpackf(buffer, bufsize, "%hhu%hhu", &len, &rsp);
+    struct layout_header header;
+    struct layout_int payload;
+    ssize_t rsplen = layout_unpack_header(buffer, bufsize, 0, &header);
 
     if(rsplen < 0) {
         return rsplen;
     }
 
-    if(rsp) {
-        rsplen += unpackf(&buffer[rsplen], bufsize - rsplen, "%d", &result->error);
+    if(header.rsp) {
+        rsplen = unpack_error(buffer, bufsize, rsplen, result);
     }
     else {
-        rsplen += unpackf(&buffer[rsplen], bufsize - rsplen, "%d", &result->temp);
-    }
-
-    if(rsplen != len) {
-        return -1;
+        rsplen = layout_unpack_int(buffer, bufsize, rsplen, &payload);
+        if(rsplen >= 0) {
+            result->temp = payload.value;
+        }
     }
 
-    return rsp;
+    return unpack_status(rsplen, &header);
 }
 
 ssize_t pack_error(unsigned char *restrict buffer, size_t bufsize, int error) {
-    return packf(buffer, bufsize, "%hhu%hhu%d", sizeof(unsigned char) + sizeof(ipc_response) + sizeof(error), ipc_rsp_err, error);
+    return pack_int(buffer, bufsize, ipc_rsp_err, error);
 }
 
 ssize_t pack_speed(unsigned char *restrict buffer, size_t bufsize, int speed) {
-    return packf(buffer, bufsize, "%hhu%hhu%d", sizeof(unsigned char) + sizeof(ipc_response) + sizeof(speed), ipc_rsp_ok, speed);
+    return pack_int(buffer, bufsize, ipc_rsp_ok, speed);
 }
 
 ssize_t unpack_speed(unsigned char const *restrict buffer, size_t bufsize, union unpack_result *restrict result) {
@@ -475,7 +731,7 @@ ssize_t unpack_speed(unsigned char const *restrict buffer, size_t bufsize, union
 }
 
 ssize_t pack_temp(unsigned char *restrict buffer, size_t bufsize, int temp) {
-    return packf(buffer, bufsize, "%hhu%hhu%d", sizeof(unsigned char) + sizeof(ipc_response) + sizeof(temp), ipc_rsp_ok, temp);
+    return pack_int(buffer, bufsize, ipc_rsp_ok, temp);
 }
 
 ssize_t unpack_temp(unsigned char const* restrict buffer, size_t bufsize, union unpack_result *restrict result) {
@@ -483,61 +739,298 @@ ssize_t unpack_temp(unsigned char const* restrict buffer, size_t bufsize, union
 }
 
 ssize_t pack_matrix(unsigned char *restrict buffer, size_t bufsize, unsigned char const *restrict matrix, unsigned char nrows) {
-    unsigned char const len = sizeof(ipc_response) + sizeof(unsigned char) * (nrows * 2 + 2);
-    return packf(buffer, bufsize, "%hhu%hhu%hhu%*hhu", len, ipc_rsp_ok, nrows, 2 * nrows, matrix);
+    struct layout_nrows const rows = { .nrows = nrows };
+    ssize_t rsplen;
+
+    if(nrows > MAX_TEMP_THRESHOLDS) {
+        return -1;
+    }
+
+    rsplen = pack_header(buffer, bufsize, layout_size(header) + layout_size(nrows) + 2u * nrows, ipc_rsp_ok);
+    rsplen = layout_pack_nrows(buffer, bufsize, rsplen, &rows);
+    return layout_pack_bytes(buffer, bufsize, rsplen, matrix, 2u * nrows);
 }
 
 ssize_t unpack_matrix(unsigned char const *restrict buffer, size_t bufsize, union unpack_result *restrict result) {
-    unsigned char len;
-    ipc_response rsp;
-    ssize_t rsplen = unpackf(buffer, bufsize, "%hhu%hhu", &len, &rsp);
+    struct layout_header header;
+    struct layout_nrows rows;
+    ssize_t rsplen = layout_unpack_header(buffer, bufsize, 0, &header);
+
+    if(rsplen < 0) {
+        return rsplen;
+    }
+
+    if(header.rsp) {
+        rsplen = unpack_error(buffer, bufsize, rsplen, result);
+        return unpack_status(rsplen, &header);
+    }
+
+    rsplen = layout_unpack_nrows(buffer, bufsize, rsplen, &rows);
+    if(rsplen < 0 || rows.nrows > MAX_TEMP_THRESHOLDS) {
+        return -1;
+    }
+
+    result->matrix[0] = rows.nrows;
+    rsplen = layout_unpack_bytes(buffer, bufsize, rsplen, &result->matrix[1], 2u * rows.nrows);
+
+    return unpack_status(rsplen, &header);
+}
+
+ssize_t pack_ticks(unsigned char *restrict buffer, size_t bufsize, unsigned long long total, unsigned long long missed,
+                   unsigned long long late, unsigned long long max_lateness) {
+    struct layout_ticks const ticks = {
+        .total = total,
+        .missed = missed,
+        .late = late,
+        .max_lateness = max_lateness
+    };
+    ssize_t rsplen = pack_header(buffer, bufsize, layout_size(header) + layout_size(ticks), ipc_rsp_ok);
+
+    return layout_pack_ticks(buffer, bufsize, rsplen, &ticks);
+}
+
+ssize_t unpack_ticks(unsigned char const *restrict buffer, size_t bufsize, union unpack_result *restrict result) {
+    struct layout_header header;
+    struct layout_ticks ticks;
+    ssize_t rsplen = layout_unpack_header(buffer, bufsize, 0, &header);
+
     if(rsplen < 0) {
         return rsplen;
     }
 
-    if(rsp) {
-        rsplen += unpackf(&buffer[rsplen], bufsize - rsplen, "%d", &result->error);
+    if(header.rsp) {
+        rsplen = unpack_error(buffer, bufsize, rsplen, result);
     }
     else {
-        rsplen += unpackf(&buffer[rsplen], bufsize - rsplen, "%hhu", &result->matrix[0]);
-        if(rsplen < 0) {
-            return rsplen;
+        rsplen = layout_unpack_ticks(buffer, bufsize, rsplen, &ticks);
+        if(rsplen >= 0) {
+            result->ticks.total = ticks.total;
+            result->ticks.missed = ticks.missed;
+            result->ticks.late = ticks.late;
+            result->ticks.max_lateness = ticks.max_lateness;
         }
+    }
+
+    return unpack_status(rsplen, &header);
+}
+
+/* Laid out as tick statistics, number of cards, a mask of the cards
+ * following card specific matrices, one record per card and the matrix */
+ssize_t pack_snapshot(unsigned char *restrict buffer, size_t bufsize, struct snapshot const *restrict snapshot) {
+    struct layout_snapshot head = {
+        .total = snapshot->ticks,
+        .missed = snapshot->missed,
+        .late = snapshot->late,
+        .max_lateness = snapshot->max_lateness,
+        .ncards = snapshot->ncards
+    };
+    struct layout_snapshot_card card;
+    struct layout_nrows const rows = { .nrows = snapshot->matrix[0] };
+    size_t const len = layout_size(header) + layout_size(snapshot) + snapshot->ncards * layout_size(snapshot_card) +
+                       layout_size(nrows) + 2u * rows.nrows;
+    ssize_t rsplen;
+
+    if(snapshot->ncards > FAND_MAX_CARDS || rows.nrows > MAX_TEMP_THRESHOLDS) {
+        return -1;
+    }
+
+    for(unsigned i = 0; i < snapshot->ncards; i++) {
+        head.card_matrices |= (unsigned char)(!snapshot->cards[i].default_matrix << i);
+    }
 
-        rsplen += unpackf(&buffer[rsplen], bufsize - rsplen, "%*hhu", 2 * result->matrix[0], &result->matrix[1]);
+    rsplen = pack_header(buffer, bufsize, len, ipc_rsp_ok);
+    rsplen = layout_pack_snapshot(buffer, bufsize, rsplen, &head);
+
+    for(unsigned i = 0; i < snapshot->ncards; i++) {
+        card = (struct layout_snapshot_card){
+            .card_idx = snapshot->cards[i].card_idx,
+            .temp = snapshot->cards[i].temp,
+            .pwm = snapshot->cards[i].pwm,
+            .speed = snapshot->cards[i].speed,
+            .threshold = snapshot->cards[i].threshold
+        };
+        rsplen = layout_pack_snapshot_card(buffer, bufsize, rsplen, &card);
     }
 
+    rsplen = layout_pack_nrows(buffer, bufsize, rsplen, &rows);
+    return layout_pack_bytes(buffer, bufsize, rsplen, &snapshot->matrix[1], 2u * rows.nrows);
+}
+
+ssize_t unpack_snapshot(unsigned char const *restrict buffer, size_t bufsize, union unpack_result *restrict result) {
+    struct snapshot *snapshot = &result->snapshot;
+    struct layout_header header;
+    struct layout_snapshot head;
+    struct layout_snapshot_card card;
+    struct layout_nrows rows;
+    ssize_t rsplen = layout_unpack_header(buffer, bufsize, 0, &header);
+
     if(rsplen < 0) {
         return rsplen;
     }
 
-    if(rsplen != len) {
+    if(header.rsp) {
+        rsplen = unpack_error(buffer, bufsize, rsplen, result);
+        return unpack_status(rsplen, &header);
+    }
+
+    rsplen = layout_unpack_snapshot(buffer, bufsize, rsplen, &head);
+    if(rsplen < 0 || head.ncards > FAND_MAX_CARDS || head.card_matrices >> head.ncards) {
         return -1;
     }
 
-    return rsp;
+    snapshot->ticks = head.total;
+    snapshot->missed = head.missed;
+    snapshot->late = head.late;
+    snapshot->max_lateness = head.max_lateness;
+    snapshot->ncards = head.ncards;
+
+    for(unsigned i = 0; i < snapshot->ncards && rsplen >= 0; i++) {
+        rsplen = layout_unpack_snapshot_card(buffer, bufsize, rsplen, &card);
+        snapshot->cards[i] = (struct snapshot_card){
+            .card_idx = card.card_idx,
+            .temp = card.temp,
+            .pwm = card.pwm,
+            .speed = card.speed,
+            .threshold = card.threshold,
+            .default_matrix = !(head.card_matrices & (1u << i))
+        };
+    }
+
+    rsplen = layout_unpack_nrows(buffer, bufsize, rsplen, &rows);
+    if(rsplen < 0 || rows.nrows > MAX_TEMP_THRESHOLDS) {
+        return -1;
+    }
+
+    snapshot->matrix[0] = rows.nrows;
+    rsplen = layout_unpack_bytes(buffer, bufsize, rsplen, &snapshot->matrix[1], 2u * rows.nrows);
+
+    return unpack_status(rsplen, &header);
+}
+
+ssize_t pack_tick_record(unsigned char *restrict buffer, size_t bufsize, struct tick_record const *restrict record) {
+    struct layout_record const head = { .tick = record->tick, .ncards = record->ncards };
+    struct layout_record_card card;
+    size_t const len = layout_size(header) + layout_size(record) + record->ncards * layout_size(record_card);
+    ssize_t rsplen;
+
+    if(record->ncards > FAND_MAX_CARDS) {
+        return -1;
+    }
+
+    rsplen = pack_header(buffer, bufsize, len, ipc_rsp_ok);
+    rsplen = layout_pack_record(buffer, bufsize, rsplen, &head);
+
+    for(unsigned i = 0; i < record->ncards; i++) {
+        card = (struct layout_record_card){
+            .temp = record->cards[i].temp,
+            .pwm = record->cards[i].pwm,
+            .threshold = record->cards[i].threshold
+        };
+        rsplen = layout_pack_record_card(buffer, bufsize, rsplen, &card);
+    }
+
+    return rsplen;
+}
+
+ssize_t unpack_tick_record(unsigned char const *restrict buffer, size_t bufsize, union unpack_result *restrict result) {
+    struct tick_record *record = &result->record;
+    struct layout_header header;
+    struct layout_record head;
+    struct layout_record_card card;
+    ssize_t rsplen = layout_unpack_header(buffer, bufsize, 0, &header);
+
+    if(rsplen < 0) {
+        return rsplen;
+    }
+
+    if(header.rsp) {
+        rsplen = unpack_error(buffer, bufsize, rsplen, result);
+        return unpack_status(rsplen, &header);
+    }
+
+    rsplen = layout_unpack_record(buffer, bufsize, rsplen, &head);
+    if(rsplen < 0 || head.ncards > FAND_MAX_CARDS) {
+        return -1;
+    }
+
+    record->tick = head.tick;
+    record->ncards = head.ncards;
+
+    for(unsigned i = 0; i < record->ncards && rsplen >= 0; i++) {
+        rsplen = layout_unpack_record_card(buffer, bufsize, rsplen, &card);
+        record->cards[i].temp = card.temp;
+        record->cards[i].pwm = card.pwm;
+        record->cards[i].threshold = card.threshold;
+    }
+
+    return unpack_status(rsplen, &header);
 }
 
 ssize_t pack_exit_rsp(unsigned char *restrict buffer, size_t bufsize) {
-    return packf(buffer, bufsize, "%hhu%hhu", sizeof(unsigned char) + sizeof(ipc_response), ipc_rsp_ok);
+    return pack_header(buffer, bufsize, layout_size(header), ipc_rsp_ok);
 }
 
 ssize_t unpack_exit_rsp(unsigned char const *restrict buffer, size_t bufsize, union unpack_result *restrict result) {
-    unsigned char len;
-    ipc_response rsp;
-    ssize_t rsplen = unpackf(buffer, bufsize, "%hhu%hhu", &len, &rsp);
+    struct layout_header header;
+    ssize_t rsplen = layout_unpack_header(buffer, bufsize, 0, &header);
 
     if(rsplen < 0) {
         return rsplen;
     }
 
-    if(rsp) {
-        rsplen += unpackf(&buffer[rsplen], bufsize - rsplen, "%d", &result->error);
+    if(header.rsp) {
+        rsplen = unpack_error(buffer, bufsize, rsplen, result);
+    }
+
+    return unpack_status(rsplen, &header);
+}
+
+ssize_t pack_session_rsp(unsigned char *restrict buffer, size_t bufsize) {
+    return pack_exit_rsp(buffer, bufsize);
+}
+
+ssize_t unpack_session_rsp(unsigned char const *restrict buffer, size_t bufsize, union unpack_result *restrict result) {
+    return unpack_exit_rsp(buffer, bufsize, result);
+}
+
+ssize_t pack_subscribe_rsp(unsigned char *restrict buffer, size_t bufsize) {
+    return pack_exit_rsp(buffer, bufsize);
+}
+
+ssize_t unpack_subscribe_rsp(unsigned char const *restrict buffer, size_t bufsize, union unpack_result *restrict result) {
+    return unpack_exit_rsp(buffer, bufsize, result);
+}
+
+/* Requests on a session are framed as length followed by request,
+ * the length covering the whole frame */
+ssize_t pack_request(unsigned char *restrict buffer, size_t bufsize, ipc_request request) {
+    struct layout_frame const frame = { .len = layout_size(frame), .request = request };
+    return layout_pack_frame(buffer, bufsize, 0, &frame);
+}
+
+/* Returns the length of the frame, 0 if it is incomplete
+ * and -1 if it is malformed. Trailing bytes are skipped */
+ssize_t unpack_request(unsigned char const *restrict buffer, size_t bufsize, ipc_request *restrict request) {
+    struct layout_frame frame;
+    unsigned char len;
+
+    if(!bufsize) {
+        return 0;
+    }
+
+    len = buffer[0];
+    if(len < layout_size(frame) || len > IPC_MAX_FRAME_LENGTH) {
+        return -1;
+    }
+
+    if(bufsize < len) {
+        return 0;
     }
 
-    if(len != rsplen) {
+    if(layout_unpack_frame(buffer, bufsize, 0, &frame) < 0) {
         return -1;
     }
 
-    return rsp;
+    *request = frame.request;
+    return len;
 }
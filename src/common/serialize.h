@@ -2,11 +2,52 @@
 #define SERIALIZE_H
 
 #include "fandcfg.h"
+#include "ipc.h"
 
+#include <stdbool.h>
 #include <stddef.h>
 
 #include <sys/types.h>
 
+struct snapshot_card {
+    /* Index of the card in /sys/class/drm */
+    unsigned char card_idx;
+    /* Degrees Celsius, negative if unavailable */
+    short temp;
+    /* Negative if unavailable */
+    short pwm;
+    signed char speed;
+    /* Active threshold, -1 if none */
+    signed char threshold;
+    /* Whether threshold indexes matrix of the snapshot, rather than a
+     * card specific matrix */
+    bool default_matrix;
+};
+
+/* State of every card and of the control loop at a single point in time */
+struct snapshot {
+    unsigned long long ticks;
+    unsigned long long missed;
+    unsigned long long late;
+    unsigned long long max_lateness;
+    unsigned char ncards;
+    struct snapshot_card cards[FAND_MAX_CARDS];
+    /* Number of rows followed by matrix values */
+    unsigned char matrix[2 * MAX_TEMP_THRESHOLDS + 1];
+};
+
+/* Pushed to subscribers once per control tick */
+struct tick_record {
+    unsigned long long tick;
+    unsigned char ncards;
+    struct {
+        /* Degrees Celsius, negative if the card was not sampled */
+        short temp;
+        short pwm;
+        signed char threshold;
+    } cards[FAND_MAX_CARDS];
+};
+
 union unpack_result {
     union {
         int temp;
@@ -14,12 +55,21 @@ union unpack_result {
         /* Fat pointer containing number of
          * rows followed by matrix values */
         unsigned char matrix[2 * MAX_TEMP_THRESHOLDS + 1];
+        struct {
+            unsigned long long total;
+            unsigned long long missed;
+            unsigned long long late;
+            unsigned long long max_lateness;
+        } ticks;
+        struct snapshot snapshot;
+        struct tick_record record;
     };
     int error;
 };
 
 ssize_t packf(unsigned char *restrict buffer, size_t bufsize, char const *restrict fmt, ...);
 ssize_t unpackf(unsigned char const *restrict buffer, size_t bufsize, char const *restrict fmt, ...);
+void packf_flush(void);
 
 ssize_t pack_error(unsigned char *restrict buffer, size_t bufsize, int error);
 
@@ -32,7 +82,26 @@ ssize_t unpack_temp(unsigned char const* restrict buffer, size_t bufsize, union
 ssize_t pack_matrix(unsigned char *restrict buffer, size_t bufsize, unsigned char const *restrict matrix, unsigned char nrows);
 ssize_t unpack_matrix(unsigned char const *restrict buffer, size_t bufsize, union unpack_result *restrict result);
 
+ssize_t pack_ticks(unsigned char *restrict buffer, size_t bufsize, unsigned long long total, unsigned long long missed,
+                   unsigned long long late, unsigned long long max_lateness);
+ssize_t unpack_ticks(unsigned char const *restrict buffer, size_t bufsize, union unpack_result *restrict result);
+
 ssize_t pack_exit_rsp(unsigned char *restrict buffer, size_t bufsize);
 ssize_t unpack_exit_rsp(unsigned char const *restrict buffer, size_t bufsize, union unpack_result *restrict result);
 
+ssize_t pack_snapshot(unsigned char *restrict buffer, size_t bufsize, struct snapshot const *restrict snapshot);
+ssize_t unpack_snapshot(unsigned char const *restrict buffer, size_t bufsize, union unpack_result *restrict result);
+
+ssize_t pack_tick_record(unsigned char *restrict buffer, size_t bufsize, struct tick_record const *restrict record);
+ssize_t unpack_tick_record(unsigned char const *restrict buffer, size_t bufsize, union unpack_result *restrict result);
+
+ssize_t pack_session_rsp(unsigned char *restrict buffer, size_t bufsize);
+ssize_t unpack_session_rsp(unsigned char const *restrict buffer, size_t bufsize, union unpack_result *restrict result);
+
+ssize_t pack_subscribe_rsp(unsigned char *restrict buffer, size_t bufsize);
+ssize_t unpack_subscribe_rsp(unsigned char const *restrict buffer, size_t bufsize, union unpack_result *restrict result);
+
+ssize_t pack_request(unsigned char *restrict buffer, size_t bufsize, ipc_request request);
+ssize_t unpack_request(unsigned char const *restrict buffer, size_t bufsize, ipc_request *restrict request);
+
 #endif /* SERIALIZE_H */
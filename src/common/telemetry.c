@@ -0,0 +1,159 @@
+#include "fandcfg.h"
+#include "telemetry.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <syslog.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+/* Retries before a reader gives up on a page that keeps changing */
+enum { TELEMETRY_READ_RETRIES = 64 };
+
+_Static_assert(sizeof(atomic_uint) == sizeof(uint32_t), "Unexpected atomic_uint size");
+_Static_assert(sizeof(struct telemetry_page) == 16 + 24 + TELEMETRY_MAX_CARDS * 32, "Unexpected telemetry page layout");
+
+static struct telemetry_page *telemetry_page;
+
+int telemetry_create(void) {
+    int fd = open(DAEMON_TELEMETRY_FILE, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if(fd == -1) {
+        syslog(LOG_ERR, "Could not create %s: %s", DAEMON_TELEMETRY_FILE, strerror(errno));
+        return -1;
+    }
+
+    if(ftruncate(fd, sizeof(*telemetry_page)) == -1) {
+        syslog(LOG_ERR, "Could not size %s: %s", DAEMON_TELEMETRY_FILE, strerror(errno));
+        goto err;
+    }
+
+    telemetry_page = mmap(0, sizeof(*telemetry_page), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(telemetry_page == MAP_FAILED) {
+        syslog(LOG_ERR, "Could not map %s: %s", DAEMON_TELEMETRY_FILE, strerror(errno));
+        telemetry_page = 0;
+        goto err;
+    }
+
+    close(fd);
+
+    telemetry_page->version = TELEMETRY_VERSION;
+    atomic_init(&telemetry_page->seq, 0);
+    /* Readers reject the page until the magic is in place */
+    atomic_thread_fence(memory_order_release);
+    telemetry_page->magic = TELEMETRY_MAGIC;
+
+    return 0;
+
+err:
+    close(fd);
+    unlink(DAEMON_TELEMETRY_FILE);
+    return -1;
+}
+
+int telemetry_destroy(void) {
+    int status = 0;
+    if(!telemetry_page) {
+        return status;
+    }
+
+    if(munmap(telemetry_page, sizeof(*telemetry_page)) == -1) {
+        syslog(LOG_WARNING, "Could not unmap %s: %s", DAEMON_TELEMETRY_FILE, strerror(errno));
+        status = -1;
+    }
+    telemetry_page = 0;
+
+    if(unlink(DAEMON_TELEMETRY_FILE) == -1) {
+        syslog(LOG_WARNING, "Could not unlink %s: %s", DAEMON_TELEMETRY_FILE, strerror(errno));
+        status = -1;
+    }
+
+    return status;
+}
+
+void telemetry_publish(struct telemetry_data const *data) {
+    if(!telemetry_page) {
+        return;
+    }
+
+    unsigned seq = atomic_load_explicit(&telemetry_page->seq, memory_order_relaxed);
+
+    atomic_store_explicit(&telemetry_page->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    telemetry_page->data = *data;
+
+    atomic_store_explicit(&telemetry_page->seq, seq + 2, memory_order_release);
+}
+
+int telemetry_map(struct telemetry_page const **page) {
+    struct stat sb;
+    struct telemetry_page const *addr;
+    int status = 0;
+
+    int fd = open(DAEMON_TELEMETRY_FILE, O_RDONLY | O_CLOEXEC);
+    if(fd == -1) {
+        return -errno;
+    }
+
+    if(fstat(fd, &sb) == -1) {
+        status = -errno;
+        goto cleanup;
+    }
+
+    if((size_t)sb.st_size < sizeof(*addr)) {
+        status = -EPROTO;
+        goto cleanup;
+    }
+
+    addr = mmap(0, sizeof(*addr), PROT_READ, MAP_SHARED, fd, 0);
+    if(addr == MAP_FAILED) {
+        status = -errno;
+        goto cleanup;
+    }
+
+    if(addr->magic != TELEMETRY_MAGIC || addr->version != TELEMETRY_VERSION) {
+        munmap((void *)(uintptr_t)addr, sizeof(*addr));
+        status = -EPROTO;
+        goto cleanup;
+    }
+
+    *page = addr;
+
+cleanup:
+    close(fd);
+    return status;
+}
+
+int telemetry_unmap(struct telemetry_page const *page) {
+    if(munmap((void *)(uintptr_t)page, sizeof(*page)) == -1) {
+        return -errno;
+    }
+    return 0;
+}
+
+int telemetry_read(struct telemetry_page const *page, struct telemetry_data *data) {
+    unsigned begin;
+    unsigned end;
+
+    for(unsigned i = 0; i < TELEMETRY_READ_RETRIES; i++) {
+        begin = atomic_load_explicit(&page->seq, memory_order_acquire);
+        if(begin & 1) {
+            continue;
+        }
+
+        *data = page->data;
+
+        atomic_thread_fence(memory_order_acquire);
+        end = atomic_load_explicit(&page->seq, memory_order_relaxed);
+
+        if(begin == end) {
+            return 0;
+        }
+    }
+
+    return -EAGAIN;
+}
@@ -0,0 +1,58 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include "fandcfg.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+enum { TELEMETRY_MAGIC = 0x666e6474 };
+enum { TELEMETRY_VERSION = 1 };
+enum { TELEMETRY_MAX_CARDS = FAND_MAX_CARDS };
+
+struct telemetry_card {
+    /* Temperature in degrees Celsius */
+    int32_t temp;
+    /* Pwm read back after the last write, -1 if unavailable */
+    int32_t pwm;
+    /* Pwm written by the control loop */
+    int32_t target_pwm;
+    /* Fan speed percentage */
+    int32_t speed;
+    /* Active threshold, -1 if none */
+    int32_t threshold;
+    /* Index of the card in /sys/class/drm */
+    uint32_t card_idx;
+    /* CLOCK_MONOTONIC time of the sample in ns */
+    uint64_t sample_time;
+};
+
+struct telemetry_data {
+    /* Control ticks handled */
+    uint64_t ticks;
+    /* CLOCK_MONOTONIC time of the last update in ns */
+    uint64_t update_time;
+    uint32_t ncards;
+    uint32_t reserved;
+    struct telemetry_card cards[TELEMETRY_MAX_CARDS];
+};
+
+/* Layout of DAEMON_TELEMETRY_FILE. The data is guarded by a
+ * seqlock, seq is odd while the daemon is writing */
+struct telemetry_page {
+    uint32_t magic;
+    uint32_t version;
+    atomic_uint seq;
+    uint32_t reserved;
+    struct telemetry_data data;
+};
+
+int telemetry_create(void);
+int telemetry_destroy(void);
+void telemetry_publish(struct telemetry_data const *data);
+
+int telemetry_map(struct telemetry_page const **page);
+int telemetry_unmap(struct telemetry_page const *page);
+int telemetry_read(struct telemetry_page const *page, struct telemetry_data *data);
+
+#endif /* TELEMETRY_H */
@@ -0,0 +1,186 @@
+#include "fakesys.h"
+#include "macro.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+/* Mirror the paths read by the daemon, relative to the root */
+#define FAKESYS_DRI_DEBUG_FMT "%s/sys/kernel/debug/dri/%u"
+#define FAKESYS_CARD_FMT "%s/sys/class/drm/card%u"
+#define FAKESYS_HWMON_DIR_FMT "/device/hwmon/hwmon%u"
+
+#define FAKESYS_PM_INFO "amdgpu_pm_info"
+
+enum { FAKESYS_PATH_SIZE = 256 };
+enum { FAKESYS_VALUE_SIZE = 128 };
+enum { FAKESYS_DIR_MODE = S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH };
+
+/* Attributes of each hwmon directory, removed in this order */
+static char const *const fakesys_attrs[] = {
+    "name", "temp1_input", "pwm1", "pwm1_enable", "pwm1_min", "pwm1_max"
+};
+
+/* Directories below the card directory, innermost first */
+static char const *const fakesys_card_dirs[] = {
+    FAKESYS_HWMON_DIR_FMT, "/device/hwmon", "/device", ""
+};
+
+/* Directories shared by all cards, innermost first */
+static char const *const fakesys_common_dirs[] = {
+    "/sys/kernel/debug/dri", "/sys/kernel/debug", "/sys/kernel",
+    "/sys/class/drm", "/sys/class", "/sys"
+};
+
+static int fakesys_mkdirs(char *path) {
+    for(char *p = path + 1; *p; p++) {
+        if(*p != '/') {
+            continue;
+        }
+        *p = '\0';
+        if(mkdir(path, FAKESYS_DIR_MODE) == -1 && errno != EEXIST) {
+            fprintf(stderr, "Could not create %s: %s\n", path, strerror(errno));
+            *p = '/';
+            return -1;
+        }
+        *p = '/';
+    }
+
+    if(mkdir(path, FAKESYS_DIR_MODE) == -1 && errno != EEXIST) {
+        fprintf(stderr, "Could not create %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+static int fakesys_write_file(char const *path, char const *contents) {
+    ssize_t len = (ssize_t)strlen(contents);
+
+    int fd = open(path, O_CREAT | O_TRUNC | O_WRONLY | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if(fd == -1) {
+        fprintf(stderr, "Could not create %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    if(write(fd, contents, (size_t)len) != len) {
+        fprintf(stderr, "Could not write %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    close(fd);
+    return 0;
+}
+
+static int fakesys_format(char *dst, size_t dstsize, char const *root, unsigned card, char const *fmt) {
+    char path[FAKESYS_PATH_SIZE];
+    int len = snprintf(path, sizeof(path), FAKESYS_CARD_FMT, root, card);
+
+    if(len < 0 || (size_t)len >= sizeof(path) ||
+       (size_t)snprintf(path + len, sizeof(path) - len, fmt, card) >= sizeof(path) - len ||
+       (size_t)snprintf(dst, dstsize, "%s", path) >= dstsize) {
+        fprintf(stderr, "Path of card %u overflows the internal buffer\n", card);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Path of the hwmon attribute attr of card in the tree at root */
+int fakesys_attr_path(char *dst, size_t dstsize, char const *root, unsigned card, char const *attr) {
+    char dir[FAKESYS_PATH_SIZE];
+
+    if(fakesys_format(dir, sizeof(dir), root, card, FAKESYS_HWMON_DIR_FMT) ||
+       (size_t)snprintf(dst, dstsize, "%s/%s", dir, attr) >= dstsize) {
+        fprintf(stderr, "Path of %s of card %u overflows the internal buffer\n", attr, card);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int fakesys_create_card(char const *root, unsigned idx, struct fakesys_card const *card) {
+    char path[FAKESYS_PATH_SIZE];
+    char values[array_size(fakesys_attrs)][FAKESYS_VALUE_SIZE] = {
+        "amdgpu\n", "", "", "2\n", "0\n", "255\n"
+    };
+    char pm_info[FAKESYS_VALUE_SIZE];
+
+    snprintf(values[1], sizeof(values[1]), "%d\n", card->temp);
+    snprintf(values[2], sizeof(values[2]), "%u\n", (unsigned)card->pwm);
+    snprintf(pm_info, sizeof(pm_info), "GFX Clocks and Power:\n\nGPU Temperature: %d C\nGPU Load: 0 %%\n", card->temp / 1000);
+
+    /* Cards are detected through their amdgpu_pm_info */
+    if((size_t)snprintf(path, sizeof(path), FAKESYS_DRI_DEBUG_FMT, root, idx) >= sizeof(path) || fakesys_mkdirs(path) ||
+       (size_t)snprintf(path, sizeof(path), FAKESYS_DRI_DEBUG_FMT "/" FAKESYS_PM_INFO, root, idx) >= sizeof(path) ||
+       fakesys_write_file(path, pm_info)) {
+        return -1;
+    }
+
+    if(fakesys_format(path, sizeof(path), root, idx, FAKESYS_HWMON_DIR_FMT) || fakesys_mkdirs(path)) {
+        return -1;
+    }
+
+    for(unsigned i = 0; i < array_size(fakesys_attrs); i++) {
+        if(fakesys_attr_path(path, sizeof(path), root, idx, fakesys_attrs[i]) ||
+           fakesys_write_file(path, values[i])) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* Builds a tree of ncards cards below root, as found by the daemon in
+ * /sys, each starting out in the state given by card */
+int fakesys_create(char const *root, unsigned ncards, struct fakesys_card const *card) {
+    for(unsigned i = 0; i < ncards; i++) {
+        if(fakesys_create_card(root, i, card)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Removes a tree created by fakesys_create, anything else
+ * found below root is left alone */
+int fakesys_remove(char const *root, unsigned ncards) {
+    char path[FAKESYS_PATH_SIZE];
+    int status = 0;
+
+    for(unsigned i = 0; i < ncards; i++) {
+        for(unsigned j = 0; j < array_size(fakesys_attrs); j++) {
+            if(fakesys_attr_path(path, sizeof(path), root, i, fakesys_attrs[j]) == 0 && unlink(path) == -1 && errno != ENOENT) {
+                status = -1;
+            }
+        }
+
+        for(unsigned j = 0; j < array_size(fakesys_card_dirs); j++) {
+            if(fakesys_format(path, sizeof(path), root, i, fakesys_card_dirs[j]) == 0 && rmdir(path) == -1 && errno != ENOENT) {
+                status = -1;
+            }
+        }
+
+        if((size_t)snprintf(path, sizeof(path), FAKESYS_DRI_DEBUG_FMT "/" FAKESYS_PM_INFO, root, i) < sizeof(path)) {
+            unlink(path);
+        }
+        if((size_t)snprintf(path, sizeof(path), FAKESYS_DRI_DEBUG_FMT, root, i) < sizeof(path) && rmdir(path) == -1 && errno != ENOENT) {
+            status = -1;
+        }
+    }
+
+    /* Shared directories may still hold other entries */
+    for(unsigned i = 0; i < array_size(fakesys_common_dirs); i++) {
+        if((size_t)snprintf(path, sizeof(path), "%s%s", root, fakesys_common_dirs[i]) < sizeof(path)) {
+            rmdir(path);
+        }
+    }
+
+    return status;
+}
@@ -0,0 +1,17 @@
+#ifndef FAKESYS_H
+#define FAKESYS_H
+
+#include <stddef.h>
+
+/* Initial state of the cards of a synthetic tree */
+struct fakesys_card {
+    /* Edge temperature in millidegrees Celsius */
+    int temp;
+    unsigned char pwm;
+};
+
+int fakesys_create(char const *root, unsigned ncards, struct fakesys_card const *card);
+int fakesys_remove(char const *root, unsigned ncards);
+int fakesys_attr_path(char *dst, size_t dstsize, char const *root, unsigned card, char const *attr);
+
+#endif /* FAKESYS_H */
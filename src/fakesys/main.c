@@ -0,0 +1,114 @@
+#include "fakesys.h"
+#include "macro.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <argp.h>
+
+char const *argp_program_version = "amdgpu-fakesys " STR_EXPAND(FAND_VERSION) ;
+char const *argp_program_bug_address = "<vilhelm.engstrom@tuta.io>";
+
+static char doc[] = "amdgpu-fakesys -- Create a synthetic sysfs tree for amdgpu-fand"
+                    "\vThe tree is created below ROOT and can be used by passing ROOT to\n"
+                    "amdgpu-fand using --root. The attributes are regular files, pwm\n"
+                    "writes stick and temperatures change only when written to.";
+static char args_doc[] = "ROOT";
+
+enum { FAKESYS_MAX_CARDS = 128 };
+
+static struct argp_option options[] = {
+    {"cards",  'n', "N",     0, "Number of cards, defaults to 1",                          0},
+    {"temp",   't', "TEMP",  0, "Initial temperature in degrees Celsius, defaults to 45", 0},
+    {"pwm",    'p', "PWM",   0, "Initial pwm, defaults to 0",                            0},
+    {"remove", 'r', 0,       0, "Remove a tree of N cards instead of creating one",      0},
+    { 0 }
+};
+
+struct args {
+    unsigned ncards;
+    struct fakesys_card card;
+    bool remove;
+    char const *root;
+};
+
+static int parse_ulong(char const *arg, unsigned long max, unsigned long *result) {
+    char *end;
+
+    errno = 0;
+    *result = strtoul(arg, &end, 10);
+    return errno || end == arg || *end || *result > max ? -1 : 0;
+}
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state) {
+    struct args *args = state->input;
+    unsigned long value;
+
+    switch(key) {
+        case 'n':
+            if(parse_ulong(arg, FAKESYS_MAX_CARDS, &value) || !value) {
+                argp_error(state, "Invalid number of cards %s", arg);
+            }
+            args->ncards = (unsigned)value;
+            break;
+        case 't':
+            if(parse_ulong(arg, 255ul, &value)) {
+                argp_error(state, "Invalid temperature %s", arg);
+            }
+            args->card.temp = (int)value * 1000;
+            break;
+        case 'p':
+            if(parse_ulong(arg, 255ul, &value)) {
+                argp_error(state, "Invalid pwm %s", arg);
+            }
+            args->card.pwm = (unsigned char)value;
+            break;
+        case 'r':
+            args->remove = true;
+            break;
+        case ARGP_KEY_ARG:
+            if(args->root) {
+                argp_usage(state);
+            }
+            args->root = arg;
+            break;
+        case ARGP_KEY_END:
+            if(!args->root) {
+                argp_usage(state);
+            }
+            break;
+        default:
+            return ARGP_ERR_UNKNOWN;
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    struct argp argp = {
+        options,
+        parse_opt,
+        args_doc,
+        doc,
+        0,
+        0,
+        0
+    };
+
+    struct args args = {
+        .ncards = 1,
+        .card = { .temp = 45000, .pwm = 0 },
+        .remove = false,
+        .root = 0
+    };
+
+    argp_parse(&argp, argc, argv, 0, 0, &args);
+
+    if(args.remove) {
+        return fakesys_remove(args.root, args.ncards) ? 1 : 0;
+    }
+
+    return fakesys_create(args.root, args.ncards, &args.card) ? 1 : 0;
+}
@@ -83,3 +83,43 @@ cleanup:
     client_kill();
     return nrecv;
 }
+
+/* Leaves the connection open, records are read with client_recv
+ * until the daemon closes it. Ticks may be further apart than
+ * the usual receive timeout */
+int client_subscribe(void) {
+    struct timeval tv = { 0 };
+    ipc_request request = ipc_req_subscribe;
+
+    if(client_init()) {
+        return -1;
+    }
+
+    if(setsockopt(clientfd, SOL_SOCKET, SO_RCVTIMEO, &tv, (socklen_t)sizeof(tv)) == -1) {
+        ctl_perror("Could not clear socket timeout");
+        client_kill();
+        return -1;
+    }
+
+    if(send(clientfd, &request, sizeof(request), 0) == -1) {
+        ctl_perror("Failed to send request");
+        client_kill();
+        return -1;
+    }
+
+    return 0;
+}
+
+ssize_t client_recv(unsigned char *buffer, size_t bufsize) {
+    ssize_t nrecv;
+
+    do {
+        nrecv = recv(clientfd, buffer, bufsize, 0);
+    } while(nrecv == -1 && errno == EINTR);
+
+    if(nrecv == -1) {
+        ctl_perror("Could not receive from server");
+    }
+
+    return nrecv;
+}
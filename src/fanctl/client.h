@@ -10,5 +10,7 @@
 int client_init(void);
 int client_kill(void);
 ssize_t client_send_and_recv(unsigned char *buffer, size_t bufsize, ipc_request request);
+int client_subscribe(void);
+ssize_t client_recv(unsigned char *buffer, size_t bufsize);
 
 #endif /* CLIENT_H */
@@ -13,6 +13,7 @@
 #define DEGC_UTF8  "°C"
 
 enum { MATRIX_CELL_WIDTH = 9 };
+enum { NSEC_PER_MSEC = 1000000 };
 
 static inline bool format_utf8_support(void) {
     regex_t utf8rgx;
@@ -66,6 +67,64 @@ void format_speed(int speed) {
     printf("%d%%\n", speed);
 }
 
+void format_ticks(unsigned long long total, unsigned long long missed, unsigned long long late, unsigned long long max_lateness) {
+    printf("ticks:        %llu\n", total);
+    printf("missed:       %llu\n", missed);
+    printf("late:         %llu\n", late);
+    printf("max lateness: %llu us\n", max_lateness);
+}
+
+void format_telemetry(struct telemetry_data const *data, unsigned long long now) {
+    char const *degc = format_utf8_support() ? DEGC_UTF8 : DEGC_ASCII;
+    struct telemetry_card const *card;
+
+    printf("ticks:      %llu\n", (unsigned long long)data->ticks);
+    printf("updated:    %llu ms ago\n", now > data->update_time ? (now - data->update_time) / NSEC_PER_MSEC : 0ull);
+
+    for(unsigned i = 0; i < data->ncards && i < TELEMETRY_MAX_CARDS; i++) {
+        card = &data->cards[i];
+        printf("card %u:\n", i);
+        printf("  temp:       %d%s\n", (int)card->temp, degc);
+        printf("  speed:      %d%%\n", (int)card->speed);
+        printf("  pwm:        %d (target %d)\n", (int)card->pwm, (int)card->target_pwm);
+        printf("  threshold:  %d\n", (int)card->threshold);
+    }
+}
+
+void format_snapshot(struct snapshot const *snapshot) {
+    char const *degc = format_utf8_support() ? DEGC_UTF8 : DEGC_ASCII;
+    struct snapshot_card const *card;
+
+    format_ticks(snapshot->ticks, snapshot->missed, snapshot->late, snapshot->max_lateness);
+
+    for(unsigned i = 0; i < snapshot->ncards && i < FAND_MAX_CARDS; i++) {
+        card = &snapshot->cards[i];
+        printf("card %u:\n", (unsigned)card->card_idx);
+        printf("  temp:         %d%s\n", (int)card->temp, degc);
+        printf("  speed:        %d%%\n", (int)card->speed);
+        printf("  pwm:          %d\n", (int)card->pwm);
+        printf("  threshold:    %d (%s matrix)\n", (int)card->threshold, card->default_matrix ? "default" : "card");
+    }
+
+    format_matrix(snapshot->matrix[0], &snapshot->matrix[1]);
+}
+
+/* One line per tick, cards that were not sampled are shown as - */
+void format_record(struct tick_record const *record) {
+    char const *degc = format_utf8_support() ? DEGC_UTF8 : DEGC_ASCII;
+
+    printf("tick %llu", record->tick);
+    for(unsigned i = 0; i < record->ncards && i < FAND_MAX_CARDS; i++) {
+        if(record->cards[i].temp < 0) {
+            printf("  card %u: -", i);
+            continue;
+        }
+        printf("  card %u: %d%s pwm %d threshold %d", i, (int)record->cards[i].temp, degc,
+               (int)record->cards[i].pwm, (int)record->cards[i].threshold);
+    }
+    putchar('\n');
+}
+
 int format(union unpack_result const *result, ipc_request req, ipc_response rsp) {
     if(rsp == ipc_rsp_err) {
         ctl_fprintf(stderr, "%s\n", strerror(result->error));
@@ -87,6 +146,15 @@ int format(union unpack_result const *result, ipc_request req, ipc_response rsp)
         case ipc_req_matrix:
             format_matrix(result->matrix[0], &result->matrix[1]);
             break;
+        case ipc_req_ticks:
+            format_ticks(result->ticks.total, result->ticks.missed, result->ticks.late, result->ticks.max_lateness);
+            break;
+        case ipc_req_snapshot:
+            format_snapshot(&result->snapshot);
+            break;
+        case ipc_req_subscribe:
+            format_record(&result->record);
+            break;
         default:
             fprintf(stderr, "Invalid request %hhu\n", req);
             return -1;
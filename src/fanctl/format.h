@@ -3,7 +3,9 @@
 
 #include "ipc.h"
 #include "serialize.h"
+#include "telemetry.h"
 
 int format(union unpack_result const *result, ipc_request req, ipc_response rsp);
+void format_telemetry(struct telemetry_data const *data, unsigned long long now);
 
 #endif /* FORMAT_H */
@@ -13,19 +13,33 @@ char const *argp_program_version = "amdgpu-fanctl " STR_EXPAND(FAND_VERSION) ;
 char const *argP_program_bug_address = "<vilhelm.engstrom@tuta.io>";
 
 static char doc[] = "amdgpu-fanctl -- Command line interface for amdgpu-fand"
-                    "\vThe TARGET passed to the get switch may be either 'matrix', 'speed' or\n"
-                    "'temp[erature]'.";
+                    "\vThe TARGET passed to the get switch may be either 'matrix', 'speed',\n"
+                    "'temp[erature]', 'ticks' or 'snapshot', the latter covering every card.\n"
+                    "The switch may be repeated, multiple targets are served by a single\n"
+                    "snapshot taken by the daemon.\n\n"
+                    "With --telemetry, speed and temperature are read from the daemon's\n"
+                    "shared telemetry page when it is available, without contacting the\n"
+                    "daemon. Without a TARGET, the whole page is printed.\n\n"
+                    "With --watch, a line is printed per control tick, holding the\n"
+                    "temperature, pwm and threshold of every card, until interrupted.";
 static char args_doc[] = "";
 
 static struct argp_option options[] = {
     {"exit", 'e', 0,        0, "Kill the daemon", 0 },
     {"get",  'g', "TARGET", 0, "Get value corresponding to TARGET (see below)", 0 },
+    {"telemetry", 't', 0,   0, "Read from the telemetry page if available (see below)", 0 },
+    {"watch", 'w', 0,       0, "Stream the state of every card (see below)", 0 },
     { 0 }
 };
 
+enum { FANCTL_MAX_TARGETS = 8 };
+
 struct args {
     bool exit;
-    char const *target;
+    bool telemetry;
+    bool watch;
+    unsigned ntargets;
+    char const *targets[FANCTL_MAX_TARGETS];
 };
 
 static error_t parse_opt(int key, char *arg, struct argp_state *state) {
@@ -36,7 +50,16 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
             args->exit = true;
             break;
         case 'g':
-            args->target = arg;
+            if(args->ntargets == FANCTL_MAX_TARGETS) {
+                argp_error(state, "At most %d targets may be given", FANCTL_MAX_TARGETS);
+            }
+            args->targets[args->ntargets++] = arg;
+            break;
+        case 't':
+            args->telemetry = true;
+            break;
+        case 'w':
+            args->watch = true;
             break;
         default:
             return ARGP_ERR_UNKNOWN;
@@ -60,25 +83,46 @@ int main(int argc, char **argv) {
 
     struct args args = {
         .exit = false,
-        .target = 0
+        .telemetry = false,
+        .watch = false,
+        .ntargets = 0
     };
 
+    ipc_request requests[FANCTL_MAX_TARGETS];
+    unsigned served = 0;
+
     argp_parse(&argp, argc, argv, 0, 0, &args);
 
-    if(!args.exit && !args.target) {
-        /* Nothing to do */
-        return 0;
+    if(!args.exit && !args.ntargets && !args.watch) {
+        /* Nothing to do unless dumping the telemetry page */
+        return args.telemetry && request_dump_telemetry() ? 1 : 0;
     }
 
-    if(args.target) {
-        ipc_request request;
-        if(request_convert(args.target, &request)) {
+    for(unsigned i = 0; i < args.ntargets; i++) {
+        if(request_convert(args.targets[i], &requests[i])) {
             return 1;
         }
+    }
 
-        if(request_process_get(request)) {
+    /* Targets are printed in order, the daemon is queried for
+     * the remaining ones once the telemetry page falls short */
+    for(; args.telemetry && served < args.ntargets; served++) {
+        status = request_process_telemetry(requests[served]);
+        if(status < 0) {
             return 1;
         }
+        if(status) {
+            break;
+        }
+    }
+    status = 0;
+
+    if(served < args.ntargets && request_process_gets(&requests[served], args.ntargets - served)) {
+        return 1;
+    }
+
+    if(args.watch && request_process_watch()) {
+        return 1;
     }
 
     if(args.exit) {
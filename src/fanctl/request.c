@@ -1,14 +1,22 @@
 #include "client.h"
 #include "ctlio.h"
+#include "fandcfg.h"
 #include "format.h"
 #include "ipc.h"
 #include "macro.h"
 #include "request.h"
 #include "serialize.h"
+#include "telemetry.h"
 
+#include <errno.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
 
+#include <time.h>
+
+enum { NSEC_PER_SEC = 1000000000 };
+
 int request_convert(char const *target, ipc_request *request) {
     *request = ipc_req_inval;
     for(unsigned i = 0; i < array_size(ipc_request_map); i++) {
@@ -48,6 +56,12 @@ int request_process_get(ipc_request request) {
         case ipc_req_matrix:
             rsp = unpack_matrix(rspbuffer, rsplen, &result);
             break;
+        case ipc_req_ticks:
+            rsp = unpack_ticks(rspbuffer, rsplen, &result);
+            break;
+        case ipc_req_snapshot:
+            rsp = unpack_snapshot(rspbuffer, rsplen, &result);
+            break;
         default:
             ctl_fprintf(stderr, "Invalid request %hhu\n", request);
             return -1;
@@ -60,6 +74,85 @@ int request_process_get(ipc_request request) {
     return 0;
 }
 
+/* Fills result as if request had been sent on its own */
+static ipc_response request_extract(struct snapshot const *snapshot, ipc_request request, union unpack_result *result) {
+    int value;
+
+    switch(request) {
+        case ipc_req_speed:
+        case ipc_req_temp:
+            /* Reported for the first card */
+            value = !snapshot->ncards ? -1 :
+                    request == ipc_req_speed ? snapshot->cards[0].speed : snapshot->cards[0].temp;
+            if(value < 0) {
+                result->error = EAGAIN;
+                return ipc_rsp_err;
+            }
+            result->temp = value;
+            break;
+        case ipc_req_matrix:
+            memcpy(result->matrix, snapshot->matrix, sizeof(result->matrix));
+            break;
+        case ipc_req_ticks:
+            result->ticks.total = snapshot->ticks;
+            result->ticks.missed = snapshot->missed;
+            result->ticks.late = snapshot->late;
+            result->ticks.max_lateness = snapshot->max_lateness;
+            break;
+        case ipc_req_snapshot:
+            result->snapshot = *snapshot;
+            break;
+        default:
+            result->error = EINVAL;
+            return ipc_rsp_err;
+    }
+
+    return ipc_rsp_ok;
+}
+
+/* Multiple targets are served by a single snapshot request */
+int request_process_gets(ipc_request const *requests, unsigned nrequests) {
+    unsigned char rspbuffer[IPC_MAX_MSG_LENGTH];
+    union unpack_result snapshot;
+    union unpack_result result;
+    ssize_t rsplen;
+    ipc_response rsp;
+    int status = 0;
+
+    if(nrequests == 1) {
+        return request_process_get(requests[0]);
+    }
+
+    rsplen = client_send_and_recv(rspbuffer, sizeof(rspbuffer), ipc_req_snapshot);
+    if(rsplen < 0) {
+        return rsplen;
+    }
+
+    rsp = unpack_snapshot(rspbuffer, rsplen, &snapshot);
+    if(rsp == ipc_rsp_err && snapshot.error == EINVAL) {
+        /* Daemon predates snapshots */
+        for(unsigned i = 0; i < nrequests; i++) {
+            if(request_process_get(requests[i])) {
+                status = -1;
+            }
+        }
+        return status;
+    }
+
+    if(rsp != ipc_rsp_ok) {
+        return format(&snapshot, ipc_req_snapshot, rsp);
+    }
+
+    for(unsigned i = 0; i < nrequests; i++) {
+        rsp = request_extract(&snapshot.snapshot, requests[i], &result);
+        if(format(&result, requests[i], rsp)) {
+            status = -1;
+        }
+    }
+
+    return status;
+}
+
 int request_process_exit(void) {
     unsigned char rspbuffer[IPC_MAX_MSG_LENGTH];
     ssize_t rsplen;
@@ -76,3 +169,105 @@ int request_process_exit(void) {
 
     return 0;
 }
+
+/* Prints a line per control tick until the daemon closes the stream */
+int request_process_watch(void) {
+    unsigned char buffer[4 * IPC_MAX_MSG_LENGTH];
+    union unpack_result result;
+    size_t len = 0;
+    size_t msglen;
+    ssize_t nrecv;
+    ssize_t rsp;
+    bool subscribed = false;
+    int status = -1;
+
+    if(client_subscribe()) {
+        return -1;
+    }
+
+    while((nrecv = client_recv(buffer + len, sizeof(buffer) - len)) > 0) {
+        len += nrecv;
+
+        /* Messages start with their total length, the first is the ack */
+        while(len && buffer[0] <= len) {
+            msglen = buffer[0];
+            rsp = subscribed ? unpack_tick_record(buffer, msglen, &result) :
+                               unpack_subscribe_rsp(buffer, msglen, &result);
+            if(rsp < 0) {
+                ctl_fprintf(stderr, "Malformed message from server\n");
+                goto cleanup;
+            }
+            if((subscribed || rsp) && format(&result, ipc_req_subscribe, (ipc_response)rsp)) {
+                goto cleanup;
+            }
+            subscribed = true;
+
+            memmove(buffer, buffer + msglen, len - msglen);
+            len -= msglen;
+        }
+        fflush(stdout);
+    }
+
+    if(!nrecv) {
+        ctl_fprintf(stderr, "Server closed the connection\n");
+    }
+
+cleanup:
+    client_kill();
+    return status;
+}
+
+static int request_read_telemetry(struct telemetry_data *data) {
+    struct telemetry_page const *page;
+    int status = telemetry_map(&page);
+
+    if(status) {
+        return status;
+    }
+
+    status = telemetry_read(page, data);
+    telemetry_unmap(page);
+
+    return status;
+}
+
+int request_process_telemetry(ipc_request request) {
+    struct telemetry_data data;
+    union unpack_result result;
+
+    if(request != ipc_req_speed && request != ipc_req_temp) {
+        return 1;
+    }
+
+    if(request_read_telemetry(&data) || !data.ncards) {
+        return 1;
+    }
+
+    if(request == ipc_req_speed) {
+        if(data.cards[0].speed < 0) {
+            return 1;
+        }
+        result.speed = data.cards[0].speed;
+    }
+    else {
+        result.temp = data.cards[0].temp;
+    }
+
+    return format(&result, request, ipc_rsp_ok) ? -1 : 0;
+}
+
+int request_dump_telemetry(void) {
+    struct telemetry_data data;
+    struct timespec ts;
+    int status = request_read_telemetry(&data);
+
+    if(status) {
+        ctl_fprintf(stderr, "Could not read telemetry page %s: %s\n", DAEMON_TELEMETRY_FILE, strerror(-status));
+        return -1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    format_telemetry(&data, (unsigned long long)ts.tv_sec * NSEC_PER_SEC + (unsigned long long)ts.tv_nsec);
+
+    return 0;
+}
@@ -3,6 +3,10 @@
 
 int request_convert(char const *target, ipc_request *request);
 int request_process_get(ipc_request request);
+int request_process_gets(ipc_request const *requests, unsigned nrequests);
 int request_process_exit(void);
+int request_process_watch(void);
+int request_process_telemetry(ipc_request request);
+int request_dump_telemetry(void);
 
 #endif /* REQUEST_H */
@@ -25,10 +25,15 @@
 struct fand_cache fand_cache;
 
 enum {
-    CACHE_SIZE = sizeof(((struct fand_cache *)0)->pwm) +
-                 sizeof(((struct fand_cache *)0)->pwm_enable) +
-                 sizeof(((struct fand_cache *)0)->temp_input) +
-                 sizeof(((struct fand_cache *)0)->card_idx) +
+    CACHE_CARD_SIZE = sizeof(((struct fand_cache_card *)0)->pwm) +
+                      sizeof(((struct fand_cache_card *)0)->pwm_enable) +
+                      sizeof(((struct fand_cache_card *)0)->temp_input) +
+                      sizeof(((struct fand_cache_card *)0)->card_idx)
+};
+
+enum {
+    CACHE_SIZE = FAND_MAX_CARDS * CACHE_CARD_SIZE +
+                 sizeof(((struct fand_cache *)0)->ncards) +
                  sizeof(((struct fand_cache *)0)->checksum)
 };
 
@@ -41,8 +46,11 @@ MOCKABLE(static inline)
 bool cache_file_exists_in_sysfs(char const *file) {
     static char const *sysfs_stem = "/sys/";
     static size_t const stem_len = 5u;
+    /* Paths are cached with the root prepended */
+    char const *root = fsys_root();
+    size_t root_len = strlen(root);
 
-    return fsys_file_exists(file) && strncmp(file, sysfs_stem, stem_len) == 0;
+    return fsys_file_exists(file) && strncmp(file, root, root_len) == 0 && strncmp(file + root_len, sysfs_stem, stem_len) == 0;
 }
 
 static int cache_validate(unsigned char *buffer, size_t nbytes) {
@@ -64,17 +72,25 @@ static int cache_validate(unsigned char *buffer, size_t nbytes) {
         return -1;
     }
 
-    if(!cache_file_exists_in_sysfs(fand_cache.pwm)) {
-        syslog(LOG_WARNING, "Cached pwm file %s does not exist in /sys tree", fand_cache.pwm);
-        status = -1;
-    }
-    else if(!cache_file_exists_in_sysfs(fand_cache.pwm_enable)) {
-        syslog(LOG_WARNING, "Cached pwm enable file %s does not exist in /sys tree", fand_cache.pwm_enable);
-        status = -1;
+    if(!fand_cache.ncards || fand_cache.ncards > FAND_MAX_CARDS) {
+        syslog(LOG_WARNING, "Corrupted cache, invalid number of cards %u", fand_cache.ncards);
+        return -1;
     }
-    else if(!cache_file_exists_in_sysfs(fand_cache.temp_input)) {
-        syslog(LOG_WARNING, "Cached temp input file %s does not exist in /sys tree", fand_cache.temp_input);
-        status = -1;
+
+    for(unsigned i = 0; i < fand_cache.ncards && !status; i++) {
+        struct fand_cache_card const *card = &fand_cache.cards[i];
+        if(!cache_file_exists_in_sysfs(card->pwm)) {
+            syslog(LOG_WARNING, "Cached pwm file %s does not exist in /sys tree", card->pwm);
+            status = -1;
+        }
+        else if(!cache_file_exists_in_sysfs(card->pwm_enable)) {
+            syslog(LOG_WARNING, "Cached pwm enable file %s does not exist in /sys tree", card->pwm_enable);
+            status = -1;
+        }
+        else if(!cache_file_exists_in_sysfs(card->temp_input)) {
+            syslog(LOG_WARNING, "Cached temp input file %s does not exist in /sys tree", card->temp_input);
+            status = -1;
+        }
     }
 
     return status;
@@ -87,12 +103,28 @@ static ssize_t cache_pack(unsigned char *buffer, size_t bufsize) {
     }
 
     ssize_t nbytes = 0;
+    ssize_t npacked;
     unsigned char digest[SHA1_DIGESTSIZE];
+    struct fand_cache_card *card;
+
+    for(unsigned i = 0; i < FAND_MAX_CARDS; i++) {
+        card = &fand_cache.cards[i];
+        npacked = packf(buffer + nbytes, bufsize - nbytes, "%*hhu%*hhu%*hhu%u", sizeof(card->pwm),        (unsigned char *)card->pwm,
+                                                                                sizeof(card->pwm_enable), (unsigned char *)card->pwm_enable,
+                                                                                sizeof(card->temp_input), (unsigned char *)card->temp_input,
+                                                                                card->card_idx);
+        if(npacked < 0) {
+            return -1;
+        }
+        nbytes += npacked;
+    }
+
+    npacked = packf(buffer + nbytes, bufsize - nbytes, "%u", fand_cache.ncards);
+    if(npacked < 0) {
+        return -1;
+    }
+    nbytes += npacked;
 
-    nbytes = packf(buffer, bufsize, "%*hhu%*hhu%*hhu%u", sizeof(fand_cache.pwm),        (unsigned char *)fand_cache.pwm,
-                                                         sizeof(fand_cache.pwm_enable), (unsigned char *)fand_cache.pwm_enable,
-                                                         sizeof(fand_cache.temp_input), (unsigned char *)fand_cache.temp_input,
-                                                         fand_cache.card_idx);
     sha1_ctx ctx;
     sha1_init(&ctx);
     sha1_update(&ctx, buffer, nbytes);
@@ -109,22 +141,40 @@ static ssize_t cache_unpack(unsigned char const *buffer, size_t bufsize) {
         return -1;
     }
     ssize_t nbytes = 0;
+    ssize_t nunpacked;
+    struct fand_cache_card *card;
+
     if(!cache_struct_is_padded()) {
         memcpy(&fand_cache, buffer, sizeof(fand_cache));
         nbytes = sizeof(fand_cache);
     }
     else {
-        nbytes = unpackf(buffer, bufsize, "%*hhu%*hhu%*hhu%u%*hhu", sizeof(fand_cache.pwm),        (unsigned char *)fand_cache.pwm,
-                                                                    sizeof(fand_cache.pwm_enable), (unsigned char *)fand_cache.pwm_enable,
-                                                                    sizeof(fand_cache.temp_input), (unsigned char *)fand_cache.temp_input,
-                                                                    &fand_cache.card_idx,
-                                                                    sizeof(fand_cache.checksum), fand_cache.checksum);
+        for(unsigned i = 0; i < FAND_MAX_CARDS; i++) {
+            card = &fand_cache.cards[i];
+            nunpacked = unpackf(buffer + nbytes, bufsize - nbytes, "%*hhu%*hhu%*hhu%u", sizeof(card->pwm),        (unsigned char *)card->pwm,
+                                                                                        sizeof(card->pwm_enable), (unsigned char *)card->pwm_enable,
+                                                                                        sizeof(card->temp_input), (unsigned char *)card->temp_input,
+                                                                                        &card->card_idx);
+            if(nunpacked < 0) {
+                return -1;
+            }
+            nbytes += nunpacked;
+        }
+
+        nunpacked = unpackf(buffer + nbytes, bufsize - nbytes, "%u%*hhu", &fand_cache.ncards, sizeof(fand_cache.checksum), fand_cache.checksum);
+        if(nunpacked < 0) {
+            return -1;
+        }
+        nbytes += nunpacked;
     }
 
     /* Prevent overrun in case of cache corruption */
-    fand_cache.pwm[sizeof(fand_cache.pwm) - 1] = '\0';
-    fand_cache.pwm_enable[sizeof(fand_cache.pwm_enable) - 1] = '\0';
-    fand_cache.temp_input[sizeof(fand_cache.temp_input) - 1] = '\0';
+    for(unsigned i = 0; i < FAND_MAX_CARDS; i++) {
+        card = &fand_cache.cards[i];
+        card->pwm[sizeof(card->pwm) - 1] = '\0';
+        card->pwm_enable[sizeof(card->pwm_enable) - 1] = '\0';
+        card->temp_input[sizeof(card->temp_input) - 1] = '\0';
+    }
 
     return nbytes;
 }
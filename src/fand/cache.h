@@ -4,11 +4,16 @@
 #include "fandcfg.h"
 #include "sha1.h"
 
-struct fand_cache {
+struct fand_cache_card {
     char pwm[HWMON_PATH_SIZE];
     char pwm_enable[HWMON_PATH_SIZE];
     char temp_input[HWMON_PATH_SIZE];
     unsigned card_idx;
+};
+
+struct fand_cache {
+    struct fand_cache_card cards[FAND_MAX_CARDS];
+    unsigned ncards;
     unsigned char checksum[SHA1_DIGESTSIZE];
 };
 
@@ -1,163 +1,201 @@
 #include "config.h"
 #include "macro.h"
-#include "regutils.h"
 #include "strutils.h"
 
+#include <ctype.h>
 #include <errno.h>
 #include <limits.h>
+#include <stdarg.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdio.h>
-#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
-#include <regex.h>
+#include <fcntl.h>
 #include <syslog.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #define CONFIG_KEY_INTERVAL "interval"
 #define CONFIG_KEY_HYSTERESIS "hysteresis"
 #define CONFIG_KEY_MATRIX "matrix"
 #define CONFIG_KEY_THROTTLE "aggressive_throttle"
+#define CONFIG_KEY_SAMPLE_MAX_AGE "sample_max_age"
+#define CONFIG_KEY_CARD_MATRIX "matrix_card"
+#define CONFIG_KEY_FAN_CURVE_OFFLOAD "fan_curve_offload"
 
-enum { CONFIG_BUFFER_SIZE = 256 };
 enum { CONFIG_KEY_SIZE = 64 };
-enum { CONFIG_NUMBUF_SIZE = 4 };
+enum { CONFIG_VALUE_SIZE = 64 };
+enum { CONFIG_EOF = -1 };
+enum { CONFIG_NSEC_PER_SEC = 1000000000 };
+/* Files changed more recently are read again by config_load */
+enum { CONFIG_RACY_NSEC = 100000000 };
+
+/* State of the single pass over the text. Each non-empty line holds
+ *
+ *     key = value    # comment
+ *
+ * the value optionally enclosed in double quotes. Matrices are given as
+ * a parenthesized list of 'temperature::percentage' rows, one per line.
+ * Nothing is allocated, values are copied to fixed size buffers on the
+ * stack only for the duration of their handler */
+struct config_parser {
+    char const *pos;
+    char const *end;
+    char const *linestart;
+    unsigned line;
+    struct config_error *error;
+};
 
 struct config_pair {
     char const *key;
-    int(*handler)(struct fand_config *, char const*);
+    int(*handler)(struct config_parser *, struct fand_config *, char const *);
 };
 
-static int config_set_interval(struct fand_config *data, char const *value);
-static int config_set_hysteresis(struct fand_config *data, char const *value);
-static int config_set_matrix(struct fand_config *data, char const *value);
-static int config_set_throttle(struct fand_config *data, char const *value);
+static int config_set_interval(struct config_parser *parser, struct fand_config *data, char const *value);
+static int config_set_hysteresis(struct config_parser *parser, struct fand_config *data, char const *value);
+static int config_set_throttle(struct config_parser *parser, struct fand_config *data, char const *value);
+static int config_set_sample_max_age(struct config_parser *parser, struct fand_config *data, char const *value);
+static int config_set_fan_curve_offload(struct config_parser *parser, struct fand_config *data, char const *value);
 
 static struct config_pair config_map[] = {
-    { CONFIG_KEY_INTERVAL,    config_set_interval },
-    { CONFIG_KEY_HYSTERESIS,  config_set_hysteresis },
-    { CONFIG_KEY_MATRIX,      config_set_matrix },
-    { CONFIG_KEY_THROTTLE,    config_set_throttle }
+    { CONFIG_KEY_INTERVAL,        config_set_interval },
+    { CONFIG_KEY_HYSTERESIS,      config_set_hysteresis },
+    { CONFIG_KEY_THROTTLE,        config_set_throttle },
+    { CONFIG_KEY_SAMPLE_MAX_AGE,  config_set_sample_max_age },
+    { CONFIG_KEY_FAN_CURVE_OFFLOAD, config_set_fan_curve_offload }
 };
 
-static inline int regmatch_length(regmatch_t *match) {
-    return match->rm_eo - match->rm_so;
+/* Records the error at the current position */
+static int config_fail(struct config_parser *parser, char const *fmt, ...) {
+    va_list args;
+
+    parser->error->line = parser->line;
+    parser->error->column = (unsigned)(parser->pos - parser->linestart) + 1u;
+
+    va_start(args, fmt);
+    vsnprintf(parser->error->message, sizeof(parser->error->message), fmt, args);
+    va_end(args);
+
+    return -1;
 }
 
-static inline void config_replace_char(char *buffer, char from, char to) {
-    char *cpos = strchr(buffer, from);
-    if(cpos) {
-        *cpos = to;
-    }
+static inline int config_peek(struct config_parser const *parser) {
+    return parser->pos < parser->end ? (unsigned char)*parser->pos : CONFIG_EOF;
 }
 
-static inline void config_strip_comments(char *buffer) {
-    config_replace_char(buffer, '#', '\0');
+static inline void config_newline(struct config_parser *parser) {
+    ++parser->pos;
+    ++parser->line;
+    parser->linestart = parser->pos;
 }
 
-static inline bool config_line_empty(char *buffer) {
-    for(; *buffer; ++buffer) {
-        switch(*buffer) {
-            case ' ':
-            case '\f':
-            case '\n':
-            case '\r':
-            case '\t':
-                /* NOP */
-                break;
-            default:
-                return false;
-        }
+static inline bool config_is_blank(int c) {
+    switch(c) {
+        case ' ':
+        case '\f':
+        case '\r':
+        case '\t':
+        case '\v':
+            return true;
+        default:
+            return false;
     }
+}
 
-    return true;
+/* Characters that may appear in keys and values */
+static inline bool config_is_word(int c) {
+    return c != CONFIG_EOF && isgraph(c) && c != '#' && c != '=' && c != '"';
 }
 
-static int config_set_interval(struct fand_config *data, char const *value) {
-    unsigned long ul;
-    int reti = strstoul_range(value, &ul, 0ul, (unsigned long)USHRT_MAX);
-    if(reti) {
-        syslog(LOG_ERR, "Invalid interval %s, must be a number between 0 and %hu", value, (unsigned short)USHRT_MAX);
-        return reti;
+static int config_unexpected(struct config_parser *parser, char const *expected) {
+    int c = config_peek(parser);
+
+    if(c == CONFIG_EOF) {
+        return config_fail(parser, "Expected %s, found end of file", expected);
     }
-    data->interval = (unsigned short)ul;
-    return 0;
+    if(c == '\n') {
+        return config_fail(parser, "Expected %s, found end of line", expected);
+    }
+    if(isprint(c)) {
+        return config_fail(parser, "Expected %s, found '%c'", expected, c);
+    }
+    return config_fail(parser, "Expected %s, found byte 0x%02x", expected, (unsigned)c);
 }
 
-static int config_set_hysteresis(struct fand_config *data, char const *value) {
-    unsigned long ul;
-    int reti = strstoul_range(value, &ul, 0, UCHAR_MAX);
-    if(reti) {
-        syslog(LOG_ERR, "Invalid hysteresis %s, must be a number between 0 and %hhu", value, (unsigned char)UCHAR_MAX);
-        return reti;
+static inline int config_expect(struct config_parser *parser, char c, char const *expected) {
+    if(config_peek(parser) != (unsigned char)c) {
+        return config_unexpected(parser, expected);
     }
-    data->hysteresis = (unsigned char)ul;
+    ++parser->pos;
     return 0;
 }
 
-static int config_set_matrix(struct fand_config *data, char const *value) {
-    regex_t matv_regex;
-    regmatch_t pmatch[3];
-    int status = 0;
-    unsigned char matrix_rows;
-    char numbuf[CONFIG_NUMBUF_SIZE];
-    unsigned long ul;
-    unsigned char temp;
+/* Skips blanks and a trailing comment, stopping at the line break */
+static void config_skip_blanks(struct config_parser *parser) {
+    char const *eol;
 
-    if(regcomp_info(&matv_regex, "[;(]'([0-9]+)::([0-9]+)'.*[;)]", REG_EXTENDED, "matrix value")) {
-        return -1;
+    while(config_is_blank(config_peek(parser))) {
+        ++parser->pos;
     }
 
-    for(matrix_rows = 0; matrix_rows < MAX_TEMP_THRESHOLDS && value; matrix_rows++) {
-        if(regexec(&matv_regex, value, array_size(pmatch), pmatch, 0)) {
-            syslog(LOG_ERR, "Error while parsing matrix, offending segment: %s", value);
-            status = -1;
-            goto cleanup;
-        }
+    if(config_peek(parser) == '#') {
+        eol = memchr(parser->pos, '\n', (size_t)(parser->end - parser->pos));
+        parser->pos = eol ? eol : parser->end;
+    }
+}
 
-        if(strsncpy(numbuf, value + pmatch[1].rm_so, sizeof(numbuf), regmatch_length(&pmatch[1])) < 0) {
-            syslog(LOG_ERR, "Temperature %.*s exceeds allowed limit", regmatch_length(&pmatch[1]), value + pmatch[1].rm_so);
-            status = -1;
-            goto cleanup;
-        }
+/* Skips empty lines and lines holding only comments */
+static void config_skip_lines(struct config_parser *parser) {
+    for(config_skip_blanks(parser); config_peek(parser) == '\n'; config_skip_blanks(parser)) {
+        config_newline(parser);
+    }
+}
 
-        if(strstoul_range(numbuf, &ul, 0, UCHAR_MAX)) {
-            syslog(LOG_ERR, "Invalid temperature %s, must be a number between 0 and %hhu", numbuf, (unsigned char)UCHAR_MAX);
-            status = -1;
-            goto cleanup;
-        }
-        temp = (unsigned char)ul;
+static int config_end_line(struct config_parser *parser) {
+    config_skip_blanks(parser);
 
-        if(strsncpy(numbuf, value + pmatch[2].rm_so, sizeof(numbuf), regmatch_length(&pmatch[2])) < 0) {
-            syslog(LOG_ERR, "Percentage %.*s exceeds allowed limit", regmatch_length(&pmatch[2]), value + pmatch[2].rm_so);
-            status = -1;
-            goto cleanup;
-        }
-        if(strstoul_range(numbuf, &ul, 0, 100)) {
-            syslog(LOG_ERR, "Invalid percentage %s, must be a number between 0 and 100", numbuf);
-            status = -1;
-            goto cleanup;
-        }
+    if(config_peek(parser) == '\n') {
+        config_newline(parser);
+        return 0;
+    }
+    if(config_peek(parser) == CONFIG_EOF) {
+        return 0;
+    }
 
-        data->matrix[matrix_rows * 2] = temp;
-        data->matrix[matrix_rows * 2 + 1] = (unsigned char)ul;
+    return config_unexpected(parser, "end of line");
+}
 
-        value = strchr(value + 1, ';');
+static size_t config_word_length(struct config_parser const *parser) {
+    char const *pos = parser->pos;
+
+    while(pos < parser->end && config_is_word((unsigned char)*pos)) {
+        ++pos;
     }
 
-    if(matrix_rows == MAX_TEMP_THRESHOLDS) {
-        syslog(LOG_ERR, "Matrix may contain at most %d rows", MAX_TEMP_THRESHOLDS);
-        status = -1;
-        goto cleanup;
+    return (size_t)(pos - parser->pos);
+}
+
+static int config_set_interval(struct config_parser *parser, struct fand_config *data, char const *value) {
+    unsigned long ul;
+    if(strstoul_range(value, &ul, 0ul, (unsigned long)USHRT_MAX)) {
+        return config_fail(parser, "Invalid interval %s, must be a number between 0 and %hu", value, (unsigned short)USHRT_MAX);
     }
+    data->interval = (unsigned short)ul;
+    return 0;
+}
 
-    data->matrix_rows = matrix_rows;
-cleanup:
-    regfree(&matv_regex);
-    return status;
+static int config_set_hysteresis(struct config_parser *parser, struct fand_config *data, char const *value) {
+    unsigned long ul;
+    if(strstoul_range(value, &ul, 0, UCHAR_MAX)) {
+        return config_fail(parser, "Invalid hysteresis %s, must be a number between 0 and %hhu", value, (unsigned char)UCHAR_MAX);
+    }
+    data->hysteresis = (unsigned char)ul;
+    return 0;
 }
 
-static int config_set_throttle(struct fand_config *data, char const *value) {
+static int config_set_throttle(struct config_parser *parser, struct fand_config *data, char const *value) {
     if(strcmp(value, "true") == 0) {
         data->throttle = true;
     }
@@ -165,178 +203,481 @@ static int config_set_throttle(struct fand_config *data, char const *value) {
         data->throttle = false;
     }
     else {
-        syslog(LOG_WARNING, "Unknown value %s for aggressive_throttle, valid options are 'true' or 'false'", value);
-        return -1;
+        return config_fail(parser, "Unknown value %s for aggressive_throttle, valid options are 'true' or 'false'", value);
     }
     return 0;
 }
 
-static int config_append_matrix_rows(char *value, size_t valsize, FILE *fp , unsigned *lineno) {
-    regex_t mpat_start, mpat_mid, mpat_end;
-    regmatch_t pmatch[2];
-    int status = -1;
-    ssize_t pos;
-    char buffer[CONFIG_BUFFER_SIZE];
-    int mid_reti, end_reti;
-    unsigned matrix_rows = 0;
+static int config_set_sample_max_age(struct config_parser *parser, struct fand_config *data, char const *value) {
+    unsigned long ul;
+    if(strstoul_range(value, &ul, 0ul, (unsigned long)USHRT_MAX)) {
+        return config_fail(parser, "Invalid sample_max_age %s, must be a number between 0 and %hu", value, (unsigned short)USHRT_MAX);
+    }
+    data->sample_max_age = (unsigned short)ul;
+    return 0;
+}
 
-    if(regcomp_info(&mpat_start, "\\s*(\\('[0-9]+::[0-9]+')\\s*$", REG_EXTENDED, "matrix start")) {
-        return status;
+static int config_set_fan_curve_offload(struct config_parser *parser, struct fand_config *data, char const *value) {
+    if(strcmp(value, "true") == 0) {
+        data->fan_curve_offload = true;
     }
-    if(regcomp_info(&mpat_mid, "\\s*('[0-9]+::[0-9]+')\\s*$", REG_EXTENDED, "matrix middle")) {
-        regfree(&mpat_start);
-        return status;
+    else if(strcmp(value, "false") == 0) {
+        data->fan_curve_offload = false;
     }
-    if(regcomp_info(&mpat_end, "\\s*('[0-9]+::[0-9]+'\\))\\s*$", REG_EXTENDED, "matrix end")) {
-        regfree(&mpat_start);
-        regfree(&mpat_mid);
-        return status;
+    else {
+        return config_fail(parser, "Unknown value %s for fan_curve_offload, valid options are 'true' or 'false'", value);
     }
+    return 0;
+}
 
-    if(regexec(&mpat_start, value, array_size(pmatch), pmatch, 0)) {
-        syslog(LOG_ERR, "Syntax error on line %u: Invalid matrix %s", *lineno, value);
-        goto cleanup;
+/* Copies the value, optionally quoted, and hands it to the handler with the
+ * parser positioned at its first character */
+static int config_parse_value(struct config_parser *parser, struct fand_config *data, struct config_pair const *pair) {
+    char value[CONFIG_VALUE_SIZE];
+    char const *start;
+    char const *next;
+    size_t len;
+    bool quoted = config_peek(parser) == '"';
+
+    parser->pos += quoted;
+    start = parser->pos;
+    len = config_word_length(parser);
+    parser->pos += len;
+
+    if(!len) {
+        return config_unexpected(parser, "value");
+    }
+    if(quoted && config_expect(parser, '"', "'\"' closing the value")) {
+        return -1;
     }
 
-    if(strsncpy(buffer, value + pmatch[1].rm_so, sizeof(buffer), regmatch_length(&pmatch[1])) < 0) {
-        syslog(LOG_ERR, "Matrix %.*s overflows the internal buffer", regmatch_length(&pmatch[1]), value + pmatch[1].rm_so);
-        goto cleanup;
+    next = parser->pos;
+    parser->pos = start;
+
+    if(len >= sizeof(value)) {
+        return config_fail(parser, "Value of %s exceeds %zu characters", pair->key, sizeof(value) - 1);
     }
+    memcpy(value, start, len);
+    value[len] = '\0';
 
-    pos = strscpy(value, buffer, valsize);
-    if(pos < 0) {
-        syslog(LOG_ERR, "Overflow while writing stripped matrix value back to buffer. This should not be possible");
-        goto cleanup;
+    if(pair->handler(parser, data, value)) {
+        return -1;
     }
-    while(fgets(buffer, sizeof(buffer), fp)) {
-        mid_reti = 1;
-        end_reti = 1;
-        ++*lineno;
-        ++matrix_rows;
-        if(matrix_rows > MATRIX_MAX_SIZE / 2) {
-            syslog(LOG_ERR, "Matrix may contain at most %u rows", MATRIX_MAX_SIZE / 2);
-            goto cleanup;
+
+    parser->pos = next;
+    return 0;
+}
+
+static int config_parse_number(struct config_parser *parser, char const *name, unsigned long max, unsigned char *value) {
+    char const *start = parser->pos;
+    unsigned long ul = 0;
+
+    if(!isdigit(config_peek(parser))) {
+        return config_unexpected(parser, name);
+    }
+
+    for(; parser->pos < parser->end && isdigit((unsigned char)*parser->pos); ++parser->pos) {
+        /* Saturate rather than overflow, the range is checked below */
+        if(ul <= max) {
+            ul = ul * 10 + (unsigned long)(*parser->pos - '0');
         }
+    }
+
+    if(ul > max) {
+        int len = (int)(parser->pos - start);
+        parser->pos = start;
+        return config_fail(parser, "Invalid %s %.*s, must be a number between 0 and %lu", name, len, start, max);
+    }
+
+    *value = (unsigned char)ul;
+    return 0;
+}
+
+/* A single 'temperature::percentage' row */
+static int config_parse_row(struct config_parser *parser, unsigned char *row) {
+    if(config_expect(parser, '\'', "' opening the row")) {
+        return -1;
+    }
+    if(config_parse_number(parser, "temperature", UCHAR_MAX, &row[0])) {
+        return -1;
+    }
+    if(parser->end - parser->pos < 2 || memcmp(parser->pos, "::", 2)) {
+        return config_unexpected(parser, "'::'");
+    }
+    parser->pos += 2;
+    if(config_parse_number(parser, "percentage", 100, &row[1])) {
+        return -1;
+    }
+    return config_expect(parser, '\'', "' closing the row");
+}
 
-        pos += strscpy(value + pos, ";", valsize - pos);
-        if(pos < 0) {
-            syslog(LOG_ERR, "Line %u: Matrix overflows the internal buffer", *lineno);
-            goto cleanup;
+/* Parses a matrix of the form
+ *
+ *     ('50::10'
+ *      '60::40'
+ *      '80::100')
+ *
+ * Empty lines and comments may appear between rows */
+static int config_parse_matrix(struct config_parser *parser, unsigned char *matrix, unsigned char *rows) {
+    unsigned char nrows = 0;
+
+    if(config_expect(parser, '(', "'(' opening the matrix")) {
+        return -1;
+    }
+
+    while(1) {
+        config_skip_lines(parser);
+
+        if(config_peek(parser) == CONFIG_EOF) {
+            return config_fail(parser, "Unterminated matrix");
+        }
+        if(config_peek(parser) == ')') {
+            if(!nrows) {
+                return config_fail(parser, "Empty matrix");
+            }
+            break;
+        }
+        if(nrows == MAX_TEMP_THRESHOLDS) {
+            return config_fail(parser, "Matrix may contain at most %d rows", MAX_TEMP_THRESHOLDS);
         }
 
-        mid_reti = regexec(&mpat_mid, buffer, array_size(pmatch), pmatch, 0);
-        if(mid_reti) {
-            end_reti = regexec(&mpat_end, buffer, array_size(pmatch), pmatch, 0);
+        if(config_parse_row(parser, &matrix[2 * nrows])) {
+            return -1;
         }
+        ++nrows;
 
-        if(!mid_reti || !end_reti) {
-            pos += strsncpy(value + pos, buffer + pmatch[1].rm_so, valsize - pos, regmatch_length(&pmatch[1]));
-            if(pos < 0) {
-                syslog(LOG_ERR, "Line %u: Matrix overflows the internal buffer", *lineno);
-                goto cleanup;
-            }
+        config_skip_blanks(parser);
+        if(config_peek(parser) == ')') {
+            break;
+        }
+        if(config_peek(parser) == CONFIG_EOF) {
+            return config_fail(parser, "Unterminated matrix");
         }
+        if(config_peek(parser) != '\n') {
+            return config_unexpected(parser, "line break or ')' after the row");
+        }
+    }
+
+    /* Closing parenthesis */
+    ++parser->pos;
+    *rows = nrows;
+    return 0;
+}
+
+/* Keys of the form matrix_cardN, N being the index of the card in /sys/class/drm */
+static bool config_is_card_matrix_key(char const *key, unsigned char *card_idx) {
+    unsigned long ul;
+    size_t const prefix_len = sizeof(CONFIG_KEY_CARD_MATRIX) - 1;
+
+    if(strncmp(key, CONFIG_KEY_CARD_MATRIX, prefix_len) || !key[prefix_len]) {
+        return false;
+    }
 
-        if(!end_reti) {
-            status = 0;
+    if(strstoul_range(key + prefix_len, &ul, 0, UCHAR_MAX)) {
+        return false;
+    }
+
+    *card_idx = (unsigned char)ul;
+    return true;
+}
+
+static int config_set_card_matrix(struct config_parser *parser, struct fand_config *data, unsigned char card_idx) {
+    struct fand_card_matrix *card = 0;
+
+    for(unsigned i = 0; i < data->ncard_matrices; i++) {
+        if(data->card_matrices[i].card_idx == card_idx) {
+            card = &data->card_matrices[i];
             break;
         }
     }
 
-    if(status) {
-        syslog(LOG_ERR, "Syntax error on line %u: Unterminated matrix", *lineno);
+    if(!card) {
+        if(data->ncard_matrices == array_size(data->card_matrices)) {
+            return config_fail(parser, "At most %d card specific matrices may be given", FAND_MAX_CARDS);
+        }
+        card = &data->card_matrices[data->ncard_matrices++];
+        card->card_idx = card_idx;
     }
 
-cleanup:
-    regfree(&mpat_start);
-    regfree(&mpat_mid);
-    regfree(&mpat_end);
-    return status;
+    return config_parse_matrix(parser, card->matrix, &card->rows);
 }
 
-int config_parse(char const *path, struct fand_config *data) {
-    int status = 0;
-    unsigned lineno = 0;
-    unsigned config_idx;
-    regex_t valregex;
-    regmatch_t pmatch[3];
-    char buffer[CONFIG_BUFFER_SIZE];
+static int config_parse_line(struct config_parser *parser, struct fand_config *data) {
     char key[CONFIG_KEY_SIZE];
-    char value[CONFIG_BUFFER_SIZE];
+    struct config_pair const *pair = 0;
+    unsigned char card_idx;
+    bool card_matrix;
+    bool matrix;
+    size_t len = config_word_length(parser);
+
+    if(!len) {
+        return config_unexpected(parser, "key");
+    }
+    if(len >= sizeof(key)) {
+        return config_fail(parser, "Unknown key %.*s", (int)len, parser->pos);
+    }
+    memcpy(key, parser->pos, len);
+    key[len] = '\0';
+    strtolower(key);
+
+    card_matrix = config_is_card_matrix_key(key, &card_idx);
+    matrix = strcmp(key, CONFIG_KEY_MATRIX) == 0;
+
+    for(unsigned i = 0; i < array_size(config_map) && !card_matrix && !matrix; i++) {
+        if(strcmp(key, config_map[i].key) == 0) {
+            pair = &config_map[i];
+            break;
+        }
+    }
+
+    if(!card_matrix && !matrix && !pair) {
+        return config_fail(parser, "Unknown key %s", key);
+    }
+
+    parser->pos += len;
+    config_skip_blanks(parser);
+    if(config_expect(parser, '=', "'=' after the key")) {
+        return -1;
+    }
+    config_skip_blanks(parser);
+
+    if(card_matrix) {
+        return config_set_card_matrix(parser, data, card_idx);
+    }
+    if(matrix) {
+        return config_parse_matrix(parser, data->matrix, &data->matrix_rows);
+    }
+    return config_parse_value(parser, data, pair);
+}
+
+/* Parses the text of a config file in a single pass. On failure, the
+ * position and cause of the first error is stored in error */
+int config_parse_string(char const *text, size_t size, struct fand_config *data, struct config_error *error) {
+    struct config_parser parser = {
+        .pos = text,
+        .end = text + size,
+        .linestart = text,
+        .line = 1,
+        .error = error
+    };
+
+    for(config_skip_lines(&parser); config_peek(&parser) != CONFIG_EOF; config_skip_lines(&parser)) {
+        if(config_parse_line(&parser, data) || config_end_line(&parser)) {
+            return -1;
+        }
+    }
 
-    int reti = regcomp_info(&valregex, "^\\s*(\\S+)\\s*=\\s*\"?([^\" ]+)\"?\\s*$", REG_EXTENDED, "config value");
-    if(reti) {
-        return reti;
+    if(data->matrix_rows == 0) {
+        return config_fail(&parser, "No matrix found");
     }
 
-    FILE *fp = fopen(path, "r");
-    if(!fp) {
+    return 0;
+}
+
+static inline int config_open(char const *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd == -1) {
         syslog(LOG_ERR, "Could not open config file %s: %s", path, strerror(errno));
-        status = -1;
-        goto cleanup;
     }
+    return fd;
+}
+
+/* Reads the whole file in one go, the extra byte detecting files that are too large */
+static ssize_t config_read(int fd, char const *path, char *buffer, size_t size) {
+    size_t total = 0;
+    ssize_t nbytes;
 
-    while(fgets(buffer, sizeof(buffer), fp)) {
-        ++lineno;
-        config_replace_char(buffer, '\n', '\0');
-        config_strip_comments(buffer);
-        if(config_line_empty(buffer)) {
+    while(total < size) {
+        nbytes = read(fd, buffer + total, size - total);
+        if(nbytes == -1 && errno == EINTR) {
             continue;
         }
-
-        if(regexec(&valregex, buffer, array_size(pmatch), pmatch, 0)) {
-           syslog(LOG_ERR, "Syntax error on line %u: %s", lineno, buffer);
-            status = -1;
-            goto cleanup;
+        if(nbytes == -1) {
+            syslog(LOG_ERR, "Could not read config file %s: %s", path, strerror(errno));
+            return -1;
         }
-
-        if(strsncpy(key, buffer + pmatch[1].rm_so, sizeof(key), regmatch_length(&pmatch[1])) < 0) {
-            syslog(LOG_ERR, "Key %.*s overflows the internal buffer", regmatch_length(&pmatch[1]), buffer + pmatch[1].rm_so);
-            status = -1;
-            goto cleanup;
+        if(!nbytes) {
+            break;
         }
-        strtolower(key);
+        total += (size_t)nbytes;
+    }
 
-        if(strsncpy(value, buffer + pmatch[2].rm_so, sizeof(value), regmatch_length(&pmatch[2])) < 0) {
-            syslog(LOG_ERR, "Value %.*s overflows the internal buffer", regmatch_length(&pmatch[2]), buffer + pmatch[2].rm_so);
-            status = -1;
-            goto cleanup;
-        }
+    if(total == size) {
+        syslog(LOG_ERR, "Config file %s exceeds %d bytes", path, CONFIG_MAX_SIZE);
+        return -1;
+    }
 
-        if(strcmp(key, CONFIG_KEY_MATRIX) == 0) {
-            reti = config_append_matrix_rows(value, sizeof(value), fp, &lineno);
-            if(reti) {
-                status = reti;
-                goto cleanup;
-            }
+    return (ssize_t)total;
+}
+
+static int config_parse_fd(int fd, char const *path, struct fand_config *data) {
+    char text[CONFIG_MAX_SIZE + 1];
+    struct config_error error;
+
+    ssize_t size = config_read(fd, path, text, sizeof(text));
+    if(size < 0) {
+        return -1;
+    }
+
+    if(config_parse_string(text, (size_t)size, data, &error)) {
+        syslog(LOG_ERR, "%s:%u:%u: %s", path, error.line, error.column, error.message);
+        return -1;
+    }
+
+    return 0;
+}
+
+int config_parse(char const *path, struct fand_config *data) {
+    int status;
+
+    int fd = config_open(path);
+    if(fd == -1) {
+        return -1;
+    }
+
+    status = config_parse_fd(fd, path, data);
+    close(fd);
+
+    return status;
+}
+
+/* Identifies a version of a file by its inode and timestamps */
+struct config_file_id {
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    struct timespec ctime;
+};
+
+/* File last parsed by config_load, and its config */
+static struct config_file_id config_loaded_id;
+static struct fand_config config_loaded;
+static bool config_loaded_valid;
+
+static inline void config_file_id(struct config_file_id *id, struct stat const *sb) {
+    *id = (struct config_file_id){
+        .dev = sb->st_dev,
+        .ino = sb->st_ino,
+        .size = sb->st_size,
+        .mtime = sb->st_mtim,
+        .ctime = sb->st_ctim
+    };
+}
+
+static inline bool config_file_id_equal(struct config_file_id const *lhs, struct config_file_id const *rhs) {
+    return lhs->dev == rhs->dev &&
+           lhs->ino == rhs->ino &&
+           lhs->size == rhs->size &&
+           lhs->mtime.tv_sec == rhs->mtime.tv_sec && lhs->mtime.tv_nsec == rhs->mtime.tv_nsec &&
+           lhs->ctime.tv_sec == rhs->ctime.tv_sec && lhs->ctime.tv_nsec == rhs->ctime.tv_nsec;
+}
+
+/* Whether the file may be written again without its timestamps moving,
+ * as they are only as fine grained as the clock tick of the kernel */
+static bool config_file_racy(struct config_file_id const *id) {
+    struct timespec now;
+
+    if(clock_gettime(CLOCK_REALTIME, &now) == -1) {
+        return true;
+    }
+
+    return (now.tv_sec - id->ctime.tv_sec) * CONFIG_NSEC_PER_SEC + (now.tv_nsec - id->ctime.tv_nsec) < CONFIG_RACY_NSEC;
+}
+
+/* As config_parse, but skips reading and parsing the file if it is the
+ * one last loaded and unchanged since. The config remembered is that
+ * parsed from the descriptor read, so that it is never attributed to a
+ * file replaced in the meantime */
+int config_load(char const *path, struct fand_config *data) {
+    struct config_file_id id;
+    struct stat sb;
+    int status;
+
+    if(config_loaded_valid && stat(path, &sb) == 0) {
+        config_file_id(&id, &sb);
+        if(config_file_id_equal(&id, &config_loaded_id)) {
+            *data = config_loaded;
+            return 0;
         }
+    }
 
-        for(config_idx = 0; config_idx < array_size(config_map); config_idx++) {
-            if(strcmp(key, config_map[config_idx].key) == 0) {
-                reti = config_map[config_idx].handler(data, value);
-                if(reti) {
-                    status = reti;
-                    goto cleanup;
-                }
-                break;
-            }
+    int fd = config_open(path);
+    if(fd == -1) {
+        return -1;
+    }
+
+    /* Taken before reading, so that writes racing the read are noticed */
+    bool identified = fstat(fd, &sb) == 0;
+
+    status = config_parse_fd(fd, path, data);
+
+    config_loaded_valid = false;
+    if(!status && identified) {
+        config_file_id(&id, &sb);
+        if(!config_file_racy(&id)) {
+            config_loaded_id = id;
+            config_loaded = *data;
+            config_loaded_valid = true;
         }
+    }
+
+    close(fd);
+
+    return status;
+}
+
+static inline bool config_matrix_equal(unsigned char const *lhs, unsigned char lhs_rows,
+                                       unsigned char const *rhs, unsigned char rhs_rows) {
+    return lhs_rows == rhs_rows && memcmp(lhs, rhs, 2u * lhs_rows) == 0;
+}
+
+static bool config_card_matrices_equal(struct fand_config const *prev, struct fand_config const *next) {
+    struct fand_card_matrix const *lhs;
+    struct fand_card_matrix const *rhs;
+
+    if(prev->ncard_matrices != next->ncard_matrices) {
+        return false;
+    }
 
-        if(config_idx == array_size(config_map)) {
-            syslog(LOG_ERR, "Syntax error on line %u: unknown key %s", lineno, key);
-            status = -1;
-            goto cleanup;
+    for(unsigned i = 0; i < prev->ncard_matrices; i++) {
+        lhs = &prev->card_matrices[i];
+        rhs = &next->card_matrices[i];
+        if(lhs->card_idx != rhs->card_idx || !config_matrix_equal(lhs->matrix, lhs->rows, rhs->matrix, rhs->rows)) {
+            return false;
         }
     }
 
-    if(data->matrix_rows == 0) {
-        syslog(LOG_ERR, "No matrix found");
-        status = -1;
+    return true;
+}
+
+/* Compares prev and next field by field, returning the CONFIG_CHANGED_*
+ * flags of those that differ. Parts of the matrices past their rows are
+ * not compared */
+unsigned config_diff(struct fand_config const *prev, struct fand_config const *next) {
+    unsigned changes = 0;
+
+    if(prev->interval != next->interval) {
+        changes |= CONFIG_CHANGED_INTERVAL;
     }
-cleanup:
-    if(fp) {
-        fclose(fp);
+    if(prev->hysteresis != next->hysteresis) {
+        changes |= CONFIG_CHANGED_HYSTERESIS;
     }
-    regfree(&valregex);
-    return status;
+    if(prev->throttle != next->throttle) {
+        changes |= CONFIG_CHANGED_THROTTLE;
+    }
+    if(prev->sample_max_age != next->sample_max_age) {
+        changes |= CONFIG_CHANGED_SAMPLE_MAX_AGE;
+    }
+    if(prev->fan_curve_offload != next->fan_curve_offload) {
+        changes |= CONFIG_CHANGED_OFFLOAD;
+    }
+    if(!config_matrix_equal(prev->matrix, prev->matrix_rows, next->matrix, next->matrix_rows)) {
+        changes |= CONFIG_CHANGED_MATRIX;
+    }
+    if(!config_card_matrices_equal(prev, next)) {
+        changes |= CONFIG_CHANGED_CARD_MATRICES;
+    }
+
+    return changes;
 }
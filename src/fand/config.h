@@ -4,20 +4,61 @@
 #include "fandcfg.h"
 
 #include <stdbool.h>
+#include <stddef.h>
 
 #define CONFIG_DEFAULT_PATH "/etc/amdgpu-fand.conf"
 
 enum { DIRENT_MAX_SIZE = 32 };
 enum { MATRIX_MAX_SIZE = 2 * MAX_TEMP_THRESHOLDS };
+/* Largest config file accepted */
+enum { CONFIG_MAX_SIZE = 32768 };
+enum { CONFIG_ERROR_SIZE = 128 };
+
+struct fand_card_matrix {
+    unsigned char card_idx;
+    unsigned char rows;
+    unsigned char matrix[MATRIX_MAX_SIZE];
+};
 
 struct fand_config {
     bool throttle;
     unsigned char matrix_rows;
     unsigned char hysteresis;
     unsigned short interval;
+    unsigned short sample_max_age;
+    /* Hand the matrix to the firmware fan curve where supported */
+    bool fan_curve_offload;
     unsigned char matrix[MATRIX_MAX_SIZE];
+    /* Matrices overriding matrix for individual cards */
+    unsigned char ncard_matrices;
+    struct fand_card_matrix card_matrices[FAND_MAX_CARDS];
+};
+
+/* Fields differing between two configs, see config_diff */
+enum {
+    CONFIG_CHANGED_INTERVAL       = 0x01,
+    CONFIG_CHANGED_HYSTERESIS     = 0x02,
+    CONFIG_CHANGED_THROTTLE       = 0x04,
+    CONFIG_CHANGED_SAMPLE_MAX_AGE = 0x08,
+    CONFIG_CHANGED_OFFLOAD        = 0x10,
+    CONFIG_CHANGED_MATRIX         = 0x20,
+    CONFIG_CHANGED_CARD_MATRICES  = 0x40
+};
+
+/* Changes applied by the fan controller */
+#define CONFIG_CHANGED_FANCTRL (CONFIG_CHANGED_HYSTERESIS | CONFIG_CHANGED_THROTTLE | CONFIG_CHANGED_OFFLOAD | \
+                                CONFIG_CHANGED_MATRIX | CONFIG_CHANGED_CARD_MATRICES)
+
+/* Position of the first error, lines and columns counted from 1 */
+struct config_error {
+    unsigned line;
+    unsigned column;
+    char message[CONFIG_ERROR_SIZE];
 };
 
 int config_parse(char const *path, struct fand_config *data);
+int config_load(char const *path, struct fand_config *data);
+int config_parse_string(char const *text, size_t size, struct fand_config *data, struct config_error *error);
+unsigned config_diff(struct fand_config const *prev, struct fand_config const *next);
 
 #endif /* CONFIG_H */
@@ -4,59 +4,81 @@
 #include "fandcfg.h"
 #include "filesystem.h"
 #include "ipc.h"
+#include "macro.h"
 #include "pidfile.h"
+#include "reactor.h"
 #include "sigutil.h"
 #include "server.h"
+#include "telemetry.h"
+#include "tick.h"
 
 #include <errno.h>
 #include <signal.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include <syslog.h>
 #include <sys/inotify.h>
+#include <sys/signalfd.h>
 #include <sys/stat.h>
+#include <sys/timerfd.h>
 #include <sys/types.h>
-#include <sys/wait.h>
 #include <unistd.h>
 
-static sig_atomic_t volatile daemon_alive = 1;
-static sig_atomic_t volatile daemon_reload_pending = 0;
-static sig_atomic_t volatile daemon_sigpipe_caught = 0;
+enum {
+    DAEMON_SOURCE_SIGNAL,
+    DAEMON_SOURCE_TICK,
+    DAEMON_SOURCE_WATCH,
+    DAEMON_SOURCE_RELOAD,
+    DAEMON_SOURCE_SERVER
+};
+
+/* Writes to the config within this window of each other cause a single reload */
+enum { DAEMON_RELOAD_DEBOUNCE_MS = 200 };
+enum { DAEMON_NSEC_PER_MSEC = 1000000 };
+
+struct daemon_ctx {
+    char const *config;
+    struct fand_config *data;
+    struct inotify_watch *watch;
+};
+
+static bool daemon_alive = true;
+static bool daemon_sigpipe_caught = false;
+
+static struct daemon_ctx daemon_ctx;
+/* Current tick interval, see fanctrl_interval */
+static unsigned short daemon_interval;
+
+static int daemon_handle_signal(struct reactor_source *source, uint32_t events);
+static int daemon_handle_tick(struct reactor_source *source, uint32_t events);
+static int daemon_handle_watch(struct reactor_source *source, uint32_t events);
+static int daemon_handle_reload(struct reactor_source *source, uint32_t events);
+static int daemon_handle_connection(struct reactor_source *source, uint32_t events);
+
+static struct reactor_source daemon_sources[] = {
+    [DAEMON_SOURCE_SIGNAL] = { .fd = -1, .handler = daemon_handle_signal,     .data = &daemon_ctx },
+    [DAEMON_SOURCE_TICK]   = { .fd = -1, .handler = daemon_handle_tick,       .data = &daemon_ctx },
+    [DAEMON_SOURCE_WATCH]  = { .fd = -1, .handler = daemon_handle_watch,      .data = &daemon_ctx },
+    [DAEMON_SOURCE_RELOAD] = { .fd = -1, .handler = daemon_handle_reload,     .data = &daemon_ctx },
+    [DAEMON_SOURCE_SERVER] = { .fd = -1, .handler = daemon_handle_connection, .data = &daemon_ctx }
+};
 
 static void daemon_kill(void) {
-    daemon_alive = 0;
+    daemon_alive = false;
 }
 
-static void daemon_sighandler(int signal) {
-    int status;
-    switch(signal) {
-        case SIGINT:
-        case SIGTERM:
-            daemon_kill();
-            break;
-        case SIGPIPE:
-            daemon_sigpipe_caught = 1;
-            break;
-        case SIGHUP:
-            daemon_reload_pending = 1;
-            break;
-        case SIGCHLD:
-            while(waitpid(-1, &status, WNOHANG) > 0);
-            if(WEXITSTATUS(status) == FAND_SERVER_EXIT) {
-                daemon_alive = 0;
-            }
-            break;
-    }
-}
+static inline int daemon_signalfd(void) {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGPIPE);
+    sigaddset(&mask, SIGHUP);
 
-static inline int daemon_set_sigacts(void) {
-    return sigutil_sethandler(SIGINT,  SA_RESTART, daemon_sighandler) |
-           sigutil_sethandler(SIGTERM, SA_RESTART, daemon_sighandler) |
-           sigutil_sethandler(SIGPIPE, SA_RESTART, daemon_sighandler) |
-           sigutil_sethandler(SIGHUP,  SA_RESTART, daemon_sighandler) |
-           sigutil_sethandler(SIGCHLD, SA_RESTART, daemon_sighandler);
+    return sigutil_signalfd(&mask);
 }
 
 static int daemon_fork(void) {
@@ -101,13 +123,85 @@ static void daemon_openlog(bool fork, bool verbose) {
     openlog(0, !fork * LOG_PERROR, LOG_DAEMON);
 }
 
-static int daemon_init(bool fork, bool verbose, char const *config, struct fand_config *data, struct inotify_watch *watch) {
-    daemon_openlog(fork, verbose);
+static int daemon_set_interval(struct fand_config const *data) {
+    unsigned short interval = fanctrl_interval(data);
+
+    if(tick_set_interval(interval)) {
+        return -1;
+    }
+
+    daemon_interval = interval;
+    return 0;
+}
+
+static int daemon_register_sources(struct fand_config const *data, struct inotify_watch const *watch) {
+    if(reactor_init()) {
+        return -1;
+    }
 
-    if(daemon_set_sigacts()) {
+    daemon_sources[DAEMON_SOURCE_SIGNAL].fd = daemon_signalfd();
+    if(daemon_sources[DAEMON_SOURCE_SIGNAL].fd == -1) {
         return -1;
     }
 
+    daemon_interval = fanctrl_interval(data);
+    if(tick_init(daemon_interval)) {
+        return -1;
+    }
+
+    daemon_sources[DAEMON_SOURCE_RELOAD].fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if(daemon_sources[DAEMON_SOURCE_RELOAD].fd == -1) {
+        syslog(LOG_ERR, "Could not create reload timerfd: %s", strerror(errno));
+        return -1;
+    }
+
+    daemon_sources[DAEMON_SOURCE_TICK].fd = tick_fd();
+    daemon_sources[DAEMON_SOURCE_WATCH].fd = watch->fd;
+    daemon_sources[DAEMON_SOURCE_SERVER].fd = server_fd();
+
+    for(unsigned i = 0; i < array_size(daemon_sources); i++) {
+        if(reactor_add(&daemon_sources[i], EPOLLIN)) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int daemon_unregister_sources(void) {
+    int status = 0;
+    int sigfd = daemon_sources[DAEMON_SOURCE_SIGNAL].fd;
+    int reloadfd = daemon_sources[DAEMON_SOURCE_RELOAD].fd;
+
+    for(unsigned i = 0; i < array_size(daemon_sources); i++) {
+        reactor_remove(&daemon_sources[i]);
+        daemon_sources[i].fd = -1;
+    }
+
+    if(sigfd != -1 && close(sigfd) == -1) {
+        syslog(LOG_WARNING, "Could not close signalfd: %s", strerror(errno));
+        status = -1;
+    }
+
+    if(reloadfd != -1 && close(reloadfd) == -1) {
+        syslog(LOG_WARNING, "Could not close reload timerfd: %s", strerror(errno));
+        status = -1;
+    }
+
+    if(tick_close()) {
+        status = -1;
+    }
+
+    if(reactor_close()) {
+        status = -1;
+    }
+
+    return status;
+}
+
+static int daemon_init(bool fork, bool verbose, char const *config, struct fand_config *data, struct inotify_watch *watch) {
+    daemon_openlog(fork, verbose);
+
     if(fork && daemon_fork()) {
         return -1;
     }
@@ -127,7 +221,7 @@ static int daemon_init(bool fork, bool verbose, char const *config, struct fand_
         return -1;
     }
 
-    if(config_parse(config, data)) {
+    if(config_load(config, data)) {
         return -1;
     }
 
@@ -135,7 +229,8 @@ static int daemon_init(bool fork, bool verbose, char const *config, struct fand_
         return -1;
     }
 
-    if(fsys_watch_init(config, watch, IN_MODIFY)) {
+    /* Written in place or renamed into place, as editors and config management tools do */
+    if(fsys_watch_init(config, watch, IN_CLOSE_WRITE | IN_MOVED_TO)) {
         return -1;
     }
 
@@ -149,23 +244,46 @@ static int daemon_init(bool fork, bool verbose, char const *config, struct fand_
         return -1;
     }
 
+    if(telemetry_create()) {
+        syslog(LOG_WARNING, "Telemetry page unavailable");
+    }
+
+    if(daemon_register_sources(data, watch)) {
+        return -1;
+    }
+
     return 0;
 }
 
+/* Applies only what changed in the config. The fan controller keeps the
+ * curve and hysteresis state of cards whose matrix is unchanged, and the
+ * tick is only rescheduled if its interval changed */
 static int daemon_reload(char const *path, struct fand_config *data) {
-    struct fand_config tmpdata;
+    struct fand_config tmpdata = { 0 };
+    unsigned changes;
 
-    if(config_parse(path, &tmpdata)) {
+    if(config_load(path, &tmpdata)) {
         syslog(LOG_WARNING, "Failed to reload config");
         return -1;
     }
+
+    changes = config_diff(data, &tmpdata);
+    if(!changes) {
+        syslog(LOG_INFO, "Config unchanged");
+        return 0;
+    }
     *data = tmpdata;
 
-    if(fanctrl_configure(data)) {
+    if((changes & CONFIG_CHANGED_FANCTRL) && fanctrl_configure(data)) {
         syslog(LOG_ERR, "Fancontroller reconfiguration failed");
         return FAND_FATAL_ERR;
     }
 
+    /* Also covers offloading changing the supervision interval */
+    if(fanctrl_interval(data) != daemon_interval && daemon_set_interval(data)) {
+        return FAND_FATAL_ERR;
+    }
+
     syslog(LOG_INFO, "Config reloaded");
 
     return 0;
@@ -174,6 +292,10 @@ static int daemon_reload(char const *path, struct fand_config *data) {
 static int daemon_free(struct inotify_watch const *watch) {
     int status = 0;
 
+    if(daemon_unregister_sources()) {
+        status = -1;
+    }
+
     if(fsys_watch_clear(watch)) {
         status = -1;
     }
@@ -182,6 +304,10 @@ static int daemon_free(struct inotify_watch const *watch) {
         status = -1;
     }
 
+    if(telemetry_destroy()) {
+        status = -1;
+    }
+
     if(pidfile_unlink()) {
         status = -1;
     }
@@ -200,30 +326,133 @@ static int daemon_free(struct inotify_watch const *watch) {
     return status;
 }
 
-static inline int daemon_adjust_fanspeed(void) {
-    int status = fanctrl_adjust();
+static int daemon_handle_signal(struct reactor_source *source, uint32_t events) {
+    (void)events;
+    struct daemon_ctx *ctx = source->data;
+    struct signalfd_siginfo info;
+    int status = 0;
 
-    if(status == FAND_FATAL_ERR) {
-        syslog(LOG_ERR, "Fatal error encountered, exiting");
-        daemon_kill();
+    while(read(source->fd, &info, sizeof(info)) == sizeof(info)) {
+        switch(info.ssi_signo) {
+            case SIGINT:
+            case SIGTERM:
+                daemon_kill();
+                break;
+            case SIGPIPE:
+                daemon_sigpipe_caught = true;
+                break;
+            case SIGHUP:
+                if(daemon_reload(ctx->config, ctx->data) == FAND_FATAL_ERR) {
+                    status = FAND_FATAL_ERR;
+                }
+                break;
+        }
+    }
+
+    return status;
+}
+
+static void daemon_publish_telemetry(void) {
+    struct telemetry_data telemetry = { 0 };
+    struct fanctrl_sample sample;
+    struct tick_stats ticks;
+    unsigned ncards = fanctrl_card_count();
+
+    tick_get_stats(&ticks);
+    telemetry.ticks = ticks.ticks;
+
+    for(unsigned i = 0; i < ncards && i < array_size(telemetry.cards); i++) {
+        if(!fanctrl_get_sample(i, &sample, 0)) {
+            continue;
+        }
+
+        telemetry.cards[telemetry.ncards++] = (struct telemetry_card){
+            .temp = sample.temp,
+            .pwm = sample.pwm,
+            .target_pwm = sample.target_pwm,
+            .speed = sample.speed,
+            .threshold = sample.threshold,
+            .card_idx = sample.card_idx,
+            .sample_time = sample.timestamp
+        };
+
+        if(sample.timestamp > telemetry.update_time) {
+            telemetry.update_time = sample.timestamp;
+        }
+    }
+
+    telemetry_publish(&telemetry);
+}
+
+static int daemon_handle_tick(struct reactor_source *source, uint32_t events) {
+    (void)events;
+    struct daemon_ctx *ctx = source->data;
+
+    int status = tick_consume();
+    if(status <= 0) {
+        return status;
+    }
+
+    /* Publish even if some card failed, the others may still have been adjusted */
+    status = fanctrl_adjust();
+    daemon_publish_telemetry();
+    server_publish_tick();
+
+    /* Supervision may have handed a fan back to the control loop */
+    if(fanctrl_interval(ctx->data) != daemon_interval && daemon_set_interval(ctx->data)) {
+        return FAND_FATAL_ERR;
     }
 
     return status;
 }
 
-static inline void daemon_watch_event(char const *config, struct fand_config *data, struct inotify_watch *watch) {
-    if(fsys_watch_event(config, watch)) {
+/* (Re)arms the reload timer, so that a burst of events is
+ * coalesced into one reload after the last of them */
+static int daemon_schedule_reload(void) {
+    struct itimerspec spec = {
+        .it_value = { .tv_nsec = DAEMON_RELOAD_DEBOUNCE_MS * DAEMON_NSEC_PER_MSEC }
+    };
+
+    if(timerfd_settime(daemon_sources[DAEMON_SOURCE_RELOAD].fd, 0, &spec, 0) == -1) {
+        syslog(LOG_ERR, "Could not arm reload timerfd: %s", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+static int daemon_handle_watch(struct reactor_source *source, uint32_t events) {
+    (void)events;
+    struct daemon_ctx *ctx = source->data;
+
+    if(fsys_watch_event(ctx->config, ctx->watch)) {
         syslog(LOG_WARNING, "Failed to poll inotify events");
     }
 
-    if(daemon_reload_pending || watch->triggered) {
-        daemon_reload_pending = 0;
+    if(ctx->watch->triggered) {
+        return daemon_schedule_reload();
+    }
 
-        if(daemon_reload(config, data) == FAND_FATAL_ERR) {
-            syslog(LOG_ERR, "Fatal error encountered, exiting");
-            daemon_kill();
-        }
+    return 0;
+}
+
+static int daemon_handle_reload(struct reactor_source *source, uint32_t events) {
+    (void)events;
+    struct daemon_ctx *ctx = source->data;
+    uint64_t expirations;
+
+    if(read(source->fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+        return 0;
     }
+
+    return daemon_reload(ctx->config, ctx->data);
+}
+
+static int daemon_handle_connection(struct reactor_source *source, uint32_t events) {
+    (void)events;
+    struct daemon_ctx *ctx = source->data;
+
+    return server_accept(ctx->data);
 }
 
 static int daemon_restart(bool fork, bool verbose, char const *config, struct fand_config *data, struct inotify_watch *watch) {
@@ -240,11 +469,11 @@ static inline void daemon_handle_pending_signals(bool fork, bool verbose, char c
         syslog(LOG_WARNING, "Broken pipe, attempting to restart");
         if(daemon_restart(fork, verbose, config, data, watch)) {
             syslog(LOG_ERR, "Restart failed");
-            daemon_alive = 0;
+            daemon_kill();
         }
 
         syslog(LOG_INFO, "Restart successful");
-        daemon_sigpipe_caught = 0;
+        daemon_sigpipe_caught = false;
     }
 }
 
@@ -258,16 +487,29 @@ int daemon_main(bool fork, bool verbose, char const *config) {
         .triggered = false
     };
 
+    daemon_ctx = (struct daemon_ctx){
+        .config = config,
+        .data = &data,
+        .watch = &watch
+    };
+
     if(daemon_init(fork, verbose, config, &data, &watch)) {
         status = 1;
         daemon_kill();
     }
 
     while(daemon_alive) {
-        status = daemon_adjust_fanspeed();
-        daemon_watch_event(config, &data, &watch);
+        status = reactor_dispatch(-1);
+        if(status == FAND_FATAL_ERR) {
+            syslog(LOG_ERR, "Fatal error encountered, exiting");
+            daemon_kill();
+        }
+        else if(status == FAND_SERVER_EXIT) {
+            syslog(LOG_INFO, "Exiting on client request");
+            status = 0;
+            daemon_kill();
+        }
         daemon_handle_pending_signals(fork, verbose, config, &data, &watch);
-        server_poll(&data);
     }
 
     return status | daemon_free(&watch);
@@ -1,5 +1,6 @@
 #include "drm.h"
 #include "fandcfg.h"
+#include "filesystem.h"
 #include "macro.h"
 #include "regutils.h"
 #include "strutils.h"
@@ -20,17 +21,19 @@
 
 #define DRI_DEV_DIR "/dev/dri/"
 
-static int drm_fd = -1;
-
 enum { DRM_BUF_SIZE = 128 };
 enum { DRM_CARD_IDX_OFFSET = 128 };
 
-int drm_open(unsigned card_idx) {
+static int drm_fds[FAND_MAX_CARDS];
+/* Entries past drm_ncards have never been opened */
+static unsigned drm_ncards;
+
+int drm_open(unsigned card, unsigned card_idx) {
     char buffer[DRM_BUF_SIZE];
     regex_t devregex;
     regmatch_t pmatch[2];
 
-    ssize_t pos = strscpy(buffer, DRI_DEV_DIR, sizeof(buffer));
+    ssize_t pos = fsys_root_path(buffer, sizeof(buffer), DRI_DEV_DIR);
 
     if(pos < 0) {
         return pos;
@@ -40,9 +43,20 @@ int drm_open(unsigned card_idx) {
         return -1;
     }
 
+    drm_fds[card] = -1;
+    if(card >= drm_ncards) {
+        drm_ncards = card + 1;
+    }
+
     DIR *dir = opendir(buffer);
     struct dirent *dp;
 
+    if(!dir) {
+        syslog(LOG_INFO, "Could not open %s: %s", buffer, strerror(errno));
+        regfree(&devregex);
+        return -1;
+    }
+
     unsigned index;
 
     while((dp = readdir(dir))) {
@@ -63,10 +77,10 @@ int drm_open(unsigned card_idx) {
 
     /* Found matching entry */
     if(dp) {
-        drm_fd = open(buffer, O_RDONLY);
+        drm_fds[card] = open(buffer, O_RDONLY | O_CLOEXEC);
     }
 
-    if(drm_fd == -1) {
+    if(drm_fds[card] == -1) {
         syslog(LOG_ERR, "Error when opening dri device: %s\n", strerror(errno));
     }
 
@@ -74,18 +88,28 @@ cleanup:
     regfree(&devregex);
     closedir(dir);
 
-    return drm_fd;
+    return drm_fds[card];
 }
 
 int drm_close(void) {
-    int status = close(drm_fd);
-    if(status == -1) {
-        syslog(LOG_WARNING, "Could not close drm file desriptor: %s", strerror(errno));
+    int status = 0;
+
+    for(unsigned i = 0; i < drm_ncards; i++) {
+        if(drm_fds[i] == -1) {
+            continue;
+        }
+        if(close(drm_fds[i]) == -1) {
+            syslog(LOG_WARNING, "Could not close drm file desriptor: %s", strerror(errno));
+            status = -1;
+        }
+        drm_fds[i] = -1;
     }
+    drm_ncards = 0;
+
     return status;
 }
 
-int drm_get_temp(void) {
+int drm_get_temp(unsigned card) {
     int temp;
     struct drm_amdgpu_info hwinfo = {
         .return_pointer = (__u64)&temp,
@@ -94,7 +118,7 @@ int drm_get_temp(void) {
         .sensor_info.type = AMDGPU_INFO_SENSOR_GPU_TEMP
     };
 
-    if(ioctl(drm_fd, DRM_IOCTL_AMDGPU_INFO, &hwinfo)) {
+    if(ioctl(drm_fds[card], DRM_IOCTL_AMDGPU_INFO, &hwinfo)) {
         syslog(LOG_WARNING, "Could not read temperature sensor: %s", strerror(errno));
         return -1;
     }
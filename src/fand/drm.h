@@ -3,9 +3,9 @@
 
 #ifdef FAND_DRM_SUPPORT
 
-int drm_open(unsigned card_idx);
+int drm_open(unsigned card, unsigned card_idx);
 int drm_close(void);
-int drm_get_temp(void);
+int drm_get_temp(unsigned card);
 
 #endif /* FAND_DRM_SUPPORT */
 
@@ -1,23 +1,32 @@
-#include "drm.h"
 #include "fanctrl.h"
+#include "fancurve.h"
 #include "fandcfg.h"
 #include "file.h"
 #include "filesystem.h"
 #include "hwmon.h"
 #include "interpolation.h"
+#include "sensor.h"
 #include "strutils.h"
 
 #include <errno.h>
+#include <limits.h>
 #include <stdbool.h>
+#include <string.h>
 
 #include <fcntl.h>
 #include <syslog.h>
 #include <sys/file.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
 enum { MILLIDEGC_ADJUST = 1000 };
+enum { NSEC_PER_SEC = 1000000000 };
+enum { NSEC_PER_MSEC = 1000000 };
+enum { FANCTRL_CURVE_SIZE = UCHAR_MAX + 1 };
+/* Seconds between supervising firmware fan curves if no card is controlled in software */
+enum { FANCTRL_SUPERVISION_INTERVAL = 60 };
 
 struct fanctrl_matrix {
     unsigned char rows;
@@ -25,135 +34,548 @@ struct fanctrl_matrix {
     unsigned char speeds[MATRIX_MAX_SIZE / 2];
 };
 
-static struct fanctrl_matrix matrix;
+/* Whole-degree temperature to pwm lookup table, built
+ * from the matrix once per configuration */
+struct fanctrl_curve {
+    /* Pwm for each temperature, throttle rule applied */
+    unsigned char pwm[FANCTRL_CURVE_SIZE];
+    /* Threshold index for each temperature, -1 if none */
+    signed char threshold[FANCTRL_CURVE_SIZE];
+    /* Pwm held while hysteresis keeps a threshold active */
+    unsigned char hold[MATRIX_MAX_SIZE / 2];
+};
+
+/* Control state of a single card */
+struct fanctrl_card {
+    struct fanctrl_curve curve;
+    struct fanctrl_matrix matrix;
+    short current_threshold;
+    /* Published by the control loop after each adjustment */
+    struct fanctrl_sample sample;
+    /* Fan controlled by the firmware using fwcurve */
+    bool offloaded;
+    struct fancurve fwcurve;
+};
+
+static struct fanctrl_card fanctrl_cards[FAND_MAX_CARDS];
+static unsigned fanctrl_ncards;
 static unsigned char hysteresis;
-static short current_threshold;
 static bool throttle;
 
+static inline unsigned long long fanctrl_now(void) {
+    struct timespec ts;
+    if(clock_gettime(CLOCK_MONOTONIC, &ts) == -1) {
+        syslog(LOG_ERR, "Could not read monotonic clock: %s", strerror(errno));
+        return 0;
+    }
+    return (unsigned long long)ts.tv_sec * NSEC_PER_SEC + (unsigned long long)ts.tv_nsec;
+}
+
+static int fanctrl_pwm_to_speed(int pwm) {
+    if(pwm < 0) {
+        return -1;
+    }
+    float frac = lerp_inverse(PWM_MIN, PWM_MAX, pwm);
+    return (int)(100 * frac);
+}
+
 static unsigned long fanctrl_percentage_to_pwm(unsigned long percentage) {
     float frac = (float)percentage / 100.f;
     unsigned long pwm = lerp(PWM_MIN, PWM_MAX, frac);
     return pwm;
 }
 
-static int fanctrl_set_matrix(unsigned char const* mat, unsigned char nrows) {
+static int fanctrl_set_matrix(struct fanctrl_matrix *matrix, unsigned char const* mat, unsigned char nrows) {
     if(nrows > MATRIX_MAX_SIZE / 2) {
         return -1;
     }
 
-    matrix.rows = nrows;
+    matrix->rows = nrows;
     for(unsigned i = 0; i < nrows; i++) {
-        matrix.temps[i] = mat[2 * i];
-        matrix.speeds[i] = mat[2 * i + 1];
+        matrix->temps[i] = mat[2 * i];
+        matrix->speeds[i] = mat[2 * i + 1];
     }
     return 0;
 }
 
+/* Speed percentage and threshold for temp, without hysteresis */
+static unsigned long fanctrl_interpolate(struct fanctrl_matrix const *matrix, int temp, short *threshold) {
+    unsigned long speed = matrix->speeds[matrix->rows - 1];
+    float frac;
+
+    *threshold = -1;
+
+    /* Below low threshold */
+    if(temp <= matrix->temps[0]) {
+        speed = matrix->speeds[0] * !throttle;
+    }
+    else if(temp <= matrix->temps[matrix->rows - 1]) {
+        /* Between two thresholds */
+        for(unsigned i = 0; i < matrix->rows - 1u; i++) {
+            if(matrix->temps[i] < temp && matrix->temps[i + 1] >= temp) {
+                *threshold = i;
+                frac = lerp_inverse(matrix->temps[i], matrix->temps[i + 1], temp);
+                speed = lerp(matrix->speeds[i], matrix->speeds[i + 1], frac);
+                break;
+            }
+        }
+    }
+    else {
+        /* Above high threshold */
+        *threshold = matrix->rows - 1;
+    }
+
+    return speed;
+}
+
+static void fanctrl_build_curve(struct fanctrl_curve *curve, struct fanctrl_matrix const *matrix) {
+    short threshold;
+
+    if(!matrix->rows) {
+        return;
+    }
+
+    for(unsigned i = 0; i < matrix->rows; i++) {
+        curve->hold[i] = fanctrl_percentage_to_pwm(matrix->speeds[i]);
+    }
+
+    for(int temp = 0; temp < FANCTRL_CURVE_SIZE; temp++) {
+        curve->pwm[temp] = fanctrl_percentage_to_pwm(fanctrl_interpolate(matrix, temp, &threshold));
+        curve->threshold[temp] = threshold;
+    }
+}
+
+static inline bool fanctrl_matrix_equal(struct fanctrl_matrix const *lhs, struct fanctrl_matrix const *rhs) {
+    return lhs->rows == rhs->rows &&
+           memcmp(lhs->temps, rhs->temps, lhs->rows) == 0 &&
+           memcmp(lhs->speeds, rhs->speeds, lhs->rows) == 0;
+}
+
+/* Threshold of matrix holding at the temperature of threshold in the
+ * previous matrix of card, so that a reload does not release the hold */
+static short fanctrl_carry_threshold(struct fanctrl_card const *card, struct fanctrl_matrix const *matrix) {
+    short threshold = -1;
+    unsigned char held;
+
+    if(card->current_threshold < 0) {
+        return -1;
+    }
+
+    held = card->matrix.temps[card->current_threshold];
+    for(unsigned i = 0; i < matrix->rows && matrix->temps[i] <= held; i++) {
+        threshold = (short)i;
+    }
+
+    return threshold;
+}
+
+/* Builds the curve of matrix aside and swaps it in together with the
+ * matrix and the carried over threshold */
+static void fanctrl_swap_curve(struct fanctrl_card *card, struct fanctrl_matrix const *matrix) {
+    struct fanctrl_curve curve = { 0 };
+    short threshold = fanctrl_carry_threshold(card, matrix);
+
+    fanctrl_build_curve(&curve, matrix);
+
+    card->curve = curve;
+    card->matrix = *matrix;
+    card->current_threshold = threshold;
+}
+
 int fanctrl_init(void) {
-    int status = 0;
-    int card_idx = hwmon_open();
+    unsigned indices[FAND_MAX_CARDS];
+    int ncards = hwmon_open();
 
-    if(card_idx < 0) {
-        return card_idx;
+    if(ncards < 0) {
+        return ncards;
     }
 
-    #ifdef FAND_DRM_SUPPORT
+    fanctrl_ncards = (unsigned)ncards;
+    for(unsigned i = 0; i < fanctrl_ncards; i++) {
+        indices[i] = hwmon_card_index(i);
+        fanctrl_cards[i] = (struct fanctrl_card){
+            .current_threshold = -1,
+            .sample = { .card_idx = indices[i] }
+        };
+    }
 
-    status = drm_open(card_idx);
+    if(sensor_init(indices, fanctrl_ncards)) {
+        return -1;
+    }
 
-    #endif
+    syslog(LOG_INFO, "Controlling %u card%s", fanctrl_ncards, fanctrl_ncards == 1 ? "" : "s");
 
-    return status;
+    return 0;
 }
 
 int fanctrl_release(void) {
-    #ifdef FAND_DRM_SUPPORT
+    char path[HWMON_PATH_SIZE];
 
-    drm_close();
+    for(unsigned i = 0; i < fanctrl_ncards; i++) {
+        if(fanctrl_cards[i].offloaded) {
+            /* hwmon_close hands the fan back to the firmware, restore its own curve */
+            if(!fancurve_path(path, sizeof(path), fanctrl_cards[i].sample.card_idx)) {
+                fancurve_reset(path);
+            }
+            fanctrl_cards[i].offloaded = false;
+        }
+        fanctrl_cards[i].sample = (struct fanctrl_sample){ 0 };
+    }
+    fanctrl_ncards = 0;
 
-    #endif
+    sensor_close();
     return hwmon_close();
 }
 
-int fanctrl_configure(struct fand_config *config) {
-    current_threshold = -1;
-    hysteresis = config->hysteresis;
-    throttle = config->throttle;
-    return fanctrl_set_matrix(config->matrix, config->matrix_rows);
+unsigned fanctrl_card_count(void) {
+    return fanctrl_ncards;
 }
 
-int fanctrl_adjust(void) {
-    int temp, speed;
-    float frac;
-    short threshold = -1;
+/* Hands the matrix to the firmware fan curve of card */
+static int fanctrl_offload(struct fanctrl_card *card, unsigned idx, unsigned char const *mat, unsigned char nrows) {
+    char path[HWMON_PATH_SIZE];
+    struct fancurve curve;
 
-    if(matrix.rows == 0) {
-        syslog(LOG_ERR, "Matrix is empty");
-        return FAND_FATAL_ERR;
+    if(fancurve_path(path, sizeof(path), card->sample.card_idx) || fancurve_read(path, &curve)) {
+        syslog(LOG_INFO, "No firmware fan curve for card %u", card->sample.card_idx);
+        return -1;
     }
 
-    speed = matrix.speeds[matrix.rows - 1];
+    if(fancurve_from_matrix(&curve, mat, nrows)) {
+        syslog(LOG_WARNING, "Matrix of card %u has more rows than the %hhu points of the firmware fan curve",
+               card->sample.card_idx, curve.npoints);
+        return -1;
+    }
 
-    temp = fanctrl_get_temp();
-    if(temp < 0) {
-        return temp;
+    if(fancurve_write(path, &curve)) {
+        return -1;
     }
 
-    /* Below low threshold */
-    if(temp <= matrix.temps[0]) {
-        threshold = -1;
-        speed = matrix.speeds[0] * !throttle;
+    if(hwmon_set_firmware_control(idx, true)) {
+        fancurve_reset(path);
+        return -1;
     }
-    else if(temp <= matrix.temps[matrix.rows - 1]) {
-        /* Between two thresholds */
-        for(unsigned i = 0; i < matrix.rows - 1u; i++) {
-            if(matrix.temps[i] < temp && matrix.temps[i + 1] >= temp) {
-                threshold = i;
-                frac = lerp_inverse(matrix.temps[i], matrix.temps[i + 1], temp);
-                speed = lerp(matrix.speeds[i], matrix.speeds[i + 1], frac);
+
+    card->fwcurve = curve;
+    card->offloaded = true;
+    syslog(LOG_INFO, "Fan of card %u controlled by the firmware", card->sample.card_idx);
+
+    return 0;
+}
+
+/* Restores the default firmware curve of card and resumes software control */
+static int fanctrl_reclaim(struct fanctrl_card *card, unsigned idx) {
+    char path[HWMON_PATH_SIZE];
+
+    card->offloaded = false;
+
+    if(!fancurve_path(path, sizeof(path), card->sample.card_idx)) {
+        fancurve_reset(path);
+    }
+
+    return hwmon_set_firmware_control(idx, false);
+}
+
+/* Applies config, only touching what differs from the current state.
+ * Cards whose matrix is unchanged keep their curve, and the hysteresis
+ * hold of those whose matrix changed is carried over by temperature */
+int fanctrl_configure(struct fand_config *config) {
+    struct fanctrl_card *card;
+    struct fanctrl_matrix matrix = { 0 };
+    unsigned char const *mat;
+    unsigned char nrows;
+    bool changed;
+    bool rebuild = throttle != config->throttle;
+
+    hysteresis = config->hysteresis;
+    throttle = config->throttle;
+
+    for(unsigned i = 0; i < fanctrl_ncards; i++) {
+        card = &fanctrl_cards[i];
+        mat = config->matrix;
+        nrows = config->matrix_rows;
+
+        for(unsigned j = 0; j < config->ncard_matrices; j++) {
+            if(config->card_matrices[j].card_idx == card->sample.card_idx) {
+                mat = config->card_matrices[j].matrix;
+                nrows = config->card_matrices[j].rows;
                 break;
             }
         }
+
+        if(fanctrl_set_matrix(&matrix, mat, nrows)) {
+            return -1;
+        }
+        card->sample.default_matrix = mat == config->matrix;
+
+        changed = !fanctrl_matrix_equal(&matrix, &card->matrix);
+        if(changed || rebuild) {
+            fanctrl_swap_curve(card, &matrix);
+        }
+
+        if(config->fan_curve_offload && card->offloaded && !changed) {
+            continue;
+        }
+
+        if(config->fan_curve_offload && !fanctrl_offload(card, i, mat, nrows)) {
+            continue;
+        }
+
+        /* The software curve is kept as fallback either way */
+        if(card->offloaded && fanctrl_reclaim(card, i)) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* Seconds between adjustments. If every fan is controlled by
+ * the firmware, the curves need only occasional supervision */
+unsigned short fanctrl_interval(struct fand_config const *config) {
+    if(!fanctrl_ncards) {
+        return config->interval;
+    }
+
+    for(unsigned i = 0; i < fanctrl_ncards; i++) {
+        if(!fanctrl_cards[i].offloaded) {
+            return config->interval;
+        }
+    }
+
+    return config->interval > FANCTRL_SUPERVISION_INTERVAL ? config->interval : FANCTRL_SUPERVISION_INTERVAL;
+}
+
+/* Target pwm for card at temp, tracking the hysteresis threshold */
+static unsigned long fanctrl_target_pwm(struct fanctrl_card *card, int temp) {
+    unsigned long pwm;
+    short threshold;
+
+    if(temp < FANCTRL_CURVE_SIZE) {
+        pwm = card->curve.pwm[temp];
+        threshold = card->curve.threshold[temp];
     }
     else {
         /* Above high threshold */
-        threshold = matrix.rows - 1;
-        speed = matrix.speeds[matrix.rows - 1];
+        threshold = card->matrix.rows - 1;
+        pwm = card->curve.hold[threshold];
     }
 
-    if(current_threshold > -1 && threshold < current_threshold && temp + hysteresis > matrix.temps[current_threshold]) {
+    if(card->current_threshold > -1 && threshold < card->current_threshold && temp + hysteresis > card->matrix.temps[card->current_threshold]) {
         /* Hysteresis not yet surpassed */
-        speed = matrix.speeds[current_threshold];
+        pwm = card->curve.hold[card->current_threshold];
     }
     else {
-        current_threshold = threshold;
+        card->current_threshold = threshold;
+    }
+
+    return pwm;
+}
+
+/* Fatal errors take precedence, otherwise the first error is kept */
+static inline void fanctrl_merge_status(int *status, int cardstatus) {
+    if(cardstatus == FAND_FATAL_ERR || !*status) {
+        *status = cardstatus;
+    }
+}
+
+/* Verifies that the firmware still uses the curve of card, reapplying it
+ * if not. Software control is resumed if the curve is unavailable */
+static int fanctrl_supervise(struct fanctrl_card *card, unsigned idx) {
+    char path[HWMON_PATH_SIZE];
+    struct fancurve curve;
+
+    if(fancurve_path(path, sizeof(path), card->sample.card_idx) || fancurve_read(path, &curve)) {
+        goto fallback;
+    }
+
+    if(fancurve_points_equal(&curve, &card->fwcurve)) {
+        return 0;
+    }
+
+    syslog(LOG_WARNING, "Firmware fan curve of card %u was modified, reapplying it", card->sample.card_idx);
+    if(!fancurve_write(path, &card->fwcurve) && !hwmon_set_firmware_control(idx, true)) {
+        return 0;
+    }
+
+fallback:
+    syslog(LOG_WARNING, "Lost firmware fan curve of card %u, resuming software control", card->sample.card_idx);
+    card->offloaded = false;
+    return hwmon_set_firmware_control(idx, false) ? FAND_FATAL_ERR : 0;
+}
+
+/* Adjusts every card. Sensors are read in one batch and pwms
+ * written in another, a failure on one card does not prevent
+ * the others from being adjusted. Cards controlled by the
+ * firmware are only supervised and sampled */
+int fanctrl_adjust(void) {
+    int temps[FAND_MAX_CARDS];
+    unsigned cards[FAND_MAX_CARDS];
+    unsigned long pwms[FAND_MAX_CARDS];
+    int results[FAND_MAX_CARDS];
+    unsigned offloaded[FAND_MAX_CARDS];
+    unsigned long long now;
+    struct fanctrl_card *card;
+    unsigned n = 0;
+    unsigned noffloaded = 0;
+    unsigned nsampled = 0;
+    int status = 0;
+
+    if(!fanctrl_ncards) {
+        syslog(LOG_ERR, "No cards to control");
+        return FAND_FATAL_ERR;
+    }
+
+    fanctrl_get_temps(temps, fanctrl_ncards);
+
+    for(unsigned i = 0; i < fanctrl_ncards; i++) {
+        if(fanctrl_cards[i].offloaded) {
+            fanctrl_merge_status(&status, fanctrl_supervise(&fanctrl_cards[i], i));
+            if(fanctrl_cards[i].offloaded) {
+                offloaded[noffloaded++] = i;
+                continue;
+            }
+        }
+        if(fanctrl_cards[i].matrix.rows == 0) {
+            syslog(LOG_ERR, "Matrix is empty");
+            fanctrl_merge_status(&status, FAND_FATAL_ERR);
+            continue;
+        }
+        if(temps[i] < 0) {
+            fanctrl_merge_status(&status, temps[i]);
+            continue;
+        }
+        cards[n] = i;
+        pwms[n++] = fanctrl_target_pwm(&fanctrl_cards[i], temps[i]);
+    }
+
+    if(n) {
+        hwmon_write_pwms(cards, pwms, results, n);
     }
 
-    return hwmon_write_pwm(fanctrl_percentage_to_pwm(speed));
+    /* Only cards whose write succeeded are sampled */
+    for(unsigned i = 0; i < n; i++) {
+        if(results[i]) {
+            fanctrl_merge_status(&status, results[i]);
+            continue;
+        }
+        cards[nsampled] = cards[i];
+        pwms[nsampled++] = pwms[i];
+    }
+
+    /* As are offloaded cards, using the pwm chosen by the firmware as target */
+    for(unsigned i = 0; i < noffloaded; i++) {
+        cards[nsampled++] = offloaded[i];
+    }
+
+    if(!nsampled) {
+        return status;
+    }
+
+    hwmon_read_pwms(cards, results, nsampled);
+    now = fanctrl_now();
+
+    for(unsigned i = 0; i < nsampled; i++) {
+        card = &fanctrl_cards[cards[i]];
+        card->sample.temp = temps[cards[i]];
+        card->sample.target_pwm = card->offloaded ? (results[i] < 0 ? 0 : results[i]) : pwms[i];
+        card->sample.pwm = results[i];
+        card->sample.speed = fanctrl_pwm_to_speed(results[i]);
+        card->sample.threshold = card->offloaded ? -1 : card->current_threshold;
+        card->sample.timestamp = now;
+    }
+
+    return status;
 }
 
-int fanctrl_get_temp(void) {
-    int temp;
-    #ifdef FAND_DRM_SUPPORT
+/* Copies the latest sample of card to result. Returns false if
+ * there is none, or if max_age is non-zero and the sample is
+ * older than max_age milliseconds */
+bool fanctrl_get_sample(unsigned card, struct fanctrl_sample *result, unsigned short max_age) {
+    struct fanctrl_sample const *sample;
+    unsigned long long now;
 
-    temp = drm_get_temp();
+    if(card >= fanctrl_ncards) {
+        return false;
+    }
 
-    #else
+    sample = &fanctrl_cards[card].sample;
+    if(!sample->timestamp) {
+        return false;
+    }
 
-    temp = hwmon_read_temp();
+    *result = *sample;
 
-    #endif
+    if(max_age) {
+        now = fanctrl_now();
+        if(now < sample->timestamp || now - sample->timestamp > (unsigned long long)max_age * NSEC_PER_MSEC) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Samples of every card, all taken by the same control tick. If a sample
+ * is missing or older than max_age milliseconds, every card is read in a
+ * single batch instead. Returns the number of cards */
+unsigned fanctrl_snapshot(struct fanctrl_sample *samples, unsigned short max_age) {
+    int temps[FAND_MAX_CARDS];
+    int pwms[FAND_MAX_CARDS];
+    unsigned cards[FAND_MAX_CARDS];
+    unsigned long long now;
+    struct fanctrl_card const *card;
+    bool fresh = true;
+
+    for(unsigned i = 0; i < fanctrl_ncards && fresh; i++) {
+        fresh = fanctrl_get_sample(i, &samples[i], max_age) && samples[i].timestamp == samples[0].timestamp;
+    }
+
+    if(fresh) {
+        return fanctrl_ncards;
+    }
+
+    for(unsigned i = 0; i < fanctrl_ncards; i++) {
+        cards[i] = i;
+    }
+
+    fanctrl_get_temps(temps, fanctrl_ncards);
+    hwmon_read_pwms(cards, pwms, fanctrl_ncards);
+    now = fanctrl_now();
+
+    for(unsigned i = 0; i < fanctrl_ncards; i++) {
+        card = &fanctrl_cards[i];
+        samples[i] = card->sample;
+        samples[i].temp = temps[i];
+        samples[i].pwm = pwms[i];
+        samples[i].speed = fanctrl_pwm_to_speed(pwms[i]);
+        samples[i].threshold = card->offloaded ? -1 : card->current_threshold;
+        samples[i].timestamp = now;
+    }
+
+    return fanctrl_ncards;
+}
+
+int fanctrl_get_temp(unsigned card) {
+    int temp = sensor_read_temp(card);
 
     /* Millidegrees Celsius to degrees Celsius */
     return temp < 0 ? temp : temp / MILLIDEGC_ADJUST;
 }
 
-int fanctrl_get_speed(void) {
-    int pwm = hwmon_read_pwm();
-    if(pwm < 0) {
-        return -1;
+/* Temperatures of the first ncards cards in degrees Celsius,
+ * failed reads are reported as negative values */
+int fanctrl_get_temps(int *temps, unsigned ncards) {
+    sensor_read_temps(temps, ncards);
+
+    for(unsigned i = 0; i < ncards; i++) {
+        /* Millidegrees Celsius to degrees Celsius */
+        temps[i] = temps[i] < 0 ? temps[i] : temps[i] / MILLIDEGC_ADJUST;
     }
-    float frac = lerp_inverse(PWM_MIN, PWM_MAX, pwm);
-    return (int)(100 * frac);
+
+    return 0;
 }
 
+int fanctrl_get_speed(unsigned card) {
+    return fanctrl_pwm_to_speed(hwmon_read_pwm(card));
+}
@@ -5,11 +5,36 @@
 
 #include <stdbool.h>
 
+/* Snapshot of the most recent control loop iteration */
+struct fanctrl_sample {
+    /* Temperature in degrees Celsius */
+    int temp;
+    /* Pwm written by the control loop */
+    unsigned char target_pwm;
+    /* Pwm read back after writing, -1 if unavailable */
+    int pwm;
+    /* Fan speed percentage corresponding to pwm */
+    int speed;
+    /* Active threshold, -1 if none */
+    short threshold;
+    /* Whether threshold indexes the default matrix rather than a card specific one */
+    bool default_matrix;
+    /* CLOCK_MONOTONIC time of the sample in ns, 0 if none taken */
+    unsigned long long timestamp;
+    /* Index of the card in /sys/class/drm */
+    unsigned card_idx;
+};
+
 int fanctrl_init(void);
 int fanctrl_release(void);
+unsigned fanctrl_card_count(void);
 int fanctrl_configure(struct fand_config *config);
+unsigned short fanctrl_interval(struct fand_config const *config);
 int fanctrl_adjust(void);
-int fanctrl_get_speed(void);
-int fanctrl_get_temp(void);
+bool fanctrl_get_sample(unsigned card, struct fanctrl_sample *result, unsigned short max_age);
+unsigned fanctrl_snapshot(struct fanctrl_sample *samples, unsigned short max_age);
+int fanctrl_get_speed(unsigned card);
+int fanctrl_get_temp(unsigned card);
+int fanctrl_get_temps(int *temps, unsigned ncards);
 
 #endif /* FANCTRL_H */
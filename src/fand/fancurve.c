@@ -0,0 +1,269 @@
+#include "fancurve.h"
+#include "filesystem.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#define SYSFS_FAN_CURVE_FMT "/sys/class/drm/card%u/device/gpu_od/fan_ctrl/fan_curve"
+
+#define FANCURVE_SECTION_CURVE "OD_FAN_CURVE:"
+#define FANCURVE_SECTION_RANGE "OD_RANGE:"
+#define FANCURVE_RANGE_PREFIX "FAN_CURVE("
+
+enum { FANCURVE_BUFSIZE = 1024 };
+enum { FANCURVE_LINE_SIZE = 64 };
+enum { FANCURVE_CMD_SIZE = 32 };
+
+enum fancurve_section {
+    FANCURVE_NONE,
+    FANCURVE_CURVE,
+    FANCURVE_RANGE
+};
+
+int fancurve_path(char *dst, size_t size, unsigned card_idx) {
+    if(fsys_root_path(dst, size, SYSFS_FAN_CURVE_FMT, card_idx) < 0) {
+        syslog(LOG_ERR, "Fan curve path of card %u overflows the internal buffer", card_idx);
+        return -1;
+    }
+    return 0;
+}
+
+static int fancurve_parse_range(char const *line, struct fancurve *curve, bool *temp_range, bool *speed_range) {
+    char const *colon = strchr(line, ':');
+    unsigned lo;
+    unsigned hi;
+
+    if(!colon || strncmp(line, FANCURVE_RANGE_PREFIX, sizeof(FANCURVE_RANGE_PREFIX) - 1)) {
+        return 0;
+    }
+
+    if(strstr(line, "temp") && sscanf(colon + 1, " %uC %uC", &lo, &hi) == 2) {
+        if(lo > hi || hi > UCHAR_MAX) {
+            return -1;
+        }
+        curve->temp_min = (unsigned char)lo;
+        curve->temp_max = (unsigned char)hi;
+        *temp_range = true;
+    }
+    else if(strstr(line, "speed") && sscanf(colon + 1, " %u%% %u%%", &lo, &hi) == 2) {
+        if(lo > hi || hi > 100) {
+            return -1;
+        }
+        curve->speed_min = (unsigned char)lo;
+        curve->speed_max = (unsigned char)hi;
+        *speed_range = true;
+    }
+
+    return 0;
+}
+
+/* Parses the contents of fan_curve, i.e. the points
+ * of the curve followed by the accepted ranges */
+int fancurve_parse(char const *text, struct fancurve *curve) {
+    enum fancurve_section section = FANCURVE_NONE;
+    char line[FANCURVE_LINE_SIZE];
+    char const *next;
+    size_t len;
+    unsigned idx;
+    unsigned temp;
+    unsigned speed;
+    bool temp_range = false;
+    bool speed_range = false;
+
+    memset(curve, 0, sizeof(*curve));
+
+    for(; *text; text = next) {
+        next = strchr(text, '\n');
+        len = next ? (size_t)(next - text) : strlen(text);
+        next = next ? next + 1 : text + len;
+
+        if(len >= sizeof(line)) {
+            return -1;
+        }
+        memcpy(line, text, len);
+        line[len] = '\0';
+
+        if(strcmp(line, FANCURVE_SECTION_CURVE) == 0) {
+            section = FANCURVE_CURVE;
+        }
+        else if(strcmp(line, FANCURVE_SECTION_RANGE) == 0) {
+            section = FANCURVE_RANGE;
+        }
+        else if(section == FANCURVE_CURVE && sscanf(line, "%u: %uC %u%%", &idx, &temp, &speed) == 3) {
+            if(idx != curve->npoints || idx >= FANCURVE_MAX_POINTS || temp > UCHAR_MAX || speed > 100) {
+                return -1;
+            }
+            curve->temps[idx] = (unsigned char)temp;
+            curve->speeds[idx] = (unsigned char)speed;
+            ++curve->npoints;
+        }
+        else if(section == FANCURVE_RANGE && fancurve_parse_range(line, curve, &temp_range, &speed_range)) {
+            return -1;
+        }
+    }
+
+    return curve->npoints && temp_range && speed_range ? 0 : -1;
+}
+
+static inline unsigned char fancurve_clamp(unsigned char value, unsigned char lo, unsigned char hi) {
+    return value < lo ? lo : value > hi ? hi : value;
+}
+
+/* Fills the points of curve, whose point count and ranges have been read
+ * from the firmware, with matrix. Unused points are placed by splitting
+ * the widest segment, midpoints lie on the linearly interpolated curve,
+ * so its shape is preserved. Values outside the accepted ranges are clamped */
+int fancurve_from_matrix(struct fancurve *curve, unsigned char const *matrix, unsigned char rows) {
+    unsigned char n;
+    unsigned widest;
+    int gap;
+    int t0, t1, tm, s0, s1;
+    bool clamped = false;
+
+    if(!rows || rows > curve->npoints) {
+        return -1;
+    }
+
+    for(n = 0; n < rows; n++) {
+        curve->temps[n] = matrix[2 * n];
+        curve->speeds[n] = matrix[2 * n + 1];
+    }
+
+    while(n < curve->npoints) {
+        gap = 1;
+        widest = n;
+        for(unsigned i = 0; i + 1u < n; i++) {
+            if(curve->temps[i + 1] - curve->temps[i] > gap) {
+                gap = curve->temps[i + 1] - curve->temps[i];
+                widest = i;
+            }
+        }
+
+        if(widest == n) {
+            /* No segment left to split */
+            curve->temps[n] = curve->temps[n - 1];
+            curve->speeds[n] = curve->speeds[n - 1];
+            ++n;
+            continue;
+        }
+
+        t0 = curve->temps[widest];
+        t1 = curve->temps[widest + 1];
+        s0 = curve->speeds[widest];
+        s1 = curve->speeds[widest + 1];
+        tm = (t0 + t1) / 2;
+
+        memmove(&curve->temps[widest + 2], &curve->temps[widest + 1], n - widest - 1);
+        memmove(&curve->speeds[widest + 2], &curve->speeds[widest + 1], n - widest - 1);
+        curve->temps[widest + 1] = (unsigned char)tm;
+        curve->speeds[widest + 1] = (unsigned char)((s0 * (t1 - tm) + s1 * (tm - t0) + (t1 - t0) / 2) / (t1 - t0));
+        ++n;
+    }
+
+    for(unsigned i = 0; i < n; i++) {
+        clamped |= curve->temps[i] < curve->temp_min || curve->temps[i] > curve->temp_max ||
+                   curve->speeds[i] < curve->speed_min || curve->speeds[i] > curve->speed_max;
+        curve->temps[i] = fancurve_clamp(curve->temps[i], curve->temp_min, curve->temp_max);
+        curve->speeds[i] = fancurve_clamp(curve->speeds[i], curve->speed_min, curve->speed_max);
+    }
+
+    if(clamped) {
+        syslog(LOG_INFO, "Matrix clamped to the firmware fan curve limits %hhu-%hhu C, %hhu-%hhu %%",
+               curve->temp_min, curve->temp_max, curve->speed_min, curve->speed_max);
+    }
+
+    return 0;
+}
+
+bool fancurve_points_equal(struct fancurve const *a, struct fancurve const *b) {
+    return a->npoints == b->npoints &&
+           memcmp(a->temps, b->temps, a->npoints) == 0 &&
+           memcmp(a->speeds, b->speeds, a->npoints) == 0;
+}
+
+int fancurve_read(char const *path, struct fancurve *curve) {
+    char buffer[FANCURVE_BUFSIZE];
+    ssize_t nbytes;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd == -1) {
+        return -1;
+    }
+
+    nbytes = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+
+    if(nbytes == -1) {
+        syslog(LOG_WARNING, "Could not read %s: %s", path, strerror(errno));
+        return -1;
+    }
+    buffer[nbytes] = '\0';
+
+    if(fancurve_parse(buffer, curve)) {
+        syslog(LOG_WARNING, "Could not parse fan curve in %s", path);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Each command is a separate write, as expected by the driver */
+static int fancurve_command(int fd, char const *path, char const *cmd) {
+    size_t len = strlen(cmd);
+
+    if(write(fd, cmd, len) != (ssize_t)len) {
+        syslog(LOG_ERR, "Could not write '%.*s' to %s: %s", (int)len - 1, cmd, path, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+int fancurve_write(char const *path, struct fancurve const *curve) {
+    char cmd[FANCURVE_CMD_SIZE];
+    int status = 0;
+
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if(fd == -1) {
+        syslog(LOG_ERR, "Could not open %s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    for(unsigned i = 0; i < curve->npoints && !status; i++) {
+        snprintf(cmd, sizeof(cmd), "%u %hhu %hhu\n", i, curve->temps[i], curve->speeds[i]);
+        status = fancurve_command(fd, path, cmd);
+    }
+
+    if(!status) {
+        /* Commit */
+        status = fancurve_command(fd, path, "c\n");
+    }
+
+    close(fd);
+    return status;
+}
+
+/* Restores the default curve of the firmware */
+int fancurve_reset(char const *path) {
+    int status;
+
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if(fd == -1) {
+        syslog(LOG_ERR, "Could not open %s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    status = fancurve_command(fd, path, "r\n");
+    if(!status) {
+        status = fancurve_command(fd, path, "c\n");
+    }
+
+    close(fd);
+    return status;
+}
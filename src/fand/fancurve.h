@@ -0,0 +1,32 @@
+#ifndef FANCURVE_H
+#define FANCURVE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+enum { FANCURVE_MAX_POINTS = 16 };
+
+/* Fan curve evaluated by the SMU firmware, as exposed
+ * through gpu_od/fan_ctrl/fan_curve */
+struct fancurve {
+    unsigned char npoints;
+    /* Temperatures in degrees Celsius */
+    unsigned char temps[FANCURVE_MAX_POINTS];
+    /* Speeds in percent */
+    unsigned char speeds[FANCURVE_MAX_POINTS];
+    /* Ranges accepted by the firmware */
+    unsigned char temp_min;
+    unsigned char temp_max;
+    unsigned char speed_min;
+    unsigned char speed_max;
+};
+
+int fancurve_path(char *dst, size_t size, unsigned card_idx);
+int fancurve_parse(char const *text, struct fancurve *curve);
+int fancurve_from_matrix(struct fancurve *curve, unsigned char const *matrix, unsigned char rows);
+bool fancurve_points_equal(struct fancurve const *a, struct fancurve const *b);
+int fancurve_read(char const *path, struct fancurve *curve);
+int fancurve_write(char const *path, struct fancurve const *curve);
+int fancurve_reset(char const *path);
+
+#endif /* FANCURVE_H */
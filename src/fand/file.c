@@ -1,8 +1,9 @@
 #include "file.h"
-#include "strutils.h"
+#include "uring.h"
 
 #include <errno.h>
-#include <stdlib.h>
+#include <limits.h>
+#include <stdbool.h>
 #include <string.h>
 
 #include <fcntl.h>
@@ -12,77 +13,63 @@
 #include <sys/types.h>
 #include <unistd.h>
 
-enum { FILE_ULONG_BUFSIZE = 16 };
+/* Upper bound on the decimal digits of ULONG_MAX */
+enum { FILE_ULONG_DIGITS = 3 * sizeof(unsigned long) };
+/* Digits and newline */
+enum { FILE_ULONG_BUFSIZE = FILE_ULONG_DIGITS + 1 };
+/* Operations handed to the kernel per submission */
+enum { FILE_BATCH_SIZE = 32 };
 
-static int file_errno;
+/* Formats value as a newline-terminated decimal string,
+ * returns the number of characters written */
+static size_t file_format_ulong(char *buffer, unsigned long value) {
+    char digits[FILE_ULONG_DIGITS];
+    size_t ndigits = 0;
+    size_t len = 0;
 
-FILE *fopen_excl(char const *path, char const *mode) {
-    FILE *fp = fopen(path, mode);
-    if(!fp) {
-        file_errno = errno;
-        syslog(LOG_ERR, "Could not open %s: %s", path, strerror(file_errno));
-        return fp;
-    }
+    do {
+        digits[ndigits++] = '0' + value % 10;
+        value /= 10;
+    } while(value);
 
-    int fd = fileno(fp);
-    if(flock(fd, LOCK_EX) == -1) {
-        file_errno = errno;
-        syslog(LOG_ERR, "Failed to acquire exclusive lock for %d: %s", fd, strerror(file_errno));
-        fclose(fp);
-        return 0;
+    while(ndigits) {
+        buffer[len++] = digits[--ndigits];
     }
+    buffer[len++] = '\n';
 
-    return fp;
-}
-
-int fclose_excl(FILE *fp) {
-    int fd = fileno(fp);
-    if(flock(fd, LOCK_UN) == -1) {
-        file_errno = errno;
-        syslog(LOG_ERR, "Failed to release exclusive lock for %d: %s", fd, strerror(file_errno));
-    }
-    return fclose(fp);
+    return len;
 }
 
-int fwrite_ulong_excl(char const *path, unsigned long value) {
-    FILE *fp = fopen_excl(path, "w");
-    if(!fp) {
-        return -1;
-    }
+/* Parses a value read into a buffer of FILE_ULONG_BUFSIZE bytes. A read
+ * filling the buffer without a terminator was cut short and is rejected */
+static int file_parse_ulong(char const *buffer, size_t len, unsigned long *value) {
+    unsigned long result = 0;
+    unsigned long digit;
+    size_t i;
 
-    fprintf(fp, "%lu", value);
-
-    return fclose_excl(fp);
-}
-
-int fread_ulong_excl(char const *path, unsigned long *value) {
-    char buffer[FILE_ULONG_BUFSIZE] = { 0 };
-    FILE *fp = fopen_excl(path, "r");
-    if(!fp) {
-        return file_errno;
-    }
-
-    {
-        char *s = fgets(buffer, sizeof(buffer), fp);
-        if(fclose_excl(fp)) {
-            file_errno = errno;
-            syslog(LOG_ERR, "Could not close %s: %s", path, strerror(file_errno));
+    for(i = 0; i < len && buffer[i] != '\n' && buffer[i] != '\0'; i++) {
+        if(buffer[i] < '0' || buffer[i] > '9') {
+            return -EINVAL;
         }
-        if(!s) {
-            syslog(LOG_ERR, "Could not read from %s", path);
-            return -EAGAIN;
+        digit = (unsigned long)(buffer[i] - '0');
+        if(result > (ULONG_MAX - digit) / 10) {
+            return -ERANGE;
         }
+        result = 10 * result + digit;
     }
 
-    buffer[strcspn(buffer, "\n")] = '\0';
+    if(!i || i >= FILE_ULONG_BUFSIZE) {
+        return -EINVAL;
+    }
 
-    return strstoul(buffer, value);
+    *value = result;
+    return 0;
 }
 
 int fdopen_excl(char const *path, int mode) {
-    int fd = open(path, mode);
+    int fd = open(path, mode | O_CLOEXEC);
     if(fd == -1) {
-        syslog(LOG_ERR, "Could not open control mode file %s: %s", path, strerror(errno));
+        syslog(LOG_ERR, "Could not open %s: %s", path, strerror(errno));
         return fd;
     }
 
@@ -93,11 +80,24 @@ int fdopen_excl(char const *path, int mode) {
     return fd;
 }
 
+int fdopen_rdonly(char const *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd == -1) {
+        syslog(LOG_ERR, "Could not open %s: %s", path, strerror(errno));
+    }
+
+    return fd;
+}
+
 int fdclose_excl(int fd) {
     if(flock(fd, LOCK_UN) == -1) {
         syslog(LOG_WARNING, "Failed to release lock for %d: %s", fd, strerror(errno));
     }
 
+    return fdclose(fd);
+}
+
+int fdclose(int fd) {
     if(close(fd)) {
         syslog(LOG_ERR, "Could not close fd %d: %s", fd, strerror(errno));
         return -1;
@@ -107,9 +107,9 @@ int fdclose_excl(int fd) {
 
 int fdwrite_ulong(int fd, unsigned long value) {
     char buffer[FILE_ULONG_BUFSIZE];
+    size_t len = file_format_ulong(buffer, value);
 
-    snprintf(buffer, sizeof(buffer), "%lu", value);
-    if(write(fd, buffer, strlen(buffer)) == -1) {
+    if(pwrite(fd, buffer, len, 0) == -1) {
         syslog(LOG_ERR, "Could not write value to fd %d: %s", fd, strerror(errno));
         return -1;
     }
@@ -119,18 +119,139 @@ int fdwrite_ulong(int fd, unsigned long value) {
 
 int fdread_ulong(int fd, unsigned long *value) {
     char buffer[FILE_ULONG_BUFSIZE];
-    unsigned byteidx = 0;
-
-    for(;read(fd, &buffer[byteidx], 1) != -1; ++byteidx) {
-        switch(buffer[byteidx]) {
-            case '\n':
-            case '\0':
-                goto convert;
-            default:
-                /* NOP */
-                break;
+
+    ssize_t nbytes = pread(fd, buffer, sizeof(buffer), 0);
+    if(nbytes == -1) {
+        int err = errno;
+        syslog(LOG_ERR, "Could not read value from fd %d: %s", fd, strerror(err));
+        return -err;
+    }
+
+    return file_parse_ulong(buffer, nbytes, value);
+}
+
+int fdbatch_init(void) {
+    #ifdef FAND_URING_SUPPORT
+
+    if(uring_init()) {
+        return -1;
+    }
+    syslog(LOG_INFO, "Batching attribute I/O through io_uring");
+
+    #endif
+
+    return 0;
+}
+
+int fdbatch_close(void) {
+    #ifdef FAND_URING_SUPPORT
+
+    return uring_close();
+
+    #else
+
+    return 0;
+
+    #endif
+}
+
+/* Reads or writes each buffer at offset 0 of the corresponding fd. Uses
+ * a single io_uring submission when possible, pread/pwrite otherwise.
+ * Each result is the number of bytes transferred or a negative errno */
+static void file_transfer_batch(struct fdio_ulong const *ops, char (*buffers)[FILE_ULONG_BUFSIZE], ssize_t *results, unsigned nops, bool is_write) {
+    bool completed[FILE_BATCH_SIZE] = { false };
+
+    #ifdef FAND_URING_SUPPORT
+
+    struct uring_op uops[FILE_BATCH_SIZE];
+
+    if(uring_available()) {
+        for(unsigned i = 0; i < nops; i++) {
+            uops[i] = (struct uring_op) {
+                .opcode = is_write ? URING_WRITE : URING_READ,
+                .fd = ops[i].fd,
+                .buffer = buffers[i],
+                .len = (unsigned)results[i]
+            };
+        }
+
+        /* Should the submission fail, only ops that did not complete are
+         * replayed, so that no value is written twice */
+        uring_submit(uops, nops);
+        for(unsigned i = 0; i < nops; i++) {
+            completed[i] = uops[i].completed;
+            if(completed[i]) {
+                results[i] = uops[i].result;
+            }
+        }
+    }
+
+    #endif
+
+    for(unsigned i = 0; i < nops; i++) {
+        if(completed[i]) {
+            continue;
+        }
+        results[i] = is_write ? pwrite(ops[i].fd, buffers[i], results[i], 0) : pread(ops[i].fd, buffers[i], results[i], 0);
+        if(results[i] == -1) {
+            results[i] = -errno;
+        }
+    }
+}
+
+int fdwrite_ulong_batch(struct fdio_ulong *ops, unsigned nops) {
+    char buffers[FILE_BATCH_SIZE][FILE_ULONG_BUFSIZE];
+    ssize_t results[FILE_BATCH_SIZE];
+    unsigned batch;
+    int nfailed = 0;
+
+    for(unsigned done = 0; done < nops; done += batch) {
+        batch = nops - done < FILE_BATCH_SIZE ? nops - done : FILE_BATCH_SIZE;
+
+        for(unsigned i = 0; i < batch; i++) {
+            results[i] = file_format_ulong(buffers[i], ops[done + i].value);
+        }
+
+        file_transfer_batch(ops + done, buffers, results, batch, true);
+
+        for(unsigned i = 0; i < batch; i++) {
+            ops[done + i].status = results[i] < 0 ? (int)results[i] : 0;
+            if(ops[done + i].status) {
+                syslog(LOG_ERR, "Could not write value to fd %d: %s", ops[done + i].fd, strerror(-ops[done + i].status));
+                ++nfailed;
+            }
+        }
+    }
+
+    return nfailed;
+}
+
+int fdread_ulong_batch(struct fdio_ulong *ops, unsigned nops) {
+    char buffers[FILE_BATCH_SIZE][FILE_ULONG_BUFSIZE];
+    ssize_t results[FILE_BATCH_SIZE];
+    unsigned batch;
+    int nfailed = 0;
+
+    for(unsigned done = 0; done < nops; done += batch) {
+        batch = nops - done < FILE_BATCH_SIZE ? nops - done : FILE_BATCH_SIZE;
+
+        for(unsigned i = 0; i < batch; i++) {
+            results[i] = FILE_ULONG_BUFSIZE;
+        }
+
+        file_transfer_batch(ops + done, buffers, results, batch, false);
+
+        for(unsigned i = 0; i < batch; i++) {
+            if(results[i] < 0) {
+                ops[done + i].status = (int)results[i];
+                syslog(LOG_ERR, "Could not read value from fd %d: %s", ops[done + i].fd, strerror(-ops[done + i].status));
+            }
+            else {
+                ops[done + i].status = file_parse_ulong(buffers[i], results[i], &ops[done + i].value);
+            }
+            nfailed += !!ops[done + i].status;
         }
     }
-convert:
-    return strstoul(buffer, value);
+
+    return nfailed;
 }
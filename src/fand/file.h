@@ -1,16 +1,23 @@
 #ifndef FILE_H
 #define FILE_H
 
-#include <stdio.h>
-
-FILE *fopen_excl(char const *path, char const *mode);
-int fclose_excl(FILE *fp);
-int fwrite_ulong_excl(char const *path, unsigned long value);
-int fread_ulong_excl(char const *path, unsigned long *value);
+/* Single attribute access in a batch */
+struct fdio_ulong {
+    int fd;
+    unsigned long value;
+    /* 0 on success, negative errno on failure */
+    int status;
+};
 
 int fdopen_excl(char const *path, int mode);
+int fdopen_rdonly(char const *path);
 int fdclose_excl(int fd);
+int fdclose(int fd);
 int fdwrite_ulong(int fd, unsigned long value);
 int fdread_ulong(int fd, unsigned long *value);
+int fdbatch_init(void);
+int fdbatch_close(void);
+int fdwrite_ulong_batch(struct fdio_ulong *ops, unsigned nops);
+int fdread_ulong_batch(struct fdio_ulong *ops, unsigned nops);
 
 #endif /* FILE_H */
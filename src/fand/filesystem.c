@@ -3,7 +3,9 @@
 
 #include <errno.h>
 #include <limits.h>
+#include <stdarg.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -14,6 +16,9 @@
 enum { FSYS_PATH_MAX_LENGTH = 256 };
 enum { INOTIFY_BUF_LENGTH = 32 * sizeof(struct inotify_event) };
 
+/* Prepended to every sysfs, debugfs and device path, empty for / */
+static char fsys_root_prefix[FSYS_PATH_MAX_LENGTH];
+
 static int fsys_strip_filename(char *path) {
     char *dir = strrchr(path, '/');
     if(!dir) {
@@ -104,6 +109,8 @@ int fsys_watch_init(char const *path, struct inotify_watch *watch, int flags) {
     return 0;
 }
 
+/* Drains the pending events, setting triggered if any of them
+ * matches the flags of the watch and concerns the file at path */
 int fsys_watch_event(char const *path, struct inotify_watch *watch) {
     unsigned char inotify_buf[INOTIFY_BUF_LENGTH];
     unsigned char *ibufp;
@@ -116,19 +123,17 @@ int fsys_watch_event(char const *path, struct inotify_watch *watch) {
     filename = strrchr(path, '/');
     filename = filename ? filename + 1 : path;
 
-    nbytes = read(watch->fd, inotify_buf, sizeof(inotify_buf));
-    if(nbytes == -1) {
-        return 0;
+    while((nbytes = read(watch->fd, inotify_buf, sizeof(inotify_buf))) > 0) {
+        for(ibufp = inotify_buf; ibufp < inotify_buf + nbytes; ibufp += sizeof(struct inotify_event) + inevent->len) {
+            inevent = (struct inotify_event *)ibufp;
+            if((inevent->mask & watch->flags) && inevent->len && strcmp(inevent->name, filename) == 0) {
+                watch->triggered = true;
+            }
+        }
     }
 
-    ibufp = inotify_buf;
-    while(ibufp < inotify_buf + nbytes) {
-        inevent = (struct inotify_event *)ibufp;
-        if((inevent->mask & watch->flags) && inevent->len && strcmp(inevent->name, filename) == 0) {
-            watch->triggered = true;
-            break;
-        }
-        ibufp += sizeof(struct inotify_event) + inevent->len;
+    if(nbytes == -1 && errno != EAGAIN && errno != EINTR) {
+        return -1;
     }
 
     return 0;
@@ -166,3 +171,58 @@ ssize_t fsys_abspath(char *dst, char const *path, size_t dstsize) {
 
     return nbytes;
 }
+
+/* Sets the directory treated as / when accessing the kernel interfaces,
+ * e.g. a synthetic tree. A null or empty root restores the real one */
+int fsys_set_root(char const *root) {
+    char buffer[PATH_MAX];
+
+    if(!root || !*root) {
+        fsys_root_prefix[0] = '\0';
+        return 0;
+    }
+
+    if(!realpath(root, buffer)) {
+        syslog(LOG_ERR, "Invalid root %s: %s", root, strerror(errno));
+        return -1;
+    }
+
+    /* Paths are formatted as root + absolute path */
+    if(strcmp(buffer, "/") == 0) {
+        buffer[0] = '\0';
+    }
+
+    if(strscpy(fsys_root_prefix, buffer, sizeof(fsys_root_prefix)) < 0) {
+        syslog(LOG_ERR, "Root %s overflows the internal buffer", buffer);
+        fsys_root_prefix[0] = '\0';
+        return -1;
+    }
+
+    return 0;
+}
+
+char const *fsys_root(void) {
+    return fsys_root_prefix;
+}
+
+/* Formats the absolute path fmt below the root, returns
+ * the length of the result or -1 if it does not fit */
+ssize_t fsys_root_path(char *dst, size_t dstsize, char const *fmt, ...) {
+    va_list args;
+    int len;
+
+    ssize_t pos = strscpy(dst, fsys_root_prefix, dstsize);
+    if(pos < 0) {
+        return -1;
+    }
+
+    va_start(args, fmt);
+    len = vsnprintf(dst + pos, dstsize - pos, fmt, args);
+    va_end(args);
+
+    if(len < 0 || (size_t)len >= dstsize - pos) {
+        return -1;
+    }
+
+    return pos + len;
+}
@@ -24,4 +24,8 @@ int fsys_watch_clear(struct inotify_watch const *watch);
 
 ssize_t fsys_abspath(char *dst, char const *path, size_t dstsize);
 
+int fsys_set_root(char const *root);
+char const *fsys_root(void);
+ssize_t fsys_root_path(char *dst, size_t dstsize, char const *fmt, ...);
+
 #endif /* FILESYSTEM_H */
@@ -0,0 +1,218 @@
+#include "fandcfg.h"
+#include "filesystem.h"
+#include "gpu_metrics.h"
+#include "macro.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#define SYSFS_GPU_METRICS_FMT "/sys/class/drm/card%u/device/gpu_metrics"
+
+/* Largest tables are a few hundred bytes */
+enum { GPU_METRICS_BUFSIZE = 1024 };
+enum { GPU_METRICS_HEADER_SIZE = 4 };
+enum { GPU_METRICS_UNSUPPORTED = 0xffff };
+
+/* Offsets of the fields in a range of table revisions, see struct
+ * gpu_metrics_v* in the kernel's kgd_pp_interface.h. An offset of 0
+ * marks a field absent from the revision */
+struct gpu_metrics_layout {
+    unsigned char format_revision;
+    unsigned char min_content_revision;
+    unsigned char max_content_revision;
+    /* Factor converting temperatures to millidegrees Celsius */
+    unsigned short temp_scale;
+    unsigned short temp_edge;
+    unsigned short temp_hotspot;
+    unsigned short temp_mem;
+    unsigned short gfx_activity;
+    unsigned short socket_power;
+    unsigned short fan_speed;
+};
+
+static struct gpu_metrics_layout const gpu_metrics_layouts[] = {
+    /* dGPUs, degrees Celsius. v1_0 has the timestamp up front */
+    { 1, 0, 0, 1000, 16, 18, 20, 28, 34, 72 },
+    { 1, 1, 3, 1000,  4,  6,  8, 16, 22, 72 },
+    /* APUs, centidegrees Celsius. Only the gfx temperature is used */
+    { 2, 0, 0,   10, 16,  0,  0, 40,  0,  0 },
+    { 2, 1, 4,   10,  4,  0,  0, 28,  0,  0 }
+};
+
+static int gpu_metrics_fds[FAND_MAX_CARDS];
+static unsigned gpu_metrics_ncards;
+
+/* Reused for every read, tables are decoded in place */
+static unsigned char gpu_metrics_buffer[GPU_METRICS_BUFSIZE];
+
+static inline unsigned gpu_metrics_u16(unsigned char const *buffer, unsigned offset) {
+    return (unsigned)buffer[offset] | (unsigned)buffer[offset + 1] << 8;
+}
+
+static inline int gpu_metrics_field(unsigned char const *buffer, unsigned offset, unsigned scale) {
+    if(!offset) {
+        return -1;
+    }
+
+    unsigned value = gpu_metrics_u16(buffer, offset);
+    return value == GPU_METRICS_UNSUPPORTED ? -1 : (int)(value * scale);
+}
+
+/* Size needed to hold every field of the layout */
+static size_t gpu_metrics_layout_size(struct gpu_metrics_layout const *layout) {
+    unsigned short const offsets[] = {
+        layout->temp_edge, layout->temp_hotspot, layout->temp_mem,
+        layout->gfx_activity, layout->socket_power, layout->fan_speed
+    };
+    unsigned short end = 0;
+
+    for(unsigned i = 0; i < array_size(offsets); i++) {
+        if(offsets[i] + 2u > end) {
+            end = offsets[i] + 2u;
+        }
+    }
+
+    return end;
+}
+
+static struct gpu_metrics_layout const *gpu_metrics_layout(unsigned char const *buffer, size_t size) {
+    struct gpu_metrics_layout const *layout;
+    unsigned structure_size;
+    unsigned char format;
+    unsigned char content;
+
+    if(size < GPU_METRICS_HEADER_SIZE) {
+        return 0;
+    }
+
+    /* struct metrics_table_header */
+    structure_size = gpu_metrics_u16(buffer, 0);
+    format = buffer[2];
+    content = buffer[3];
+
+    if(structure_size > size) {
+        return 0;
+    }
+
+    for(unsigned i = 0; i < array_size(gpu_metrics_layouts); i++) {
+        layout = &gpu_metrics_layouts[i];
+        if(layout->format_revision == format &&
+           layout->min_content_revision <= content &&
+           layout->max_content_revision >= content) {
+            return gpu_metrics_layout_size(layout) <= structure_size ? layout : 0;
+        }
+    }
+
+    return 0;
+}
+
+int gpu_metrics_decode(unsigned char const *buffer, size_t size, struct gpu_metrics *metrics) {
+    struct gpu_metrics_layout const *layout = gpu_metrics_layout(buffer, size);
+    if(!layout) {
+        return -EPROTO;
+    }
+
+    metrics->temp_edge = gpu_metrics_field(buffer, layout->temp_edge, layout->temp_scale);
+    metrics->temp_hotspot = gpu_metrics_field(buffer, layout->temp_hotspot, layout->temp_scale);
+    metrics->temp_mem = gpu_metrics_field(buffer, layout->temp_mem, layout->temp_scale);
+    metrics->gfx_activity = gpu_metrics_field(buffer, layout->gfx_activity, 1);
+    metrics->socket_power = gpu_metrics_field(buffer, layout->socket_power, 1);
+    metrics->fan_speed = gpu_metrics_field(buffer, layout->fan_speed, 1);
+
+    return 0;
+}
+
+static ssize_t gpu_metrics_fetch(unsigned card) {
+    ssize_t nbytes = pread(gpu_metrics_fds[card], gpu_metrics_buffer, sizeof(gpu_metrics_buffer), 0);
+    if(nbytes == -1) {
+        syslog(LOG_WARNING, "Could not read gpu_metrics: %s", strerror(errno));
+    }
+    return nbytes;
+}
+
+/* Opens the table of card and verifies that its revision is known */
+int gpu_metrics_open(unsigned card, unsigned card_idx) {
+    char path[HWMON_PATH_SIZE];
+    ssize_t nbytes;
+
+    if(card >= gpu_metrics_ncards) {
+        for(unsigned i = gpu_metrics_ncards; i <= card; i++) {
+            gpu_metrics_fds[i] = -1;
+        }
+        gpu_metrics_ncards = card + 1;
+    }
+
+    if(fsys_root_path(path, sizeof(path), SYSFS_GPU_METRICS_FMT, card_idx) < 0) {
+        syslog(LOG_ERR, "Path of gpu_metrics of card %u overflows the internal buffer", card_idx);
+        return -1;
+    }
+    gpu_metrics_fds[card] = open(path, O_RDONLY | O_CLOEXEC);
+    if(gpu_metrics_fds[card] == -1) {
+        syslog(LOG_INFO, "Could not open %s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    nbytes = gpu_metrics_fetch(card);
+    if(nbytes < 0 || !gpu_metrics_layout(gpu_metrics_buffer, nbytes)) {
+        if(nbytes >= GPU_METRICS_HEADER_SIZE) {
+            syslog(LOG_INFO, "Unsupported gpu_metrics revision %u.%u for card %u",
+                   gpu_metrics_buffer[2], gpu_metrics_buffer[3], card_idx);
+        }
+        close(gpu_metrics_fds[card]);
+        gpu_metrics_fds[card] = -1;
+        return -1;
+    }
+
+    return gpu_metrics_fds[card];
+}
+
+int gpu_metrics_close(void) {
+    int status = 0;
+
+    for(unsigned i = 0; i < gpu_metrics_ncards; i++) {
+        if(gpu_metrics_fds[i] == -1) {
+            continue;
+        }
+        if(close(gpu_metrics_fds[i]) == -1) {
+            syslog(LOG_WARNING, "Could not close gpu_metrics file descriptor: %s", strerror(errno));
+            status = -1;
+        }
+        gpu_metrics_fds[i] = -1;
+    }
+    gpu_metrics_ncards = 0;
+
+    return status;
+}
+
+int gpu_metrics_read(unsigned card, struct gpu_metrics *metrics) {
+    ssize_t nbytes = gpu_metrics_fetch(card);
+    if(nbytes < 0) {
+        return -1;
+    }
+
+    return -!!gpu_metrics_decode(gpu_metrics_buffer, nbytes, metrics);
+}
+
+/* Edge temperature in millidegrees Celsius, matching temp1_input */
+int gpu_metrics_read_temp(unsigned card) {
+    struct gpu_metrics_layout const *layout;
+    ssize_t nbytes = gpu_metrics_fetch(card);
+
+    if(nbytes < 0) {
+        return -1;
+    }
+
+    layout = gpu_metrics_layout(gpu_metrics_buffer, nbytes);
+    if(!layout) {
+        syslog(LOG_WARNING, "Malformed gpu_metrics table");
+        return -1;
+    }
+
+    return gpu_metrics_field(gpu_metrics_buffer, layout->temp_edge, layout->temp_scale);
+}
@@ -0,0 +1,27 @@
+#ifndef GPU_METRICS_H
+#define GPU_METRICS_H
+
+#include <stddef.h>
+
+/* Decoded subset of the gpu_metrics table, fields
+ * not reported by the card are set to -1 */
+struct gpu_metrics {
+    /* Temperatures in millidegrees Celsius */
+    int temp_edge;
+    int temp_hotspot;
+    int temp_mem;
+    /* Average gfx activity in percent */
+    int gfx_activity;
+    /* Average socket power in watts */
+    int socket_power;
+    /* Fan speed in rpm */
+    int fan_speed;
+};
+
+int gpu_metrics_decode(unsigned char const *buffer, size_t size, struct gpu_metrics *metrics);
+int gpu_metrics_open(unsigned card, unsigned card_idx);
+int gpu_metrics_close(void);
+int gpu_metrics_read(unsigned card, struct gpu_metrics *metrics);
+int gpu_metrics_read_temp(unsigned card);
+
+#endif /* GPU_METRICS_H */
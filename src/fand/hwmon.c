@@ -3,10 +3,12 @@
 #include "file.h"
 #include "filesystem.h"
 #include "hwmon.h"
+#include "macro.h"
 #include "regutils.h"
 #include "strutils.h"
 
 #include <errno.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <string.h>
@@ -33,42 +35,43 @@ enum { PWM_MODE_AUTO = 2 };
 
 enum { MAX_DRI_DIR_IDX = 128 };
 
-static int hwmon_pwm_enable_fd = -1;
+/* Attribute descriptors, one entry per controlled card */
+struct hwmon_card {
+    int pwm_enable_fd;
+    int pwm_fd;
+    int temp_input_fd;
+};
 
-static char *hwmon_pwm = fand_cache.pwm;
-static char *hwmon_pwm_enable = fand_cache.pwm_enable;
-static char *hwmon_temp_input = fand_cache.temp_input;
+static struct hwmon_card hwmon_cards[FAND_MAX_CARDS];
+static unsigned hwmon_ncards;
 
-static size_t hwmon_pwm_size = sizeof(fand_cache.pwm);
-static size_t hwmon_pwm_enable_size = sizeof(fand_cache.pwm_enable);
-static size_t hwmon_temp_input_size = sizeof(fand_cache.temp_input);
-
-static int hwmon_detect_card_index(void) {
+/* Fills indices with the drm indices of all cards exposing
+ * power management info, returns the number of cards found */
+static int hwmon_detect_card_indices(unsigned *indices, unsigned maxcards) {
     char buffer[HWMON_PATH_SIZE];
-    int card_idx = -1;
+    unsigned ncards = 0;
 
-    for(int i = 0; i < MAX_DRI_DIR_IDX; i++) {
-        if((size_t)snprintf(buffer, sizeof(buffer), "%s/%d/%s", SYSFS_DRI_DEBUG, i, AMDGPU_PM_FILE) >= sizeof(buffer)) {
-            syslog(LOG_ERR, "Sysfs kernel path %s/%d/%s overflows the internal buffer", SYSFS_DRI_DEBUG, i, AMDGPU_PM_FILE);
+    for(int i = 0; i < MAX_DRI_DIR_IDX && ncards < maxcards; i++) {
+        if(fsys_root_path(buffer, sizeof(buffer), "%s/%d/%s", SYSFS_DRI_DEBUG, i, AMDGPU_PM_FILE) < 0) {
+            syslog(LOG_ERR, "Sysfs kernel path %s%s/%d/%s overflows the internal buffer", fsys_root(), SYSFS_DRI_DEBUG, i, AMDGPU_PM_FILE);
             return -1;
         }
         if(fsys_file_exists(buffer)) {
-            card_idx = i;
-            break;
+            indices[ncards++] = (unsigned)i;
         }
     }
 
-    return card_idx;
+    return (int)ncards;
 }
 
 static ssize_t hwmon_detect_iface_dir(char *dst, unsigned card_idx, size_t dstsize) {
     char buffer[HWMON_PATH_SIZE];
 
-    int pos = snprintf(buffer, sizeof(buffer), SYSFS_HWMON_PATH_FMT, card_idx);
+    ssize_t pos = fsys_root_path(buffer, sizeof(buffer), SYSFS_HWMON_PATH_FMT, card_idx);
     ssize_t status = 0;
 
-    if((size_t)pos > sizeof(buffer)) {
-        syslog(LOG_ERR, "Sysfs hwmon path "SYSFS_HWMON_PATH_FMT" overflows the internal buffer", card_idx);
+    if(pos < 0) {
+        syslog(LOG_ERR, "Sysfs hwmon path %s"SYSFS_HWMON_PATH_FMT" overflows the internal buffer", fsys_root(), card_idx);
         return -1;
     }
 
@@ -79,6 +82,11 @@ static ssize_t hwmon_detect_iface_dir(char *dst, unsigned card_idx, size_t dstsi
 
     struct dirent *dp;
     DIR *dir = opendir(buffer);
+    if(!dir) {
+        syslog(LOG_WARNING, "Could not open %s: %s", buffer, strerror(errno));
+        regfree(&hwmon_regex);
+        return -1;
+    }
 
     while((dp = readdir(dir))) {
         if(regexec(&hwmon_regex, dp->d_name, 0, 0, 0)) {
@@ -102,6 +110,7 @@ static ssize_t hwmon_detect_iface_dir(char *dst, unsigned card_idx, size_t dstsi
     }
 
 cleanup:
+    regfree(&hwmon_regex);
     closedir(dir);
 
     return status;
@@ -119,98 +128,303 @@ static ssize_t hwmon_init_single_sysfs_path(char *dst, char const *hwmon_iface_d
     return strscpy(dst + pos, filename, dstsize - pos);
 }
 
-static int hwmon_set_pwm_mode_manual(void) {
-    hwmon_pwm_enable_fd = fdopen_excl(hwmon_pwm_enable, O_WRONLY);
-    if(hwmon_pwm_enable_fd == -1) {
+static int hwmon_set_pwm_mode_manual(struct hwmon_card *card, struct fand_cache_card const *paths) {
+    card->pwm_enable_fd = fdopen_excl(paths->pwm_enable, O_WRONLY);
+    if(card->pwm_enable_fd == -1) {
         return -1;
     }
-    return -!!fdwrite_ulong(hwmon_pwm_enable_fd, PWM_MODE_MANUAL);
+    return -!!fdwrite_ulong(card->pwm_enable_fd, PWM_MODE_MANUAL);
 }
 
+static int hwmon_open_attributes(struct hwmon_card *card, struct fand_cache_card const *paths) {
+    card->temp_input_fd = fdopen_rdonly(paths->temp_input);
+    if(card->temp_input_fd == -1) {
+        return -1;
+    }
+
+    card->pwm_fd = fdopen_excl(paths->pwm, O_RDWR);
+    if(card->pwm_fd == -1) {
+        fdclose(card->temp_input_fd);
+        card->temp_input_fd = -1;
+        return -1;
+    }
+
+    return 0;
+}
 
-static int hwmon_set_sysfs_paths(void) {
+static int hwmon_set_card_sysfs_paths(struct fand_cache_card *paths, unsigned card_idx) {
     char hwmon_iface[HWMON_PATH_SIZE];
     ssize_t status;
 
-    int card_idx = hwmon_detect_card_index();
-    if(card_idx < 0) {
-        return card_idx;
-    }
-
-    fand_cache.card_idx = (unsigned)card_idx;
+    paths->card_idx = card_idx;
 
     status = hwmon_detect_iface_dir(hwmon_iface, card_idx, sizeof(hwmon_iface));
     if(status < 0) {
         return status;
     }
 
-    status = hwmon_init_single_sysfs_path(hwmon_temp_input, hwmon_iface, SYSFS_TEMP_INPUT, hwmon_temp_input_size);
+    status = hwmon_init_single_sysfs_path(paths->temp_input, hwmon_iface, SYSFS_TEMP_INPUT, sizeof(paths->temp_input));
     if(status < 0) {
         return status;
     }
 
-    status = hwmon_init_single_sysfs_path(hwmon_pwm, hwmon_iface, SYSFS_PWM, hwmon_pwm_size);
+    status = hwmon_init_single_sysfs_path(paths->pwm, hwmon_iface, SYSFS_PWM, sizeof(paths->pwm));
     if(status < 0) {
         return status;
     }
 
-    return hwmon_init_single_sysfs_path(hwmon_pwm_enable, hwmon_iface, SYSFS_PWM_ENABLE, hwmon_pwm_enable_size);
+    status = hwmon_init_single_sysfs_path(paths->pwm_enable, hwmon_iface, SYSFS_PWM_ENABLE, sizeof(paths->pwm_enable));
+    if(status < 0) {
+        return status;
+    }
+
+    /* Cards without fan control, e.g. APUs, are skipped */
+    return fsys_file_exists(paths->pwm) && fsys_file_exists(paths->pwm_enable) ? 0 : -1;
 }
 
-int hwmon_open(void) {
-    int status;
-    if(cache_load()) {
-        status = hwmon_set_sysfs_paths();
-        if(status < 0) {
-            return status;
+static int hwmon_set_sysfs_paths(unsigned const *indices, unsigned ncards) {
+    struct fand_cache_card *paths;
+
+    memset(&fand_cache, 0, sizeof(fand_cache));
+
+    for(unsigned i = 0; i < ncards; i++) {
+        paths = &fand_cache.cards[fand_cache.ncards];
+        if(hwmon_set_card_sysfs_paths(paths, indices[i])) {
+            syslog(LOG_INFO, "No fan control found for card %u", indices[i]);
+            memset(paths, 0, sizeof(*paths));
+            continue;
         }
-        status = cache_write();
-        if(status < 0) {
-            return status;
+        ++fand_cache.ncards;
+    }
+
+    if(!fand_cache.ncards) {
+        syslog(LOG_ERR, "No controllable card found");
+        return -1;
+    }
+
+    return 0;
+}
+
+static bool hwmon_card_cached(unsigned card_idx) {
+    for(unsigned i = 0; i < fand_cache.ncards; i++) {
+        if(fand_cache.cards[i].card_idx == card_idx) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* The cache is stale if a cached card is gone, or if a card with fan
+ * control was added since it was written. Cards without fan control are
+ * never cached, they are probed again */
+static bool hwmon_cache_stale(unsigned const *indices, unsigned ncards) {
+    struct fand_cache_card paths;
+    unsigned nfound = 0;
+
+    for(unsigned i = 0; i < ncards; i++) {
+        if(hwmon_card_cached(indices[i])) {
+            ++nfound;
         }
+        else if(!hwmon_set_card_sysfs_paths(&paths, indices[i])) {
+            syslog(LOG_INFO, "Card %u added since the cache was written", indices[i]);
+            return true;
+        }
+    }
+
+    return nfound != fand_cache.ncards;
+}
+
+static int hwmon_close_card(unsigned idx) {
+    struct hwmon_card *card = &hwmon_cards[idx];
+    int status = 0;
+
+    if(card->temp_input_fd != -1) {
+        status |= fdclose(card->temp_input_fd);
+        card->temp_input_fd = -1;
     }
 
-    status = hwmon_set_pwm_mode_manual();
+    if(card->pwm_fd != -1) {
+        status |= fdclose_excl(card->pwm_fd);
+        card->pwm_fd = -1;
+    }
+
+    if(card->pwm_enable_fd == -1) {
+        syslog(LOG_WARNING, "No open control mode file descriptor for card %u", fand_cache.cards[idx].card_idx);
+        return status;
+    }
+
+    fdwrite_ulong(card->pwm_enable_fd, PWM_MODE_AUTO);
+
+    status |= fdclose_excl(card->pwm_enable_fd);
+    card->pwm_enable_fd = -1;
+
+    return status;
+}
+
+/* Fills fand_cache with the sysfs paths of every card with fan control,
+ * taken from the cache file if it is up to date */
+int hwmon_load_paths(void) {
+    unsigned indices[FAND_MAX_CARDS];
+    int status;
+
+    /* Detected even with a valid cache, as cards may have been added */
+    int ncards = hwmon_detect_card_indices(indices, array_size(indices));
+    if(ncards < 0) {
+        return ncards;
+    }
+
+    if(!cache_load() && !hwmon_cache_stale(indices, (unsigned)ncards)) {
+        return 0;
+    }
+
+    status = hwmon_set_sysfs_paths(indices, (unsigned)ncards);
     if(status < 0) {
         return status;
     }
 
-    return (int)fand_cache.card_idx;
+    return cache_write();
+}
+
+int hwmon_open(void) {
+    struct hwmon_card *card;
+
+    int status = hwmon_load_paths();
+    if(status < 0) {
+        return status;
+    }
+
+    for(hwmon_ncards = 0; hwmon_ncards < fand_cache.ncards; hwmon_ncards++) {
+        card = &hwmon_cards[hwmon_ncards];
+        *card = (struct hwmon_card){ .pwm_enable_fd = -1, .pwm_fd = -1, .temp_input_fd = -1 };
+
+        if(hwmon_open_attributes(card, &fand_cache.cards[hwmon_ncards]) < 0 ||
+           hwmon_set_pwm_mode_manual(card, &fand_cache.cards[hwmon_ncards]) < 0) {
+            /* Hand every card opened so far back to the kernel */
+            hwmon_close_card(hwmon_ncards);
+            hwmon_close();
+            return -1;
+        }
+    }
+
+    /* Synchronous I/O is used if batching is unavailable */
+    fdbatch_init();
+
+    return (int)hwmon_ncards;
 }
 
 int hwmon_close(void) {
-    if(hwmon_pwm_enable_fd == -1) {
+    int status = 0;
+
+    if(!hwmon_ncards) {
         syslog(LOG_WARNING, "No open control mode file descriptor");
-        return 0;
+        return status;
+    }
+
+    fdbatch_close();
+
+    for(unsigned i = 0; i < hwmon_ncards; i++) {
+        status |= hwmon_close_card(i);
     }
+    hwmon_ncards = 0;
+
+    return status;
+}
 
-    fdwrite_ulong(hwmon_pwm_enable_fd, PWM_MODE_AUTO);
+unsigned hwmon_card_index(unsigned card) {
+    return fand_cache.cards[card].card_idx;
+}
 
-    return fdclose_excl(hwmon_pwm_enable_fd);
+/* Hands control of the fan of card to the firmware, or takes it back */
+int hwmon_set_firmware_control(unsigned card, bool enable) {
+    if(fdwrite_ulong(hwmon_cards[card].pwm_enable_fd, enable ? PWM_MODE_AUTO : PWM_MODE_MANUAL)) {
+        syslog(LOG_ERR, "Could not set control mode of card %u", fand_cache.cards[card].card_idx);
+        return -1;
+    }
+    return 0;
 }
 
-int hwmon_read_temp(void) {
+int hwmon_read_temp(unsigned card) {
     unsigned long temp;
-    if(fread_ulong_excl(hwmon_temp_input, &temp)) {
+    if(fdread_ulong(hwmon_cards[card].temp_input_fd, &temp)) {
         return -1;
     }
     return (int)temp;
 }
 
-int hwmon_read_pwm(void) {
+int hwmon_read_pwm(unsigned card) {
     unsigned long pwm;
-    if(fread_ulong_excl(hwmon_pwm, &pwm)) {
+    if(fdread_ulong(hwmon_cards[card].pwm_fd, &pwm)) {
         return -1;
     }
     return (int)pwm;
 }
 
-int hwmon_write_pwm(unsigned long pwm) {
-    if(pwm > PWM_MAX) {
-        syslog(LOG_ERR, "Invalid pwm %lu", pwm);
-        return FAND_FATAL_ERR;
+/* Reads the temperature of the first ncards cards in one batch,
+ * returns the number of failed reads. Failures are reported as
+ * -1 in temps */
+int hwmon_read_temps(int *temps, unsigned ncards) {
+    struct fdio_ulong ops[FAND_MAX_CARDS];
+    int nfailed;
+
+    for(unsigned i = 0; i < ncards; i++) {
+        ops[i].fd = hwmon_cards[i].temp_input_fd;
+    }
+
+    nfailed = fdread_ulong_batch(ops, ncards);
+
+    for(unsigned i = 0; i < ncards; i++) {
+        temps[i] = ops[i].status ? -1 : (int)ops[i].value;
+    }
+
+    return nfailed;
+}
+
+/* Reads the pwm of each of the n cards in one batch, returns
+ * the number of failed reads. Failures are reported as -1 in pwms */
+int hwmon_read_pwms(unsigned const *cards, int *pwms, unsigned n) {
+    struct fdio_ulong ops[FAND_MAX_CARDS];
+    int nfailed;
+
+    for(unsigned i = 0; i < n; i++) {
+        ops[i].fd = hwmon_cards[cards[i]].pwm_fd;
     }
 
-    return fwrite_ulong_excl(hwmon_pwm, pwm);
+    nfailed = fdread_ulong_batch(ops, n);
+
+    for(unsigned i = 0; i < n; i++) {
+        pwms[i] = ops[i].status ? -1 : (int)ops[i].value;
+    }
+
+    return nfailed;
 }
 
+/* Writes pwms[i] to cards[i] for each of the n cards in one batch.
+ * The outcome for each card is stored in status, the number of
+ * failed writes is returned */
+int hwmon_write_pwms(unsigned const *cards, unsigned long const *pwms, int *status, unsigned n) {
+    struct fdio_ulong ops[FAND_MAX_CARDS];
+    unsigned nops = 0;
+    int nfailed = 0;
+
+    for(unsigned i = 0; i < n; i++) {
+        if(pwms[i] > PWM_MAX) {
+            syslog(LOG_ERR, "Invalid pwm %lu", pwms[i]);
+            status[i] = FAND_FATAL_ERR;
+            ++nfailed;
+            continue;
+        }
+        ops[nops++] = (struct fdio_ulong){ .fd = hwmon_cards[cards[i]].pwm_fd, .value = pwms[i] };
+    }
+
+    fdwrite_ulong_batch(ops, nops);
+
+    for(unsigned i = 0, op = 0; i < n; i++) {
+        if(pwms[i] > PWM_MAX) {
+            continue;
+        }
+        status[i] = -!!ops[op++].status;
+        nfailed += !!status[i];
+    }
+
+    return nfailed;
+}
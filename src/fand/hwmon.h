@@ -1,10 +1,17 @@
 #ifndef HWMON_H
 #define HWMON_H
 
+#include <stdbool.h>
+
+int hwmon_load_paths(void);
 int hwmon_open(void);
 int hwmon_close(void);
-int hwmon_read_temp(void);
-int hwmon_read_pwm(void);
-int hwmon_write_pwm(unsigned long pwm);
+unsigned hwmon_card_index(unsigned card);
+int hwmon_set_firmware_control(unsigned card, bool enable);
+int hwmon_read_temp(unsigned card);
+int hwmon_read_pwm(unsigned card);
+int hwmon_read_temps(int *temps, unsigned ncards);
+int hwmon_read_pwms(unsigned const *cards, int *pwms, unsigned n);
+int hwmon_write_pwms(unsigned const *cards, unsigned long const *pwms, int *status, unsigned n);
 
 #endif /* HWMON_H */
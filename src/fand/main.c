@@ -1,14 +1,20 @@
 #include "config.h"
 #include "daemon.h"
+#include "filesystem.h"
 #include "macro.h"
 
 #include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
 
 #include <argp.h>
 
 char const *argp_program_version = "amdgpu-fand " STR_EXPAND(FAND_VERSION) ;
 char const *argp_program_bug_address = "<vilhelm.engstrom@tuta.io>";
 
+/* Alternative to --root */
+#define FAND_ROOT_ENV "AMDGPU_FAND_ROOT"
+
 static char doc[] = "amdgpu-fand -- A daemon controlling the fan speed of AMD Radeon GPUs";
 static char args_doc[] = "";
 
@@ -16,6 +22,7 @@ static struct argp_option options[] = {
     {"no-fork", 'F', 0,      0, "Do not fork into background", 0},
     {"verbose", 'v', 0,      0, "Enable all log priorities",   0},
     {"config",  'c', "FILE", 0, "Specify config path",         0},
+    {"root",    'r', "DIR",  0, "Access sysfs, debugfs and devices below DIR, e.g. a synthetic tree", 0},
     { 0 }
 };
 
@@ -23,6 +30,7 @@ struct args {
     bool fork;
     bool verbose;
     char const *config;
+    char const *root;
 };
 
 static error_t parse_opt(int key, char *arg, struct argp_state *state) {
@@ -38,6 +46,9 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
         case 'c':
             args->config = arg;
             break;
+        case 'r':
+            args->root = arg;
+            break;
         default:
             return ARGP_ERR_UNKNOWN;
     }
@@ -59,10 +70,17 @@ int main(int argc, char **argv) {
     struct args args = {
         .fork = true,
         .verbose = false,
-        .config = CONFIG_DEFAULT_PATH
+        .config = CONFIG_DEFAULT_PATH,
+        .root = getenv(FAND_ROOT_ENV)
     };
 
     argp_parse(&argp, argc, argv, 0, 0, &args);
 
+    /* Resolved before the daemon changes its working directory */
+    if(fsys_set_root(args.root)) {
+        fprintf(stderr, "Invalid root directory %s\n", args.root);
+        return 1;
+    }
+
     return daemon_main(args.fork, args.verbose, args.config);
 }
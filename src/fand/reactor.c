@@ -0,0 +1,117 @@
+#include "fandcfg.h"
+#include "macro.h"
+#include "reactor.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <syslog.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+enum { REACTOR_MAX_EVENTS = 16 };
+
+static int reactor_fd = -1;
+
+/* Events returned by the epoll_wait being dispatched, those from
+ * reactor_next on are yet to be handled */
+static struct epoll_event reactor_events[REACTOR_MAX_EVENTS];
+static int reactor_nready;
+static int reactor_next;
+
+static int reactor_ctl(int op, struct reactor_source *source, uint32_t events) {
+    struct epoll_event event = {
+        .events = events,
+        .data.ptr = source
+    };
+
+    if(epoll_ctl(reactor_fd, op, source->fd, &event) == -1) {
+        syslog(LOG_ERR, "Could not update epoll registration of fd %d: %s", source->fd, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+int reactor_init(void) {
+    reactor_fd = epoll_create1(EPOLL_CLOEXEC);
+    if(reactor_fd == -1) {
+        syslog(LOG_ERR, "Could not create epoll instance: %s", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+int reactor_close(void) {
+    if(reactor_fd == -1) {
+        return 0;
+    }
+
+    int status = close(reactor_fd);
+    if(status == -1) {
+        syslog(LOG_WARNING, "Could not close epoll instance: %s", strerror(errno));
+    }
+    reactor_fd = -1;
+
+    return status;
+}
+
+int reactor_add(struct reactor_source *source, uint32_t events) {
+    return reactor_ctl(EPOLL_CTL_ADD, source, events);
+}
+
+int reactor_modify(struct reactor_source *source, uint32_t events) {
+    return reactor_ctl(EPOLL_CTL_MOD, source, events);
+}
+
+int reactor_remove(struct reactor_source *source) {
+    /* Removed by a handler, e.g. when a client is dropped, the source
+     * may be freed or reused before its pending events come up */
+    for(int i = reactor_next; i < reactor_nready; i++) {
+        if(reactor_events[i].data.ptr == source) {
+            reactor_events[i].data.ptr = 0;
+        }
+    }
+
+    if(reactor_fd == -1 || source->fd == -1) {
+        return 0;
+    }
+
+    return reactor_ctl(EPOLL_CTL_DEL, source, 0);
+}
+
+int reactor_dispatch(int timeout) {
+    struct epoll_event const *event;
+    struct reactor_source *source;
+    int status = 0;
+    int rv;
+
+    int nready = epoll_wait(reactor_fd, reactor_events, array_size(reactor_events), timeout);
+    if(nready == -1) {
+        if(errno == EINTR) {
+            return 0;
+        }
+        syslog(LOG_ERR, "Error on epoll_wait: %s", strerror(errno));
+        return -1;
+    }
+
+    reactor_nready = nready;
+    for(reactor_next = 0; reactor_next < reactor_nready;) {
+        event = &reactor_events[reactor_next++];
+        source = event->data.ptr;
+        /* Removed by an earlier handler */
+        if(!source) {
+            continue;
+        }
+        rv = source->handler(source, event->events);
+        /* Fatal errors take precedence, positive statuses
+         * are passed on for the caller to act on */
+        if(rv == FAND_FATAL_ERR || (rv > 0 && status != FAND_FATAL_ERR)) {
+            status = rv;
+        }
+    }
+    reactor_nready = 0;
+
+    return status;
+}
@@ -0,0 +1,25 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <stdint.h>
+
+#include <sys/epoll.h>
+
+struct reactor_source;
+
+typedef int(*reactor_handler)(struct reactor_source *source, uint32_t events);
+
+struct reactor_source {
+    int fd;
+    reactor_handler handler;
+    void *data;
+};
+
+int reactor_init(void);
+int reactor_close(void);
+int reactor_add(struct reactor_source *source, uint32_t events);
+int reactor_modify(struct reactor_source *source, uint32_t events);
+int reactor_remove(struct reactor_source *source);
+int reactor_dispatch(int timeout);
+
+#endif /* REACTOR_H */
@@ -0,0 +1,249 @@
+#include "drm.h"
+#include "fandcfg.h"
+#include "gpu_metrics.h"
+#include "hwmon.h"
+#include "macro.h"
+#include "sensor.h"
+
+#include <limits.h>
+#include <stdlib.h>
+
+#include <syslog.h>
+#include <time.h>
+
+enum { NSEC_PER_SEC = 1000000000 };
+/* Timed reads of every card per backend during probing */
+enum { SENSOR_PROBE_READS = 8 };
+/* Largest accepted deviation from the reference, in millidegrees */
+enum { SENSOR_MAX_DEVIATION = 2000 };
+
+/* Attributes are opened and closed along with the pwm ones by hwmon */
+static int sensor_hwmon_open(unsigned card, unsigned card_idx) {
+    (void)card;
+    (void)card_idx;
+    return 0;
+}
+
+static int sensor_hwmon_close(void) {
+    return 0;
+}
+
+static struct sensor_backend const sensor_hwmon = {
+    .name = "hwmon",
+    .caps = SENSOR_CAP_EDGE_TEMP | SENSOR_CAP_BATCH | SENSOR_CAP_REFERENCE,
+    .open = sensor_hwmon_open,
+    .close = sensor_hwmon_close,
+    .read = hwmon_read_temp,
+    .read_all = hwmon_read_temps
+};
+
+static struct sensor_backend const sensor_gpu_metrics = {
+    .name = "gpu_metrics",
+    .caps = SENSOR_CAP_EDGE_TEMP,
+    .open = gpu_metrics_open,
+    .close = gpu_metrics_close,
+    .read = gpu_metrics_read_temp
+};
+
+#ifdef FAND_DRM_SUPPORT
+
+static struct sensor_backend const sensor_drm = {
+    .name = "drm",
+    .caps = SENSOR_CAP_EDGE_TEMP,
+    .open = drm_open,
+    .close = drm_close,
+    .read = drm_get_temp
+};
+
+#endif
+
+static struct sensor_backend const *const sensor_backends[] = {
+    #ifdef FAND_DRM_SUPPORT
+    &sensor_drm,
+    #endif
+    &sensor_gpu_metrics,
+    &sensor_hwmon
+};
+
+static struct sensor_backend const *sensor_active;
+
+static inline unsigned long long sensor_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * NSEC_PER_SEC + (unsigned long long)ts.tv_nsec;
+}
+
+static int sensor_open_backend(struct sensor_backend const *backend, unsigned const *card_indices, unsigned ncards) {
+    for(unsigned i = 0; i < ncards; i++) {
+        if(backend->open(i, card_indices[i]) < 0) {
+            backend->close();
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Reads every card using backend, fails if any read does */
+static int sensor_read_backend(struct sensor_backend const *backend, int *temps, unsigned ncards) {
+    int status = 0;
+
+    if(backend->read_all) {
+        backend->read_all(temps, ncards);
+    }
+    else {
+        for(unsigned i = 0; i < ncards; i++) {
+            temps[i] = backend->read(i);
+        }
+    }
+
+    for(unsigned i = 0; i < ncards; i++) {
+        status |= temps[i] < 0;
+    }
+
+    return -status;
+}
+
+/* Average cost of reading a single card, in ns */
+static int sensor_time_backend(struct sensor_backend const *backend, int *temps, unsigned ncards, unsigned long long *cost) {
+    unsigned long long start;
+
+    /* Untimed, may populate caches in the driver */
+    if(sensor_read_backend(backend, temps, ncards)) {
+        return -1;
+    }
+
+    start = sensor_now();
+    for(unsigned i = 0; i < SENSOR_PROBE_READS; i++) {
+        if(sensor_read_backend(backend, temps, ncards)) {
+            return -1;
+        }
+    }
+
+    *cost = (sensor_now() - start) / (SENSOR_PROBE_READS * ncards);
+    return 0;
+}
+
+static int sensor_agrees(int const *temps, int const *reference, unsigned ncards) {
+    for(unsigned i = 0; i < ncards; i++) {
+        if(abs(temps[i] - reference[i]) > SENSOR_MAX_DEVIATION) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Opens each of the backends, times a few reads of every card and
+ * keeps the cheapest one whose readings agree with the reference */
+int sensor_probe(struct sensor_backend const *const *backends, unsigned nbackends, unsigned const *card_indices, unsigned ncards) {
+    int reference[FAND_MAX_CARDS];
+    int temps[FAND_MAX_CARDS];
+    struct sensor_backend const *backend;
+    struct sensor_backend const *refbackend = 0;
+    struct sensor_backend const *best = 0;
+    unsigned long long best_cost = ULLONG_MAX;
+    unsigned long long cost;
+
+    sensor_close();
+
+    if(!ncards || ncards > FAND_MAX_CARDS) {
+        syslog(LOG_ERR, "Invalid number of cards %u", ncards);
+        return -1;
+    }
+
+    for(unsigned i = 0; i < nbackends && !refbackend; i++) {
+        backend = backends[i];
+        if(!(backend->caps & SENSOR_CAP_REFERENCE) || sensor_open_backend(backend, card_indices, ncards)) {
+            continue;
+        }
+        if(!sensor_read_backend(backend, reference, ncards)) {
+            refbackend = backend;
+        }
+        backend->close();
+    }
+
+    if(!refbackend) {
+        syslog(LOG_WARNING, "No reference temperature available, sensor backends are not validated");
+    }
+
+    for(unsigned i = 0; i < nbackends; i++) {
+        backend = backends[i];
+
+        if(sensor_open_backend(backend, card_indices, ncards)) {
+            syslog(LOG_INFO, "Sensor backend %s unavailable", backend->name);
+            continue;
+        }
+
+        if(sensor_time_backend(backend, temps, ncards, &cost)) {
+            syslog(LOG_INFO, "Sensor backend %s could not be read", backend->name);
+            backend->close();
+            continue;
+        }
+
+        if(refbackend && backend != refbackend && !sensor_agrees(temps, reference, ncards)) {
+            syslog(LOG_WARNING, "Sensor backend %s disagrees with %s, ignoring it", backend->name, refbackend->name);
+            backend->close();
+            continue;
+        }
+
+        syslog(LOG_INFO, "Sensor backend %s: %llu ns per read", backend->name, cost);
+
+        if(cost < best_cost) {
+            if(best) {
+                best->close();
+            }
+            best = backend;
+            best_cost = cost;
+        }
+        else {
+            backend->close();
+        }
+    }
+
+    if(!best) {
+        syslog(LOG_ERR, "No usable temperature sensor");
+        return -1;
+    }
+
+    sensor_active = best;
+    syslog(LOG_INFO, "Reading temperatures using %s", best->name);
+
+    return 0;
+}
+
+int sensor_init(unsigned const *card_indices, unsigned ncards) {
+    return sensor_probe(sensor_backends, array_size(sensor_backends), card_indices, ncards);
+}
+
+int sensor_close(void) {
+    int status = 0;
+
+    if(sensor_active) {
+        status = sensor_active->close();
+        sensor_active = 0;
+    }
+
+    return status;
+}
+
+char const *sensor_name(void) {
+    return sensor_active ? sensor_active->name : "none";
+}
+
+int sensor_read_temp(unsigned card) {
+    if(!sensor_active) {
+        return -1;
+    }
+    return sensor_active->read(card);
+}
+
+int sensor_read_temps(int *temps, unsigned ncards) {
+    if(!sensor_active) {
+        for(unsigned i = 0; i < ncards; i++) {
+            temps[i] = -1;
+        }
+        return -1;
+    }
+
+    sensor_read_backend(sensor_active, temps, ncards);
+    return 0;
+}
@@ -0,0 +1,32 @@
+#ifndef SENSOR_H
+#define SENSOR_H
+
+enum {
+    /* Reports the edge temperature, i.e. what temp1_input reports */
+    SENSOR_CAP_EDGE_TEMP = 0x1,
+    /* Reads every card with a single submission */
+    SENSOR_CAP_BATCH = 0x2,
+    /* Readings other backends are validated against */
+    SENSOR_CAP_REFERENCE = 0x4
+};
+
+/* Source of card temperatures, all temperatures are
+ * in millidegrees Celsius and negative on failure */
+struct sensor_backend {
+    char const *name;
+    unsigned caps;
+    int(*open)(unsigned card, unsigned card_idx);
+    int(*close)(void);
+    int(*read)(unsigned card);
+    /* Optional, reads the first ncards cards */
+    int(*read_all)(int *temps, unsigned ncards);
+};
+
+int sensor_init(unsigned const *card_indices, unsigned ncards);
+int sensor_probe(struct sensor_backend const *const *backends, unsigned nbackends, unsigned const *card_indices, unsigned ncards);
+int sensor_close(void);
+char const *sensor_name(void);
+int sensor_read_temp(unsigned card);
+int sensor_read_temps(int *temps, unsigned ncards);
+
+#endif /* SENSOR_H */
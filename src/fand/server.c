@@ -2,16 +2,16 @@
 #include "fandcfg.h"
 #include "ipc.h"
 #include "macro.h"
+#include "reactor.h"
 #include "serialize.h"
 #include "server.h"
 #include "strutils.h"
+#include "tick.h"
 
 #include <errno.h>
 #include <stdbool.h>
-#include <stdlib.h>
 #include <string.h>
 
-#include <poll.h>
 #include <syslog.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
@@ -19,9 +19,52 @@
 #include <sys/un.h>
 #include <unistd.h>
 
-enum { SRVBACKLOG = 8 };
-
-static struct pollfd pollfd;
+enum { SRVBACKLOG = 64 };
+enum { SERVER_MAX_CONNECTIONS = 32 };
+enum { SERVER_INPUT_SIZE = 256 };
+/* Room for the responses to a full input buffer of minimal frames */
+enum { SERVER_OUTPUT_SIZE = 2048 };
+
+enum server_conn_state {
+    server_conn_free,
+    /* Awaiting the first request */
+    server_conn_recv,
+    /* Persistent, reading framed requests */
+    server_conn_session,
+    /* Flushing the final response */
+    server_conn_closing,
+    /* Receiving a record per control tick, input is discarded */
+    server_conn_subscribed
+};
+
+/* Clients are served in-process, each open connection
+ * is a small state machine driven by the reactor. A legacy
+ * client sends a single request byte and the connection is
+ * closed once the response is flushed. A client opening with
+ * ipc_req_session keeps the connection, pipelining framed
+ * requests whose responses are sent in the same order. Either
+ * may subscribe, after which only records are sent */
+struct server_connection {
+    struct reactor_source source;
+    enum server_conn_state state;
+    uint32_t events;
+    int exitcode;
+    /* Peer has shut down its end */
+    bool eof;
+    /* Complete requests left unanswered for lack of output space */
+    bool backlog;
+    size_t inlen;
+    size_t outlen;
+    size_t nsent;
+    struct fand_config const *config;
+    unsigned char input[SERVER_INPUT_SIZE];
+    unsigned char buffer[SERVER_OUTPUT_SIZE];
+};
+
+static int server_sockfd = -1;
+static struct server_connection server_connections[SERVER_MAX_CONNECTIONS];
+
+static int server_handle_connection(struct reactor_source *source, uint32_t events);
 
 static int server_validate_request(int fd, ipc_request request) {
     struct ucred clientcreds;
@@ -53,14 +96,18 @@ static int server_validate_request(int fd, ipc_request request) {
     return 0;
 }
 
-static ssize_t server_pack_result(unsigned char *buffer, size_t bufsize, ipc_request request) {
+static ssize_t server_pack_result(unsigned char *buffer, size_t bufsize, ipc_request request, struct fand_config const *config) {
+    struct fanctrl_sample sample;
+    /* Speed and temperature are reported for the first card */
+    bool cached = fanctrl_get_sample(0, &sample, config->sample_max_age);
     int rspval;
+
     switch(request) {
         case ipc_req_speed:
-            rspval = fanctrl_get_speed();
+            rspval = cached ? sample.speed : fanctrl_get_speed(0);
             break;
         case ipc_req_temp:
-            rspval = fanctrl_get_temp();
+            rspval = cached ? sample.temp : fanctrl_get_temp(0);
             break;
         default:
             rspval = -1;
@@ -74,11 +121,43 @@ static ssize_t server_pack_result(unsigned char *buffer, size_t bufsize, ipc_req
                                       pack_temp(buffer, bufsize, rspval);
 }
 
+/* Every card is sampled at once, so the fields are consistent */
+static ssize_t server_pack_snapshot(unsigned char *buffer, size_t bufsize, struct fand_config const *config) {
+    struct fanctrl_sample samples[FAND_MAX_CARDS];
+    struct tick_stats ticks;
+    struct snapshot snapshot;
+    unsigned ncards = fanctrl_snapshot(samples, config->sample_max_age);
+
+    tick_get_stats(&ticks);
+
+    snapshot.ticks = ticks.ticks;
+    snapshot.missed = ticks.missed;
+    snapshot.late = ticks.late;
+    snapshot.max_lateness = ticks.max_lateness;
+    snapshot.ncards = (unsigned char)ncards;
+
+    for(unsigned i = 0; i < ncards; i++) {
+        snapshot.cards[i] = (struct snapshot_card){
+            .card_idx = (unsigned char)samples[i].card_idx,
+            .temp = (short)samples[i].temp,
+            .pwm = (short)samples[i].pwm,
+            .speed = (signed char)samples[i].speed,
+            .threshold = (signed char)samples[i].threshold,
+            .default_matrix = samples[i].default_matrix
+        };
+    }
+
+    snapshot.matrix[0] = config->matrix_rows;
+    memcpy(&snapshot.matrix[1], config->matrix, 2 * config->matrix_rows);
+
+    return pack_snapshot(buffer, bufsize, &snapshot);
+}
+
 int server_init(void) {
     union unsockaddr srvaddr;
     int status = 0;
 
-    int srvfd = socket(PF_UNIX, SOCK_STREAM, 0);
+    int srvfd = socket(PF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     if(srvfd == -1) {
         syslog(LOG_ERR, "Error while creating socket: %s", strerror(errno));
         return -1;
@@ -110,8 +189,18 @@ int server_init(void) {
         goto rmsock;
     }
 
-    pollfd.fd = srvfd;
-    pollfd.events = POLLIN;
+    server_sockfd = srvfd;
+
+    for(unsigned i = 0; i < array_size(server_connections); i++) {
+        server_connections[i] = (struct server_connection){
+            .source = {
+                .fd = -1,
+                .handler = server_handle_connection,
+                .data = &server_connections[i]
+            },
+            .state = server_conn_free
+        };
+    }
 
     syslog(LOG_INFO, "Opened socket: %s", DAEMON_SERVER_SOCKET);
 
@@ -124,9 +213,28 @@ closesock:
     return status;
 }
 
+static void server_close_connection(struct server_connection *conn) {
+    reactor_remove(&conn->source);
+    if(close(conn->source.fd) == -1) {
+        syslog(LOG_WARNING, "Error closing client connection: %s", strerror(errno));
+    }
+    conn->source.fd = -1;
+    conn->state = server_conn_free;
+}
+
 int server_kill(void) {
     int status = 0;
-    if(close(pollfd.fd) == -1) {
+    if(server_sockfd == -1) {
+        return status;
+    }
+
+    for(unsigned i = 0; i < array_size(server_connections); i++) {
+        if(server_connections[i].state != server_conn_free) {
+            server_close_connection(&server_connections[i]);
+        }
+    }
+
+    if(close(server_sockfd) == -1) {
         syslog(LOG_WARNING, "Error closing socket: %s", strerror(errno));
         status = -1;
     }
@@ -135,122 +243,349 @@ int server_kill(void) {
         syslog(LOG_WARNING, "Error unlinking socket: %s", strerror(errno));
         status = -1;
     }
+    server_sockfd = -1;
     return status;
 }
 
-int server_recv_and_respond(int fd, struct fand_config const *config) {
-    unsigned char buffer[IPC_MAX_MSG_LENGTH];
-    ipc_request request;
-    int status;
-    int exitcode = 0;
-    ssize_t rsplen;
-    ssize_t nsent;
-    ssize_t nbytes = recv(fd, &request, sizeof(request), 0);
-
-    switch(nbytes) {
-        case -1:
-            syslog(LOG_ERR, "Error on recv: %s", strerror(errno));
-            return 1;
-        case 0:
-            syslog(LOG_INFO, "Connection reset by peer");
-            return 1;
+int server_fd(void) {
+    return server_sockfd;
+}
+
+static ssize_t server_pack_response(struct server_connection *conn, ipc_request request) {
+    unsigned char *buffer = conn->buffer + conn->outlen;
+    size_t const bufsize = sizeof(conn->buffer) - conn->outlen;
+    struct tick_stats ticks;
+    int status = server_validate_request(conn->source.fd, request);
+
+    if(status) {
+        return pack_error(buffer, bufsize, status);
+    }
+
+    switch(request) {
+        case ipc_req_exit:
+            syslog(LOG_INFO, "Exit request received");
+            conn->exitcode = FAND_SERVER_EXIT;
+            return pack_exit_rsp(buffer, bufsize);
+        case ipc_req_speed:
+        case ipc_req_temp:
+            return server_pack_result(buffer, bufsize, request, conn->config);
+        case ipc_req_matrix:
+            return pack_matrix(buffer, bufsize, conn->config->matrix, conn->config->matrix_rows);
+        case ipc_req_ticks:
+            tick_get_stats(&ticks);
+            return pack_ticks(buffer, bufsize, ticks.ticks, ticks.missed, ticks.late, ticks.max_lateness);
+        case ipc_req_snapshot:
+            return server_pack_snapshot(buffer, bufsize, conn->config);
+        case ipc_req_subscribe:
+            conn->state = server_conn_subscribed;
+            return pack_subscribe_rsp(buffer, bufsize);
         default:
-            /* NOP */
+            syslog(LOG_WARNING, "Received invalid request %hhu, this should never happen!", request);
             break;
     }
 
-    status = server_validate_request(fd, request);
+    return pack_error(buffer, bufsize, EINVAL);
+}
 
-    if(status) {
-        rsplen = pack_error(buffer, sizeof(buffer), status);
-    }
-    else {
-        switch(request) {
-            case ipc_req_exit:
-                syslog(LOG_INFO, "Exit request received, signalling parent");
-                rsplen = pack_exit_rsp(buffer, sizeof(buffer));
-                exitcode = FAND_SERVER_EXIT;
+/* Reads as much as fits in the input buffer, returns -1 on error */
+static int server_recv_requests(struct server_connection *conn) {
+    ssize_t nbytes;
+
+    while(!conn->eof && conn->inlen < sizeof(conn->input)) {
+        nbytes = recv(conn->source.fd, conn->input + conn->inlen, sizeof(conn->input) - conn->inlen, MSG_DONTWAIT);
+        switch(nbytes) {
+            case -1:
+                if(errno == EINTR) {
+                    continue;
+                }
+                if(errno == EAGAIN) {
+                    return 0;
+                }
+                syslog(LOG_ERR, "Error on recv: %s", strerror(errno));
+                return -1;
+            case 0:
+                conn->eof = true;
                 break;
-            case ipc_req_speed:
-                rsplen = server_pack_result(buffer, sizeof(buffer), request);
+            default:
+                conn->inlen += nbytes;
                 break;
-            case ipc_req_temp:
-                rsplen = server_pack_result(buffer, sizeof(buffer), request);
+        }
+    }
+
+    return 0;
+}
+
+/* Packs the responses to the buffered requests, as many as
+ * there is room for. Returns -1 on error */
+static int server_process_requests(struct server_connection *conn) {
+    size_t offset = 0;
+    ssize_t framelen;
+    ssize_t rsplen;
+    ipc_request request;
+
+    conn->backlog = false;
+
+    while(conn->state != server_conn_closing && conn->state != server_conn_subscribed && offset < conn->inlen) {
+        if(sizeof(conn->buffer) - conn->outlen < IPC_MAX_MSG_LENGTH) {
+            conn->backlog = true;
+            break;
+        }
+
+        if(conn->state == server_conn_recv) {
+            request = conn->input[offset++];
+            if(request == ipc_req_session) {
+                rsplen = pack_session_rsp(conn->buffer + conn->outlen, sizeof(conn->buffer) - conn->outlen);
+                conn->state = server_conn_session;
+            }
+            else {
+                rsplen = server_pack_response(conn, request);
+                /* Legacy clients are served a single request */
+                if(conn->state == server_conn_recv) {
+                    conn->state = server_conn_closing;
+                }
+            }
+        }
+        else {
+            framelen = unpack_request(conn->input + offset, conn->inlen - offset, &request);
+            if(framelen < 0) {
+                /* Earlier requests are still answered */
+                syslog(LOG_INFO, "Received malformed request frame, dropping client");
+                conn->state = server_conn_closing;
                 break;
-            case ipc_req_matrix:
-                rsplen = pack_matrix(buffer, sizeof(buffer), config->matrix, config->matrix_rows);
+            }
+            if(!framelen) {
                 break;
-            default:
-                syslog(LOG_WARNING, "Received invalid request %hhu, this should never happen!", request);
-                rsplen = pack_error(buffer, sizeof(buffer), EINVAL);
+            }
+            offset += framelen;
+            rsplen = server_pack_response(conn, request);
+        }
+
+        if(rsplen < 0) {
+            syslog(LOG_ERR, "Error while packing response for %hhu", request);
+            return -1;
+        }
+
+        conn->outlen += rsplen;
+        if(conn->exitcode) {
+            conn->state = server_conn_closing;
+        }
+    }
+
+    memmove(conn->input, conn->input + offset, conn->inlen - offset);
+    conn->inlen -= offset;
+
+    /* Subscribers have nothing left to ask for */
+    if(conn->state == server_conn_subscribed) {
+        conn->inlen = 0;
+    }
+
+    return 0;
+}
+
+/* Returns 1 if parts of the output remain to be
+ * sent, 0 once it has been flushed and -1 on error */
+static int server_send_responses(struct server_connection *conn) {
+    ssize_t nsent;
+
+    while(conn->nsent < conn->outlen) {
+        nsent = send(conn->source.fd, conn->buffer + conn->nsent, conn->outlen - conn->nsent, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if(nsent == -1) {
+            if(errno == EINTR) {
+                continue;
+            }
+            if(errno == EAGAIN) {
                 break;
+            }
+            syslog(LOG_ERR, "Error on send: %s", strerror(errno));
+            return -1;
         }
+        conn->nsent += nsent;
     }
 
-    if(rsplen < 0) {
-        syslog(LOG_ERR, "Error while packing response for %hhu", request);
-        return exitcode | 1;
+    /* Make room for further responses */
+    memmove(conn->buffer, conn->buffer + conn->nsent, conn->outlen - conn->nsent);
+    conn->outlen -= conn->nsent;
+    conn->nsent = 0;
+
+    return conn->outlen ? 1 : 0;
+}
+
+static bool server_connection_done(struct server_connection const *conn) {
+    /* Records still pending for a subscriber are of no use */
+    if(conn->state == server_conn_subscribed) {
+        return conn->eof;
+    }
+    if(conn->outlen || conn->backlog) {
+        return false;
     }
+    /* Partial frames left at end of file are discarded */
+    return conn->state == server_conn_closing || conn->eof;
+}
 
-    nsent = send(fd, buffer, rsplen, 0);
+/* Reads while there is room for input and writes while there is output
+ * pending. Unanswered requests also wait for the socket to be writable,
+ * which guarantees another pass without starving other connections */
+static int server_update_events(struct server_connection *conn) {
+    uint32_t events = 0;
 
-    if(nsent == -1) {
-        syslog(LOG_ERR, "Error on send: %s", strerror(errno));
-        exitcode |= 1;
+    if(conn->state != server_conn_closing && !conn->eof && conn->inlen < sizeof(conn->input)) {
+        events |= EPOLLIN;
+    }
+    if(conn->outlen || conn->backlog) {
+        events |= EPOLLOUT;
     }
 
-    return exitcode;
+    if(events == conn->events) {
+        return 0;
+    }
+
+    conn->events = events;
+    return reactor_modify(&conn->source, events);
 }
 
+static int server_handle_connection(struct reactor_source *source, uint32_t events) {
+    struct server_connection *conn = source->data;
+    int exitcode;
+    int status;
 
-int server_poll(struct fand_config const *config) {
-    union unsockaddr clientaddr;
-    int newfd;
-    int status = 0;
+    (void)events;
 
-    int nready = poll(&pollfd, 1u, config->interval * 1000);
+    status = server_recv_requests(conn);
+    if(!status) {
+        status = server_process_requests(conn);
+    }
+    if(!status) {
+        status = server_send_responses(conn);
+    }
 
-    switch(nready) {
-        case -1:
-            if(errno == EINTR) {
-                /* SIGCHLD caught */
+    if(status >= 0 && !server_connection_done(conn)) {
+        if(server_update_events(conn)) {
+            server_close_connection(conn);
+        }
+        return 0;
+    }
+
+    exitcode = status < 0 ? 0 : conn->exitcode;
+    server_close_connection(conn);
+    return exitcode;
+}
+
+int server_accept(struct fand_config const *config) {
+    struct server_connection *conn;
+    unsigned slot = 0;
+    int newfd;
+
+    while(1) {
+        newfd = accept4(server_sockfd, 0, 0, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(newfd == -1) {
+            if(errno == EAGAIN || errno == EINTR) {
                 return 0;
             }
-            syslog(LOG_ERR, "Error on poll: %s", strerror(errno));
+            syslog(LOG_ERR, "Error while accepting client connection: %s", strerror(errno));
             return -1;
-        case 0:
-            return 0;
-        default:
-            /* NOP */
-            break;
-    }
+        }
 
-    newfd = accept(pollfd.fd, &clientaddr.addr, &(socklen_t){ sizeof(clientaddr) });
-    if(newfd == -1) {
-        syslog(LOG_ERR, "Error while accepting client connection: %s", strerror(errno));
-        return -1;
+        for(; slot < array_size(server_connections); slot++) {
+            if(server_connections[slot].state == server_conn_free) {
+                break;
+            }
+        }
+
+        if(slot == array_size(server_connections)) {
+            syslog(LOG_WARNING, "Connection limit reached, dropping client");
+            close(newfd);
+            continue;
+        }
+
+        conn = &server_connections[slot];
+        conn->source.fd = newfd;
+        conn->state = server_conn_recv;
+        conn->events = EPOLLIN;
+        conn->exitcode = 0;
+        conn->eof = false;
+        conn->backlog = false;
+        conn->inlen = 0;
+        conn->outlen = 0;
+        conn->nsent = 0;
+        conn->config = config;
+
+        if(reactor_add(&conn->source, EPOLLIN)) {
+            close(newfd);
+            conn->source.fd = -1;
+            conn->state = server_conn_free;
+        }
     }
+}
 
-#ifdef FAND_FUZZ_CONFIG
-    // Fuzz targets may not call exit
-    status = server_recv_and_respond(newfd, config);
-#else
-    int pid = fork();
-    if(pid == -1) {
-        syslog(LOG_ERR, "Unable to fork to respond to incoming connection: %s", strerror(errno));
-        return -1;
+/* Temperature, pwm and threshold of every card sampled by the last tick */
+static ssize_t server_pack_tick_record(unsigned char *buffer, size_t bufsize) {
+    struct fanctrl_sample samples[FAND_MAX_CARDS];
+    struct tick_stats ticks;
+    struct tick_record record;
+    unsigned long long latest = 0;
+    unsigned ncards = fanctrl_card_count();
+
+    ncards = ncards < FAND_MAX_CARDS ? ncards : FAND_MAX_CARDS;
+    for(unsigned i = 0; i < ncards; i++) {
+        if(!fanctrl_get_sample(i, &samples[i], 0)) {
+            samples[i].timestamp = 0;
+        }
+        latest = samples[i].timestamp > latest ? samples[i].timestamp : latest;
     }
 
-    if(!pid) {
-        /* Child process */
-        close(pollfd.fd);
-        status = server_recv_and_respond(newfd, config);
-        close(newfd);
-        exit(status);
+    tick_get_stats(&ticks);
+    record.tick = ticks.ticks;
+    record.ncards = (unsigned char)ncards;
+
+    /* Cards that failed keep the sample of an earlier tick, which is not reported */
+    for(unsigned i = 0; i < ncards; i++) {
+        if(!latest || samples[i].timestamp != latest) {
+            record.cards[i].temp = -1;
+            record.cards[i].pwm = -1;
+            record.cards[i].threshold = -1;
+            continue;
+        }
+        record.cards[i].temp = (short)samples[i].temp;
+        record.cards[i].pwm = (short)samples[i].pwm;
+        record.cards[i].threshold = (signed char)samples[i].threshold;
     }
-#endif
 
-    close(newfd);
+    return pack_tick_record(buffer, bufsize, &record);
+}
+
+/* Packs the record of the current tick once and appends it to the output
+ * of every subscriber. Writes never block, a subscriber whose output is
+ * still backed up is dropped rather than stalling the control loop */
+void server_publish_tick(void) {
+    unsigned char record[IPC_MAX_MSG_LENGTH];
+    struct server_connection *conn;
+    ssize_t len = -1;
+
+    for(unsigned i = 0; i < array_size(server_connections); i++) {
+        conn = &server_connections[i];
+        if(conn->state != server_conn_subscribed) {
+            continue;
+        }
 
-    return status;
+        if(len < 0) {
+            len = server_pack_tick_record(record, sizeof(record));
+            if(len < 0) {
+                syslog(LOG_ERR, "Error while packing tick record");
+                return;
+            }
+        }
+
+        if(sizeof(conn->buffer) - conn->outlen < (size_t)len) {
+            syslog(LOG_INFO, "Subscriber fell behind, dropping it");
+            server_close_connection(conn);
+            continue;
+        }
+
+        memcpy(conn->buffer + conn->outlen, record, (size_t)len);
+        conn->outlen += (size_t)len;
+
+        if(server_send_responses(conn) < 0 || server_update_events(conn)) {
+            server_close_connection(conn);
+        }
+    }
 }
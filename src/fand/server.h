@@ -7,7 +7,8 @@ enum { FAND_SERVER_EXIT = 0x3 };
 
 int server_init(void);
 int server_kill(void);
-int server_recv_and_respond(int fd, struct fand_config const *config);
-int server_poll(struct fand_config const *config);
+int server_fd(void);
+int server_accept(struct fand_config const *config);
+void server_publish_tick(void);
 
 #endif /* SERVER_H */
@@ -4,6 +4,7 @@
 #include <string.h>
 
 #include <syslog.h>
+#include <sys/signalfd.h>
 
 int sigutil_sethandler(int signal, int flags, sighandler handler) {
 
@@ -18,3 +19,17 @@ int sigutil_sethandler(int signal, int flags, sighandler handler) {
     }
     return 0;
 }
+
+int sigutil_signalfd(sigset_t const *mask) {
+    if(sigprocmask(SIG_BLOCK, mask, 0) == -1) {
+        syslog(LOG_ERR, "Failed to block signals: %s", strerror(errno));
+        return -1;
+    }
+
+    int fd = signalfd(-1, mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if(fd == -1) {
+        syslog(LOG_ERR, "Could not create signalfd: %s", strerror(errno));
+    }
+
+    return fd;
+}
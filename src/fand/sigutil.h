@@ -10,5 +10,6 @@
 typedef void (*sighandler)(int);
 
 int sigutil_sethandler(int signal, int flags, sighandler handler);
+int sigutil_signalfd(sigset_t const *mask);
 
 #endif /* SIGUTIL_H */
@@ -0,0 +1,154 @@
+#include "tick.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <syslog.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+enum { NSEC_PER_SEC = 1000000000 };
+enum { NSEC_PER_USEC = 1000 };
+
+/* An interval of 0 asks for continuous adjustment,
+ * cap it at 1 kHz rather than spinning */
+enum { TICK_MIN_PERIOD_NS = 1000000 };
+
+/* Ticks handled more than this long after their
+ * deadline are counted as late */
+enum { TICK_LATE_THRESHOLD_NS = 10000000 };
+
+static int tick_timerfd = -1;
+
+/* Deadlines are kept as absolute CLOCK_MONOTONIC
+ * nanoseconds. The kernel advances the deadline by
+ * exactly one period per expiration, so time spent
+ * handling a tick or serving clients never shifts
+ * the schedule */
+static uint64_t tick_base;
+static uint64_t tick_period;
+static uint64_t tick_expirations;
+
+static struct tick_stats tick_stats;
+
+static inline uint64_t tick_timespec_to_ns(struct timespec const *ts) {
+    return (uint64_t)ts->tv_sec * NSEC_PER_SEC + (uint64_t)ts->tv_nsec;
+}
+
+static inline void tick_ns_to_timespec(struct timespec *ts, uint64_t ns) {
+    ts->tv_sec = ns / NSEC_PER_SEC;
+    ts->tv_nsec = ns % NSEC_PER_SEC;
+}
+
+static inline int tick_now(uint64_t *ns) {
+    struct timespec ts;
+    if(clock_gettime(CLOCK_MONOTONIC, &ts) == -1) {
+        syslog(LOG_ERR, "Could not read monotonic clock: %s", strerror(errno));
+        return -1;
+    }
+    *ns = tick_timespec_to_ns(&ts);
+    return 0;
+}
+
+int tick_init(unsigned short interval) {
+    tick_timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if(tick_timerfd == -1) {
+        syslog(LOG_ERR, "Could not create timerfd: %s", strerror(errno));
+        return -1;
+    }
+
+    if(tick_set_interval(interval)) {
+        tick_close();
+        return -1;
+    }
+
+    return 0;
+}
+
+int tick_close(void) {
+    if(tick_timerfd == -1) {
+        return 0;
+    }
+
+    int status = close(tick_timerfd);
+    if(status == -1) {
+        syslog(LOG_WARNING, "Could not close timerfd: %s", strerror(errno));
+    }
+    tick_timerfd = -1;
+
+    return status;
+}
+
+int tick_fd(void) {
+    return tick_timerfd;
+}
+
+int tick_set_interval(unsigned short interval) {
+    uint64_t now;
+    if(tick_now(&now)) {
+        return -1;
+    }
+
+    tick_period = interval ? (uint64_t)interval * NSEC_PER_SEC : TICK_MIN_PERIOD_NS;
+    /* First deadline is now, i.e. the first tick fires immediately */
+    tick_base = now;
+    tick_expirations = 0;
+
+    struct itimerspec spec;
+    tick_ns_to_timespec(&spec.it_interval, tick_period);
+    tick_ns_to_timespec(&spec.it_value, tick_base);
+
+    if(timerfd_settime(tick_timerfd, TFD_TIMER_ABSTIME, &spec, 0) == -1) {
+        syslog(LOG_ERR, "Could not arm timerfd: %s", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+int tick_consume(void) {
+    uint64_t expirations;
+    uint64_t deadline;
+    uint64_t lateness;
+    uint64_t now;
+
+    if(read(tick_timerfd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+        if(errno == EAGAIN) {
+            return 0;
+        }
+        syslog(LOG_ERR, "Could not read timerfd: %s", strerror(errno));
+        return -1;
+    }
+
+    if(!expirations) {
+        return 0;
+    }
+
+    tick_expirations += expirations;
+    ++tick_stats.ticks;
+    tick_stats.missed += expirations - 1;
+
+    if(tick_now(&now)) {
+        return 1;
+    }
+
+    /* Most recent deadline that has passed */
+    deadline = tick_base + (tick_expirations - 1) * tick_period;
+    lateness = now > deadline ? now - deadline : 0;
+
+    if(lateness > TICK_LATE_THRESHOLD_NS) {
+        ++tick_stats.late;
+    }
+
+    if(lateness / NSEC_PER_USEC > tick_stats.max_lateness) {
+        tick_stats.max_lateness = lateness / NSEC_PER_USEC;
+    }
+
+    return 1;
+}
+
+void tick_get_stats(struct tick_stats *stats) {
+    *stats = tick_stats;
+}
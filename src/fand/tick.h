@@ -0,0 +1,22 @@
+#ifndef TICK_H
+#define TICK_H
+
+struct tick_stats {
+    /* Control ticks handled */
+    unsigned long long ticks;
+    /* Periods that elapsed without a tick being handled */
+    unsigned long long missed;
+    /* Ticks handled noticeably after their deadline */
+    unsigned long long late;
+    /* Largest observed distance to the deadline, in microseconds */
+    unsigned long long max_lateness;
+};
+
+int tick_init(unsigned short interval);
+int tick_close(void);
+int tick_fd(void);
+int tick_set_interval(unsigned short interval);
+int tick_consume(void);
+void tick_get_stats(struct tick_stats *stats);
+
+#endif /* TICK_H */
@@ -0,0 +1,277 @@
+#include "uring.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <linux/io_uring.h>
+#include <syslog.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Enough for reading or writing one attribute of
+ * every card in a single submission */
+enum { URING_ENTRIES = 32 };
+/* Interval with which the completion ring is polled if waiting fails */
+enum { URING_DRAIN_POLL_NSEC = 1000000 };
+
+/* Submission and completion rings shared with the kernel,
+ * accessed through raw syscalls to avoid depending on liburing */
+static int uring_fd = -1;
+
+static void *uring_sq_ring = MAP_FAILED;
+static void *uring_cq_ring = MAP_FAILED;
+static struct io_uring_sqe *uring_sqes = MAP_FAILED;
+static size_t uring_sq_ring_size;
+static size_t uring_cq_ring_size;
+static size_t uring_sqes_size;
+
+static unsigned *uring_sq_tail;
+static unsigned *uring_sq_mask;
+static unsigned *uring_sq_array;
+static unsigned uring_sq_entries;
+
+static unsigned *uring_cq_head;
+static unsigned *uring_cq_tail;
+static unsigned *uring_cq_mask;
+static struct io_uring_cqe *uring_cqes;
+
+static inline int uring_setup(unsigned entries, struct io_uring_params *params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static inline int uring_enter(unsigned to_submit, unsigned min_complete) {
+    return (int)syscall(__NR_io_uring_enter, uring_fd, to_submit, min_complete, IORING_ENTER_GETEVENTS, 0, 0);
+}
+
+static inline int uring_register(unsigned opcode, void *arg, unsigned nargs) {
+    return (int)syscall(__NR_io_uring_register, uring_fd, opcode, arg, nargs);
+}
+
+static int uring_map_rings(struct io_uring_params const *params) {
+    uring_sq_ring_size = params->sq_off.array + params->sq_entries * sizeof(unsigned);
+    uring_cq_ring_size = params->cq_off.cqes + params->cq_entries * sizeof(struct io_uring_cqe);
+
+    if(params->features & IORING_FEAT_SINGLE_MMAP) {
+        if(uring_cq_ring_size > uring_sq_ring_size) {
+            uring_sq_ring_size = uring_cq_ring_size;
+        }
+        uring_cq_ring_size = uring_sq_ring_size;
+    }
+
+    uring_sq_ring = mmap(0, uring_sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring_fd, IORING_OFF_SQ_RING);
+    if(uring_sq_ring == MAP_FAILED) {
+        syslog(LOG_ERR, "Could not map io_uring submission ring: %s", strerror(errno));
+        return -1;
+    }
+
+    if(params->features & IORING_FEAT_SINGLE_MMAP) {
+        uring_cq_ring = uring_sq_ring;
+    }
+    else {
+        uring_cq_ring = mmap(0, uring_cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring_fd, IORING_OFF_CQ_RING);
+        if(uring_cq_ring == MAP_FAILED) {
+            syslog(LOG_ERR, "Could not map io_uring completion ring: %s", strerror(errno));
+            return -1;
+        }
+    }
+
+    uring_sqes_size = params->sq_entries * sizeof(struct io_uring_sqe);
+    uring_sqes = mmap(0, uring_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring_fd, IORING_OFF_SQES);
+    if(uring_sqes == MAP_FAILED) {
+        syslog(LOG_ERR, "Could not map io_uring submission entries: %s", strerror(errno));
+        return -1;
+    }
+
+    uring_sq_tail = (unsigned *)((unsigned char *)uring_sq_ring + params->sq_off.tail);
+    uring_sq_mask = (unsigned *)((unsigned char *)uring_sq_ring + params->sq_off.ring_mask);
+    uring_sq_array = (unsigned *)((unsigned char *)uring_sq_ring + params->sq_off.array);
+    uring_sq_entries = params->sq_entries;
+
+    uring_cq_head = (unsigned *)((unsigned char *)uring_cq_ring + params->cq_off.head);
+    uring_cq_tail = (unsigned *)((unsigned char *)uring_cq_ring + params->cq_off.tail);
+    uring_cq_mask = (unsigned *)((unsigned char *)uring_cq_ring + params->cq_off.ring_mask);
+    uring_cqes = (struct io_uring_cqe *)((unsigned char *)uring_cq_ring + params->cq_off.cqes);
+
+    return 0;
+}
+
+/* Plain reads and writes were added in 5.6, older kernels
+ * set up rings but fail every submission */
+static int uring_probe_ops(void) {
+    size_t size = sizeof(struct io_uring_probe) + IORING_OP_LAST * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, size);
+    int status = -1;
+
+    if(!probe) {
+        syslog(LOG_ERR, "Could not allocate io_uring probe");
+        return -1;
+    }
+
+    if(uring_register(IORING_REGISTER_PROBE, probe, IORING_OP_LAST) == -1) {
+        syslog(LOG_INFO, "Could not probe io_uring operations: %s", strerror(errno));
+        goto cleanup;
+    }
+
+    if(probe->last_op < IORING_OP_WRITE ||
+       !(probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED) ||
+       !(probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED)) {
+        syslog(LOG_INFO, "Kernel io_uring lacks plain read and write");
+        goto cleanup;
+    }
+
+    status = 0;
+
+cleanup:
+    free(probe);
+    return status;
+}
+
+int uring_init(void) {
+    struct io_uring_params params;
+
+    if(uring_fd != -1) {
+        return 0;
+    }
+
+    memset(&params, 0, sizeof(params));
+    uring_fd = uring_setup(URING_ENTRIES, &params);
+    if(uring_fd == -1) {
+        /* Missing or disabled, e.g. by sysctl or seccomp */
+        syslog(LOG_INFO, "io_uring unavailable, using synchronous I/O: %s", strerror(errno));
+        return -1;
+    }
+
+    if(uring_map_rings(&params) || uring_probe_ops()) {
+        uring_close();
+        return -1;
+    }
+
+    return 0;
+}
+
+int uring_close(void) {
+    int status = 0;
+
+    if(uring_sqes != MAP_FAILED) {
+        munmap(uring_sqes, uring_sqes_size);
+        uring_sqes = MAP_FAILED;
+    }
+
+    if(uring_cq_ring != MAP_FAILED && uring_cq_ring != uring_sq_ring) {
+        munmap(uring_cq_ring, uring_cq_ring_size);
+    }
+    uring_cq_ring = MAP_FAILED;
+
+    if(uring_sq_ring != MAP_FAILED) {
+        munmap(uring_sq_ring, uring_sq_ring_size);
+        uring_sq_ring = MAP_FAILED;
+    }
+
+    if(uring_fd != -1) {
+        status = close(uring_fd);
+        if(status == -1) {
+            syslog(LOG_WARNING, "Could not close io_uring instance: %s", strerror(errno));
+        }
+        uring_fd = -1;
+    }
+
+    return status;
+}
+
+bool uring_available(void) {
+    return uring_fd != -1;
+}
+
+static void uring_prep(struct io_uring_sqe *sqe, struct uring_op const *op, unsigned user_data) {
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = op->opcode == URING_READ ? IORING_OP_READ : IORING_OP_WRITE;
+    sqe->fd = op->fd;
+    sqe->addr = (uint64_t)(uintptr_t)op->buffer;
+    sqe->len = op->len;
+    sqe->off = 0;
+    sqe->user_data = user_data;
+}
+
+/* Moves all available completions to ops, returns the number reaped */
+static unsigned uring_reap(struct uring_op *ops) {
+    unsigned head = *uring_cq_head;
+    unsigned tail = __atomic_load_n(uring_cq_tail, __ATOMIC_ACQUIRE);
+    unsigned nreaped = 0;
+    struct io_uring_cqe const *cqe;
+
+    for(; head != tail; head++, nreaped++) {
+        cqe = &uring_cqes[head & *uring_cq_mask];
+        ops[cqe->user_data].result = cqe->res;
+        ops[cqe->user_data].completed = true;
+    }
+
+    __atomic_store_n(uring_cq_head, head, __ATOMIC_RELEASE);
+    return nreaped;
+}
+
+/* Waits for the ops handed to the kernel to complete, so that none of
+ * them touches its buffer once the caller has moved on. Closing the
+ * ring does not cancel reads queued on io-wq workers. Completions are
+ * posted even if waiting for them fails, the ring is polled then */
+static void uring_drain(struct uring_op *ops, unsigned inflight) {
+    while(inflight) {
+        inflight -= uring_reap(ops);
+        if(inflight && uring_enter(0, inflight) == -1 && errno != EINTR) {
+            nanosleep(&(struct timespec){ .tv_nsec = URING_DRAIN_POLL_NSEC }, 0);
+        }
+    }
+}
+
+/* Submits ops in as few syscalls as the ring allows and waits for
+ * all of them to complete. On failure the ring is torn down once
+ * nothing is in flight, and the caller is expected to fall back to
+ * synchronous I/O for the ops not marked completed */
+int uring_submit(struct uring_op *ops, unsigned nops) {
+    unsigned batch;
+    unsigned tail;
+    unsigned idx;
+    unsigned pending;
+    unsigned completed;
+    int rv;
+
+    for(unsigned i = 0; i < nops; i++) {
+        ops[i].completed = false;
+    }
+
+    if(uring_fd == -1) {
+        return -1;
+    }
+
+    for(unsigned done = 0; done < nops; done += batch) {
+        batch = nops - done < uring_sq_entries ? nops - done : uring_sq_entries;
+        tail = *uring_sq_tail;
+
+        for(unsigned i = 0; i < batch; i++) {
+            idx = (tail + i) & *uring_sq_mask;
+            uring_prep(&uring_sqes[idx], &ops[done + i], i);
+            uring_sq_array[idx] = idx;
+        }
+
+        __atomic_store_n(uring_sq_tail, tail + batch, __ATOMIC_RELEASE);
+
+        for(pending = batch, completed = 0; completed < batch; completed += uring_reap(ops + done)) {
+            rv = uring_enter(pending, batch - completed);
+            if(rv == -1) {
+                if(errno == EINTR) {
+                    continue;
+                }
+                syslog(LOG_ERR, "Could not submit io_uring batch, falling back to synchronous I/O: %s", strerror(errno));
+                uring_drain(ops + done, batch - pending - completed);
+                uring_close();
+                return -1;
+            }
+            pending -= (unsigned)rv;
+        }
+    }
+
+    return 0;
+}
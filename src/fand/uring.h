@@ -0,0 +1,26 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stdbool.h>
+
+enum uring_opcode {
+    URING_READ,
+    URING_WRITE
+};
+
+struct uring_op {
+    enum uring_opcode opcode;
+    int fd;
+    void *buffer;
+    unsigned len;
+    /* Bytes transferred or negative errno, set on completion */
+    int result;
+    bool completed;
+};
+
+int uring_init(void);
+int uring_close(void);
+bool uring_available(void);
+int uring_submit(struct uring_op *ops, unsigned nops);
+
+#endif /* URING_H */
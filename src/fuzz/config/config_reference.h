@@ -0,0 +1,8 @@
+#ifndef CONFIG_REFERENCE_H
+#define CONFIG_REFERENCE_H
+
+#include "config.h"
+
+int config_parse_reference(char const *path, struct fand_config *data);
+
+#endif /* CONFIG_REFERENCE_H */
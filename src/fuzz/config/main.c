@@ -1,8 +1,11 @@
 #include "config.h"
+#include "config_reference.h"
 
 #include <errno.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <fcntl.h>
@@ -11,35 +14,148 @@
 #include <unistd.h>
 
 #define FAND_CONFIG "/tmp/_fand.conf"
+#define FAND_REFERENCE_CONFIG "/tmp/_fand_reference.conf"
 
-int LLVMFuzzerTestOneInput(uint8_t const *data, size_t size) {
-    if(!size) {
-        return 0;
+/* Line length at which the reference, reading with fgets, splits lines */
+enum { REFERENCE_LINE_SIZE = 255 };
+
+/* The reference does not strip comments within matrices, it is handed
+ * the input without them */
+static size_t strip_comments(uint8_t *dst, uint8_t const *src, size_t size) {
+    size_t len = 0;
+    bool comment = false;
+
+    for(size_t i = 0; i < size; i++) {
+        comment = src[i] != '\n' && (comment || src[i] == '#');
+        if(!comment) {
+            dst[len++] = src[i];
+        }
     }
 
-    int fd = open(FAND_CONFIG, O_CREAT | O_WRONLY, S_IWUSR | S_IRUSR);
+    return len;
+}
+
+static int write_config(char const *path, uint8_t const *data, size_t size) {
+    int status = 0;
+
+    int fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, S_IWUSR | S_IRUSR);
     if(fd == -1) {
         perror("open");
-        return 0;
+        return -1;
     }
 
     if(write(fd, data, size) == -1) {
         perror("write");
+        status = -1;
+    }
+
+    if(close(fd) == -1) {
+        perror("close");
+    }
+
+    return status;
+}
+
+static bool matrix_equal(unsigned char const *lhs, unsigned char const *rhs, unsigned rows) {
+    return memcmp(lhs, rhs, 2 * rows) == 0;
+}
+
+static bool config_equal(struct fand_config const *lhs, struct fand_config const *rhs) {
+    if(lhs->throttle != rhs->throttle ||
+       lhs->matrix_rows != rhs->matrix_rows ||
+       lhs->hysteresis != rhs->hysteresis ||
+       lhs->interval != rhs->interval ||
+       lhs->sample_max_age != rhs->sample_max_age ||
+       lhs->fan_curve_offload != rhs->fan_curve_offload ||
+       lhs->ncard_matrices != rhs->ncard_matrices ||
+       !matrix_equal(lhs->matrix, rhs->matrix, lhs->matrix_rows)) {
+        return false;
+    }
+
+    for(unsigned i = 0; i < lhs->ncard_matrices; i++) {
+        if(lhs->card_matrices[i].card_idx != rhs->card_matrices[i].card_idx ||
+           lhs->card_matrices[i].rows != rhs->card_matrices[i].rows ||
+           !matrix_equal(lhs->card_matrices[i].matrix, rhs->card_matrices[i].matrix, lhs->card_matrices[i].rows)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool matrix_repeats_row(unsigned char const *matrix, unsigned rows) {
+    for(unsigned i = 1; i < rows; i++) {
+        if(matrix_equal(&matrix[2 * (i - 1)], &matrix[2 * i], 1)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* The reference stops at NUL bytes, splits long lines and repeats the row
+ * following any line in a matrix it cannot match, e.g. an empty one. The
+ * results of such inputs are not compared */
+static bool config_comparable(uint8_t const *data, size_t size, struct fand_config const *reference) {
+    uint8_t const *eol;
+
+    if(memchr(data, '\0', size)) {
+        return false;
+    }
+
+    for(; size; size -= (size_t)(eol - data) + 1, data = eol + 1) {
+        eol = memchr(data, '\n', size);
+        if(!eol) {
+            eol = data + size - 1;
+        }
+        if(eol - data >= REFERENCE_LINE_SIZE) {
+            return false;
+        }
+    }
+
+    if(matrix_repeats_row(reference->matrix, reference->matrix_rows)) {
+        return false;
+    }
+    for(unsigned i = 0; i < reference->ncard_matrices; i++) {
+        if(matrix_repeats_row(reference->card_matrices[i].matrix, reference->card_matrices[i].rows)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int LLVMFuzzerTestOneInput(uint8_t const *data, size_t size) {
+    struct fand_config reference = { 0 };
+    struct fand_config config = { 0 };
+    static uint8_t stripped[CONFIG_MAX_SIZE];
+    size_t stripped_size;
+    int reference_status;
+    int status;
+
+    if(!size || size > CONFIG_MAX_SIZE) {
+        return 0;
+    }
+
+    stripped_size = strip_comments(stripped, data, size);
+    if(write_config(FAND_CONFIG, data, size) || write_config(FAND_REFERENCE_CONFIG, stripped, stripped_size)) {
         goto cleanup;
     }
 
     setlogmask(0);
     openlog(0, 0, LOG_DAEMON);
-    config_parse(FAND_CONFIG, &(struct fand_config){ 0 });
+    reference_status = config_parse_reference(FAND_REFERENCE_CONFIG, &reference);
+    status = config_parse(FAND_CONFIG, &config);
     closelog();
 
-cleanup:
-    if(close(fd) == -1) {
-        perror("close");
-    }
-    if(unlink(FAND_CONFIG) == -1) {
-        perror("unlink");
+    /* Configs accepted by both parsers must be identical */
+    if(!reference_status && !status && config_comparable(data, size, &reference) && !config_equal(&reference, &config)) {
+        fputs("Parsed config differs from the reference\n", stderr);
+        abort();
     }
 
+cleanup:
+    unlink(FAND_CONFIG);
+    unlink(FAND_REFERENCE_CONFIG);
+
     return 0;
 }
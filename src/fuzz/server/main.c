@@ -2,6 +2,7 @@
 #include "fanctrl_mock.h"
 #include "ipc.h"
 #include "mock.h"
+#include "reactor.h"
 #include "server.h"
 #include "strutils.h"
 
@@ -23,11 +24,13 @@
 
 static int clientfd;
 
-static int get_temp(void) {
+static int get_temp(unsigned card) {
+    (void)card;
     return -1;
 }
 
-static int get_speed(void) {
+static int get_speed(unsigned card) {
+    (void)card;
     return -1;
 }
 
@@ -103,8 +106,14 @@ int LLVMFuzzerTestOneInput(uint8_t const *data, size_t size) {
     }
 
 
+    if(reactor_init()) {
+        fputs("Error creating reactor\n", stderr);
+        return 0;
+    }
+
     if(server_init()) {
         fputs("Error starting server\n", stderr);
+        reactor_close();
         return 0;
     }
 
@@ -119,7 +128,8 @@ int LLVMFuzzerTestOneInput(uint8_t const *data, size_t size) {
     mock_guard {
         mock_fanctrl_get_temp(get_temp);
         mock_fanctrl_get_speed(get_speed);
-        server_poll(&config);
+        server_accept(&config);
+        reactor_dispatch(0);
     }
 
 cleanup:
@@ -128,6 +138,7 @@ cleanup:
     if(server_kill()) {
         fputs("Error stopping server\n", stderr);
     }
+    reactor_close();
     closelog();
 
     return 0;
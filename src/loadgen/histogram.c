@@ -0,0 +1,109 @@
+#include "histogram.h"
+
+#include <string.h>
+
+static inline unsigned histogram_msb(uint64_t value) {
+    unsigned msb = 0;
+    while(value >>= 1) {
+        ++msb;
+    }
+    return msb;
+}
+
+void histogram_init(struct histogram *hist) {
+    memset(hist, 0, sizeof(*hist));
+    hist->min = UINT64_MAX;
+}
+
+/* Values in [2^k, 2^(k+1)) share a shift, each shift adding
+ * HISTOGRAM_SUB_COUNT / 2 buckets */
+unsigned histogram_index(uint64_t value) {
+    unsigned shift;
+
+    if(value >= (uint64_t)1 << HISTOGRAM_MAX_BITS) {
+        value = ((uint64_t)1 << HISTOGRAM_MAX_BITS) - 1;
+    }
+
+    if(value < HISTOGRAM_SUB_COUNT) {
+        return (unsigned)value;
+    }
+
+    shift = histogram_msb(value) - HISTOGRAM_SUB_BITS + 1;
+    return shift * (HISTOGRAM_SUB_COUNT / 2) + (unsigned)(value >> shift);
+}
+
+uint64_t histogram_lowest_equivalent(unsigned index) {
+    unsigned shift;
+
+    if(index < HISTOGRAM_SUB_COUNT) {
+        return index;
+    }
+
+    shift = index / (HISTOGRAM_SUB_COUNT / 2) - 1;
+    return (uint64_t)(index - shift * (HISTOGRAM_SUB_COUNT / 2)) << shift;
+}
+
+uint64_t histogram_highest_equivalent(unsigned index) {
+    unsigned shift = index < HISTOGRAM_SUB_COUNT ? 0 : index / (HISTOGRAM_SUB_COUNT / 2) - 1;
+    return histogram_lowest_equivalent(index) + ((uint64_t)1 << shift) - 1;
+}
+
+void histogram_record(struct histogram *hist, uint64_t value) {
+    ++hist->counts[histogram_index(value)];
+    ++hist->total;
+    hist->sum += (double)value;
+
+    if(value < hist->min) {
+        hist->min = value;
+    }
+    if(value > hist->max) {
+        hist->max = value;
+    }
+}
+
+void histogram_merge(struct histogram *dst, struct histogram const *src) {
+    for(unsigned i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        dst->counts[i] += src->counts[i];
+    }
+
+    dst->total += src->total;
+    dst->sum += src->sum;
+    if(src->min < dst->min) {
+        dst->min = src->min;
+    }
+    if(src->max > dst->max) {
+        dst->max = src->max;
+    }
+}
+
+/* Highest value equivalent to the one at percentile, 0 if empty */
+uint64_t histogram_percentile(struct histogram const *hist, double percentile) {
+    uint64_t target;
+    uint64_t count = 0;
+
+    if(!hist->total) {
+        return 0;
+    }
+
+    if(percentile >= 100.0) {
+        return hist->max;
+    }
+
+    target = (uint64_t)(percentile / 100.0 * (double)hist->total + 0.5);
+    target = target ? target : 1;
+
+    for(unsigned i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        count += hist->counts[i];
+        if(count >= target) {
+            /* The true value is never larger than the largest recorded */
+            uint64_t value = histogram_highest_equivalent(i);
+            return value < hist->max ? value : hist->max;
+        }
+    }
+
+    return hist->max;
+}
+
+double histogram_mean(struct histogram const *hist) {
+    return hist->total ? hist->sum / (double)hist->total : 0.0;
+}
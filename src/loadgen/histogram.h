@@ -0,0 +1,34 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+/* Log-linear histogram in the style of HdrHistogram. Values below
+ * 2^HISTOGRAM_SUB_BITS are recorded exactly, larger ones in buckets
+ * whose width is at most 1 / 2^(HISTOGRAM_SUB_BITS - 1) of their
+ * value, i.e. with a relative error below 1.6% */
+enum { HISTOGRAM_SUB_BITS = 7 };
+enum { HISTOGRAM_SUB_COUNT = 1 << HISTOGRAM_SUB_BITS };
+/* Largest recordable value is 2^HISTOGRAM_MAX_BITS - 1, larger ones are clamped */
+enum { HISTOGRAM_MAX_BITS = 40 };
+enum { HISTOGRAM_BUCKETS = (HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 2) * (HISTOGRAM_SUB_COUNT / 2) };
+
+struct histogram {
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+    /* Sum of recorded values, for the mean */
+    double sum;
+};
+
+void histogram_init(struct histogram *hist);
+void histogram_record(struct histogram *hist, uint64_t value);
+void histogram_merge(struct histogram *dst, struct histogram const *src);
+uint64_t histogram_percentile(struct histogram const *hist, double percentile);
+double histogram_mean(struct histogram const *hist);
+unsigned histogram_index(uint64_t value);
+uint64_t histogram_lowest_equivalent(unsigned index);
+uint64_t histogram_highest_equivalent(unsigned index);
+
+#endif /* HISTOGRAM_H */
@@ -0,0 +1,537 @@
+#include "fandcfg.h"
+#include "ipc.h"
+#include "loadgen.h"
+#include "macro.h"
+#include "serialize.h"
+#include "strutils.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+enum { NSEC_PER_SEC = 1000000000 };
+enum { NSEC_PER_MSEC = 1000000 };
+/* Time given to requests in flight once the run is over */
+enum { LOADGEN_DRAIN_MSEC = 1000 };
+enum { LOADGEN_MAX_EVENTS = 64 };
+
+/* A slot issuing requests. Without pipelining, each request is sent on
+ * a connection of its own. Otherwise the slot holds a session on which
+ * up to depth requests are in flight, answered in the order they were sent */
+struct loadgen_conn {
+    int fd;
+    /* Requests in flight, oldest first */
+    unsigned head;
+    unsigned ninflight;
+    unsigned requests[LOADGEN_MAX_DEPTH];
+    /* CLOCK_MONOTONIC time each request was scheduled for */
+    uint64_t scheduled[LOADGEN_MAX_DEPTH];
+    size_t nrecv;
+    unsigned char buffer[LOADGEN_MAX_DEPTH * IPC_MAX_MSG_LENGTH];
+};
+
+static inline uint64_t loadgen_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NSEC_PER_SEC + (uint64_t)ts.tv_nsec;
+}
+
+/* Parses a comma-separated list of request[=weight], e.g. "speed=4,temp=4,matrix" */
+int loadgen_parse_mix(char const *text, struct loadgen_mix *mix) {
+    char name[32];
+    char const *end;
+    char *numend;
+    size_t len;
+    unsigned long weight;
+    ipc_request request;
+
+    memset(mix, 0, sizeof(*mix));
+
+    while(*text) {
+        end = strchr(text, ',');
+        end = end ? end : text + strlen(text);
+
+        len = strcspn(text, "=,");
+        if(!len || len >= sizeof(name)) {
+            fprintf(stderr, "Invalid request in mix at '%s'\n", text);
+            return -1;
+        }
+        memcpy(name, text, len);
+        name[len] = '\0';
+
+        weight = 1;
+        if(text[len] == '=') {
+            errno = 0;
+            weight = strtoul(text + len + 1, &numend, 10);
+            if(errno || numend == text + len + 1 || numend != end || !weight || weight > 1000) {
+                fprintf(stderr, "Invalid weight for %s\n", name);
+                return -1;
+            }
+        }
+
+        request = ipc_req_inval;
+        for(unsigned i = 0; i < array_size(ipc_request_map); i++) {
+            if(strcmp(name, ipc_request_map[i].name) == 0) {
+                request = ipc_request_map[i].code;
+                break;
+            }
+        }
+
+        if(request == ipc_req_inval || request < ipc_req_unprivileged) {
+            fprintf(stderr, "Invalid request %s\n", name);
+            return -1;
+        }
+
+        if(mix->nrequests >= LOADGEN_MAX_REQUESTS) {
+            fprintf(stderr, "Mix may contain at most %u requests\n", LOADGEN_MAX_REQUESTS);
+            return -1;
+        }
+
+        mix->requests[mix->nrequests] = request;
+        mix->weights[mix->nrequests++] = (unsigned)weight;
+        mix->total_weight += (unsigned)weight;
+
+        text = *end ? end + 1 : end;
+    }
+
+    if(!mix->nrequests) {
+        fputs("Empty request mix\n", stderr);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Deterministic, so runs with the same parameters issue the same sequence */
+static unsigned loadgen_pick(struct loadgen_mix const *mix, uint32_t *state) {
+    unsigned value;
+
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+
+    value = *state % mix->total_weight;
+    for(unsigned i = 0; i < mix->nrequests; i++) {
+        if(value < mix->weights[i]) {
+            return i;
+        }
+        value -= mix->weights[i];
+    }
+
+    return 0;
+}
+
+static int loadgen_connect(int flags) {
+    union unsockaddr srvaddr;
+    int fd = socket(PF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | flags, 0);
+    if(fd == -1) {
+        return -1;
+    }
+
+    memset(&srvaddr, 0, sizeof(srvaddr));
+    srvaddr.addr_un.sun_family = AF_UNIX;
+    strscpy(srvaddr.addr_un.sun_path, DAEMON_SERVER_SOCKET, sizeof(srvaddr.addr_un.sun_path));
+
+    if(connect(fd, &srvaddr.addr, sizeof(srvaddr)) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/* Tick statistics of the daemon, queried over a separate connection */
+int loadgen_query_ticks(struct loadgen_ticks *ticks) {
+    unsigned char buffer[IPC_MAX_MSG_LENGTH];
+    ipc_request request = ipc_req_ticks;
+    union unpack_result result;
+    ssize_t nrecv;
+
+    int fd = loadgen_connect(0);
+    if(fd == -1) {
+        perror("Could not connect to server");
+        return -1;
+    }
+
+    if(send(fd, &request, sizeof(request), MSG_NOSIGNAL) != sizeof(request)) {
+        perror("Failed to send request");
+        close(fd);
+        return -1;
+    }
+
+    nrecv = recv(fd, buffer, sizeof(buffer), 0);
+    close(fd);
+
+    if(nrecv <= 0 || unpack_ticks(buffer, (size_t)nrecv, &result) != ipc_rsp_ok) {
+        fputs("Could not query tick statistics\n", stderr);
+        return -1;
+    }
+
+    *ticks = (struct loadgen_ticks){
+        .ticks = result.ticks.total,
+        .missed = result.ticks.missed,
+        .late = result.ticks.late,
+        .max_lateness = result.ticks.max_lateness
+    };
+
+    return 0;
+}
+
+/* Opens a session, the connection is kept across requests */
+static int loadgen_open_session(void) {
+    unsigned char buffer[IPC_MAX_MSG_LENGTH];
+    ipc_request request = ipc_req_session;
+    union unpack_result result;
+    ssize_t nrecv;
+
+    int fd = loadgen_connect(0);
+    if(fd == -1) {
+        perror("Could not connect to server");
+        return -1;
+    }
+
+    if(send(fd, &request, sizeof(request), MSG_NOSIGNAL) != sizeof(request)) {
+        perror("Failed to send request");
+        close(fd);
+        return -1;
+    }
+
+    nrecv = recv(fd, buffer, sizeof(buffer), 0);
+    if(nrecv <= 0 || unpack_session_rsp(buffer, (size_t)nrecv, &result) != ipc_rsp_ok) {
+        fputs("Could not open session, the daemon may predate them\n", stderr);
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static void loadgen_close(int epfd, struct loadgen_conn *conn) {
+    epoll_ctl(epfd, EPOLL_CTL_DEL, conn->fd, 0);
+    close(conn->fd);
+    conn->fd = -1;
+    conn->nrecv = 0;
+}
+
+/* Closes the connection, failing the requests in flight on it.
+ * Returns the number of requests failed */
+static unsigned loadgen_fail(int epfd, struct loadgen_conn *conn, struct loadgen_result *result) {
+    unsigned const nfailed = conn->ninflight;
+
+    result->failed += nfailed;
+    conn->ninflight = 0;
+    loadgen_close(epfd, conn);
+
+    return nfailed;
+}
+
+/* Sends the request, connecting first unless on a session. The
+ * response is awaited through epoll */
+static int loadgen_issue(int epfd, struct loadgen_conn *conn, bool session, ipc_request request) {
+    unsigned char frame[IPC_MAX_FRAME_LENGTH];
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = conn };
+    ssize_t framelen;
+
+    if(session) {
+        framelen = pack_request(frame, sizeof(frame), request);
+        return framelen > 0 && send(conn->fd, frame, (size_t)framelen, MSG_NOSIGNAL | MSG_DONTWAIT) == framelen ? 0 : -1;
+    }
+
+    conn->fd = loadgen_connect(SOCK_NONBLOCK);
+    if(conn->fd == -1) {
+        return -1;
+    }
+
+    if(send(conn->fd, &request, sizeof(request), MSG_NOSIGNAL) != sizeof(request) ||
+       epoll_ctl(epfd, EPOLL_CTL_ADD, conn->fd, &event) == -1) {
+        close(conn->fd);
+        conn->fd = -1;
+        return -1;
+    }
+
+    return 0;
+}
+
+static ssize_t loadgen_unpack(ipc_request request, unsigned char const *buffer, size_t bufsize) {
+    union unpack_result result;
+
+    switch(request) {
+        case ipc_req_speed:
+            return unpack_speed(buffer, bufsize, &result);
+        case ipc_req_temp:
+            return unpack_temp(buffer, bufsize, &result);
+        case ipc_req_matrix:
+            return unpack_matrix(buffer, bufsize, &result);
+        case ipc_req_ticks:
+            return unpack_ticks(buffer, bufsize, &result);
+        default:
+            return -1;
+    }
+}
+
+/* Reads the responses received so far, recording each complete one.
+ * Returns the number of requests no longer in flight */
+static unsigned loadgen_receive(int epfd, struct loadgen_conn *conn, struct loadgen_params const *params, struct loadgen_result *result) {
+    unsigned nfinished = 0;
+    size_t offset = 0;
+    size_t len;
+    ssize_t nbytes;
+    ssize_t status;
+    bool closed = false;
+
+    while(conn->nrecv < sizeof(conn->buffer)) {
+        nbytes = recv(conn->fd, conn->buffer + conn->nrecv, sizeof(conn->buffer) - conn->nrecv, MSG_DONTWAIT);
+        if(nbytes == -1 && errno == EINTR) {
+            continue;
+        }
+        if(nbytes == -1 && errno == EAGAIN) {
+            break;
+        }
+        if(nbytes <= 0) {
+            closed = true;
+            break;
+        }
+        conn->nrecv += (size_t)nbytes;
+    }
+
+    /* Each response starts with its length */
+    while(conn->ninflight && offset < conn->nrecv && conn->buffer[offset] && conn->buffer[offset] <= conn->nrecv - offset) {
+        len = conn->buffer[offset];
+        status = loadgen_unpack(params->mix.requests[conn->requests[conn->head]], conn->buffer + offset, len);
+        if(status == ipc_rsp_ok) {
+            ++result->completed;
+            ++result->per_request[conn->requests[conn->head]];
+        }
+        else {
+            ++result->errors;
+        }
+
+        histogram_record(&result->latency, loadgen_now() - conn->scheduled[conn->head]);
+        conn->head = (conn->head + 1) % LOADGEN_MAX_DEPTH;
+        --conn->ninflight;
+        ++nfinished;
+        offset += len;
+    }
+
+    memmove(conn->buffer, conn->buffer + offset, conn->nrecv - offset);
+    conn->nrecv -= offset;
+
+    /* A full buffer without a complete response is garbage */
+    closed |= conn->nrecv == sizeof(conn->buffer);
+
+    if(closed) {
+        nfinished += loadgen_fail(epfd, conn, result);
+    }
+    else if(!params->depth && !conn->ninflight) {
+        loadgen_close(epfd, conn);
+    }
+
+    return nfinished;
+}
+
+/* Next slot with room for another request, round robin */
+static struct loadgen_conn *loadgen_next_conn(struct loadgen_conn *conns, struct loadgen_params const *params, unsigned *cursor) {
+    unsigned const depth = params->depth ? params->depth : 1;
+    struct loadgen_conn *conn;
+
+    for(unsigned i = 0; i < params->connections; i++) {
+        conn = &conns[(*cursor + i) % params->connections];
+        if(conn->ninflight < depth && (!params->depth || conn->fd != -1)) {
+            *cursor = (*cursor + i + 1) % params->connections;
+            return conn;
+        }
+    }
+
+    return 0;
+}
+
+static int loadgen_open_sessions(int epfd, struct loadgen_conn *conns, unsigned nconns) {
+    struct epoll_event event = { .events = EPOLLIN };
+
+    for(unsigned i = 0; i < nconns; i++) {
+        conns[i].fd = loadgen_open_session();
+        if(conns[i].fd == -1) {
+            return -1;
+        }
+
+        event.data.ptr = &conns[i];
+        if(epoll_ctl(epfd, EPOLL_CTL_ADD, conns[i].fd, &event) == -1) {
+            perror("Could not add connection to epoll");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* Requests are scheduled at a fixed rate regardless of how quickly the
+ * daemon responds. Latency is measured from the scheduled time, so time
+ * spent waiting for a free connection is included rather than hidden */
+int loadgen_run(struct loadgen_params const *params, struct loadgen_result *result) {
+    struct epoll_event events[LOADGEN_MAX_EVENTS];
+    struct loadgen_conn *conns;
+    struct loadgen_conn *conn;
+    uint32_t rng = 0x9e3779b9u;
+    uint64_t const period = params->rate ? NSEC_PER_SEC / params->rate : 0;
+    uint64_t start;
+    uint64_t end;
+    uint64_t now;
+    uint64_t next;
+    uint64_t deadline;
+    uint64_t expirations;
+    struct itimerspec timer = { 0 };
+    struct epoll_event timer_event = { .events = EPOLLIN, .data.ptr = 0 };
+    unsigned nbusy = 0;
+    unsigned cursor = 0;
+    unsigned slot;
+    bool full = false;
+    int nevents;
+    int status = 0;
+
+    memset(result, 0, sizeof(*result));
+    histogram_init(&result->latency);
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if(epfd == -1) {
+        perror("Could not create epoll instance");
+        return -1;
+    }
+
+    /* Epoll timeouts are in ms, too coarse for pacing requests */
+    int timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if(timerfd == -1 || epoll_ctl(epfd, EPOLL_CTL_ADD, timerfd, &timer_event) == -1) {
+        perror("Could not create timer");
+        if(timerfd != -1) {
+            close(timerfd);
+        }
+        close(epfd);
+        return -1;
+    }
+
+    conns = calloc(params->connections, sizeof(*conns));
+    if(!conns) {
+        fputs("Could not allocate connections\n", stderr);
+        close(timerfd);
+        close(epfd);
+        return -1;
+    }
+    for(unsigned i = 0; i < params->connections; i++) {
+        conns[i].fd = -1;
+    }
+
+    if(params->depth && loadgen_open_sessions(epfd, conns, params->connections)) {
+        status = -1;
+        goto cleanup;
+    }
+
+    start = loadgen_now();
+    end = start + (uint64_t)params->duration * NSEC_PER_SEC;
+    next = start;
+
+    while(1) {
+        now = loadgen_now();
+
+        /* Issue every request that is due, as long as connections are free */
+        full = false;
+        while(now < end && next <= now) {
+            conn = loadgen_next_conn(conns, params, &cursor);
+            if(!conn) {
+                full = true;
+                break;
+            }
+
+            slot = (conn->head + conn->ninflight) % LOADGEN_MAX_DEPTH;
+            conn->requests[slot] = loadgen_pick(&params->mix, &rng);
+            conn->scheduled[slot] = params->rate ? next : now;
+            ++result->sent;
+
+            if(loadgen_issue(epfd, conn, params->depth != 0, params->mix.requests[conn->requests[slot]])) {
+                ++result->failed;
+                if(params->depth) {
+                    nbusy -= loadgen_fail(epfd, conn, result);
+                }
+            }
+            else {
+                ++conn->ninflight;
+                ++nbusy;
+            }
+
+            next = params->rate ? next + period : now;
+        }
+
+        if(params->depth && full && !nbusy) {
+            fputs("Every session was closed by the daemon\n", stderr);
+            status = -1;
+            break;
+        }
+
+        if(now >= end && (!nbusy || now >= end + (uint64_t)LOADGEN_DRAIN_MSEC * NSEC_PER_MSEC)) {
+            break;
+        }
+
+        /* Wake up for the next scheduled request, a response or the end of the run */
+        if(now >= end) {
+            deadline = end + (uint64_t)LOADGEN_DRAIN_MSEC * NSEC_PER_MSEC;
+        }
+        else if(!full && next < end) {
+            deadline = next;
+        }
+        else {
+            deadline = end;
+        }
+
+        timer.it_value.tv_sec = (time_t)(deadline / NSEC_PER_SEC);
+        timer.it_value.tv_nsec = (long)(deadline % NSEC_PER_SEC);
+        if(timerfd_settime(timerfd, TFD_TIMER_ABSTIME, &timer, 0) == -1) {
+            perror("Could not arm timer");
+            status = -1;
+            break;
+        }
+
+        nevents = epoll_wait(epfd, events, array_size(events), -1);
+        if(nevents == -1) {
+            if(errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait");
+            status = -1;
+            break;
+        }
+
+        for(int i = 0; i < nevents; i++) {
+            if(!events[i].data.ptr) {
+                /* Only clears the timer, expiry is checked against the clock */
+                if(read(timerfd, &expirations, sizeof(expirations)) == -1 && errno != EAGAIN) {
+                    perror("Could not read timer");
+                }
+                continue;
+            }
+            nbusy -= loadgen_receive(epfd, events[i].data.ptr, params, result);
+        }
+    }
+
+    result->elapsed = loadgen_now() - start;
+
+cleanup:
+    for(unsigned i = 0; i < params->connections; i++) {
+        result->timeouts += conns[i].ninflight;
+        if(conns[i].fd != -1) {
+            loadgen_close(epfd, &conns[i]);
+        }
+    }
+
+    free(conns);
+    close(timerfd);
+    close(epfd);
+
+    return status;
+}
@@ -0,0 +1,62 @@
+#ifndef LOADGEN_H
+#define LOADGEN_H
+
+#include "histogram.h"
+#include "ipc.h"
+
+#include <stdint.h>
+
+enum { LOADGEN_MAX_CONNECTIONS = 1024 };
+enum { LOADGEN_MAX_REQUESTS = 8 };
+enum { LOADGEN_MAX_DEPTH = 64 };
+
+/* Requests issued, in proportion to their weights */
+struct loadgen_mix {
+    unsigned nrequests;
+    ipc_request requests[LOADGEN_MAX_REQUESTS];
+    unsigned weights[LOADGEN_MAX_REQUESTS];
+    unsigned total_weight;
+};
+
+struct loadgen_params {
+    struct loadgen_mix mix;
+    /* Concurrent connections */
+    unsigned connections;
+    /* Requests per second, 0 to issue the next request as soon as a connection is idle */
+    unsigned rate;
+    /* Seconds */
+    unsigned duration;
+    /* Requests in flight per connection, kept open as a session. 0 for
+     * a connection per request, as issued by legacy clients */
+    unsigned depth;
+};
+
+struct loadgen_ticks {
+    unsigned long long ticks;
+    unsigned long long missed;
+    unsigned long long late;
+    /* Microseconds, largest since the daemon was started */
+    unsigned long long max_lateness;
+};
+
+struct loadgen_result {
+    /* Latencies in ns, measured from the time a request was scheduled */
+    struct histogram latency;
+    uint64_t sent;
+    uint64_t completed;
+    /* Requests answered with an error */
+    uint64_t errors;
+    /* Requests whose connection failed */
+    uint64_t failed;
+    /* Requests still in flight when the run ended */
+    uint64_t timeouts;
+    uint64_t per_request[LOADGEN_MAX_REQUESTS];
+    /* Wall-clock ns */
+    uint64_t elapsed;
+};
+
+int loadgen_parse_mix(char const *text, struct loadgen_mix *mix);
+int loadgen_query_ticks(struct loadgen_ticks *ticks);
+int loadgen_run(struct loadgen_params const *params, struct loadgen_result *result);
+
+#endif /* LOADGEN_H */
@@ -0,0 +1,215 @@
+#include "histogram.h"
+#include "ipc.h"
+#include "loadgen.h"
+#include "macro.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <argp.h>
+
+char const *argp_program_version = "amdgpu-loadgen " STR_EXPAND(FAND_VERSION) ;
+char const *argp_program_bug_address = "<vilhelm.engstrom@tuta.io>";
+
+static char doc[] = "amdgpu-loadgen -- Load generator for the amdgpu-fand control interface"
+                    "\vRequests are issued over CONNECTIONS concurrent connections at RATE\n"
+                    "requests per second, chosen from MIX, a comma-separated list of\n"
+                    "request[=weight] such as speed=4,temp=4,matrix=1. Latencies include\n"
+                    "time spent waiting for a free connection. Each request is sent on a\n"
+                    "connection of its own unless DEPTH is given, in which case connections\n"
+                    "are kept open as sessions with up to DEPTH requests in flight each.\n"
+                    "The tick statistics of the daemon are compared before and after the\n"
+                    "run to show whether the control loop kept up.";
+
+enum { LOADGEN_MAX_RATE = 10000000 };
+enum { LOADGEN_MAX_DURATION = 86400 };
+
+static double const loadgen_percentiles[] = { 50.0, 75.0, 90.0, 99.0, 99.9, 99.99, 100.0 };
+
+static struct argp_option options[] = {
+    {"connections", 'c', "CONNECTIONS", 0, "Concurrent connections, defaults to 16",                     0},
+    {"rate",        'r', "RATE",        0, "Requests per second, 0 for as fast as possible, defaults to 1000", 0},
+    {"duration",    'd', "SECONDS",     0, "Duration of the run, defaults to 10",                        0},
+    {"mix",         'm', "MIX",         0, "Requests to issue, defaults to speed,temp,matrix",           0},
+    {"pipeline",    'p', "DEPTH",       0, "Pipeline requests on persistent connections, defaults to 0", 0},
+    { 0 }
+};
+
+struct args {
+    struct loadgen_params params;
+    char const *mix;
+};
+
+static int parse_ulong(char const *arg, unsigned long max, unsigned long *result) {
+    char *end;
+
+    errno = 0;
+    *result = strtoul(arg, &end, 10);
+    return errno || end == arg || *end || *result > max ? -1 : 0;
+}
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state) {
+    struct args *args = state->input;
+    unsigned long value;
+
+    switch(key) {
+        case 'c':
+            if(parse_ulong(arg, LOADGEN_MAX_CONNECTIONS, &value) || !value) {
+                argp_error(state, "Invalid number of connections %s", arg);
+            }
+            args->params.connections = (unsigned)value;
+            break;
+        case 'r':
+            if(parse_ulong(arg, LOADGEN_MAX_RATE, &value)) {
+                argp_error(state, "Invalid rate %s", arg);
+            }
+            args->params.rate = (unsigned)value;
+            break;
+        case 'd':
+            if(parse_ulong(arg, LOADGEN_MAX_DURATION, &value) || !value) {
+                argp_error(state, "Invalid duration %s", arg);
+            }
+            args->params.duration = (unsigned)value;
+            break;
+        case 'm':
+            args->mix = arg;
+            break;
+        case 'p':
+            if(parse_ulong(arg, LOADGEN_MAX_DEPTH, &value)) {
+                argp_error(state, "Invalid pipeline depth %s", arg);
+            }
+            args->params.depth = (unsigned)value;
+            break;
+        case ARGP_KEY_ARG:
+            argp_usage(state);
+            break;
+        default:
+            return ARGP_ERR_UNKNOWN;
+    }
+
+    return 0;
+}
+
+static char const *request_name(ipc_request request) {
+    for(unsigned i = 0; i < array_size(ipc_request_map); i++) {
+        if(ipc_request_map[i].code == request) {
+            return ipc_request_map[i].name;
+        }
+    }
+    return "unknown";
+}
+
+static void print_latency(struct histogram const *hist) {
+    printf("latency (us):\n");
+    printf("  %10s %12.1f\n", "min", hist->total ? hist->min / 1e3 : 0.0);
+    printf("  %10s %12.1f\n", "mean", histogram_mean(hist) / 1e3);
+    for(unsigned i = 0; i < array_size(loadgen_percentiles); i++) {
+        printf("  %9.2f%% %12.1f\n", loadgen_percentiles[i], histogram_percentile(hist, loadgen_percentiles[i]) / 1e3);
+    }
+
+    /* Counts per power of two, as an overview of the distribution */
+    printf("distribution:\n");
+    for(unsigned bits = 0, i = 0; i < HISTOGRAM_BUCKETS; bits++) {
+        uint64_t const lower = bits ? (uint64_t)1 << (bits - 1) : 0;
+        uint64_t const upper = ((uint64_t)1 << bits) - 1;
+        uint64_t count = 0;
+
+        for(; i < HISTOGRAM_BUCKETS && histogram_lowest_equivalent(i) <= upper; i++) {
+            count += hist->counts[i];
+        }
+
+        if(count) {
+            printf("  %12.3f - %12.3f us %10llu  %6.2f%%\n", lower / 1e3, upper / 1e3,
+                   (unsigned long long)count, 100.0 * count / hist->total);
+        }
+    }
+}
+
+static void print_ticks(struct loadgen_ticks const *before, struct loadgen_ticks const *after) {
+    printf("control ticks:\n");
+    printf("  %-12s %llu\n", "handled", after->ticks - before->ticks);
+    printf("  %-12s %llu\n", "missed", after->missed - before->missed);
+    printf("  %-12s %llu\n", "late", after->late - before->late);
+    if(after->max_lateness > before->max_lateness) {
+        printf("  %-12s %llu us, during the run\n", "max late", after->max_lateness);
+    }
+    else {
+        printf("  %-12s %llu us, before the run\n", "max late", after->max_lateness);
+    }
+}
+
+static void print_result(struct loadgen_params const *params, struct loadgen_result const *result) {
+    double const seconds = result->elapsed / 1e9;
+
+    printf("connections:  %u\n", params->connections);
+    if(params->depth) {
+        printf("pipeline:     %u requests per session\n", params->depth);
+    }
+    if(params->rate) {
+        printf("target rate:  %u req/s\n", params->rate);
+    }
+    else {
+        printf("target rate:  unbounded\n");
+    }
+    printf("duration:     %.2f s\n", seconds);
+    printf("requests:     %llu sent, %llu ok, %llu errors, %llu failed, %llu timed out\n",
+           (unsigned long long)result->sent, (unsigned long long)result->completed, (unsigned long long)result->errors,
+           (unsigned long long)result->failed, (unsigned long long)result->timeouts);
+    printf("throughput:   %.0f req/s\n", seconds > 0.0 ? result->completed / seconds : 0.0);
+
+    for(unsigned i = 0; i < params->mix.nrequests; i++) {
+        printf("  %-10s  %llu ok\n", request_name(params->mix.requests[i]), (unsigned long long)result->per_request[i]);
+    }
+
+    print_latency(&result->latency);
+}
+
+int main(int argc, char **argv) {
+    struct argp argp = {
+        options,
+        parse_opt,
+        0,
+        doc,
+        0,
+        0,
+        0
+    };
+
+    struct args args = {
+        .params = {
+            .connections = 16,
+            .rate = 1000,
+            .duration = 10,
+            .depth = 0
+        },
+        .mix = "speed,temp,matrix"
+    };
+
+    struct loadgen_ticks before;
+    struct loadgen_ticks after;
+    static struct loadgen_result result;
+
+    argp_parse(&argp, argc, argv, 0, 0, &args);
+
+    if(loadgen_parse_mix(args.mix, &args.params.mix)) {
+        return 1;
+    }
+
+    /* Also checks that the daemon is reachable */
+    if(loadgen_query_ticks(&before)) {
+        return 1;
+    }
+
+    if(loadgen_run(&args.params, &result)) {
+        return 1;
+    }
+
+    print_result(&args.params, &result);
+
+    if(loadgen_query_ticks(&after) == 0) {
+        print_ticks(&before, &after);
+    }
+
+    return 0;
+}
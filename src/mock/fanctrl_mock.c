@@ -3,23 +3,33 @@
 
 #include <stdio.h>
 
-static int(*get_speed)(void) = 0;
-static int(*get_temp)(void) = 0;
+static int(*get_speed)(unsigned) = 0;
+static int(*get_temp)(unsigned) = 0;
+static int(*get_temps)(int *, unsigned) = 0;
 
-void mock_fanctrl_get_speed(int(*mock)(void)) {
+void mock_fanctrl_get_speed(int(*mock)(unsigned)) {
     mock_function(get_speed, mock);
 }
 
-void mock_fanctrl_get_temp(int(*mock)(void)) {
+void mock_fanctrl_get_temp(int(*mock)(unsigned)) {
     mock_function(get_temp, mock);
 }
 
-int fanctrl_get_speed(void) {
+void mock_fanctrl_get_temps(int(*mock)(int *, unsigned)) {
+    mock_function(get_temps, mock);
+}
+
+int fanctrl_get_speed(unsigned card) {
     validate_mock(fanctrl_get_speed, get_speed);
-    return get_speed();
+    return get_speed(card);
 }
 
-int fanctrl_get_temp(void) {
+int fanctrl_get_temp(unsigned card) {
     validate_mock(fanctrl_get_temp, get_temp);
-    return get_temp();
+    return get_temp(card);
+}
+
+int fanctrl_get_temps(int *temps, unsigned ncards) {
+    validate_mock(fanctrl_get_temps, get_temps);
+    return get_temps(temps, ncards);
 }
@@ -1,7 +1,8 @@
 #ifndef MOCK_FANCTRL_H
 #define MOCK_FANCTRL_H
 
-void mock_fanctrl_get_speed(int(*mock)(void));
-void mock_fanctrl_get_temp(int(*mock)(void));
+void mock_fanctrl_get_speed(int(*mock)(unsigned));
+void mock_fanctrl_get_temp(int(*mock)(unsigned));
+void mock_fanctrl_get_temps(int(*mock)(int *, unsigned));
 
 #endif /* MOCK_FANCTRL_H */
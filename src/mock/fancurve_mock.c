@@ -0,0 +1,15 @@
+#include "fancurve_mock.h"
+#include "mock.h"
+
+#include <stdio.h>
+
+static int(*curve_path)(char *, size_t, unsigned) = 0;
+
+void mock_fancurve_path(int(*mock)(char *, size_t, unsigned)) {
+    mock_function(curve_path, mock);
+}
+
+int fancurve_path(char *dst, size_t size, unsigned card_idx) {
+    validate_mock(fancurve_path, curve_path);
+    return curve_path(dst, size, card_idx);
+}
@@ -0,0 +1,8 @@
+#ifndef MOCK_FANCURVE_H
+#define MOCK_FANCURVE_H
+
+#include <stddef.h>
+
+void mock_fancurve_path(int(*mock)(char *, size_t, unsigned));
+
+#endif /* MOCK_FANCURVE_H */
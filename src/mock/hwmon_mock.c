@@ -3,13 +3,63 @@
 
 #include <stdio.h>
 
-static int(*write_pwm)(unsigned long) = 0;
+static int(*open_hwmon)(void) = 0;
+static unsigned(*card_index)(unsigned) = 0;
+static int(*set_firmware_control)(unsigned, bool) = 0;
+static int(*read_pwm)(unsigned) = 0;
+static int(*read_pwms)(unsigned const *, int *, unsigned) = 0;
+static int(*write_pwms)(unsigned const *, unsigned long const *, int *, unsigned) = 0;
 
-void mock_hwmon_write_pwm(int(*mock)(unsigned long)) {
-    mock_function(write_pwm, mock);
+void mock_hwmon_open(int(*mock)(void)) {
+    mock_function(open_hwmon, mock);
 }
 
-int hwmon_write_pwm(unsigned long pwm) {
-    validate_mock(hwmon_write_pwm, write_pwm);
-    return write_pwm(pwm);
+void mock_hwmon_card_index(unsigned(*mock)(unsigned)) {
+    mock_function(card_index, mock);
+}
+
+void mock_hwmon_set_firmware_control(int(*mock)(unsigned, bool)) {
+    mock_function(set_firmware_control, mock);
+}
+
+void mock_hwmon_read_pwm(int(*mock)(unsigned)) {
+    mock_function(read_pwm, mock);
+}
+
+void mock_hwmon_read_pwms(int(*mock)(unsigned const *, int *, unsigned)) {
+    mock_function(read_pwms, mock);
+}
+
+void mock_hwmon_write_pwms(int(*mock)(unsigned const *, unsigned long const *, int *, unsigned)) {
+    mock_function(write_pwms, mock);
+}
+
+int hwmon_open(void) {
+    validate_mock(hwmon_open, open_hwmon);
+    return open_hwmon();
+}
+
+unsigned hwmon_card_index(unsigned card) {
+    validate_mock(hwmon_card_index, card_index);
+    return card_index(card);
+}
+
+int hwmon_set_firmware_control(unsigned card, bool enable) {
+    validate_mock(hwmon_set_firmware_control, set_firmware_control);
+    return set_firmware_control(card, enable);
+}
+
+int hwmon_read_pwm(unsigned card) {
+    validate_mock(hwmon_read_pwm, read_pwm);
+    return read_pwm(card);
+}
+
+int hwmon_read_pwms(unsigned const *cards, int *pwms, unsigned n) {
+    validate_mock(hwmon_read_pwms, read_pwms);
+    return read_pwms(cards, pwms, n);
+}
+
+int hwmon_write_pwms(unsigned const *cards, unsigned long const *pwms, int *status, unsigned n) {
+    validate_mock(hwmon_write_pwms, write_pwms);
+    return write_pwms(cards, pwms, status, n);
 }
@@ -1,6 +1,13 @@
 #ifndef MOCK_HWMON_H
 #define MOCK_HWMON_H
 
-void mock_hwmon_write_pwm(int(*mock)(unsigned long));
+#include <stdbool.h>
+
+void mock_hwmon_open(int(*mock)(void));
+void mock_hwmon_card_index(unsigned(*mock)(unsigned));
+void mock_hwmon_set_firmware_control(int(*mock)(unsigned, bool));
+void mock_hwmon_read_pwm(int(*mock)(unsigned));
+void mock_hwmon_read_pwms(int(*mock)(unsigned const *, int *, unsigned));
+void mock_hwmon_write_pwms(int(*mock)(unsigned const *, unsigned long const *, int *, unsigned));
 
 #endif /* MOCK_HWMON_H */
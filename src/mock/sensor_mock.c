@@ -0,0 +1,15 @@
+#include "mock.h"
+#include "sensor_mock.h"
+
+#include <stdio.h>
+
+static int(*init_sensor)(unsigned const *, unsigned) = 0;
+
+void mock_sensor_init(int(*mock)(unsigned const *, unsigned)) {
+    mock_function(init_sensor, mock);
+}
+
+int sensor_init(unsigned const *card_indices, unsigned ncards) {
+    validate_mock(sensor_init, init_sensor);
+    return init_sensor(card_indices, ncards);
+}
@@ -0,0 +1,6 @@
+#ifndef MOCK_SENSOR_H
+#define MOCK_SENSOR_H
+
+void mock_sensor_init(int(*mock)(unsigned const *, unsigned));
+
+#endif /* MOCK_SENSOR_H */
@@ -0,0 +1,204 @@
+#include "config.h"
+#include "macro.h"
+#include "sim.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <argp.h>
+#include <syslog.h>
+
+char const *argp_program_version = "amdgpu-simd " STR_EXPAND(FAND_VERSION) ;
+char const *argp_program_bug_address = "<vilhelm.engstrom@tuta.io>";
+
+static char doc[] = "amdgpu-simd -- Run the amdgpu-fand control loop against a simulated card"
+                    "\vThe card is modelled as a first-order thermal system whose\n"
+                    "equilibrium temperature is AMBIENT + RISE * load / (1 + COOLING * duty),\n"
+                    "approached with time constant TAU. The load follows PROFILE, a\n"
+                    "comma-separated list of time:load pairs in seconds and percent,\n"
+                    "repeated every PERIOD seconds. Time is virtual, a day is simulated\n"
+                    "in well under a second.";
+
+enum { SIM_MAX_HOURS = 24 * 365 };
+enum { SEC_PER_HOUR = 3600 };
+
+static struct argp_option options[] = {
+    {"config",    'c', "PATH",      0, "Configuration file, defaults to " CONFIG_DEFAULT_PATH,            0},
+    {"load",      'l', "PROFILE",   0, "Load profile, defaults to 0:10,600:100,1800:10",                 0},
+    {"period",    'p', "PERIOD",    0, "Period of the load profile, defaults to 3600",                   0},
+    {"duration",  'd', "HOURS",     0, "Simulated hours, defaults to 24",                                0},
+    {"ambient",   'a', "AMBIENT",   0, "Ambient temperature in degrees Celsius, defaults to 30",         0},
+    {"rise",      'r', "RISE",      0, "Rise at full load with the fan stopped, defaults to 80",         0},
+    {"cooling",   'k', "COOLING",   0, "Cooling gain at full duty, defaults to 3",                       0},
+    {"tau",       'T', "TAU",       0, "Time constant in seconds, defaults to 40",                       0},
+    {"threshold", 't', "TEMP",      0, "Temperature counted against, defaults to the highest in the matrix", 0},
+    {"band",      'b', "DEGREES",   0, "Settling band in degrees Celsius, defaults to 1",                0},
+    { 0 }
+};
+
+struct args {
+    char const *config;
+    char const *profile;
+    struct sim_params params;
+    bool threshold_set;
+};
+
+static int parse_ulong(char const *arg, unsigned long max, unsigned long *result) {
+    char *end;
+
+    errno = 0;
+    *result = strtoul(arg, &end, 10);
+    return errno || end == arg || *end || *result > max ? -1 : 0;
+}
+
+static int parse_float(char const *arg, float min, float *result) {
+    char *end;
+
+    errno = 0;
+    *result = strtof(arg, &end);
+    return errno || end == arg || *end || !isfinite(*result) || *result < min ? -1 : 0;
+}
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state) {
+    struct args *args = state->input;
+    unsigned long value;
+
+    switch(key) {
+        case 'c':
+            args->config = arg;
+            break;
+        case 'l':
+            args->profile = arg;
+            break;
+        case 'p':
+            if(parse_ulong(arg, UINT_MAX, &value)) {
+                argp_error(state, "Invalid period %s", arg);
+            }
+            args->params.profile.period = (unsigned)value;
+            break;
+        case 'd':
+            if(parse_ulong(arg, SIM_MAX_HOURS, &value) || !value) {
+                argp_error(state, "Invalid duration %s", arg);
+            }
+            args->params.duration = value * SEC_PER_HOUR;
+            break;
+        case 'a':
+            if(parse_float(arg, -273.f, &args->params.plant.ambient)) {
+                argp_error(state, "Invalid ambient temperature %s", arg);
+            }
+            break;
+        case 'r':
+            if(parse_float(arg, 0.f, &args->params.plant.rise)) {
+                argp_error(state, "Invalid rise %s", arg);
+            }
+            break;
+        case 'k':
+            if(parse_float(arg, 0.f, &args->params.plant.cooling)) {
+                argp_error(state, "Invalid cooling gain %s", arg);
+            }
+            break;
+        case 'T':
+            if(parse_float(arg, 0.f, &args->params.plant.time_constant) || !(args->params.plant.time_constant > 0.f)) {
+                argp_error(state, "Invalid time constant %s", arg);
+            }
+            break;
+        case 't':
+            if(parse_float(arg, -273.f, &args->params.threshold)) {
+                argp_error(state, "Invalid threshold %s", arg);
+            }
+            args->threshold_set = true;
+            break;
+        case 'b':
+            if(parse_float(arg, 0.f, &args->params.band)) {
+                argp_error(state, "Invalid band %s", arg);
+            }
+            break;
+        case ARGP_KEY_ARG:
+            argp_usage(state);
+            break;
+        default:
+            return ARGP_ERR_UNKNOWN;
+    }
+
+    return 0;
+}
+
+static void print_result(struct sim_params const *params, struct sim_result const *result) {
+    printf("simulated:        %llu s\n", params->duration);
+    printf("load steps:       %llu\n", result->nsteps);
+    printf("settling time:    %.1f s mean, %llu s max\n", result->settling_mean, result->settling_max);
+    printf("overshoot:        %.2f C max\n", result->overshoot_max);
+    printf("time above %.0f C: %llu s\n", params->threshold, result->time_above);
+    printf("temperature:      %.2f C min, %.2f C mean, %.2f C max\n", result->temp_min, result->temp_mean, result->temp_max);
+    printf("fan speed:        %.1f %% mean\n", result->speed_mean);
+    printf("pwm writes:       %llu, %llu changing the pwm\n", result->pwm_writes, result->pwm_changes);
+    printf("wall clock:       %.3f ms, %.0f simulated h/s\n", result->elapsed / 1e6,
+           result->elapsed ? (double)params->duration / SEC_PER_HOUR * 1e9 / result->elapsed : 0.0);
+}
+
+int main(int argc, char **argv) {
+    struct argp argp = {
+        options,
+        parse_opt,
+        0,
+        doc,
+        0,
+        0,
+        0
+    };
+
+    struct args args = {
+        .config = CONFIG_DEFAULT_PATH,
+        .profile = "0:10,600:100,1800:10",
+        .params = {
+            .plant = {
+                .ambient = 30.f,
+                .rise = 80.f,
+                .cooling = 3.f,
+                .time_constant = 40.f
+            },
+            .profile = { .period = 3600 },
+            .duration = 24 * SEC_PER_HOUR,
+            .band = 1.f
+        },
+        .threshold_set = false
+    };
+
+    struct fand_config config;
+    struct sim_result result;
+
+    argp_parse(&argp, argc, argv, 0, 0, &args);
+
+    if(profile_parse(args.profile, &args.params.profile)) {
+        return 1;
+    }
+
+    /* Errors are reported on stderr, the rest is noise */
+    openlog("amdgpu-simd", LOG_PERROR, LOG_USER);
+    setlogmask(LOG_UPTO(LOG_ERR));
+
+    if(config_parse(args.config, &config)) {
+        fprintf(stderr, "Could not parse %s\n", args.config);
+        return 1;
+    }
+
+    if(!config.matrix_rows) {
+        fprintf(stderr, "No matrix in %s\n", args.config);
+        return 1;
+    }
+
+    if(!args.threshold_set) {
+        args.params.threshold = config.matrix[2 * (config.matrix_rows - 1)];
+    }
+
+    if(sim_run(&config, &args.params, &result)) {
+        return 1;
+    }
+
+    print_result(&args.params, &result);
+
+    return 0;
+}
@@ -0,0 +1,85 @@
+#include "plant.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+void plant_init(struct plant *plant, struct plant_params const *params, float step) {
+    plant->params = *params;
+    plant->alpha = 1.f - expf(-step / params->time_constant);
+    plant->temp = params->ambient;
+}
+
+float plant_equilibrium(struct plant_params const *params, float load, float duty) {
+    return params->ambient + params->rise * load / (1.f + params->cooling * duty);
+}
+
+/* Advances the model by one step, load and duty in [0, 1]. The
+ * exact solution is used, so the step may be large compared
+ * to the time constant */
+void plant_step(struct plant *plant, float load, float duty) {
+    plant->temp += (plant_equilibrium(&plant->params, load, duty) - plant->temp) * plant->alpha;
+}
+
+/* Parses a comma-separated list of time:load pairs, time in
+ * seconds and load in percent, e.g. "0:10,600:100,1800:10" */
+int profile_parse(char const *text, struct load_profile *profile) {
+    char *end;
+    unsigned long time;
+    unsigned long load;
+
+    profile->npoints = 0;
+
+    while(*text) {
+        if(profile->npoints >= PROFILE_MAX_POINTS) {
+            fprintf(stderr, "Load profile may contain at most %u points\n", PROFILE_MAX_POINTS);
+            return -1;
+        }
+
+        errno = 0;
+        time = strtoul(text, &end, 10);
+        if(errno || end == text || *end != ':') {
+            goto syntax;
+        }
+        text = end + 1;
+
+        load = strtoul(text, &end, 10);
+        if(errno || end == text || (*end && (*end != ',' || !end[1])) || load > 100) {
+            goto syntax;
+        }
+        text = *end ? end + 1 : end;
+
+        if(profile->npoints && time <= profile->times[profile->npoints - 1]) {
+            fprintf(stderr, "Load profile times must be increasing\n");
+            return -1;
+        }
+
+        profile->times[profile->npoints] = (unsigned)time;
+        profile->loads[profile->npoints++] = (unsigned char)load;
+    }
+
+    if(!profile->npoints || profile->times[0]) {
+        fprintf(stderr, "Load profile must start at time 0\n");
+        return -1;
+    }
+
+    return 0;
+
+syntax:
+    fprintf(stderr, "Invalid load profile at '%s', expected time:load[,time:load]...\n", text);
+    return -1;
+}
+
+/* Load at time seconds */
+unsigned char profile_load(struct load_profile const *profile, unsigned long long time) {
+    unsigned i;
+
+    if(profile->period) {
+        time %= profile->period;
+    }
+
+    for(i = 1; i < profile->npoints && profile->times[i] <= time; i++) { }
+
+    return profile->loads[i - 1];
+}
@@ -0,0 +1,43 @@
+#ifndef PLANT_H
+#define PLANT_H
+
+enum { PROFILE_MAX_POINTS = 32 };
+
+/* First-order thermal model of a card. At a given load and fan duty,
+ * the temperature approaches ambient + rise * load / (1 + cooling * duty)
+ * exponentially with the given time constant */
+struct plant_params {
+    /* Degrees Celsius */
+    float ambient;
+    /* Rise above ambient at full load with the fan stopped */
+    float rise;
+    /* Relative increase of the heat removed at full fan duty */
+    float cooling;
+    /* Seconds */
+    float time_constant;
+};
+
+struct plant {
+    struct plant_params params;
+    /* Fraction of the distance to equilibrium covered per step */
+    float alpha;
+    float temp;
+};
+
+/* Piecewise constant load in percent, loads[i] applies from times[i] on */
+struct load_profile {
+    unsigned npoints;
+    unsigned times[PROFILE_MAX_POINTS];
+    unsigned char loads[PROFILE_MAX_POINTS];
+    /* Seconds after which the profile repeats, 0 if never */
+    unsigned period;
+};
+
+void plant_init(struct plant *plant, struct plant_params const *params, float step);
+float plant_equilibrium(struct plant_params const *params, float load, float duty);
+void plant_step(struct plant *plant, float load, float duty);
+
+int profile_parse(char const *text, struct load_profile *profile);
+unsigned char profile_load(struct load_profile const *profile, unsigned long long time);
+
+#endif /* PLANT_H */
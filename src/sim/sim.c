@@ -0,0 +1,229 @@
+#include "fanctrl.h"
+#include "fanctrl_mock.h"
+#include "fandcfg.h"
+#include "hwmon_mock.h"
+#include "sensor_mock.h"
+#include "sim.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <time.h>
+
+enum { NSEC_PER_SEC = 1000000000 };
+/* Simulated seconds per step of the plant */
+enum { SIM_STEP = 1 };
+enum { SIM_SEGMENT_INITIAL_SIZE = 4096 };
+
+/* Temperatures of the current load step, one per simulated second */
+struct sim_segment {
+    float *temps;
+    size_t size;
+    size_t capacity;
+    /* Direction of the load change starting the segment */
+    int direction;
+};
+
+/* State shared with the mocked hwmon and sensor functions */
+static float sim_temp;
+static unsigned long sim_pwm;
+static unsigned long long sim_writes;
+static unsigned long long sim_changes;
+
+static int sim_open(void) {
+    return 1;
+}
+
+static unsigned sim_card_index(unsigned card) {
+    return card;
+}
+
+static int sim_init_sensor(unsigned const *card_indices, unsigned ncards) {
+    (void)card_indices;
+    (void)ncards;
+    return 0;
+}
+
+/* Sensors report whole degrees */
+static int sim_get_temps(int *temps, unsigned ncards) {
+    for(unsigned i = 0; i < ncards; i++) {
+        temps[i] = (int)sim_temp;
+    }
+    return 0;
+}
+
+static int sim_write_pwms(unsigned const *cards, unsigned long const *pwms, int *status, unsigned n) {
+    (void)cards;
+    for(unsigned i = 0; i < n; i++) {
+        sim_changes += pwms[i] != sim_pwm;
+        sim_pwm = pwms[i];
+        status[i] = 0;
+        ++sim_writes;
+    }
+    return 0;
+}
+
+static int sim_read_pwms(unsigned const *cards, int *pwms, unsigned n) {
+    (void)cards;
+    for(unsigned i = 0; i < n; i++) {
+        pwms[i] = (int)sim_pwm;
+    }
+    return 0;
+}
+
+static int sim_set_firmware_control(unsigned card, bool enable) {
+    (void)card;
+    (void)enable;
+    return -1;
+}
+
+static inline unsigned long long sim_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * NSEC_PER_SEC + (unsigned long long)ts.tv_nsec;
+}
+
+static int sim_segment_push(struct sim_segment *segment, float temp) {
+    float *temps;
+
+    if(segment->size == segment->capacity) {
+        segment->capacity = segment->capacity ? 2 * segment->capacity : SIM_SEGMENT_INITIAL_SIZE;
+        temps = realloc(segment->temps, segment->capacity * sizeof(*temps));
+        if(!temps) {
+            fputs("Could not allocate segment\n", stderr);
+            return -1;
+        }
+        segment->temps = temps;
+    }
+
+    segment->temps[segment->size++] = temp;
+    return 0;
+}
+
+/* Accounts for the settling time and overshoot of a completed load step */
+static void sim_segment_finish(struct sim_segment *segment, struct sim_params const *params, struct sim_result *result, double *settling_total) {
+    float final;
+    float overshoot = 0.f;
+    size_t settled = 0;
+
+    if(!segment->size || !segment->direction) {
+        segment->size = 0;
+        return;
+    }
+
+    final = segment->temps[segment->size - 1];
+    for(size_t i = 0; i < segment->size; i++) {
+        if(fabsf(segment->temps[i] - final) > params->band) {
+            settled = i + 1;
+        }
+        if((segment->temps[i] - final) * segment->direction > overshoot) {
+            overshoot = (segment->temps[i] - final) * segment->direction;
+        }
+    }
+
+    ++result->nsteps;
+    *settling_total += settled * SIM_STEP;
+    if(settled * SIM_STEP > result->settling_max) {
+        result->settling_max = settled * SIM_STEP;
+    }
+    if(overshoot > result->overshoot_max) {
+        result->overshoot_max = overshoot;
+    }
+
+    segment->size = 0;
+}
+
+static void sim_mock(void) {
+    mock_hwmon_open(sim_open);
+    mock_hwmon_card_index(sim_card_index);
+    mock_hwmon_set_firmware_control(sim_set_firmware_control);
+    mock_hwmon_read_pwms(sim_read_pwms);
+    mock_hwmon_write_pwms(sim_write_pwms);
+    mock_sensor_init(sim_init_sensor);
+    mock_fanctrl_get_temps(sim_get_temps);
+}
+
+/* Runs the control loop configured by config against the plant for
+ * the given duration. Time is virtual, the loop is invoked every
+ * interval simulated seconds, or every step if the interval is 0 */
+int sim_run(struct fand_config *config, struct sim_params const *params, struct sim_result *result) {
+    struct plant plant;
+    struct sim_segment segment = { 0 };
+    unsigned char load;
+    unsigned char prevload = 0;
+    double temp_total = 0.0;
+    double speed_total = 0.0;
+    double settling_total = 0.0;
+    unsigned long long start;
+    unsigned long long time;
+    int status = 0;
+
+    sim_mock();
+    sim_pwm = 0;
+    sim_writes = 0;
+    sim_changes = 0;
+
+    *result = (struct sim_result){ .temp_min = FLT_MAX, .temp_max = -FLT_MAX };
+
+    /* Offloading makes no sense for a simulated card */
+    config->fan_curve_offload = false;
+
+    if(fanctrl_init() || fanctrl_configure(config)) {
+        fputs("Could not configure fan controller\n", stderr);
+        return -1;
+    }
+
+    plant_init(&plant, &params->plant, (float)SIM_STEP);
+    start = sim_now();
+
+    for(time = 0; time < params->duration; time += SIM_STEP) {
+        load = profile_load(&params->profile, time);
+        if(load != prevload || !time) {
+            sim_segment_finish(&segment, params, result, &settling_total);
+            segment.direction = (load > prevload) - (load < prevload);
+            prevload = load;
+        }
+
+        if(!config->interval || time % config->interval == 0) {
+            sim_temp = plant.temp;
+            fanctrl_adjust();
+        }
+
+        plant_step(&plant, load / 100.f, sim_pwm / (float)PWM_MAX);
+
+        if(sim_segment_push(&segment, plant.temp)) {
+            status = -1;
+            break;
+        }
+
+        temp_total += plant.temp;
+        speed_total += 100.0 * sim_pwm / PWM_MAX;
+        result->time_above += (plant.temp > params->threshold) * SIM_STEP;
+        if(plant.temp < result->temp_min) {
+            result->temp_min = plant.temp;
+        }
+        if(plant.temp > result->temp_max) {
+            result->temp_max = plant.temp;
+        }
+    }
+
+    sim_segment_finish(&segment, params, result, &settling_total);
+    result->elapsed = sim_now() - start;
+
+    result->pwm_writes = sim_writes;
+    result->pwm_changes = sim_changes;
+    if(time) {
+        result->temp_mean = temp_total * SIM_STEP / time;
+        result->speed_mean = speed_total * SIM_STEP / time;
+    }
+    if(result->nsteps) {
+        result->settling_mean = settling_total / result->nsteps;
+    }
+
+    free(segment.temps);
+    fanctrl_release();
+
+    return status;
+}
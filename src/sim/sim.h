@@ -0,0 +1,43 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include "config.h"
+#include "plant.h"
+
+struct sim_params {
+    struct plant_params plant;
+    struct load_profile profile;
+    /* Simulated seconds */
+    unsigned long long duration;
+    /* Degrees Celsius */
+    float threshold;
+    /* Distance from the final temperature of a load step within
+     * which the temperature is considered settled */
+    float band;
+};
+
+struct sim_result {
+    /* Load changes during the run */
+    unsigned long long nsteps;
+    /* Seconds until the temperature stays within the band, over all load steps */
+    unsigned long long settling_max;
+    double settling_mean;
+    /* Largest excursion past the final temperature of a load step */
+    float overshoot_max;
+    /* Seconds spent above the threshold */
+    unsigned long long time_above;
+    unsigned long long pwm_writes;
+    /* Writes changing the pwm */
+    unsigned long long pwm_changes;
+    float temp_min;
+    float temp_max;
+    double temp_mean;
+    /* Percent */
+    double speed_mean;
+    /* Wall-clock ns spent simulating */
+    unsigned long long elapsed;
+};
+
+int sim_run(struct fand_config *config, struct sim_params const *params, struct sim_result *result);
+
+#endif /* SIM_H */
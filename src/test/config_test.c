@@ -0,0 +1,233 @@
+#include "config.h"
+#include "config_test.h"
+#include "macro.h"
+#include "test.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#define CONFIG_TEST_PATH "/tmp/_fand_test.conf"
+#define CONFIG_TEST_TMP "/tmp/_fand_test.conf.tmp"
+
+enum { CONFIG_TEST_BUFSIZE = 2048 };
+
+struct config_test_error {
+    char const *text;
+    unsigned line;
+    unsigned column;
+};
+
+static int config_test_parse(char const *text, struct fand_config *data, struct config_error *error) {
+    memset(data, 0, sizeof(*data));
+    return config_parse_string(text, strlen(text), data, error);
+}
+
+void test_config_parse(void) {
+    static unsigned char const matrix[] = { 50, 5, 55, 10, 65, 30, 80, 100 };
+    static unsigned char const card_matrix[] = { 40, 20, 70, 100 };
+    char const *text =
+        "# Comment\n"
+        "interval = 2 # seconds\n"
+        "\n"
+        "HYSTERESIS=\"3\"\r\n"
+        "aggressive_throttle = true\n"
+        "sample_max_age\t=\t250\n"
+        "fan_curve_offload = false\n"
+        "matrix=('50::5'\n"
+        "        '55::10' # comment\n"
+        "        #'60::20'\n"
+        "\n"
+        "        '65::30'\n"
+        "        '80::100')\n"
+        "matrix_card1=('40::20'\n"
+        "              '70::100')";
+
+    struct fand_config data;
+    struct config_error error;
+
+    fand_assert(config_test_parse(text, &data, &error) == 0);
+    fand_assert(data.interval == 2);
+    fand_assert(data.hysteresis == 3);
+    fand_assert(data.throttle);
+    fand_assert(data.sample_max_age == 250);
+    fand_assert(!data.fan_curve_offload);
+    fand_assert(data.matrix_rows == sizeof(matrix) / 2);
+    fand_assert(memcmp(data.matrix, matrix, sizeof(matrix)) == 0);
+    fand_assert(data.ncard_matrices == 1);
+    fand_assert(data.card_matrices[0].card_idx == 1);
+    fand_assert(data.card_matrices[0].rows == sizeof(card_matrix) / 2);
+    fand_assert(memcmp(data.card_matrices[0].matrix, card_matrix, sizeof(card_matrix)) == 0);
+}
+
+void test_config_parse_errors(void) {
+    static struct config_test_error const cases[] = {
+        { "interval = 2\nfoo = 1\n",                          2, 1 },
+        { "interval = 70000\n",                               1, 12 },
+        { "interval 2\n",                                     1, 10 },
+        { "interval =\n",                                     1, 11 },
+        { "interval = \"2\n",                                 1, 14 },
+        { "interval = 2 3\n",                                 1, 14 },
+        { "aggressive_throttle = yes\n",                      1, 23 },
+        { "matrix=('50::5'\n'80::100'\n",                     3, 1 },
+        { "matrix=('50::5'\n  '256::100')\n",                 2, 4 },
+        { "matrix=('50::5'\n  '60::101')\n",                  2, 8 },
+        { "matrix=('50:5')\n",                                1, 12 },
+        { "matrix=('50::5' '60::10')\n",                      1, 17 },
+        { "matrix=()\n",                                      1, 9 },
+        { "matrix='50::5'\n",                                 1, 8 },
+        { "matrix=('50::5') x\n",                             1, 18 },
+        { "interval = 2\n",                                   2, 1 },
+        { "interval = 2\n\x01 = 3\n",                         2, 1 }
+    };
+
+    struct fand_config data;
+    struct config_error error;
+    unsigned failed = 0;
+
+    for(unsigned i = 0; i < array_size(cases); i++) {
+        if(config_test_parse(cases[i].text, &data, &error) != -1 ||
+           error.line != cases[i].line || error.column != cases[i].column || !error.message[0]) {
+            printf("\n    case %u: %u:%u %s", i, error.line, error.column, error.message);
+            ++failed;
+        }
+    }
+
+    fand_assert(failed == 0);
+}
+
+void test_config_parse_limits(void) {
+    char text[CONFIG_TEST_BUFSIZE];
+    struct fand_config data;
+    struct config_error error;
+    int len;
+
+    /* MAX_TEMP_THRESHOLDS rows */
+    len = snprintf(text, sizeof(text), "matrix=(");
+    for(unsigned i = 0; i < MAX_TEMP_THRESHOLDS; i++) {
+        len += snprintf(text + len, sizeof(text) - (size_t)len, "'%u::%u'\n", 10 * i, 5 * i);
+    }
+    text[len - 1] = ')';
+
+    fand_assert(config_test_parse(text, &data, &error) == 0);
+    fand_assert(data.matrix_rows == MAX_TEMP_THRESHOLDS);
+    fand_assert(data.matrix[2 * MAX_TEMP_THRESHOLDS - 2] == 10 * (MAX_TEMP_THRESHOLDS - 1));
+    fand_assert(data.matrix[2 * MAX_TEMP_THRESHOLDS - 1] == 5 * (MAX_TEMP_THRESHOLDS - 1));
+
+    /* One row too many */
+    snprintf(text + len - 1, sizeof(text) - (size_t)len + 1, "\n'255::100')");
+    fand_assert(config_test_parse(text, &data, &error) == -1);
+    fand_assert(error.line == MAX_TEMP_THRESHOLDS + 1 && error.column == 1);
+
+    /* FAND_MAX_CARDS card matrices and one too many */
+    len = snprintf(text, sizeof(text), "matrix=('50::50')\n");
+    for(unsigned i = 0; i < FAND_MAX_CARDS; i++) {
+        len += snprintf(text + len, sizeof(text) - (size_t)len, "matrix_card%u=('%u::100')\n", i, i);
+    }
+    fand_assert(config_test_parse(text, &data, &error) == 0);
+    fand_assert(data.ncard_matrices == FAND_MAX_CARDS);
+    fand_assert(data.card_matrices[FAND_MAX_CARDS - 1].card_idx == FAND_MAX_CARDS - 1);
+
+    snprintf(text + len, sizeof(text) - (size_t)len, "matrix_card%u=('1::100')\n", FAND_MAX_CARDS);
+    fand_assert(config_test_parse(text, &data, &error) == -1);
+    fand_assert(error.line == FAND_MAX_CARDS + 2);
+}
+
+void test_config_diff(void) {
+    char const *base = "interval = 2\nmatrix=('50::5'\n'80::100')\nmatrix_card1=('40::20'\n'70::100')\n";
+    struct config_test_diff {
+        char const *text;
+        unsigned changes;
+    } const cases[] = {
+        { base,                                                                          0 },
+        { "interval = 3\nmatrix=('50::5'\n'80::100')\nmatrix_card1=('40::20'\n'70::100')\n", CONFIG_CHANGED_INTERVAL },
+        { "interval = 2\nhysteresis = 4\nsample_max_age = 5\nmatrix=('50::5'\n'80::100')\n"
+          "matrix_card1=('40::20'\n'70::100')\n",  CONFIG_CHANGED_HYSTERESIS | CONFIG_CHANGED_SAMPLE_MAX_AGE },
+        { "interval = 2\nmatrix=('50::5'\n'80::90')\nmatrix_card1=('40::20'\n'70::100')\n",  CONFIG_CHANGED_MATRIX },
+        { "interval = 2\nmatrix=('50::5'\n'80::100')\nmatrix_card2=('40::20'\n'70::100')\n", CONFIG_CHANGED_CARD_MATRICES },
+        { "interval = 2\nfan_curve_offload = true\naggressive_throttle = true\nmatrix=('50::5'\n'80::100')\n",
+          CONFIG_CHANGED_OFFLOAD | CONFIG_CHANGED_THROTTLE | CONFIG_CHANGED_CARD_MATRICES }
+    };
+
+    struct fand_config prev;
+    struct fand_config next;
+    struct config_error error;
+    unsigned failed = 0;
+
+    fand_assert(config_test_parse(base, &prev, &error) == 0);
+
+    for(unsigned i = 0; i < array_size(cases); i++) {
+        /* Stale rows past the end of a matrix are not compared */
+        memset(&next, 0, sizeof(next));
+        memset(next.matrix, 0xff, sizeof(next.matrix));
+        memset(next.card_matrices, 0xff, sizeof(next.card_matrices));
+        if(config_parse_string(cases[i].text, strlen(cases[i].text), &next, &error) ||
+           config_diff(&prev, &next) != cases[i].changes) {
+            printf("\n    case %u: %#x", i, config_diff(&prev, &next));
+            ++failed;
+        }
+    }
+
+    fand_assert(failed == 0);
+}
+
+static int config_test_write(char const *path, char const *text) {
+    int fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, S_IRUSR | S_IWUSR);
+    if(fd == -1) {
+        return -1;
+    }
+
+    ssize_t nbytes = write(fd, text, strlen(text));
+    close(fd);
+    return nbytes == (ssize_t)strlen(text) ? 0 : -1;
+}
+
+static unsigned short config_test_load_interval(void) {
+    struct fand_config config = { 0 };
+    return config_load(CONFIG_TEST_PATH, &config) ? 0 : config.interval;
+}
+
+/* Long enough for config_load to remember files written before */
+static inline void config_test_settle(void) {
+    nanosleep(&(struct timespec){ .tv_nsec = 150000000 }, 0);
+}
+
+void test_config_load(void) {
+    int logmask = setlogmask(LOG_UPTO(LOG_ERR));
+
+    /* Rewritten right after being loaded, possibly without the timestamps moving */
+    fand_assert(config_test_write(CONFIG_TEST_PATH, "interval = 2\nmatrix=('50::5')\n") == 0);
+    fand_assert(config_test_load_interval() == 2);
+    fand_assert(config_test_write(CONFIG_TEST_PATH, "interval = 3\nmatrix=('50::5')\n") == 0);
+    fand_assert(config_test_load_interval() == 3);
+
+    /* Unchanged */
+    config_test_settle();
+    fand_assert(config_test_load_interval() == 3);
+    fand_assert(config_test_load_interval() == 3);
+
+    /* Written in place */
+    fand_assert(config_test_write(CONFIG_TEST_PATH, "interval = 14\nmatrix=('50::5')\n") == 0);
+    fand_assert(config_test_load_interval() == 14);
+    config_test_settle();
+    fand_assert(config_test_load_interval() == 14);
+
+    /* Renamed into place */
+    fand_assert(config_test_write(CONFIG_TEST_TMP, "interval = 15\nmatrix=('50::5')\n") == 0);
+    config_test_settle();
+    fand_assert(rename(CONFIG_TEST_TMP, CONFIG_TEST_PATH) == 0);
+    fand_assert(config_test_load_interval() == 15);
+
+    /* Invalid */
+    config_test_settle();
+    fand_assert(config_test_write(CONFIG_TEST_PATH, "interval = 16\n") == 0);
+    fand_assert(config_test_load_interval() == 0);
+
+    unlink(CONFIG_TEST_PATH);
+    setlogmask(logmask);
+}
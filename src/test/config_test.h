@@ -0,0 +1,10 @@
+#ifndef CONFIG_TEST_H
+#define CONFIG_TEST_H
+
+void test_config_parse(void);
+void test_config_parse_errors(void);
+void test_config_parse_limits(void);
+void test_config_diff(void);
+void test_config_load(void);
+
+#endif /* CONFIG_TEST_H */
@@ -0,0 +1,58 @@
+#include "fakesys.h"
+#include "fakesys_test.h"
+#include "fandcfg.h"
+#include "file.h"
+#include "filesystem.h"
+#include "test.h"
+
+#include <string.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define FAKESYS_TEST_ROOT "/tmp/_fand_fakesys_test"
+
+void test_fakesys_root(void) {
+    char path[HWMON_PATH_SIZE];
+    unsigned long value;
+    struct fakesys_card const card = { .temp = 50000, .pwm = 77 };
+
+    mkdir(FAKESYS_TEST_ROOT, S_IRWXU);
+    fand_assert(fakesys_create(FAKESYS_TEST_ROOT, 2, &card) == 0);
+    fand_assert(fsys_set_root(FAKESYS_TEST_ROOT) == 0);
+    fand_assert(strcmp(fsys_root(), FAKESYS_TEST_ROOT) == 0);
+
+    /* Kernel paths resolve to the synthetic tree */
+    fand_assert(fsys_root_path(path, sizeof(path), "/sys/kernel/debug/dri/%u/amdgpu_pm_info", 1u) > 0);
+    fand_assert(fsys_file_exists(path));
+
+    fand_assert(fsys_root_path(path, sizeof(path), "/sys/class/drm/card%u/device/hwmon/hwmon%u/temp1_input", 1u, 1u) > 0);
+    fand_assert(strcmp(path, FAKESYS_TEST_ROOT "/sys/class/drm/card1/device/hwmon/hwmon1/temp1_input") == 0);
+    int fd = open(path, O_RDONLY);
+    fand_assert(fd != -1);
+    fand_assert(fdread_ulong(fd, &value) == 0);
+    fand_assert(value == 50000);
+    close(fd);
+
+    fand_assert(fakesys_attr_path(path, sizeof(path), FAKESYS_TEST_ROOT, 0, "pwm1") == 0);
+    fd = open(path, O_RDONLY);
+    fand_assert(fd != -1);
+    fand_assert(fdread_ulong(fd, &value) == 0);
+    fand_assert(value == 77);
+    close(fd);
+
+    /* Paths that do not fit with the root prepended */
+    fand_assert(fsys_root_path(path, sizeof(FAKESYS_TEST_ROOT) + 4, "/sys/class") == -1);
+
+    fand_assert(fsys_set_root(0) == 0);
+    fand_assert(fsys_root_path(path, sizeof(path), "/sys/class/drm/card%u", 0u) > 0);
+    fand_assert(strcmp(path, "/sys/class/drm/card0") == 0);
+
+    fand_assert(fsys_set_root("/nonexistent/_fand_root") == -1);
+    fand_assert(strcmp(fsys_root(), "") == 0);
+
+    /* Nothing but the root itself is left behind */
+    fand_assert(fakesys_remove(FAKESYS_TEST_ROOT, 2) == 0);
+    fand_assert(rmdir(FAKESYS_TEST_ROOT) == 0);
+}
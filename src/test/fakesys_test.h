@@ -0,0 +1,6 @@
+#ifndef FAKESYS_TEST_H
+#define FAKESYS_TEST_H
+
+void test_fakesys_root(void);
+
+#endif /* FAKESYS_TEST_H */
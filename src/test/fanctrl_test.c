@@ -2,39 +2,312 @@
 #include "fanctrl.h"
 #include "fanctrl_test.h"
 #include "fanctrl_mock.h"
+#include "fancurve_mock.h"
 #include "hwmon_mock.h"
 #include "mock.h"
 #include "interpolation.h"
+#include "sensor_mock.h"
 #include "test.h"
 
 #include <math.h>
 #include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
 #define MAX_PWM 255.f
+#define FAN_CURVE_TEST_PATH "/tmp/_fand_fanctrl_curve_test"
+
+enum { CURVE_TEST_MAX_TEMP = 300 };
+enum { CURVE_TEST_VARIANTS = 12 };
+
+struct reference_state {
+    unsigned char rows;
+    unsigned char temps[MAX_TEMP_THRESHOLDS];
+    unsigned char speeds[MAX_TEMP_THRESHOLDS];
+    unsigned char hysteresis;
+    bool throttle;
+    short current_threshold;
+};
+
+static unsigned long rng_state = 0x2545f491ul;
 
 static int temp = -1;
 static int speed = -1;
 
 static unsigned long pwm;
 
-static int get_speed(void) {
+/* Per-card state for the multi-card test */
+static int card_temps[FAND_MAX_CARDS];
+static unsigned long card_pwms[FAND_MAX_CARDS];
+/* Card whose pwm writes fail, -1 for none */
+static int failing_card = -1;
+
+static bool firmware_control;
+
+static int open_single_card(void) {
+    return 1;
+}
+
+static int open_three_cards(void) {
+    return 3;
+}
+
+static unsigned card_index(unsigned card) {
+    return card;
+}
+
+static int init_sensor(unsigned const *card_indices, unsigned ncards) {
+    (void)card_indices;
+    (void)ncards;
+    return 0;
+}
+
+static int get_speed(unsigned card) {
+    (void)card;
     return speed;
 }
 
-static int get_temp(void) {
-    return temp;
+static int get_temps(int *temps, unsigned ncards) {
+    for(unsigned i = 0; i < ncards; i++) {
+        temps[i] = temp;
+    }
+    return 0;
+}
+
+static int read_pwms(unsigned const *cards, int *pwms, unsigned n) {
+    (void)cards;
+    for(unsigned i = 0; i < n; i++) {
+        pwms[i] = (int)pwm;
+    }
+    return 0;
+}
+
+static int write_pwms(unsigned const *cards, unsigned long const *values, int *status, unsigned n) {
+    (void)cards;
+    for(unsigned i = 0; i < n; i++) {
+        pwm = values[i];
+        status[i] = 0;
+    }
+    return 0;
 }
 
-static int write_pwm(unsigned long value) {
-    pwm =  value;
+static int get_card_temps(int *temps, unsigned ncards) {
+    for(unsigned i = 0; i < ncards; i++) {
+        temps[i] = card_temps[i];
+    }
     return 0;
 }
 
+static int read_card_pwms(unsigned const *cards, int *pwms, unsigned n) {
+    for(unsigned i = 0; i < n; i++) {
+        pwms[i] = (int)card_pwms[cards[i]];
+    }
+    return 0;
+}
+
+static int write_card_pwms(unsigned const *cards, unsigned long const *values, int *status, unsigned n) {
+    for(unsigned i = 0; i < n; i++) {
+        if((int)cards[i] == failing_card) {
+            status[i] = -1;
+            continue;
+        }
+        card_pwms[cards[i]] = values[i];
+        status[i] = 0;
+    }
+    return 0;
+}
+
+static int set_firmware_control(unsigned card, bool enable) {
+    (void)card;
+    firmware_control = enable;
+    return 0;
+}
+
+static int fan_curve_path(char *dst, size_t size, unsigned card_idx) {
+    (void)card_idx;
+    return (size_t)snprintf(dst, size, "%s", FAN_CURVE_TEST_PATH) >= size ? -1 : 0;
+}
+
+/* Replaces the contents of the fake fan_curve file with text */
+static int fan_curve_store(char const *text) {
+    ssize_t len = (ssize_t)strlen(text);
+
+    int fd = open(FAN_CURVE_TEST_PATH, O_CREAT | O_TRUNC | O_WRONLY, S_IRUSR | S_IWUSR);
+    if(fd == -1) {
+        return -1;
+    }
+
+    len -= write(fd, text, (size_t)len);
+    close(fd);
+    return len ? -1 : 0;
+}
+
+/* Whether the fake fan_curve file starts with text */
+static bool fan_curve_starts_with(char const *text) {
+    char buffer[512];
+    ssize_t nbytes;
+
+    int fd = open(FAN_CURVE_TEST_PATH, O_RDONLY);
+    if(fd == -1) {
+        return false;
+    }
+
+    nbytes = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+    if(nbytes < 0) {
+        return false;
+    }
+
+    buffer[nbytes] = '\0';
+    return strncmp(buffer, text, strlen(text)) == 0;
+}
+
+static unsigned rng_next(void) {
+    rng_state = rng_state * 1103515245ul + 12345ul;
+    return (unsigned)(rng_state >> 16) & 0x7fffu;
+}
+
+/* Floating point implementation the lookup table replaced */
+static unsigned long reference_adjust(struct reference_state *ref, int t) {
+    int pct = ref->speeds[ref->rows - 1];
+    short threshold = -1;
+    float frac;
+
+    if(t <= ref->temps[0]) {
+        threshold = -1;
+        pct = ref->speeds[0] * !ref->throttle;
+    }
+    else if(t <= ref->temps[ref->rows - 1]) {
+        for(unsigned i = 0; i < ref->rows - 1u; i++) {
+            if(ref->temps[i] < t && ref->temps[i + 1] >= t) {
+                threshold = i;
+                frac = lerp_inverse(ref->temps[i], ref->temps[i + 1], t);
+                pct = lerp(ref->speeds[i], ref->speeds[i + 1], frac);
+                break;
+            }
+        }
+    }
+    else {
+        threshold = ref->rows - 1;
+        pct = ref->speeds[ref->rows - 1];
+    }
+
+    if(ref->current_threshold > -1 && threshold < ref->current_threshold && t + ref->hysteresis > ref->temps[ref->current_threshold]) {
+        pct = ref->speeds[ref->current_threshold];
+    }
+    else {
+        ref->current_threshold = threshold;
+    }
+
+    return lerp(0ul, 255ul, (float)pct / 100.f);
+}
+
+/* Variants 0-7 are sorted with strictly increasing temperatures,
+ * 8-9 contain duplicate temperatures and 10-11 are unsorted */
+static void curve_test_matrix(struct fand_config *config, struct reference_state *ref, unsigned rows, unsigned variant) {
+    unsigned char t = rng_next() % 40;
+
+    config->matrix_rows = rows;
+    config->hysteresis = rng_next() % 8;
+    for(unsigned i = 0; i < rows; i++) {
+        if(variant < 8) {
+            t += 1 + rng_next() % (variant < 4 ? 6 : 16);
+        }
+        else if(variant < 10) {
+            t += rng_next() % 3;
+        }
+        else {
+            t = rng_next() % 256;
+        }
+        config->matrix[2 * i] = t;
+        config->matrix[2 * i + 1] = rng_next() % 101;
+    }
+
+    ref->rows = rows;
+    ref->hysteresis = config->hysteresis;
+    ref->throttle = config->throttle;
+    ref->current_threshold = -1;
+    for(unsigned i = 0; i < rows; i++) {
+        ref->temps[i] = config->matrix[2 * i];
+        ref->speeds[i] = config->matrix[2 * i + 1];
+    }
+}
+
+/* Configures a controller without state, fanctrl_configure
+ * alone keeps the threshold of an unchanged matrix */
+static int fresh_configure(struct fand_config *config) {
+    fanctrl_release();
+    return fanctrl_init() || fanctrl_configure(config) ? -1 : 0;
+}
+
+void test_fanctrl_curve_matches_reference(void) {
+    mock_guard {
+        mock_fanctrl_get_temps(get_temps);
+        mock_hwmon_open(open_single_card);
+        mock_hwmon_card_index(card_index);
+        mock_sensor_init(init_sensor);
+        mock_hwmon_read_pwms(read_pwms);
+        mock_hwmon_write_pwms(write_pwms);
+
+        fand_assert(fanctrl_init() == 0);
+
+        struct fand_config config = { 0 };
+        struct reference_state ref;
+        unsigned mismatches = 0;
+        unsigned long expected;
+
+        for(unsigned throttle = 0; throttle < 2; throttle++) {
+            config.throttle = throttle;
+            for(unsigned rows = 1; rows <= MAX_TEMP_THRESHOLDS; rows++) {
+                for(unsigned variant = 0; variant < CURVE_TEST_VARIANTS; variant++) {
+                    curve_test_matrix(&config, &ref, rows, variant);
+
+                    /* Every temperature from a fresh controller state */
+                    for(temp = 0; temp <= CURVE_TEST_MAX_TEMP; temp++) {
+                        ref.current_threshold = -1;
+                        expected = reference_adjust(&ref, temp);
+                        if(fresh_configure(&config) != 0 || fanctrl_adjust() != 0 || pwm != expected) {
+                            ++mismatches;
+                        }
+                    }
+
+                    /* Random walk exercising the hysteresis */
+                    mismatches += fresh_configure(&config) != 0;
+                    ref.current_threshold = -1;
+                    temp = rng_next() % 256;
+                    for(unsigned step = 0; step < 512; step++) {
+                        temp += (int)(rng_next() % 9) - 4;
+                        temp = temp < 0 ? 0 : temp > CURVE_TEST_MAX_TEMP ? CURVE_TEST_MAX_TEMP : temp;
+                        expected = reference_adjust(&ref, temp);
+                        if(fanctrl_adjust() != 0 || pwm != expected) {
+                            ++mismatches;
+                        }
+                    }
+                }
+            }
+        }
+
+        fand_assert(mismatches == 0);
+        fanctrl_release();
+    }
+}
+
 void test_fanctrl_adjust(void) {
     mock_guard {
         mock_fanctrl_get_speed(get_speed);
-        mock_fanctrl_get_temp(get_temp);
-        mock_hwmon_write_pwm(write_pwm);
+        mock_fanctrl_get_temps(get_temps);
+        mock_hwmon_open(open_single_card);
+        mock_hwmon_card_index(card_index);
+        mock_sensor_init(init_sensor);
+        mock_hwmon_read_pwms(read_pwms);
+        mock_hwmon_write_pwms(write_pwms);
+
+        fand_assert(fanctrl_init() == 0);
 
         struct fand_config config = {
             .throttle = true,
@@ -79,5 +352,325 @@ void test_fanctrl_adjust(void) {
         temp = 45;
         fand_assert(fanctrl_adjust() == 0);
         fand_assert(pwm == (unsigned long)round(MAX_PWM * 0.2f));
+
+        fanctrl_release();
+    }
+}
+
+void test_fanctrl_sample(void) {
+    mock_guard {
+        mock_fanctrl_get_temps(get_temps);
+        mock_hwmon_open(open_single_card);
+        mock_hwmon_card_index(card_index);
+        mock_sensor_init(init_sensor);
+        mock_hwmon_read_pwms(read_pwms);
+        mock_hwmon_write_pwms(write_pwms);
+
+        struct fanctrl_sample sample;
+        struct fand_config config = {
+            .throttle = true,
+            .matrix_rows = 3,
+            .hysteresis = 3,
+            .interval = 2,
+            .matrix = {
+                50, 20, 60, 50, 80, 100
+            }
+        };
+
+        fand_assert(fanctrl_init() == 0);
+        fand_assert(!fanctrl_get_sample(0, &sample, 0));
+
+        fand_assert(fanctrl_configure(&config) == 0);
+
+        temp = 70;
+        fand_assert(fanctrl_adjust() == 0);
+        fand_assert(fanctrl_get_sample(0, &sample, 0));
+        fand_assert(sample.temp == 70);
+        fand_assert(sample.target_pwm == pwm);
+        fand_assert(sample.pwm == (int)pwm);
+        fand_assert(sample.speed == (int)(100 * lerp_inverse(0, 255, pwm)));
+        fand_assert(sample.threshold == 1);
+
+        /* Sensors are not touched when serving the sample */
+        temp = -1;
+        fand_assert(fanctrl_get_sample(0, &sample, 1000));
+        fand_assert(sample.temp == 70);
+
+        nanosleep(&(struct timespec){ .tv_nsec = 5000000 }, 0);
+        fand_assert(!fanctrl_get_sample(0, &sample, 1));
+        fand_assert(fanctrl_get_sample(0, &sample, 0));
+        fand_assert(!fanctrl_get_sample(1, &sample, 0));
+
+        fanctrl_release();
+        fand_assert(!fanctrl_get_sample(0, &sample, 0));
+    }
+}
+
+void test_fanctrl_multiple_cards(void) {
+    mock_guard {
+        mock_fanctrl_get_temps(get_card_temps);
+        mock_hwmon_open(open_three_cards);
+        mock_hwmon_card_index(card_index);
+        mock_sensor_init(init_sensor);
+        mock_hwmon_read_pwms(read_card_pwms);
+        mock_hwmon_write_pwms(write_card_pwms);
+
+        struct fanctrl_sample sample;
+        struct fand_config config = {
+            .throttle = true,
+            .matrix_rows = 3,
+            .hysteresis = 3,
+            .interval = 2,
+            .matrix = {
+                50, 20, 60, 50, 80, 100
+            },
+            .ncard_matrices = 1,
+            .card_matrices = {
+                { .card_idx = 2, .rows = 2, .matrix = { 30, 40, 40, 60 } }
+            }
+        };
+
+        fand_assert(fanctrl_init() == 0);
+        fand_assert(fanctrl_card_count() == 3);
+        fand_assert(fanctrl_configure(&config) == 0);
+
+        card_temps[0] = 70;
+        card_temps[1] = 55;
+        card_temps[2] = 35;
+
+        fand_assert(fanctrl_adjust() == 0);
+        fand_assert(card_pwms[0] == (unsigned long)round(MAX_PWM * 0.75f));
+        fand_assert(card_pwms[1] == (unsigned long)round(MAX_PWM * 0.35f));
+        /* Card 2 uses its own matrix */
+        fand_assert(card_pwms[2] == (unsigned long)round(MAX_PWM * 0.5f));
+
+        /* Hysteresis is tracked per card */
+        card_temps[0] = 58;
+        card_temps[1] = 58;
+        fand_assert(fanctrl_adjust() == 0);
+        fand_assert(card_pwms[0] == (unsigned long)round(MAX_PWM * 0.5f));
+        fand_assert(card_pwms[1] == (unsigned long)round(MAX_PWM * 0.44f));
+
+        /* A failing card does not stop the others */
+        card_temps[1] = -1;
+        card_temps[2] = 45;
+        fand_assert(fanctrl_adjust() == -1);
+        fand_assert(card_pwms[2] == (unsigned long)round(MAX_PWM * 0.6f));
+
+        fand_assert(fanctrl_get_sample(2, &sample, 0));
+        fand_assert(sample.temp == 45);
+        fand_assert(sample.card_idx == 2);
+        fand_assert(!fanctrl_get_sample(3, &sample, 0));
+
+        /* As does one that cannot be written to */
+        card_temps[1] = 55;
+        card_temps[2] = 35;
+        failing_card = 0;
+        fand_assert(fanctrl_adjust() == -1);
+        fand_assert(card_pwms[1] == (unsigned long)round(MAX_PWM * 0.35f));
+        fand_assert(card_pwms[2] == (unsigned long)round(MAX_PWM * 0.5f));
+        fand_assert(fanctrl_get_sample(0, &sample, 0));
+        fand_assert(sample.temp == 58);
+        failing_card = -1;
+
+        fanctrl_release();
+    }
+}
+
+void test_fanctrl_fan_curve_offload(void) {
+    char const *range =
+        "OD_RANGE:\n"
+        "FAN_CURVE(hotspot temp): 25C 100C\n"
+        "FAN_CURVE(fan speed): 15% 100%\n";
+    char const *commands = "0 30 20\n1 40 35\n2 50 50\n3 70 75\n4 90 100\nc\n";
+    char table[256];
+
+    mock_guard {
+        mock_fanctrl_get_temps(get_temps);
+        mock_hwmon_open(open_single_card);
+        mock_hwmon_card_index(card_index);
+        mock_hwmon_set_firmware_control(set_firmware_control);
+        mock_sensor_init(init_sensor);
+        mock_hwmon_read_pwms(read_pwms);
+        mock_hwmon_write_pwms(write_pwms);
+        mock_fancurve_path(fan_curve_path);
+
+        struct fanctrl_sample sample;
+        struct fand_config config = {
+            .throttle = false,
+            .matrix_rows = 3,
+            .hysteresis = 0,
+            .interval = 2,
+            .fan_curve_offload = true,
+            .matrix = {
+                30, 20, 50, 50, 90, 100
+            }
+        };
+
+        snprintf(table, sizeof(table), "OD_FAN_CURVE:\n0: 0C 0%%\n1: 0C 0%%\n2: 0C 0%%\n3: 0C 0%%\n4: 0C 0%%\n%s", range);
+        fand_assert(fan_curve_store(table) == 0);
+
+        fand_assert(fanctrl_init() == 0);
+        fand_assert(fanctrl_configure(&config) == 0);
+        fand_assert(firmware_control);
+        fand_assert(fan_curve_starts_with(commands));
+        /* Only supervision remains */
+        fand_assert(fanctrl_interval(&config) > config.interval);
+
+        /* The kernel now reports the written curve */
+        snprintf(table, sizeof(table), "OD_FAN_CURVE:\n0: 30C 20%%\n1: 40C 35%%\n2: 50C 50%%\n3: 70C 75%%\n4: 90C 100%%\n%s", range);
+        fand_assert(fan_curve_store(table) == 0);
+
+        temp = 60;
+        pwm = 100;
+        fand_assert(fanctrl_adjust() == 0);
+        /* Neither the curve nor the pwm are touched */
+        fand_assert(fan_curve_starts_with(table));
+        fand_assert(pwm == 100);
+        fand_assert(fanctrl_get_sample(0, &sample, 0));
+        fand_assert(sample.temp == 60);
+        fand_assert(sample.pwm == 100);
+        fand_assert(sample.threshold == -1);
+
+        /* A curve modified behind the daemon's back is reapplied */
+        snprintf(table, sizeof(table), "OD_FAN_CURVE:\n0: 30C 20%%\n1: 40C 35%%\n2: 50C 50%%\n3: 70C 75%%\n4: 90C 90%%\n%s", range);
+        fand_assert(fan_curve_store(table) == 0);
+        fand_assert(fanctrl_adjust() == 0);
+        fand_assert(fan_curve_starts_with(commands));
+        fand_assert(firmware_control);
+
+        /* Disabling offload restores the default curve */
+        config.fan_curve_offload = false;
+        fand_assert(fanctrl_configure(&config) == 0);
+        fand_assert(!firmware_control);
+        fand_assert(fan_curve_starts_with("r\nc\n"));
+        fand_assert(fanctrl_interval(&config) == config.interval);
+
+        /* Control stays in software if the firmware has no curve */
+        unlink(FAN_CURVE_TEST_PATH);
+        config.fan_curve_offload = true;
+        fand_assert(fanctrl_configure(&config) == 0);
+        fand_assert(!firmware_control);
+        fand_assert(fanctrl_interval(&config) == config.interval);
+        temp = 70;
+        fand_assert(fanctrl_adjust() == 0);
+        fand_assert(pwm == (unsigned long)round(MAX_PWM * 0.75f));
+
+        fanctrl_release();
+    }
+}
+
+void test_fanctrl_snapshot(void) {
+    mock_guard {
+        mock_fanctrl_get_temps(get_card_temps);
+        mock_hwmon_open(open_three_cards);
+        mock_hwmon_card_index(card_index);
+        mock_sensor_init(init_sensor);
+        mock_hwmon_read_pwms(read_card_pwms);
+        mock_hwmon_write_pwms(write_card_pwms);
+
+        struct fanctrl_sample samples[FAND_MAX_CARDS];
+        struct fand_config config = {
+            .throttle = true,
+            .matrix_rows = 3,
+            .hysteresis = 3,
+            .interval = 2,
+            .matrix = {
+                50, 20, 60, 50, 80, 100
+            },
+            .ncard_matrices = 1,
+            .card_matrices = {
+                { .card_idx = 1, .rows = 2, .matrix = { 40, 30, 70, 100 } }
+            }
+        };
+
+        fand_assert(fanctrl_init() == 0);
+        fand_assert(fanctrl_configure(&config) == 0);
+
+        card_temps[0] = 70;
+        card_temps[1] = 55;
+        card_temps[2] = 35;
+        fand_assert(fanctrl_adjust() == 0);
+
+        /* Served from the samples of the last tick */
+        card_temps[0] = 20;
+        fand_assert(fanctrl_snapshot(samples, 0) == 3);
+        fand_assert(samples[0].temp == 70);
+        fand_assert(samples[1].temp == 55);
+        fand_assert(samples[2].card_idx == 2);
+        fand_assert(samples[0].threshold == 1);
+        fand_assert(samples[0].timestamp == samples[2].timestamp);
+
+        /* Thresholds of cards with a matrix of their own index that one */
+        fand_assert(samples[0].default_matrix && samples[2].default_matrix);
+        fand_assert(!samples[1].default_matrix);
+        fand_assert(samples[1].threshold == 0);
+
+        /* A card missing from the last tick makes every card be read */
+        card_temps[0] = 70;
+        card_temps[1] = -1;
+        card_temps[2] = 45;
+        fand_assert(fanctrl_adjust() == -1);
+        card_temps[2] = 40;
+        fand_assert(fanctrl_snapshot(samples, 0) == 3);
+        fand_assert(samples[1].temp == -1);
+        fand_assert(samples[2].temp == 40);
+        fand_assert(samples[2].pwm == (int)card_pwms[2]);
+        fand_assert(samples[0].timestamp == samples[1].timestamp);
+
+        fanctrl_release();
+        fand_assert(fanctrl_snapshot(samples, 0) == 0);
+    }
+}
+
+void test_fanctrl_reconfigure_keeps_hysteresis(void) {
+    mock_guard {
+        mock_fanctrl_get_temps(get_temps);
+        mock_hwmon_open(open_single_card);
+        mock_hwmon_card_index(card_index);
+        mock_sensor_init(init_sensor);
+        mock_hwmon_read_pwms(read_pwms);
+        mock_hwmon_write_pwms(write_pwms);
+
+        struct fand_config config = {
+            .throttle = true,
+            .matrix_rows = 3,
+            .hysteresis = 3,
+            .interval = 2,
+            .matrix = {
+                50, 20, 60, 50, 80, 100
+            }
+        };
+
+        fand_assert(fanctrl_init() == 0);
+        fand_assert(fanctrl_configure(&config) == 0);
+
+        temp = 70;
+        fand_assert(fanctrl_adjust() == 0);
+
+        /* Held at the 60 degree threshold */
+        temp = 58;
+        fand_assert(fanctrl_adjust() == 0);
+        fand_assert(pwm == (unsigned long)round(MAX_PWM * 0.5f));
+
+        /* Unrelated changes keep the hold */
+        config.interval = 5;
+        config.throttle = false;
+        fand_assert(fanctrl_configure(&config) == 0);
+        fand_assert(fanctrl_adjust() == 0);
+        fand_assert(pwm == (unsigned long)round(MAX_PWM * 0.5f));
+
+        /* As does a new matrix with the threshold, holding its speed */
+        config.matrix_rows = 4;
+        memcpy(config.matrix, (unsigned char[]){ 50, 20, 60, 60, 70, 80, 80, 100 }, 8);
+        fand_assert(fanctrl_configure(&config) == 0);
+        fand_assert(fanctrl_adjust() == 0);
+        fand_assert(pwm == (unsigned long)round(MAX_PWM * 0.6f));
+
+        temp = 57;
+        fand_assert(fanctrl_adjust() == 0);
+        fand_assert(pwm == (unsigned long)round(MAX_PWM * 0.48f));
+
+        fanctrl_release();
     }
 }
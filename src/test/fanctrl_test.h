@@ -2,5 +2,11 @@
 #define FANCTRL_TEST_H
 
 void test_fanctrl_adjust(void);
+void test_fanctrl_curve_matches_reference(void);
+void test_fanctrl_sample(void);
+void test_fanctrl_multiple_cards(void);
+void test_fanctrl_fan_curve_offload(void);
+void test_fanctrl_snapshot(void);
+void test_fanctrl_reconfigure_keeps_hysteresis(void);
 
 #endif /* FANCTRL_TEST_H */
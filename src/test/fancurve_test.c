@@ -0,0 +1,130 @@
+#include "fancurve.h"
+#include "fancurve_test.h"
+#include "test.h"
+
+#include <string.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define FANCURVE_TEST_PATH "/tmp/_fand_fancurve_test"
+
+/* As printed by the kernel */
+static char const fancurve_table[] =
+    "OD_FAN_CURVE:\n"
+    "0: 0C 0%\n"
+    "1: 45C 30%\n"
+    "2: 60C 45%\n"
+    "3: 75C 70%\n"
+    "4: 90C 100%\n"
+    "OD_RANGE:\n"
+    "FAN_CURVE(hotspot temp): 25C 100C\n"
+    "FAN_CURVE(fan speed): 15% 100%\n";
+
+static int fancurve_test_read_file(char *buffer, size_t size) {
+    ssize_t nbytes;
+
+    int fd = open(FANCURVE_TEST_PATH, O_RDONLY);
+    if(fd == -1) {
+        return -1;
+    }
+
+    nbytes = read(fd, buffer, size - 1);
+    close(fd);
+    if(nbytes < 0) {
+        return -1;
+    }
+
+    buffer[nbytes] = '\0';
+    return 0;
+}
+
+void test_fancurve_parse(void) {
+    struct fancurve curve;
+
+    fand_assert(fancurve_parse(fancurve_table, &curve) == 0);
+    fand_assert(curve.npoints == 5);
+    fand_assert(curve.temps[1] == 45);
+    fand_assert(curve.speeds[1] == 30);
+    fand_assert(curve.temps[4] == 90);
+    fand_assert(curve.speeds[4] == 100);
+    fand_assert(curve.temp_min == 25);
+    fand_assert(curve.temp_max == 100);
+    fand_assert(curve.speed_min == 15);
+    fand_assert(curve.speed_max == 100);
+
+    /* Ranges are required */
+    fand_assert(fancurve_parse("OD_FAN_CURVE:\n0: 30C 20%\n", &curve) == -1);
+    /* Points must be consecutive */
+    fand_assert(fancurve_parse("OD_FAN_CURVE:\n1: 30C 20%\nOD_RANGE:\n"
+                               "FAN_CURVE(hotspot temp): 25C 100C\n"
+                               "FAN_CURVE(fan speed): 15% 100%\n", &curve) == -1);
+    /* Speeds are percentages */
+    fand_assert(fancurve_parse("OD_FAN_CURVE:\n0: 30C 120%\nOD_RANGE:\n"
+                               "FAN_CURVE(hotspot temp): 25C 100C\n"
+                               "FAN_CURVE(fan speed): 15% 100%\n", &curve) == -1);
+    fand_assert(fancurve_parse("", &curve) == -1);
+}
+
+void test_fancurve_from_matrix(void) {
+    struct fancurve curve;
+    unsigned char const matrix[] = { 30, 20, 50, 50, 90, 100 };
+    unsigned char const clamped[] = { 10, 5, 110, 100 };
+    unsigned char const narrow[] = { 50, 50, 51, 60 };
+
+    /* Unused points split the widest segment on the linear curve */
+    fand_assert(fancurve_parse(fancurve_table, &curve) == 0);
+    fand_assert(fancurve_from_matrix(&curve, matrix, 3) == 0);
+    fand_assert(curve.npoints == 5);
+    fand_assert(memcmp(curve.temps, (unsigned char[]){ 30, 40, 50, 70, 90 }, 5) == 0);
+    fand_assert(memcmp(curve.speeds, (unsigned char[]){ 20, 35, 50, 75, 100 }, 5) == 0);
+
+    /* Values outside the firmware ranges are clamped */
+    fand_assert(fancurve_parse(fancurve_table, &curve) == 0);
+    curve.npoints = 3;
+    fand_assert(fancurve_from_matrix(&curve, clamped, 2) == 0);
+    fand_assert(memcmp(curve.temps, (unsigned char[]){ 25, 60, 100 }, 3) == 0);
+    fand_assert(memcmp(curve.speeds, (unsigned char[]){ 15, 53, 100 }, 3) == 0);
+
+    /* The last point is repeated once no segment can be split */
+    fand_assert(fancurve_parse(fancurve_table, &curve) == 0);
+    curve.npoints = 3;
+    fand_assert(fancurve_from_matrix(&curve, narrow, 2) == 0);
+    fand_assert(memcmp(curve.temps, (unsigned char[]){ 50, 51, 51 }, 3) == 0);
+    fand_assert(memcmp(curve.speeds, (unsigned char[]){ 50, 60, 60 }, 3) == 0);
+
+    /* More rows than firmware points */
+    curve.npoints = 2;
+    fand_assert(fancurve_from_matrix(&curve, matrix, 3) == -1);
+}
+
+void test_fancurve_write(void) {
+    char buffer[256];
+    struct fancurve curve;
+    struct fancurve readback;
+
+    int fd = open(FANCURVE_TEST_PATH, O_CREAT | O_TRUNC | O_WRONLY, S_IRUSR | S_IWUSR);
+    fand_assert(fd != -1);
+    fand_assert(write(fd, fancurve_table, sizeof(fancurve_table) - 1) == (ssize_t)(sizeof(fancurve_table) - 1));
+    close(fd);
+
+    fand_assert(fancurve_read(FANCURVE_TEST_PATH, &curve) == 0);
+    fand_assert(fancurve_parse(fancurve_table, &readback) == 0);
+    fand_assert(fancurve_points_equal(&curve, &readback));
+    readback.speeds[2] = 50;
+    fand_assert(!fancurve_points_equal(&curve, &readback));
+
+    fand_assert(truncate(FANCURVE_TEST_PATH, 0) == 0);
+    fand_assert(fancurve_write(FANCURVE_TEST_PATH, &curve) == 0);
+    fand_assert(fancurve_test_read_file(buffer, sizeof(buffer)) == 0);
+    fand_assert(strcmp(buffer, "0 0 0\n1 45 30\n2 60 45\n3 75 70\n4 90 100\nc\n") == 0);
+
+    fand_assert(truncate(FANCURVE_TEST_PATH, 0) == 0);
+    fand_assert(fancurve_reset(FANCURVE_TEST_PATH) == 0);
+    fand_assert(fancurve_test_read_file(buffer, sizeof(buffer)) == 0);
+    fand_assert(strcmp(buffer, "r\nc\n") == 0);
+
+    unlink(FANCURVE_TEST_PATH);
+    fand_assert(fancurve_read(FANCURVE_TEST_PATH, &curve) == -1);
+}
@@ -0,0 +1,8 @@
+#ifndef FANCURVE_TEST_H
+#define FANCURVE_TEST_H
+
+void test_fancurve_parse(void);
+void test_fancurve_from_matrix(void);
+void test_fancurve_write(void);
+
+#endif /* FANCURVE_TEST_H */
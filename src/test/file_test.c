@@ -0,0 +1,132 @@
+#include "file.h"
+#include "file_test.h"
+#include "test.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define FILE_TEST_PATH "/tmp/_fand_file_test"
+
+/* More than fit in a single submission */
+enum { FILE_TEST_BATCH_SIZE = 40 };
+
+static int file_test_batch_roundtrip(struct fdio_ulong *ops, unsigned nops) {
+    int nfailed = 0;
+
+    for(unsigned i = 0; i < nops; i++) {
+        ops[i].value = 1000 - 17 * i;
+    }
+    nfailed += fdwrite_ulong_batch(ops, nops);
+
+    for(unsigned i = 0; i < nops; i++) {
+        ops[i].value = 0;
+    }
+    nfailed += fdread_ulong_batch(ops, nops);
+
+    for(unsigned i = 0; i < nops; i++) {
+        nfailed += ops[i].status != 0 || ops[i].value != 1000 - 17 * i;
+    }
+
+    return nfailed;
+}
+
+void test_fdwrite_fdread_ulong(void) {
+    unsigned long value = 0;
+
+    int fd = open(FILE_TEST_PATH, O_CREAT | O_TRUNC | O_RDWR, S_IRUSR | S_IWUSR);
+    fand_assert(fd != -1);
+
+    fand_assert(fdwrite_ulong(fd, 255) == 0);
+    fand_assert(fdread_ulong(fd, &value) == 0);
+    fand_assert(value == 255);
+
+    /* Shorter values must not pick up trailing digits from earlier writes */
+    fand_assert(fdwrite_ulong(fd, 7) == 0);
+    fand_assert(fdread_ulong(fd, &value) == 0);
+    fand_assert(value == 7);
+
+    fand_assert(fdwrite_ulong(fd, 0) == 0);
+    fand_assert(fdread_ulong(fd, &value) == 0);
+    fand_assert(value == 0);
+
+    fand_assert(fdwrite_ulong(fd, 65000) == 0);
+    fand_assert(fdread_ulong(fd, &value) == 0);
+    fand_assert(value == 65000);
+
+    fand_assert(fdwrite_ulong(fd, ULONG_MAX) == 0);
+    fand_assert(fdread_ulong(fd, &value) == 0);
+    fand_assert(value == ULONG_MAX);
+
+    close(fd);
+    unlink(FILE_TEST_PATH);
+}
+
+void test_fdread_ulong_invalid(void) {
+    unsigned long value = 13;
+    char buffer[64];
+
+    int fd = open(FILE_TEST_PATH, O_CREAT | O_TRUNC | O_RDWR, S_IRUSR | S_IWUSR);
+    fand_assert(fd != -1);
+
+    fand_assert(fdread_ulong(fd, &value) < 0);
+    fand_assert(write(fd, "12a\n", 4) == 4);
+    fand_assert(fdread_ulong(fd, &value) < 0);
+    fand_assert(value == 13);
+
+    /* ULONG_MAX + 1 */
+    fand_assert(snprintf(buffer, sizeof(buffer), "%lu\n", ULONG_MAX) > 0);
+    buffer[strlen(buffer) - 2]++;
+    fand_assert(ftruncate(fd, 0) == 0);
+    fand_assert(pwrite(fd, buffer, strlen(buffer), 0) == (ssize_t)strlen(buffer));
+    fand_assert(fdread_ulong(fd, &value) < 0);
+    fand_assert(value == 13);
+
+    /* Longer than any valid value, the read is cut short */
+    memset(buffer, '0', sizeof(buffer));
+    fand_assert(pwrite(fd, buffer, sizeof(buffer), 0) == (ssize_t)sizeof(buffer));
+    fand_assert(fdread_ulong(fd, &value) < 0);
+    fand_assert(value == 13);
+
+    close(fd);
+    unlink(FILE_TEST_PATH);
+}
+
+void test_fdbatch_ulong(void) {
+    struct fdio_ulong ops[FILE_TEST_BATCH_SIZE];
+    char path[64];
+
+    for(unsigned i = 0; i < FILE_TEST_BATCH_SIZE; i++) {
+        snprintf(path, sizeof(path), FILE_TEST_PATH "%u", i);
+        ops[i].fd = open(path, O_CREAT | O_TRUNC | O_RDWR, S_IRUSR | S_IWUSR);
+        fand_assert(ops[i].fd != -1);
+    }
+
+    /* Synchronous fallback */
+    fand_assert(file_test_batch_roundtrip(ops, FILE_TEST_BATCH_SIZE) == 0);
+
+    /* io_uring, if available */
+    fdbatch_init();
+    fand_assert(file_test_batch_roundtrip(ops, FILE_TEST_BATCH_SIZE) == 0);
+
+    /* A failing descriptor only fails its own operation */
+    close(ops[3].fd);
+    ops[3].fd = -1;
+    fand_assert(fdread_ulong_batch(ops, FILE_TEST_BATCH_SIZE) == 1);
+    fand_assert(ops[3].status < 0);
+    fand_assert(ops[4].status == 0 && ops[4].value == 1000 - 17 * 4);
+
+    fdbatch_close();
+
+    for(unsigned i = 0; i < FILE_TEST_BATCH_SIZE; i++) {
+        if(ops[i].fd != -1) {
+            close(ops[i].fd);
+        }
+        snprintf(path, sizeof(path), FILE_TEST_PATH "%u", i);
+        unlink(path);
+    }
+}
@@ -0,0 +1,8 @@
+#ifndef FILE_TEST_H
+#define FILE_TEST_H
+
+void test_fdwrite_fdread_ulong(void);
+void test_fdread_ulong_invalid(void);
+void test_fdbatch_ulong(void);
+
+#endif /* FILE_TEST_H */
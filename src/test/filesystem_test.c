@@ -0,0 +1,68 @@
+#include "filesystem.h"
+#include "filesystem_test.h"
+#include "test.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define WATCH_TEST_DIR "/tmp/_fand_watch_test"
+#define WATCH_TEST_PATH WATCH_TEST_DIR "/fand.conf"
+#define WATCH_TEST_TMP WATCH_TEST_DIR "/fand.conf.tmp"
+#define WATCH_TEST_OTHER WATCH_TEST_DIR "/other.conf"
+
+static int watch_test_write(char const *path) {
+    int fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, S_IRUSR | S_IWUSR);
+    if(fd == -1) {
+        return -1;
+    }
+
+    ssize_t nbytes = write(fd, "interval = 2\n", 13);
+    close(fd);
+    return nbytes == 13 ? 0 : -1;
+}
+
+void test_fsys_watch_event(void) {
+    struct inotify_watch watch = { .fd = -1, .wd = -1 };
+
+    mkdir(WATCH_TEST_DIR, S_IRWXU);
+    fand_assert(watch_test_write(WATCH_TEST_PATH) == 0);
+    fand_assert(fsys_watch_init(WATCH_TEST_PATH, &watch, IN_CLOSE_WRITE | IN_MOVED_TO) == 0);
+
+    /* Nothing pending */
+    fand_assert(fsys_watch_event(WATCH_TEST_PATH, &watch) == 0);
+    fand_assert(!watch.triggered);
+
+    /* Written in place */
+    fand_assert(watch_test_write(WATCH_TEST_PATH) == 0);
+    fand_assert(fsys_watch_event(WATCH_TEST_PATH, &watch) == 0);
+    fand_assert(watch.triggered);
+
+    /* Other files in the directory */
+    fand_assert(watch_test_write(WATCH_TEST_OTHER) == 0);
+    fand_assert(fsys_watch_event(WATCH_TEST_PATH, &watch) == 0);
+    fand_assert(!watch.triggered);
+
+    /* Saved atomically by renaming into place */
+    fand_assert(watch_test_write(WATCH_TEST_TMP) == 0);
+    fand_assert(rename(WATCH_TEST_TMP, WATCH_TEST_PATH) == 0);
+    fand_assert(fsys_watch_event(WATCH_TEST_PATH, &watch) == 0);
+    fand_assert(watch.triggered);
+
+    /* Bursts are drained at once */
+    for(unsigned i = 0; i < 64; i++) {
+        watch_test_write(WATCH_TEST_PATH);
+    }
+    fand_assert(fsys_watch_event(WATCH_TEST_PATH, &watch) == 0);
+    fand_assert(watch.triggered);
+    fand_assert(fsys_watch_event(WATCH_TEST_PATH, &watch) == 0);
+    fand_assert(!watch.triggered);
+
+    fand_assert(fsys_watch_clear(&watch) == 0);
+    unlink(WATCH_TEST_PATH);
+    unlink(WATCH_TEST_OTHER);
+    rmdir(WATCH_TEST_DIR);
+}
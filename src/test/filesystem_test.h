@@ -0,0 +1,6 @@
+#ifndef FILESYSTEM_TEST_H
+#define FILESYSTEM_TEST_H
+
+void test_fsys_watch_event(void);
+
+#endif /* FILESYSTEM_TEST_H */
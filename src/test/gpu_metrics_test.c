@@ -0,0 +1,292 @@
+#include "gpu_metrics.h"
+#include "gpu_metrics_test.h"
+#include "test.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Copies of the leading fields of struct gpu_metrics_v* from the kernel's
+ * drivers/gpu/drm/amd/include/kgd_pp_interface.h, up to the last field
+ * the decoder reads. Kept independent of the decoder's offset table */
+struct metrics_table_header {
+    uint16_t structure_size;
+    uint8_t format_revision;
+    uint8_t content_revision;
+};
+
+struct gpu_metrics_v1_0 {
+    struct metrics_table_header common_header;
+    uint64_t system_clock_counter;
+    uint16_t temperature_edge;
+    uint16_t temperature_hotspot;
+    uint16_t temperature_mem;
+    uint16_t temperature_vrgfx;
+    uint16_t temperature_vrsoc;
+    uint16_t temperature_vrmem;
+    uint16_t average_gfx_activity;
+    uint16_t average_umc_activity;
+    uint16_t average_mm_activity;
+    uint16_t average_socket_power;
+    uint32_t energy_accumulator;
+    uint16_t average_clocks[7];
+    uint16_t current_clocks[7];
+    uint32_t throttle_status;
+    uint16_t current_fan_speed;
+};
+
+/* Content revisions 2 and 3 only append fields */
+struct gpu_metrics_v1_1 {
+    struct metrics_table_header common_header;
+    uint16_t temperature_edge;
+    uint16_t temperature_hotspot;
+    uint16_t temperature_mem;
+    uint16_t temperature_vrgfx;
+    uint16_t temperature_vrsoc;
+    uint16_t temperature_vrmem;
+    uint16_t average_gfx_activity;
+    uint16_t average_umc_activity;
+    uint16_t average_mm_activity;
+    uint16_t average_socket_power;
+    uint64_t energy_accumulator;
+    uint64_t system_clock_counter;
+    uint16_t average_clocks[7];
+    uint16_t current_clocks[7];
+    uint32_t throttle_status;
+    uint16_t current_fan_speed;
+};
+
+struct gpu_metrics_v2_0 {
+    struct metrics_table_header common_header;
+    uint64_t system_clock_counter;
+    uint16_t temperature_gfx;
+    uint16_t temperature_soc;
+    uint16_t temperature_core[8];
+    uint16_t temperature_l3[2];
+    uint16_t average_gfx_activity;
+};
+
+/* Content revisions 2 to 4 only append fields */
+struct gpu_metrics_v2_1 {
+    struct metrics_table_header common_header;
+    uint16_t temperature_gfx;
+    uint16_t temperature_soc;
+    uint16_t temperature_core[8];
+    uint16_t temperature_l3[2];
+    uint16_t average_gfx_activity;
+};
+
+/* Synthetic tables, no dumps from hardware were available. They were laid
+ * out by hand after the kernel structs above, unused fields hold random
+ * bytes. test_gpu_metrics_decode_structs checks the layout independently */
+static unsigned char const gpu_metrics_v1_0[] = {
+    0x50, 0x00, 0x01, 0x00, 0xa6, 0x0c, 0x12, 0xd2, 0xc0, 0x21, 0x5e, 0x8f, 0x3a, 0x0d, 0x00, 0x00,
+    0x2e, 0x00, 0x35, 0x00, 0x3e, 0x00, 0x2c, 0x00, 0x29, 0x00, 0x30, 0x00, 0x0c, 0x00, 0x03, 0x00,
+    0x00, 0x00, 0x25, 0x00, 0x93, 0x95, 0x65, 0x0c, 0xf9, 0x38, 0x0b, 0x8e, 0xdb, 0x22, 0x4a, 0x6b,
+    0x24, 0x8a, 0x1e, 0x92, 0x4e, 0x8f, 0xd0, 0xae, 0x2e, 0x1a, 0x94, 0x92, 0xa3, 0x30, 0x5f, 0x18,
+    0x8c, 0xb6, 0x10, 0x90, 0x0f, 0x9e, 0x34, 0x7f, 0x50, 0x04, 0x6d, 0xc6, 0x50, 0x77, 0x95, 0xec,
+};
+
+static unsigned char const gpu_metrics_v1_1[] = {
+    0x68, 0x00, 0x01, 0x01, 0x33, 0x00, 0x3c, 0x00, 0x42, 0x00, 0x31, 0x00, 0x2d, 0x00, 0x34, 0x00,
+    0x57, 0x00, 0x28, 0x00, 0x00, 0x00, 0xd4, 0x00, 0x6b, 0x2a, 0xc1, 0x57, 0x26, 0xee, 0x7d, 0x6b,
+    0xc0, 0x21, 0x5e, 0x8f, 0x3a, 0x0d, 0x00, 0x00, 0xe0, 0xd1, 0x50, 0x57, 0xb1, 0x59, 0x98, 0x7f,
+    0x94, 0xcc, 0x74, 0x11, 0xd7, 0x17, 0xf1, 0x45, 0x79, 0xb2, 0xaa, 0x10, 0x0f, 0xbb, 0xb3, 0x4f,
+    0xa5, 0x93, 0xfe, 0xae, 0xd2, 0x72, 0x48, 0xb7, 0xae, 0x06, 0xab, 0x58, 0x05, 0xf0, 0x76, 0x5a,
+    0x2b, 0x9c, 0x1d, 0x7e, 0x0f, 0x37, 0xc4, 0x49, 0x21, 0xbd, 0x3f, 0x65, 0x64, 0xea, 0xdf, 0x7f,
+    0x14, 0x2a, 0x72, 0x66, 0x8c, 0x47, 0xe2, 0x23,
+};
+
+static unsigned char const gpu_metrics_v1_3[] = {
+    0x08, 0x01, 0x01, 0x03, 0x26, 0x00, 0x29, 0x00, 0x2c, 0x00, 0x25, 0x00, 0x24, 0x00, 0x27, 0x00,
+    0x02, 0x00, 0x01, 0x00, 0xff, 0xff, 0x09, 0x00, 0x96, 0x2e, 0x43, 0x48, 0x01, 0x25, 0x6b, 0x88,
+    0xc0, 0x21, 0x5e, 0x8f, 0x3a, 0x0d, 0x00, 0x00, 0x83, 0xf3, 0x9e, 0xa7, 0xad, 0xbd, 0x0d, 0x74,
+    0xe6, 0xde, 0xc7, 0xf3, 0xdf, 0xae, 0xcc, 0x8f, 0x64, 0x65, 0x66, 0x64, 0x1a, 0x7b, 0xa2, 0x66,
+    0x0f, 0x30, 0x11, 0xfc, 0x35, 0x70, 0x29, 0x1c, 0xff, 0xff, 0x0d, 0x1a, 0x00, 0x91, 0x26, 0x89,
+    0x19, 0xf2, 0x5d, 0x9d, 0x06, 0x12, 0xdf, 0x35, 0x9d, 0x60, 0x26, 0xa2, 0x40, 0xf4, 0x58, 0x9a,
+    0x5d, 0x79, 0x1f, 0x1d, 0xd9, 0x7c, 0xfe, 0xfa, 0x77, 0x7a, 0x7b, 0x4f, 0x15, 0x24, 0x1a, 0xbf,
+    0x57, 0xbd, 0x43, 0x7a, 0xd4, 0xb1, 0x29, 0x84, 0x05, 0x34, 0xf3, 0xf3, 0x87, 0x5c, 0x25, 0xb0,
+    0x8b, 0xea, 0x06, 0xc2, 0x87, 0x4c, 0xfa, 0xa4, 0xdd, 0x17, 0xb2, 0xd8, 0x42, 0x84, 0x5d, 0xe8,
+    0x2a, 0x5b, 0xc5, 0x39, 0x88, 0x8a, 0xc7, 0x80, 0x54, 0xa2, 0x39, 0x9c, 0xcf, 0xc9, 0xfc, 0xc2,
+    0xda, 0x31, 0xce, 0x3d, 0xd1, 0x66, 0xbd, 0xcd, 0x3a, 0x33, 0x84, 0x7e, 0x5b, 0xbb, 0x07, 0xfd,
+    0x07, 0xca, 0x47, 0x78, 0x42, 0x31, 0xb1, 0x9a, 0xf4, 0x58, 0x72, 0xce, 0xef, 0xb9, 0xfc, 0x59,
+    0xf4, 0xf9, 0x5d, 0x14, 0x38, 0x1a, 0x3a, 0x78, 0x32, 0x56, 0x34, 0x7b, 0x9f, 0xfc, 0xe6, 0x9c,
+    0xd7, 0x00, 0x7a, 0xe8, 0xa7, 0x58, 0xcc, 0xa4, 0x15, 0xd5, 0xa9, 0x1e, 0xe8, 0x63, 0xc8, 0xb6,
+    0xc0, 0x33, 0x7a, 0xe3, 0x2d, 0x6f, 0xca, 0xa2, 0x55, 0x16, 0xcd, 0xf2, 0xf8, 0xb8, 0x65, 0x76,
+    0x66, 0xbe, 0xf2, 0x15, 0xb9, 0x28, 0x2b, 0xfe, 0x20, 0x07, 0x26, 0x97, 0xe7, 0x77, 0xce, 0xa7,
+    0x25, 0x9c, 0xd3, 0x98, 0xfa, 0x79, 0xa8, 0xef,
+};
+
+static unsigned char const gpu_metrics_v2_0[] = {
+    0xc8, 0x00, 0x02, 0x00, 0x21, 0x05, 0x03, 0xcc, 0xc0, 0x21, 0x5e, 0x8f, 0x3a, 0x0d, 0x00, 0x00,
+    0x75, 0x12, 0x2a, 0x12, 0xd3, 0xdf, 0x36, 0x07, 0x40, 0x36, 0x4a, 0x80, 0x3d, 0xc3, 0x96, 0x53,
+    0x42, 0x8b, 0x6b, 0xd5, 0x21, 0x0f, 0xe8, 0xbd, 0x12, 0x00, 0x00, 0x00, 0x95, 0xd0, 0xe7, 0x84,
+    0x6b, 0xd3, 0xea, 0xe0, 0x80, 0x21, 0x88, 0x26, 0x86, 0x82, 0x04, 0xdf, 0x70, 0xc6, 0x2e, 0x9b,
+    0x01, 0xc6, 0xcc, 0x26, 0x2c, 0x24, 0x79, 0x9e, 0xb9, 0x1e, 0x8e, 0x0f, 0x53, 0xae, 0x84, 0x87,
+    0x8e, 0x7b, 0xc8, 0xc6, 0x1b, 0xe2, 0x8f, 0x0e, 0x3f, 0x30, 0x46, 0x0a, 0xc5, 0x19, 0x81, 0x73,
+    0x8f, 0x07, 0xc2, 0xe4, 0xe9, 0x10, 0x71, 0x53, 0x9c, 0xf9, 0x81, 0x9b, 0x83, 0x33, 0xb1, 0x46,
+    0x73, 0x82, 0x88, 0xce, 0x7a, 0x81, 0xf1, 0x3f, 0xb2, 0x85, 0xe0, 0xe0, 0xf1, 0xed, 0x42, 0xec,
+    0x8f, 0xe4, 0xf1, 0x33, 0xd7, 0x72, 0x23, 0x6a, 0x1f, 0x64, 0x71, 0x50, 0x12, 0xab, 0x3d, 0x6d,
+    0x12, 0x36, 0xab, 0x4d, 0xc8, 0x1f, 0xe5, 0xc6, 0x27, 0xf0, 0xb7, 0xa4, 0xa9, 0x5d, 0x24, 0x40,
+    0xe2, 0x23, 0xf7, 0x77, 0x38, 0xbf, 0xf3, 0x18, 0x65, 0xe2, 0x7c, 0x29, 0xfd, 0xaa, 0xd5, 0x39,
+    0x29, 0xb4, 0x6e, 0xfe, 0x83, 0x67, 0x56, 0x6b, 0x32, 0x5b, 0x51, 0x17, 0xb8, 0x5d, 0x04, 0x56,
+    0x8d, 0x75, 0x70, 0xb4, 0x04, 0x62, 0x54, 0x84,
+};
+
+static unsigned char const gpu_metrics_v2_1[] = {
+    0xb0, 0x00, 0x02, 0x01, 0x0a, 0x14, 0x6f, 0x13, 0xc9, 0x3a, 0xf8, 0xe0, 0x1a, 0x15, 0x43, 0x45,
+    0x0a, 0xe7, 0xc7, 0x2e, 0x45, 0xc1, 0x21, 0xd1, 0x6c, 0xd9, 0xe9, 0xad, 0x40, 0x00, 0x05, 0x00,
+    0xc0, 0x21, 0x5e, 0x8f, 0x3a, 0x0d, 0x00, 0x00, 0x16, 0x47, 0x0e, 0xcc, 0xb0, 0x2e, 0x6c, 0xe5,
+    0x12, 0x44, 0xf0, 0x04, 0xa2, 0x16, 0xcd, 0x42, 0x15, 0x9b, 0xdb, 0x38, 0x11, 0x43, 0xdc, 0x1f,
+    0x74, 0x02, 0x56, 0xfe, 0x8d, 0x6a, 0xed, 0xea, 0x44, 0x9f, 0x21, 0x0b, 0x86, 0xb5, 0x3d, 0xf0,
+    0x1c, 0xf8, 0x29, 0x43, 0x0c, 0x2e, 0x33, 0xee, 0x4f, 0xa0, 0x4e, 0x87, 0xc2, 0x34, 0x4a, 0x72,
+    0x80, 0xac, 0x2d, 0x45, 0x58, 0xcd, 0x04, 0xfe, 0x40, 0x09, 0x03, 0x04, 0xbb, 0x81, 0x8d, 0xfa,
+    0x30, 0x83, 0x79, 0x3e, 0xef, 0x72, 0x1b, 0xa8, 0xd1, 0xa6, 0x6e, 0xa8, 0x7e, 0x8b, 0xd5, 0xe3,
+    0x64, 0xf8, 0x81, 0x4e, 0xb0, 0x37, 0xfb, 0x3a, 0x57, 0x32, 0xd5, 0xe1, 0xb4, 0xba, 0xa2, 0x23,
+    0x67, 0xfd, 0x58, 0xfb, 0x0d, 0xd6, 0x21, 0x03, 0x12, 0xa0, 0xbd, 0xe1, 0x41, 0x6e, 0x29, 0x0e,
+    0x15, 0xaa, 0xd7, 0x61, 0xde, 0x81, 0xab, 0xf8, 0x48, 0x99, 0x3e, 0xb1, 0x4b, 0x0b, 0x75, 0x2f,
+};
+
+void test_gpu_metrics_decode_v1(void) {
+    struct gpu_metrics metrics;
+
+    fand_assert(gpu_metrics_decode(gpu_metrics_v1_0, sizeof(gpu_metrics_v1_0), &metrics) == 0);
+    fand_assert(metrics.temp_edge == 46000);
+    fand_assert(metrics.temp_hotspot == 53000);
+    fand_assert(metrics.temp_mem == 62000);
+    fand_assert(metrics.gfx_activity == 12);
+    fand_assert(metrics.socket_power == 37);
+    fand_assert(metrics.fan_speed == 1104);
+
+    fand_assert(gpu_metrics_decode(gpu_metrics_v1_1, sizeof(gpu_metrics_v1_1), &metrics) == 0);
+    fand_assert(metrics.temp_edge == 51000);
+    fand_assert(metrics.temp_hotspot == 60000);
+    fand_assert(metrics.temp_mem == 66000);
+    fand_assert(metrics.gfx_activity == 87);
+    fand_assert(metrics.socket_power == 212);
+    fand_assert(metrics.fan_speed == 1710);
+
+    /* Zero-rpm fan reported as unsupported */
+    fand_assert(gpu_metrics_decode(gpu_metrics_v1_3, sizeof(gpu_metrics_v1_3), &metrics) == 0);
+    fand_assert(metrics.temp_edge == 38000);
+    fand_assert(metrics.temp_hotspot == 41000);
+    fand_assert(metrics.temp_mem == 44000);
+    fand_assert(metrics.gfx_activity == 2);
+    fand_assert(metrics.socket_power == 9);
+    fand_assert(metrics.fan_speed == -1);
+}
+
+void test_gpu_metrics_decode_v2(void) {
+    struct gpu_metrics metrics;
+
+    fand_assert(gpu_metrics_decode(gpu_metrics_v2_0, sizeof(gpu_metrics_v2_0), &metrics) == 0);
+    fand_assert(metrics.temp_edge == 47250);
+    fand_assert(metrics.temp_hotspot == -1);
+    fand_assert(metrics.temp_mem == -1);
+    fand_assert(metrics.gfx_activity == 18);
+    fand_assert(metrics.socket_power == -1);
+    fand_assert(metrics.fan_speed == -1);
+
+    fand_assert(gpu_metrics_decode(gpu_metrics_v2_1, sizeof(gpu_metrics_v2_1), &metrics) == 0);
+    fand_assert(metrics.temp_edge == 51300);
+    fand_assert(metrics.gfx_activity == 64);
+    fand_assert(metrics.fan_speed == -1);
+}
+
+void test_gpu_metrics_decode_invalid(void) {
+    unsigned char table[sizeof(gpu_metrics_v1_3)];
+    struct gpu_metrics metrics;
+
+    /* Shorter than the header */
+    fand_assert(gpu_metrics_decode(gpu_metrics_v1_0, 3, &metrics) == -EPROTO);
+
+    /* Truncated read */
+    fand_assert(gpu_metrics_decode(gpu_metrics_v1_3, sizeof(gpu_metrics_v1_3) - 1, &metrics) == -EPROTO);
+
+    /* Unknown revisions */
+    memcpy(table, gpu_metrics_v1_3, sizeof(table));
+    table[3] = 4;
+    fand_assert(gpu_metrics_decode(table, sizeof(table), &metrics) == -EPROTO);
+    table[2] = 3;
+    table[3] = 0;
+    fand_assert(gpu_metrics_decode(table, sizeof(table), &metrics) == -EPROTO);
+
+    /* Structure too small for the revision */
+    memcpy(table, gpu_metrics_v1_3, sizeof(table));
+    table[0] = 64;
+    table[1] = 0;
+    fand_assert(gpu_metrics_decode(table, sizeof(table), &metrics) == -EPROTO);
+}
+
+void test_gpu_metrics_decode_structs(void) {
+    unsigned char table[256];
+    struct gpu_metrics metrics;
+    struct gpu_metrics_v1_0 v1_0 = {
+        .common_header = { sizeof(v1_0), 1, 0 },
+        .temperature_edge = 45,
+        .temperature_hotspot = 58,
+        .temperature_mem = 70,
+        .temperature_vrgfx = 1,
+        .average_gfx_activity = 33,
+        .average_umc_activity = 2,
+        .average_socket_power = 120,
+        .throttle_status = 3,
+        .current_fan_speed = 980
+    };
+    struct gpu_metrics_v1_1 v1_1 = {
+        .temperature_edge = 50,
+        .temperature_hotspot = 64,
+        .temperature_mem = 80,
+        .temperature_vrgfx = 1,
+        .average_gfx_activity = 91,
+        .average_umc_activity = 2,
+        .average_socket_power = 250,
+        .throttle_status = 3,
+        .current_fan_speed = 2100
+    };
+    struct gpu_metrics_v2_0 v2_0 = {
+        .common_header = { sizeof(v2_0), 2, 0 },
+        .temperature_gfx = 4125,
+        .temperature_soc = 1,
+        .average_gfx_activity = 7
+    };
+    struct gpu_metrics_v2_1 v2_1 = {
+        .temperature_gfx = 5550,
+        .temperature_soc = 1,
+        .average_gfx_activity = 26
+    };
+
+    memcpy(table, &v1_0, sizeof(v1_0));
+    fand_assert(gpu_metrics_decode(table, sizeof(v1_0), &metrics) == 0);
+    fand_assert(metrics.temp_edge == 45000);
+    fand_assert(metrics.temp_hotspot == 58000);
+    fand_assert(metrics.temp_mem == 70000);
+    fand_assert(metrics.gfx_activity == 33);
+    fand_assert(metrics.socket_power == 120);
+    fand_assert(metrics.fan_speed == 980);
+
+    for(uint8_t content = 1; content <= 3; content++) {
+        v1_1.common_header = (struct metrics_table_header){ sizeof(v1_1), 1, content };
+        memcpy(table, &v1_1, sizeof(v1_1));
+        fand_assert(gpu_metrics_decode(table, sizeof(v1_1), &metrics) == 0);
+        fand_assert(metrics.temp_edge == 50000);
+        fand_assert(metrics.temp_hotspot == 64000);
+        fand_assert(metrics.temp_mem == 80000);
+        fand_assert(metrics.gfx_activity == 91);
+        fand_assert(metrics.socket_power == 250);
+        fand_assert(metrics.fan_speed == 2100);
+    }
+
+    memcpy(table, &v2_0, sizeof(v2_0));
+    fand_assert(gpu_metrics_decode(table, sizeof(v2_0), &metrics) == 0);
+    fand_assert(metrics.temp_edge == 41250);
+    fand_assert(metrics.gfx_activity == 7);
+
+    for(uint8_t content = 1; content <= 4; content++) {
+        v2_1.common_header = (struct metrics_table_header){ sizeof(v2_1), 2, content };
+        memcpy(table, &v2_1, sizeof(v2_1));
+        fand_assert(gpu_metrics_decode(table, sizeof(v2_1), &metrics) == 0);
+        fand_assert(metrics.temp_edge == 55500);
+        fand_assert(metrics.gfx_activity == 26);
+    }
+}
@@ -0,0 +1,9 @@
+#ifndef GPU_METRICS_TEST_H
+#define GPU_METRICS_TEST_H
+
+void test_gpu_metrics_decode_v1(void);
+void test_gpu_metrics_decode_v2(void);
+void test_gpu_metrics_decode_invalid(void);
+void test_gpu_metrics_decode_structs(void);
+
+#endif /* GPU_METRICS_TEST_H */
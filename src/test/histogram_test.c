@@ -0,0 +1,61 @@
+#include "histogram.h"
+#include "histogram_test.h"
+#include "test.h"
+
+#include <stdint.h>
+
+void test_histogram_index(void) {
+    unsigned idx;
+    uint64_t lo;
+    uint64_t hi;
+    unsigned mismatches = 0;
+
+    /* Small values are exact */
+    for(uint64_t v = 0; v < HISTOGRAM_SUB_COUNT; v++) {
+        mismatches += histogram_index(v) != v || histogram_lowest_equivalent((unsigned)v) != v;
+    }
+    fand_assert(mismatches == 0);
+
+    /* Buckets are contiguous and narrow relative to their values */
+    for(uint64_t v = HISTOGRAM_SUB_COUNT; v < (uint64_t)1 << 30; v += v / 37 + 1) {
+        idx = histogram_index(v);
+        lo = histogram_lowest_equivalent(idx);
+        hi = histogram_highest_equivalent(idx);
+        mismatches += idx >= HISTOGRAM_BUCKETS || lo > v || v > hi ||
+                      (hi - lo + 1) * (HISTOGRAM_SUB_COUNT / 2) > lo ||
+                      histogram_index(hi + 1) != idx + 1;
+    }
+    fand_assert(mismatches == 0);
+
+    fand_assert(histogram_index(UINT64_MAX) == HISTOGRAM_BUCKETS - 1);
+}
+
+void test_histogram_percentile(void) {
+    static struct histogram hist;
+    static struct histogram other;
+    uint64_t value;
+
+    histogram_init(&hist);
+    fand_assert(histogram_percentile(&hist, 50.0) == 0);
+
+    for(uint64_t v = 1; v <= 10000; v++) {
+        histogram_record(&hist, v * 1000);
+    }
+
+    fand_assert(hist.total == 10000);
+    fand_assert(hist.min == 1000);
+    fand_assert(hist.max == 10000000);
+    fand_assert(histogram_percentile(&hist, 100.0) == 10000000);
+
+    value = histogram_percentile(&hist, 50.0);
+    fand_assert(value >= 5000000 && value <= 5000000 + 5000000 / 60);
+    value = histogram_percentile(&hist, 99.0);
+    fand_assert(value >= 9900000 && value <= 9900000 + 9900000 / 60);
+
+    histogram_init(&other);
+    histogram_record(&other, 20000000);
+    histogram_merge(&hist, &other);
+    fand_assert(hist.total == 10001);
+    fand_assert(hist.max == 20000000);
+    fand_assert(histogram_percentile(&hist, 100.0) == 20000000);
+}
@@ -0,0 +1,7 @@
+#ifndef HISTOGRAM_TEST_H
+#define HISTOGRAM_TEST_H
+
+void test_histogram_index(void);
+void test_histogram_percentile(void);
+
+#endif /* HISTOGRAM_TEST_H */
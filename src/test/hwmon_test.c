@@ -0,0 +1,89 @@
+#include "cache.h"
+#include "cache_mock.h"
+#include "fakesys.h"
+#include "filesystem.h"
+#include "hwmon.h"
+#include "hwmon_test.h"
+#include "mock.h"
+#include "test.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include <sys/stat.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#define HWMON_TEST_ROOT "/tmp/_fand_hwmon_test"
+/* Written by cache_write in test builds */
+#define HWMON_TEST_CACHE "/tmp/amdgpu-fand.cache"
+
+/* Caches the paths of the first ncards cards of the tree */
+static int hwmon_test_write_cache(unsigned ncards) {
+    memset(&fand_cache, 0, sizeof(fand_cache));
+    for(unsigned i = 0; i < ncards; i++) {
+        if(fakesys_attr_path(fand_cache.cards[i].pwm, sizeof(fand_cache.cards[i].pwm), fsys_root(), i, "pwm1") ||
+           fakesys_attr_path(fand_cache.cards[i].pwm_enable, sizeof(fand_cache.cards[i].pwm_enable), fsys_root(), i, "pwm1_enable") ||
+           fakesys_attr_path(fand_cache.cards[i].temp_input, sizeof(fand_cache.cards[i].temp_input), fsys_root(), i, "temp1_input")) {
+            return -1;
+        }
+        fand_cache.cards[i].card_idx = i;
+    }
+    fand_cache.ncards = ncards;
+
+    return cache_write();
+}
+
+/* Matches the check done outside of tests */
+static bool hwmon_test_exists_in_sysfs(char const *file) {
+    char const *root = fsys_root();
+    size_t root_len = strlen(root);
+
+    return fsys_file_exists(file) && strncmp(file, root, root_len) == 0 && strncmp(file + root_len, "/sys/", 5) == 0;
+}
+
+static bool hwmon_test_padded(void) {
+    return true;
+}
+
+void test_hwmon_load_paths_stale_cache(void) {
+    struct fakesys_card const card = { .temp = 50000, .pwm = 128 };
+    int logmask = setlogmask(LOG_UPTO(LOG_ERR));
+
+    mkdir(HWMON_TEST_ROOT, S_IRWXU);
+    fand_assert(fakesys_create(HWMON_TEST_ROOT, 2, &card) == 0);
+    fand_assert(fsys_set_root(HWMON_TEST_ROOT) == 0);
+
+    mock_guard {
+        mock_cache_file_exists_in_sysfs(hwmon_test_exists_in_sysfs);
+        mock_cache_struct_is_padded(hwmon_test_padded);
+
+        /* Card added since the cache was written */
+        fand_assert(hwmon_test_write_cache(1) == 0);
+        fand_assert(hwmon_load_paths() == 0);
+        fand_assert(fand_cache.ncards == 2);
+        fand_assert(fand_cache.cards[0].card_idx == 0);
+        fand_assert(fand_cache.cards[1].card_idx == 1);
+
+        /* Rewritten with both */
+        memset(&fand_cache, 0, sizeof(fand_cache));
+        fand_assert(cache_load() == 0);
+        fand_assert(fand_cache.ncards == 2);
+
+        /* Up to date */
+        fand_assert(hwmon_load_paths() == 0);
+        fand_assert(fand_cache.ncards == 2);
+
+        /* Card removed */
+        fand_assert(fakesys_remove(HWMON_TEST_ROOT, 2) == 0);
+        fand_assert(fakesys_create(HWMON_TEST_ROOT, 1, &card) == 0);
+        fand_assert(hwmon_load_paths() == 0);
+        fand_assert(fand_cache.ncards == 1);
+    }
+
+    fsys_set_root(0);
+    unlink(HWMON_TEST_CACHE);
+    fand_assert(fakesys_remove(HWMON_TEST_ROOT, 1) == 0);
+    rmdir(HWMON_TEST_ROOT);
+    setlogmask(logmask);
+}
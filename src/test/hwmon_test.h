@@ -0,0 +1,6 @@
+#ifndef HWMON_TEST_H
+#define HWMON_TEST_H
+
+void test_hwmon_load_paths_stale_cache(void);
+
+#endif /* HWMON_TEST_H */
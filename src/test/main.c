@@ -1,10 +1,24 @@
+#include "config_test.h"
+#include "fakesys_test.h"
 #include "fanctrl_test.h"
+#include "fancurve_test.h"
+#include "file_test.h"
+#include "filesystem_test.h"
+#include "gpu_metrics_test.h"
+#include "histogram_test.h"
+#include "hwmon_test.h"
 #include "interpolation_test.h"
 #include "mock_test.h"
+#include "reactor_test.h"
 #include "request_test.h"
+#include "sensor_test.h"
 #include "serialize_test.h"
+#include "server_test.h"
 #include "sha1_test.h"
+#include "sim_test.h"
 #include "strutils_test.h"
+#include "telemetry_test.h"
+#include "tick_test.h"
 #include "test.h"
 
 int main(void) {
@@ -24,9 +38,65 @@ int main(void) {
     run(test_unpackf_insufficient_bufsize);
     run(test_unpackf_invalid_fmtstring);
     run(test_unpackf_repeat);
+    run(test_packf_compiled);
+    run(test_request_frame);
+    run(test_snapshot);
+    run(test_tick_record);
+    run(test_layout_packf_equivalence);
+
+    section(config);
+    run(test_config_parse);
+    run(test_config_parse_errors);
+    run(test_config_parse_limits);
+    run(test_config_diff);
+    run(test_config_load);
 
     section(fanctrl);
     run(test_fanctrl_adjust);
+    run(test_fanctrl_curve_matches_reference);
+    run(test_fanctrl_sample);
+    run(test_fanctrl_multiple_cards);
+    run(test_fanctrl_fan_curve_offload);
+    run(test_fanctrl_snapshot);
+    run(test_fanctrl_reconfigure_keeps_hysteresis);
+
+    section(fancurve);
+    run(test_fancurve_parse);
+    run(test_fancurve_from_matrix);
+    run(test_fancurve_write);
+
+    section(file);
+    run(test_fdwrite_fdread_ulong);
+    run(test_fdread_ulong_invalid);
+    run(test_fdbatch_ulong);
+
+    section(filesystem);
+    run(test_fsys_watch_event);
+
+    section(fakesys);
+    run(test_fakesys_root);
+
+    section(hwmon);
+    run(test_hwmon_load_paths_stale_cache);
+
+    section(gpu_metrics);
+    run(test_gpu_metrics_decode_v1);
+    run(test_gpu_metrics_decode_v2);
+    run(test_gpu_metrics_decode_invalid);
+    run(test_gpu_metrics_decode_structs);
+
+    section(sim);
+    run(test_plant_step);
+    run(test_profile_parse);
+    run(test_sim_run);
+
+    section(histogram);
+    run(test_histogram_index);
+    run(test_histogram_percentile);
+
+    section(sensor);
+    run(test_sensor_probe_picks_cheapest_accurate);
+    run(test_sensor_probe_falls_back);
 
     section(strutils);
     run(test_strscpy_result);
@@ -36,8 +106,25 @@ int main(void) {
     run(test_strsncpy_return_value);
     run(test_strsncpy_null_termination);
 
+    section(tick);
+    run(test_tick_missed);
+
+    section(telemetry);
+    run(test_telemetry_publish_read);
+
+    section(reactor);
+    run(test_reactor_remove_pending);
+
+    section(server);
+    run(test_server_legacy_request);
+    run(test_server_session_pipelined);
+    run(test_server_session_malformed_frame);
+    run(test_server_subscribe);
+    run(test_server_subscriber_dropped);
+
     section(request);
     run(test_request_convert);
+    run(test_request_process_gets);
 
     section(mock);
     run(test_validate_mock);
@@ -0,0 +1,71 @@
+#include "reactor.h"
+#include "reactor_test.h"
+#include "test.h"
+
+#include <unistd.h>
+
+static unsigned reactor_test_calls[2];
+static struct reactor_source reactor_test_sources[2];
+/* Read end of a pipe with nothing to read */
+static int reactor_test_idle_fd = -1;
+
+static int reactor_test_count(struct reactor_source *source, uint32_t events) {
+    (void)events;
+    ++reactor_test_calls[source - reactor_test_sources];
+    return 0;
+}
+
+/* Drops the other source, and reuses its slot for an idle fd, as the
+ * server does when dropping a client and accepting another */
+static int reactor_test_drop_other(struct reactor_source *source, uint32_t events) {
+    struct reactor_source *other = &reactor_test_sources[source == reactor_test_sources];
+
+    reactor_test_count(source, events);
+    reactor_remove(other);
+    other->fd = reactor_test_idle_fd;
+    reactor_add(other, EPOLLIN);
+
+    return 0;
+}
+
+void test_reactor_remove_pending(void) {
+    int pipes[3][2];
+    unsigned npipes = 0;
+
+    fand_assert(reactor_init() == 0);
+    for(; npipes < 3; npipes++) {
+        if(pipe(pipes[npipes])) {
+            break;
+        }
+    }
+    fand_assert(npipes == 3);
+    if(npipes != 3) {
+        goto cleanup;
+    }
+    reactor_test_idle_fd = pipes[2][0];
+
+    for(unsigned i = 0; i < 2; i++) {
+        reactor_test_calls[i] = 0;
+        reactor_test_sources[i] = (struct reactor_source){ .fd = pipes[i][0], .handler = reactor_test_drop_other };
+        fand_assert(write(pipes[i][1], "x", 1) == 1);
+        fand_assert(reactor_add(&reactor_test_sources[i], EPOLLIN) == 0);
+    }
+
+    /* Both ready in the same batch, whichever runs first drops the other */
+    fand_assert(reactor_dispatch(0) == 0);
+    fand_assert(reactor_test_calls[0] + reactor_test_calls[1] == 1);
+
+    /* The source in the reused slot only runs once ready itself */
+    reactor_test_sources[0].handler = reactor_test_count;
+    reactor_test_sources[1].handler = reactor_test_count;
+    reactor_test_calls[0] = reactor_test_calls[1] = 0;
+    fand_assert(reactor_dispatch(0) == 0);
+    fand_assert(reactor_test_calls[0] + reactor_test_calls[1] == 1);
+
+cleanup:
+    reactor_close();
+    for(unsigned i = 0; i < npipes; i++) {
+        close(pipes[i][0]);
+        close(pipes[i][1]);
+    }
+}
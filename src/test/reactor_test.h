@@ -0,0 +1,6 @@
+#ifndef REACTOR_TEST_H
+#define REACTOR_TEST_H
+
+void test_reactor_remove_pending(void);
+
+#endif /* REACTOR_TEST_H */
@@ -1,8 +1,61 @@
+#include "client_mock.h"
 #include "ipc.h"
+#include "mock.h"
 #include "request.h"
 #include "request_test.h"
+#include "serialize.h"
 #include "test.h"
 
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+static unsigned nsent;
+static ipc_request last_request;
+static bool snapshot_supported;
+
+static ssize_t send_and_recv(unsigned char *buffer, size_t bufsize, ipc_request request) {
+    struct snapshot snapshot = {
+        .ncards = 1,
+        .cards = { { .card_idx = 0, .temp = 60, .pwm = 102, .speed = 40, .threshold = 0 } },
+        .matrix = { 1, 50, 40 }
+    };
+
+    ++nsent;
+    last_request = request;
+
+    switch(request) {
+        case ipc_req_snapshot:
+            return snapshot_supported ? pack_snapshot(buffer, bufsize, &snapshot) : pack_error(buffer, bufsize, EINVAL);
+        case ipc_req_speed:
+            return pack_speed(buffer, bufsize, 40);
+        case ipc_req_temp:
+            return pack_temp(buffer, bufsize, 60);
+        default:
+            return pack_error(buffer, bufsize, EINVAL);
+    }
+}
+
+/* Runs request_process_gets with stdout discarded */
+static int process_gets_quietly(ipc_request const *requests, unsigned nrequests) {
+    int status;
+    int devnull = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    int saved = dup(STDOUT_FILENO);
+
+    fflush(stdout);
+    dup2(devnull, STDOUT_FILENO);
+    status = request_process_gets(requests, nrequests);
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+
+    close(saved);
+    close(devnull);
+    return status;
+}
+
 void test_request_convert(void) {
     ipc_request req;
 
@@ -18,6 +71,39 @@ void test_request_convert(void) {
     fand_assert(request_convert("temperature", &req) == 0);
     fand_assert(req == ipc_req_temp);
 
+    fand_assert(request_convert("ticks", &req) == 0);
+    fand_assert(req == ipc_req_ticks);
+
+    fand_assert(request_convert("snapshot", &req) == 0);
+    fand_assert(req == ipc_req_snapshot);
+
     fand_assert(request_convert("asdf", &req) == -1);
     fand_assert(req == ipc_req_inval);
 }
+
+void test_request_process_gets(void) {
+    ipc_request const requests[] = { ipc_req_temp, ipc_req_speed, ipc_req_matrix };
+
+    mock_guard {
+        mock_client_send_and_recv(send_and_recv);
+
+        /* A single target is requested on its own */
+        nsent = 0;
+        snapshot_supported = true;
+        fand_assert(process_gets_quietly(requests, 1) == 0);
+        fand_assert(nsent == 1);
+        fand_assert(last_request == ipc_req_temp);
+
+        /* Multiple ones with a single snapshot */
+        nsent = 0;
+        fand_assert(process_gets_quietly(requests, 3) == 0);
+        fand_assert(nsent == 1);
+        fand_assert(last_request == ipc_req_snapshot);
+
+        /* Or one by one if the daemon does not know snapshots */
+        nsent = 0;
+        snapshot_supported = false;
+        fand_assert(process_gets_quietly(requests, 2) == 0);
+        fand_assert(nsent == 3);
+    }
+}
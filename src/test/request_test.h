@@ -2,5 +2,6 @@
 #define REQUEST_TEST_H
 
 void test_request_convert(void);
+void test_request_process_gets(void);
 
 #endif /* REQUEST_TEST_H */
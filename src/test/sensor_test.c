@@ -0,0 +1,185 @@
+#include "sensor.h"
+#include "sensor_test.h"
+#include "test.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include <time.h>
+
+enum { SENSOR_TEST_CARDS = 2 };
+/* Cost of a read from the slow backend, in ns */
+enum { SENSOR_TEST_SLOW_READ = 20000 };
+
+static bool reference_open;
+static bool fast_open;
+static bool wrong_open;
+
+static void spin(long ns) {
+    struct timespec start;
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    } while((now.tv_sec - start.tv_sec) * 1000000000l + now.tv_nsec - start.tv_nsec < ns);
+}
+
+static int open_reference(unsigned card, unsigned card_idx) {
+    (void)card;
+    (void)card_idx;
+    reference_open = true;
+    return 0;
+}
+
+static int close_reference(void) {
+    reference_open = false;
+    return 0;
+}
+
+static int read_reference(unsigned card) {
+    spin(SENSOR_TEST_SLOW_READ);
+    return 50000 + 1000 * (int)card;
+}
+
+static int open_fast(unsigned card, unsigned card_idx) {
+    (void)card;
+    (void)card_idx;
+    fast_open = true;
+    return 0;
+}
+
+static int close_fast(void) {
+    fast_open = false;
+    return 0;
+}
+
+static int read_fast(unsigned card) {
+    return 50500 + 1000 * (int)card;
+}
+
+static int read_all_fast(int *temps, unsigned ncards) {
+    for(unsigned i = 0; i < ncards; i++) {
+        temps[i] = read_fast(i);
+    }
+    return 0;
+}
+
+static int open_wrong(unsigned card, unsigned card_idx) {
+    (void)card;
+    (void)card_idx;
+    wrong_open = true;
+    return 0;
+}
+
+static int close_wrong(void) {
+    wrong_open = false;
+    return 0;
+}
+
+static int read_wrong(unsigned card) {
+    /* Cheapest, but e.g. reporting the hotspot temperature */
+    return 80000 + 1000 * (int)card;
+}
+
+static int open_missing(unsigned card, unsigned card_idx) {
+    (void)card_idx;
+    /* Only the first card has the interface */
+    return card ? -1 : 0;
+}
+
+static int close_missing(void) {
+    return 0;
+}
+
+static int read_missing(unsigned card) {
+    (void)card;
+    return -1;
+}
+
+static struct sensor_backend const reference_backend = {
+    .name = "reference",
+    .caps = SENSOR_CAP_EDGE_TEMP | SENSOR_CAP_REFERENCE,
+    .open = open_reference,
+    .close = close_reference,
+    .read = read_reference
+};
+
+static struct sensor_backend const fast_backend = {
+    .name = "fast",
+    .caps = SENSOR_CAP_EDGE_TEMP | SENSOR_CAP_BATCH,
+    .open = open_fast,
+    .close = close_fast,
+    .read = read_fast,
+    .read_all = read_all_fast
+};
+
+static struct sensor_backend const wrong_backend = {
+    .name = "wrong",
+    .caps = SENSOR_CAP_EDGE_TEMP,
+    .open = open_wrong,
+    .close = close_wrong,
+    .read = read_wrong
+};
+
+static struct sensor_backend const missing_backend = {
+    .name = "missing",
+    .caps = SENSOR_CAP_EDGE_TEMP,
+    .open = open_missing,
+    .close = close_missing,
+    .read = read_missing
+};
+
+static unsigned const card_indices[SENSOR_TEST_CARDS] = { 0, 1 };
+
+void test_sensor_probe_picks_cheapest_accurate(void) {
+    struct sensor_backend const *backends[] = {
+        &missing_backend, &wrong_backend, &reference_backend, &fast_backend
+    };
+    int temps[SENSOR_TEST_CARDS];
+
+    fand_assert(sensor_probe(backends, 4, card_indices, SENSOR_TEST_CARDS) == 0);
+    fand_assert(strcmp(sensor_name(), "fast") == 0);
+
+    /* Only the selected backend is left open */
+    fand_assert(fast_open);
+    fand_assert(!reference_open);
+    fand_assert(!wrong_open);
+
+    fand_assert(sensor_read_temp(1) == 51500);
+    fand_assert(sensor_read_temps(temps, SENSOR_TEST_CARDS) == 0);
+    fand_assert(temps[0] == 50500 && temps[1] == 51500);
+
+    fand_assert(sensor_close() == 0);
+    fand_assert(!fast_open);
+    fand_assert(strcmp(sensor_name(), "none") == 0);
+}
+
+void test_sensor_probe_falls_back(void) {
+    struct sensor_backend const *backends[] = {
+        &wrong_backend, &missing_backend, &reference_backend
+    };
+    struct sensor_backend const *unusable[] = {
+        &missing_backend
+    };
+    int temps[SENSOR_TEST_CARDS];
+
+    /* Slower, but the only accurate one */
+    fand_assert(sensor_probe(backends, 3, card_indices, SENSOR_TEST_CARDS) == 0);
+    fand_assert(strcmp(sensor_name(), "reference") == 0);
+    fand_assert(sensor_read_temp(0) == 50000);
+    fand_assert(!wrong_open);
+
+    /* Reprobing releases the previous selection */
+    fand_assert(sensor_probe(unusable, 1, card_indices, SENSOR_TEST_CARDS) == -1);
+    fand_assert(!reference_open);
+    fand_assert(strcmp(sensor_name(), "none") == 0);
+    fand_assert(sensor_read_temp(0) < 0);
+    fand_assert(sensor_read_temps(temps, SENSOR_TEST_CARDS) < 0);
+    fand_assert(temps[0] < 0 && temps[1] < 0);
+
+    /* Without a reference, nothing can be validated */
+    fand_assert(sensor_probe(backends, 1, card_indices, SENSOR_TEST_CARDS) == 0);
+    fand_assert(strcmp(sensor_name(), "wrong") == 0);
+    sensor_close();
+}
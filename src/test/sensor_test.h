@@ -0,0 +1,7 @@
+#ifndef SENSOR_TEST_H
+#define SENSOR_TEST_H
+
+void test_sensor_probe_picks_cheapest_accurate(void);
+void test_sensor_probe_falls_back(void);
+
+#endif /* SENSOR_TEST_H */
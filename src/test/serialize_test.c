@@ -1,7 +1,9 @@
+#include "ipc.h"
 #include "serialize.h"
 #include "serialize_test.h"
 #include "test.h"
 
+#include <errno.h>
 #include <string.h>
 
 #include <sys/types.h>
@@ -107,3 +109,252 @@ void test_unpackf_repeat(void) {
     }
     fand_assert(outd == 30);
 }
+
+/* Compiled formats are looked up by address, storage reused
+ * for another format must not run the program of the first */
+void test_packf_compiled(void) {
+    unsigned char buffer[32];
+    unsigned char const expected[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+    char fmt[64];
+    unsigned long long llu = 0;
+
+    strcpy(fmt, "%hhu%hhu");
+    fand_assert(packf(buffer, sizeof(buffer), fmt, 1, 2) == 2);
+    fand_assert(packf(buffer, sizeof(buffer), fmt, 1, 2) == 2);
+
+    strcpy(fmt, "%llu");
+    fand_assert(packf(buffer, sizeof(buffer), fmt, 3ull) == sizeof(llu));
+    fand_assert(unpackf(buffer, sizeof(buffer), fmt, &llu) == sizeof(llu));
+    fand_assert(llu == 3ull);
+
+    /* Too long to be compiled, interpreted instead */
+    strcpy(fmt, "%hhu%hhu%hhu%hhu%hhu%hhu%hhu%hhu%hhu%hhu%hhu%hhu");
+    fand_assert(packf(buffer, sizeof(buffer), fmt, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11) == sizeof(expected));
+    fand_assert(memcmp(buffer, expected, sizeof(expected)) == 0);
+
+    /* Invalid formats are rejected on every call */
+    fand_assert(packf(buffer, sizeof(buffer), "%hhuc%d", 28, 33) < 0);
+    fand_assert(packf(buffer, sizeof(buffer), "%hhuc%d", 28, 33) < 0);
+
+    packf_flush();
+    fand_assert(packf(buffer, sizeof(buffer), "%hhu%hhu", 1, 2) == 2);
+}
+
+void test_request_frame(void) {
+    unsigned char buffer[IPC_MAX_FRAME_LENGTH + 1] = { 0 };
+    ipc_request request = ipc_req_inval;
+
+    fand_assert(pack_request(buffer, sizeof(buffer), ipc_req_matrix) == 2);
+    fand_assert(unpack_request(buffer, 2, &request) == 2);
+    fand_assert(request == ipc_req_matrix);
+
+    /* Incomplete */
+    fand_assert(unpack_request(buffer, 0, &request) == 0);
+    fand_assert(unpack_request(buffer, 1, &request) == 0);
+
+    /* Trailing bytes of longer frames are skipped */
+    buffer[0] = IPC_MAX_FRAME_LENGTH;
+    fand_assert(unpack_request(buffer, IPC_MAX_FRAME_LENGTH - 1, &request) == 0);
+    fand_assert(unpack_request(buffer, IPC_MAX_FRAME_LENGTH, &request) == IPC_MAX_FRAME_LENGTH);
+
+    /* Malformed */
+    buffer[0] = 1;
+    fand_assert(unpack_request(buffer, sizeof(buffer), &request) < 0);
+    buffer[0] = IPC_MAX_FRAME_LENGTH + 1;
+    fand_assert(unpack_request(buffer, sizeof(buffer), &request) < 0);
+}
+
+void test_snapshot(void) {
+    unsigned char buffer[IPC_MAX_MSG_LENGTH];
+    struct snapshot snapshot = {
+        .ticks = 1000,
+        .missed = 2,
+        .late = 3,
+        .max_lateness = 40000,
+        .matrix = { MAX_TEMP_THRESHOLDS }
+    };
+    union unpack_result result;
+    ssize_t len;
+    unsigned mismatches = 0;
+
+    snapshot.ncards = FAND_MAX_CARDS;
+    for(unsigned i = 0; i < FAND_MAX_CARDS; i++) {
+        snapshot.cards[i] = (struct snapshot_card){
+            .card_idx = (unsigned char)(i + 1),
+            .temp = (short)(40 + i),
+            .pwm = (short)(i ? (int)(20 * i) : -1),
+            .speed = (signed char)(i ? (int)(8 * i) : -1),
+            .threshold = (signed char)(i % 3 - 1),
+            .default_matrix = i % 2 == 0
+        };
+    }
+    for(unsigned i = 0; i < 2 * MAX_TEMP_THRESHOLDS; i++) {
+        snapshot.matrix[i + 1] = (unsigned char)(3 * i);
+    }
+
+    /* The largest snapshot fits in a single message */
+    len = pack_snapshot(buffer, sizeof(buffer), &snapshot);
+    fand_assert(len > 0 && len == buffer[0]);
+    fand_assert(unpack_snapshot(buffer, (size_t)len, &result) == ipc_rsp_ok);
+
+    fand_assert(result.snapshot.ticks == 1000);
+    fand_assert(result.snapshot.max_lateness == 40000);
+    fand_assert(result.snapshot.ncards == FAND_MAX_CARDS);
+    for(unsigned i = 0; i < FAND_MAX_CARDS; i++) {
+        mismatches += result.snapshot.cards[i].card_idx != snapshot.cards[i].card_idx ||
+                      result.snapshot.cards[i].temp != snapshot.cards[i].temp ||
+                      result.snapshot.cards[i].pwm != snapshot.cards[i].pwm ||
+                      result.snapshot.cards[i].speed != snapshot.cards[i].speed ||
+                      result.snapshot.cards[i].threshold != snapshot.cards[i].threshold ||
+                      result.snapshot.cards[i].default_matrix != snapshot.cards[i].default_matrix;
+    }
+    fand_assert(mismatches == 0);
+    fand_assert(memcmp(result.snapshot.matrix, snapshot.matrix, sizeof(snapshot.matrix)) == 0);
+
+    /* Truncated */
+    fand_assert(unpack_snapshot(buffer, (size_t)len - 1, &result) < 0);
+
+    /* Without cards */
+    snapshot.ncards = 0;
+    snapshot.matrix[0] = 1;
+    len = pack_snapshot(buffer, sizeof(buffer), &snapshot);
+    fand_assert(unpack_snapshot(buffer, (size_t)len, &result) == ipc_rsp_ok);
+    fand_assert(result.snapshot.ncards == 0);
+    fand_assert(result.snapshot.matrix[0] == 1);
+
+    fand_assert(pack_error(buffer, sizeof(buffer), EAGAIN) > 0);
+    fand_assert(unpack_snapshot(buffer, sizeof(buffer), &result) == ipc_rsp_err);
+    fand_assert(result.error == EAGAIN);
+}
+
+void test_tick_record(void) {
+    unsigned char buffer[IPC_MAX_MSG_LENGTH];
+    struct tick_record record = { .tick = 123456789ull };
+    union unpack_result result;
+    ssize_t len;
+    unsigned mismatches = 0;
+
+    record.ncards = FAND_MAX_CARDS;
+    for(unsigned i = 0; i < FAND_MAX_CARDS; i++) {
+        record.cards[i].temp = (short)(i ? (int)(40 + i) : -1);
+        record.cards[i].pwm = (short)(i ? (int)(30 * i) : -1);
+        record.cards[i].threshold = (signed char)(i % 3 - 1);
+    }
+
+    len = pack_tick_record(buffer, sizeof(buffer), &record);
+    fand_assert(len > 0 && len == buffer[0]);
+    fand_assert(unpack_tick_record(buffer, (size_t)len, &result) == ipc_rsp_ok);
+    fand_assert(result.record.tick == record.tick);
+    fand_assert(result.record.ncards == FAND_MAX_CARDS);
+    for(unsigned i = 0; i < FAND_MAX_CARDS; i++) {
+        mismatches += result.record.cards[i].temp != record.cards[i].temp ||
+                      result.record.cards[i].pwm != record.cards[i].pwm ||
+                      result.record.cards[i].threshold != record.cards[i].threshold;
+    }
+    fand_assert(mismatches == 0);
+
+    /* Truncated */
+    fand_assert(unpack_tick_record(buffer, (size_t)len - 1, &result) < 0);
+
+    record.ncards = FAND_MAX_CARDS + 1;
+    fand_assert(pack_tick_record(buffer, sizeof(buffer), &record) < 0);
+}
+
+/* Messages packed from their layouts must match packf byte for byte, and
+ * unpack to the values unpackf reads from the same bytes */
+void test_layout_packf_equivalence(void) {
+    unsigned char expected[IPC_MAX_MSG_LENGTH];
+    unsigned char actual[IPC_MAX_MSG_LENGTH];
+    unsigned char const matrix[] = { 30, 20, 55, 60, 80, 100 };
+    struct snapshot snapshot = {
+        .ticks = 86400,
+        .missed = 3,
+        .late = 12,
+        .max_lateness = 4096,
+        .ncards = 2,
+        .cards = {
+            { .card_idx = 0, .temp = 61, .pwm = 140, .speed = 54, .threshold = 1, .default_matrix = true },
+            { .card_idx = 3, .temp = -1, .pwm = -1, .speed = -1, .threshold = -1 }
+        },
+        .matrix = { 1, 50, 75 }
+    };
+    struct tick_record record = {
+        .tick = 1ull << 40,
+        .ncards = 2,
+        .cards = { { .temp = 72, .pwm = 255, .threshold = 2 }, { .temp = -1, .pwm = -1, .threshold = -1 } }
+    };
+    union unpack_result result;
+    unsigned long long ticks[4];
+    unsigned char header[2];
+    unsigned char nrows;
+    unsigned char rows[sizeof(matrix)];
+    int value;
+    ssize_t len;
+    ssize_t nbytes;
+    ipc_request request;
+
+    len = packf(expected, sizeof(expected), "%hhu%hhu%d", sizeof(unsigned char) + sizeof(ipc_response) + sizeof(int), ipc_rsp_err, EAGAIN);
+    fand_assert(pack_error(actual, sizeof(actual), EAGAIN) == len);
+    fand_assert(memcmp(expected, actual, (size_t)len) == 0);
+    fand_assert(unpack_temp(expected, (size_t)len, &result) == ipc_rsp_err);
+    fand_assert(result.error == EAGAIN);
+
+    len = packf(expected, sizeof(expected), "%hhu%hhu%d", sizeof(unsigned char) + sizeof(ipc_response) + sizeof(int), ipc_rsp_ok, -40);
+    fand_assert(pack_temp(actual, sizeof(actual), -40) == len);
+    fand_assert(memcmp(expected, actual, (size_t)len) == 0);
+    fand_assert(unpackf(expected, (size_t)len, "%hhu%hhu%d", &header[0], &header[1], &value) == len);
+    fand_assert(unpack_temp(expected, (size_t)len, &result) == ipc_rsp_ok);
+    fand_assert(result.temp == value);
+
+    len = packf(expected, sizeof(expected), "%hhu%hhu%llu%llu%llu%llu", sizeof(unsigned char) + sizeof(ipc_response) + 4 * sizeof(unsigned long long),
+                ipc_rsp_ok, 86400ull, 3ull, 12ull, 4096ull);
+    fand_assert(pack_ticks(actual, sizeof(actual), 86400ull, 3ull, 12ull, 4096ull) == len);
+    fand_assert(memcmp(expected, actual, (size_t)len) == 0);
+    fand_assert(unpackf(expected, (size_t)len, "%hhu%hhu%llu%llu%llu%llu", &header[0], &header[1], &ticks[0], &ticks[1], &ticks[2], &ticks[3]) == len);
+    fand_assert(unpack_ticks(expected, (size_t)len, &result) == ipc_rsp_ok);
+    fand_assert(result.ticks.total == ticks[0]);
+    fand_assert(result.ticks.missed == ticks[1]);
+    fand_assert(result.ticks.late == ticks[2]);
+    fand_assert(result.ticks.max_lateness == ticks[3]);
+
+    len = packf(expected, sizeof(expected), "%hhu%hhu%hhu%*hhu", sizeof(unsigned char) + sizeof(ipc_response) + 1 + sizeof(matrix),
+                ipc_rsp_ok, sizeof(matrix) / 2, sizeof(matrix), matrix);
+    fand_assert(pack_matrix(actual, sizeof(actual), matrix, sizeof(matrix) / 2) == len);
+    fand_assert(memcmp(expected, actual, (size_t)len) == 0);
+    fand_assert(unpackf(expected, (size_t)len, "%hhu%hhu%hhu%*hhu", &header[0], &header[1], &nrows, sizeof(rows), rows) == len);
+    fand_assert(unpack_matrix(expected, (size_t)len, &result) == ipc_rsp_ok);
+    fand_assert(result.matrix[0] == nrows);
+    fand_assert(memcmp(&result.matrix[1], rows, sizeof(rows)) == 0);
+
+    /* Only the second card follows a matrix of its own */
+    len = packf(expected, sizeof(expected), "%hhu%hhu%llu%llu%llu%llu%hhu%hhu", 0, ipc_rsp_ok, snapshot.ticks, snapshot.missed,
+                snapshot.late, snapshot.max_lateness, snapshot.ncards, 0x2);
+    for(unsigned i = 0; i < snapshot.ncards; i++) {
+        len += packf(expected + len, sizeof(expected) - len, "%hhu%hd%hd%hhd%hhd", snapshot.cards[i].card_idx, snapshot.cards[i].temp,
+                     snapshot.cards[i].pwm, snapshot.cards[i].speed, snapshot.cards[i].threshold);
+    }
+    len += packf(expected + len, sizeof(expected) - len, "%hhu%*hhu", snapshot.matrix[0], 2, &snapshot.matrix[1]);
+    expected[0] = (unsigned char)len;
+    fand_assert(pack_snapshot(actual, sizeof(actual), &snapshot) == len);
+    fand_assert(memcmp(expected, actual, (size_t)len) == 0);
+
+    len = packf(expected, sizeof(expected), "%hhu%hhu%llu%hhu", 0, ipc_rsp_ok, record.tick, record.ncards);
+    for(unsigned i = 0; i < record.ncards; i++) {
+        len += packf(expected + len, sizeof(expected) - len, "%hd%hd%hhd", record.cards[i].temp, record.cards[i].pwm,
+                     record.cards[i].threshold);
+    }
+    expected[0] = (unsigned char)len;
+    fand_assert(pack_tick_record(actual, sizeof(actual), &record) == len);
+    fand_assert(memcmp(expected, actual, (size_t)len) == 0);
+
+    len = packf(expected, sizeof(expected), "%hhu%hhu", sizeof(unsigned char) + sizeof(ipc_request), ipc_req_ticks);
+    fand_assert(pack_request(actual, sizeof(actual), ipc_req_ticks) == len);
+    fand_assert(memcmp(expected, actual, (size_t)len) == 0);
+    fand_assert(unpack_request(expected, (size_t)len, &request) == len);
+    fand_assert(request == ipc_req_ticks);
+
+    /* Both fail the same way when the buffer is too small */
+    nbytes = packf(expected, 9, "%hhu%hhu%llu%llu%llu%llu", 34, ipc_rsp_ok, 1ull, 2ull, 3ull, 4ull);
+    fand_assert(nbytes == -E2BIG);
+    fand_assert(pack_ticks(actual, 9, 1ull, 2ull, 3ull, 4ull) == nbytes);
+}
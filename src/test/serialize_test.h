@@ -11,4 +11,10 @@ void test_unpackf_insufficient_bufsize(void);
 void test_unpackf_invalid_fmtstring(void);
 void test_unpackf_repeat(void);
 
+void test_packf_compiled(void);
+void test_request_frame(void);
+void test_snapshot(void);
+void test_tick_record(void);
+void test_layout_packf_equivalence(void);
+
 #endif /* SERIALIZE_TEST_H */
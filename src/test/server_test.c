@@ -0,0 +1,274 @@
+#include "config.h"
+#include "fandcfg.h"
+#include "ipc.h"
+#include "reactor.h"
+#include "serialize.h"
+#include "server.h"
+#include "server_test.h"
+#include "strutils.h"
+#include "test.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <syslog.h>
+#include <unistd.h>
+
+enum { SERVER_TEST_ROUNDS = 64 };
+/* Far more records than a subscriber's socket and output buffer hold */
+enum { SERVER_TEST_PUBLISHED = 10000 };
+
+static struct fand_config server_test_config = {
+    .matrix_rows = 2,
+    .matrix = { 30, 20, 80, 100 }
+};
+
+static int server_test_start(void) {
+    union unsockaddr srvaddr;
+    int fd;
+
+    setlogmask(0);
+    unlink(DAEMON_SERVER_SOCKET);
+    if(reactor_init() || server_init()) {
+        return -1;
+    }
+
+    fd = socket(PF_UNIX, SOCK_STREAM, 0);
+    if(fd == -1) {
+        return -1;
+    }
+
+    memset(&srvaddr, 0, sizeof(srvaddr));
+    srvaddr.addr_un.sun_family = AF_UNIX;
+    strscpy(srvaddr.addr_un.sun_path, DAEMON_SERVER_SOCKET, sizeof(srvaddr.addr_un.sun_path));
+    if(connect(fd, &srvaddr.addr, sizeof(srvaddr)) == -1 || server_accept(&server_test_config)) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static void server_test_stop(int fd) {
+    if(fd != -1) {
+        close(fd);
+    }
+    server_kill();
+    reactor_close();
+    setlogmask(LOG_UPTO(LOG_DEBUG));
+}
+
+/* Lets the server run until size bytes have been received or the
+ * connection is closed, returns the number of bytes received */
+static size_t server_test_recv(int fd, unsigned char *buffer, size_t size) {
+    size_t nrecv = 0;
+    ssize_t nbytes;
+
+    for(unsigned i = 0; i < SERVER_TEST_ROUNDS && nrecv < size; i++) {
+        reactor_dispatch(0);
+        nbytes = recv(fd, buffer + nrecv, size - nrecv, MSG_DONTWAIT);
+        if(nbytes == 0) {
+            break;
+        }
+        if(nbytes > 0) {
+            nrecv += (size_t)nbytes;
+        }
+    }
+
+    return nrecv;
+}
+
+/* Whether the server has closed the connection */
+static bool server_test_closed(int fd) {
+    unsigned char byte;
+
+    for(unsigned i = 0; i < SERVER_TEST_ROUNDS; i++) {
+        reactor_dispatch(0);
+        if(recv(fd, &byte, sizeof(byte), MSG_DONTWAIT) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void test_server_legacy_request(void) {
+    unsigned char buffer[IPC_MAX_MSG_LENGTH];
+    union unpack_result result;
+    ipc_request request = ipc_req_matrix;
+    size_t nrecv;
+
+    int fd = server_test_start();
+    fand_assert(fd != -1);
+    if(fd == -1) {
+        server_test_stop(fd);
+        return;
+    }
+
+    fand_assert(send(fd, &request, sizeof(request), 0) == sizeof(request));
+    nrecv = server_test_recv(fd, buffer, 1 + sizeof(ipc_response) + 1 + 2 * server_test_config.matrix_rows);
+    fand_assert(unpack_matrix(buffer, nrecv, &result) == ipc_rsp_ok);
+    fand_assert(result.matrix[0] == server_test_config.matrix_rows);
+    fand_assert(memcmp(&result.matrix[1], server_test_config.matrix, 2 * server_test_config.matrix_rows) == 0);
+
+    /* Single-shot clients are disconnected once served */
+    fand_assert(server_test_closed(fd));
+
+    server_test_stop(fd);
+}
+
+void test_server_session_pipelined(void) {
+    unsigned char frames[4 * IPC_MAX_FRAME_LENGTH];
+    unsigned char buffer[4 * IPC_MAX_MSG_LENGTH];
+    union unpack_result result;
+    size_t nframes = 0;
+    size_t nrecv;
+    size_t expected;
+    ssize_t offset;
+    ssize_t rsplen;
+
+    int fd = server_test_start();
+    fand_assert(fd != -1);
+    if(fd == -1) {
+        server_test_stop(fd);
+        return;
+    }
+
+    /* Upgrade and three requests in a single write */
+    frames[nframes++] = ipc_req_session;
+    nframes += pack_request(frames + nframes, sizeof(frames) - nframes, ipc_req_matrix);
+    nframes += pack_request(frames + nframes, sizeof(frames) - nframes, ipc_req_inval);
+    nframes += pack_request(frames + nframes, sizeof(frames) - nframes, ipc_req_ticks);
+    fand_assert(send(fd, frames, nframes, 0) == (ssize_t)nframes);
+
+    expected = 2 + (3 + 2 * server_test_config.matrix_rows) + (2 + sizeof(int)) + (2 + 4 * sizeof(unsigned long long));
+    nrecv = server_test_recv(fd, buffer, expected);
+    fand_assert(nrecv == expected);
+
+    /* Responses arrive in the order of the requests */
+    fand_assert(unpack_session_rsp(buffer, nrecv, &result) == ipc_rsp_ok);
+    offset = buffer[0];
+
+    rsplen = buffer[offset];
+    fand_assert(unpack_matrix(buffer + offset, nrecv - offset, &result) == ipc_rsp_ok);
+    fand_assert(result.matrix[0] == server_test_config.matrix_rows);
+    offset += rsplen;
+
+    rsplen = buffer[offset];
+    fand_assert(unpack_temp(buffer + offset, nrecv - offset, &result) == ipc_rsp_err);
+    fand_assert(result.error == EINVAL);
+    offset += rsplen;
+
+    fand_assert(unpack_ticks(buffer + offset, nrecv - offset, &result) == ipc_rsp_ok);
+
+    /* The connection remains open for further requests, the
+     * session request itself is only valid as the first byte */
+    nframes = pack_request(frames, sizeof(frames), ipc_req_session);
+    fand_assert(send(fd, frames, nframes, 0) == (ssize_t)nframes);
+    nrecv = server_test_recv(fd, buffer, 2 + sizeof(int));
+    fand_assert(unpack_temp(buffer, nrecv, &result) == ipc_rsp_err);
+    fand_assert(result.error == EINVAL);
+
+    /* A shut down write end ends the session */
+    shutdown(fd, SHUT_WR);
+    fand_assert(server_test_closed(fd));
+
+    server_test_stop(fd);
+}
+
+void test_server_session_malformed_frame(void) {
+    unsigned char frames[] = { ipc_req_session, 1, ipc_req_matrix };
+    unsigned char buffer[IPC_MAX_MSG_LENGTH];
+    union unpack_result result;
+    size_t nrecv;
+
+    int fd = server_test_start();
+    fand_assert(fd != -1);
+    if(fd == -1) {
+        server_test_stop(fd);
+        return;
+    }
+
+    fand_assert(send(fd, frames, sizeof(frames), 0) == sizeof(frames));
+    nrecv = server_test_recv(fd, buffer, 2);
+    fand_assert(unpack_session_rsp(buffer, nrecv, &result) == ipc_rsp_ok);
+
+    /* The frame boundary is lost, so is the client */
+    fand_assert(server_test_closed(fd));
+
+    server_test_stop(fd);
+}
+
+void test_server_subscribe(void) {
+    unsigned char frames[2 * IPC_MAX_FRAME_LENGTH];
+    unsigned char buffer[2 * IPC_MAX_MSG_LENGTH];
+    union unpack_result result;
+    size_t nframes = 0;
+    size_t nrecv;
+
+    int fd = server_test_start();
+    fand_assert(fd != -1);
+    if(fd == -1) {
+        server_test_stop(fd);
+        return;
+    }
+
+    /* Sessions may subscribe as well */
+    frames[nframes++] = ipc_req_session;
+    nframes += pack_request(frames + nframes, sizeof(frames) - nframes, ipc_req_subscribe);
+    fand_assert(send(fd, frames, nframes, 0) == (ssize_t)nframes);
+    nrecv = server_test_recv(fd, buffer, 4);
+    fand_assert(nrecv == 4);
+    fand_assert(unpack_session_rsp(buffer, nrecv, &result) == ipc_rsp_ok);
+    fand_assert(unpack_subscribe_rsp(buffer + 2, nrecv - 2, &result) == ipc_rsp_ok);
+
+    /* Further requests go unanswered */
+    nframes = pack_request(frames, sizeof(frames), ipc_req_matrix);
+    fand_assert(send(fd, frames, nframes, 0) == (ssize_t)nframes);
+    fand_assert(server_test_recv(fd, buffer, 1) == 0);
+
+    server_publish_tick();
+    nrecv = server_test_recv(fd, buffer, sizeof(buffer));
+    fand_assert(nrecv > 0 && nrecv == buffer[0]);
+    fand_assert(unpack_tick_record(buffer, nrecv, &result) == ipc_rsp_ok);
+
+    shutdown(fd, SHUT_WR);
+    fand_assert(server_test_closed(fd));
+
+    server_test_stop(fd);
+}
+
+void test_server_subscriber_dropped(void) {
+    unsigned char buffer[4096];
+    ipc_request request = ipc_req_subscribe;
+    ssize_t nbytes = -1;
+
+    int fd = server_test_start();
+    fand_assert(fd != -1);
+    if(fd == -1) {
+        server_test_stop(fd);
+        return;
+    }
+
+    fand_assert(send(fd, &request, sizeof(request), 0) == sizeof(request));
+    fand_assert(server_test_recv(fd, buffer, 2) == 2);
+
+    /* Never reading falls behind, publishing never blocks */
+    for(unsigned i = 0; i < SERVER_TEST_PUBLISHED; i++) {
+        server_publish_tick();
+    }
+
+    /* What was sent before the drop is followed by end of file */
+    for(unsigned i = 0; i < SERVER_TEST_PUBLISHED && nbytes; i++) {
+        nbytes = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if(nbytes == -1) {
+            break;
+        }
+    }
+    fand_assert(nbytes == 0);
+
+    server_test_stop(fd);
+}
@@ -0,0 +1,10 @@
+#ifndef SERVER_TEST_H
+#define SERVER_TEST_H
+
+void test_server_legacy_request(void);
+void test_server_session_pipelined(void);
+void test_server_session_malformed_frame(void);
+void test_server_subscribe(void);
+void test_server_subscriber_dropped(void);
+
+#endif /* SERVER_TEST_H */
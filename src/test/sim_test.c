@@ -0,0 +1,93 @@
+#include "config.h"
+#include "mock.h"
+#include "plant.h"
+#include "sim.h"
+#include "sim_test.h"
+#include "test.h"
+
+#include <math.h>
+
+static struct plant_params const params = {
+    .ambient = 30.f,
+    .rise = 60.f,
+    .cooling = 2.f,
+    .time_constant = 10.f
+};
+
+void test_plant_step(void) {
+    struct plant plant;
+
+    fand_assert(fabsf(plant_equilibrium(&params, 1.f, 0.f) - 90.f) < 1e-4f);
+    fand_assert(fabsf(plant_equilibrium(&params, 1.f, 1.f) - 50.f) < 1e-4f);
+    fand_assert(fabsf(plant_equilibrium(&params, 0.f, 1.f) - 30.f) < 1e-4f);
+
+    plant_init(&plant, &params, 1.f);
+    fand_assert(fabsf(plant.temp - params.ambient) < 1e-4f);
+
+    /* One time constant covers 1 - 1/e of the distance */
+    for(unsigned i = 0; i < 10; i++) {
+        plant_step(&plant, 1.f, 0.f);
+    }
+    fand_assert(fabsf(plant.temp - (30.f + 60.f * (1.f - expf(-1.f)))) < 1e-3f);
+
+    for(unsigned i = 0; i < 1000; i++) {
+        plant_step(&plant, 1.f, 1.f);
+    }
+    fand_assert(fabsf(plant.temp - 50.f) < 1e-3f);
+}
+
+void test_profile_parse(void) {
+    struct load_profile profile = { .period = 100 };
+
+    fand_assert(profile_parse("0:10,20:100,50:0", &profile) == 0);
+    fand_assert(profile.npoints == 3);
+    fand_assert(profile_load(&profile, 0) == 10);
+    fand_assert(profile_load(&profile, 19) == 10);
+    fand_assert(profile_load(&profile, 20) == 100);
+    fand_assert(profile_load(&profile, 99) == 0);
+    fand_assert(profile_load(&profile, 120) == 100);
+
+    profile.period = 0;
+    fand_assert(profile_load(&profile, 120) == 0);
+
+    fand_assert(profile_parse("10:10", &profile) == -1);
+    fand_assert(profile_parse("0:10,0:20", &profile) == -1);
+    fand_assert(profile_parse("0:101", &profile) == -1);
+    fand_assert(profile_parse("0:10,", &profile) == -1);
+    fand_assert(profile_parse("0-10", &profile) == -1);
+    fand_assert(profile_parse("", &profile) == -1);
+}
+
+void test_sim_run(void) {
+    struct fand_config config = {
+        .throttle = true,
+        .matrix_rows = 3,
+        .hysteresis = 0,
+        .interval = 2,
+        .matrix = { 40, 20, 60, 60, 80, 100 }
+    };
+    struct sim_params simparams = {
+        .plant = params,
+        .duration = 1200,
+        .threshold = 70.f,
+        .band = 1.f
+    };
+    struct sim_result result;
+
+    fand_assert(profile_parse("0:0,600:100", &simparams.profile) == 0);
+
+    mock_guard {
+        fand_assert(sim_run(&config, &simparams, &result) == 0);
+    }
+
+    /* The control loop runs every interval simulated seconds */
+    fand_assert(result.pwm_writes == 600);
+    fand_assert(result.pwm_changes > 0);
+    fand_assert(result.nsteps == 1);
+    fand_assert(result.settling_max > 0 && result.settling_max < 600);
+    fand_assert(result.temp_min >= 30.f);
+    /* Equilibrium is reached below the fan-off temperature at full load */
+    fand_assert(result.temp_max < 90.f);
+    fand_assert(result.time_above == 0);
+    fand_assert(result.speed_mean > 0.0);
+}
@@ -0,0 +1,8 @@
+#ifndef SIM_TEST_H
+#define SIM_TEST_H
+
+void test_plant_step(void);
+void test_profile_parse(void);
+void test_sim_run(void);
+
+#endif /* SIM_TEST_H */
@@ -0,0 +1,54 @@
+#include "telemetry.h"
+#include "telemetry_test.h"
+#include "test.h"
+
+#include <errno.h>
+#include <string.h>
+
+void test_telemetry_publish_read(void) {
+    struct telemetry_page const *page;
+    struct telemetry_data read;
+    struct telemetry_data data = {
+        .ticks = 42,
+        .update_time = 1234567,
+        .ncards = 2,
+        .cards = {
+            { .temp = 55, .pwm = 120, .target_pwm = 121, .speed = 47, .threshold = 1, .sample_time = 1234000 },
+            { .temp = 71, .pwm = -1,  .target_pwm = 255, .speed = -1, .threshold = 3, .sample_time = 1234500 }
+        }
+    };
+
+    int status = telemetry_create();
+    fand_assert(status == 0);
+    if(status) {
+        return;
+    }
+
+    status = telemetry_map(&page);
+    fand_assert(status == 0);
+    if(status) {
+        telemetry_destroy();
+        return;
+    }
+
+    /* Nothing published yet */
+    fand_assert(telemetry_read(page, &read) == 0);
+    fand_assert(read.ncards == 0);
+
+    telemetry_publish(&data);
+    fand_assert(atomic_load(&page->seq) % 2 == 0);
+    fand_assert(telemetry_read(page, &read) == 0);
+    fand_assert(memcmp(&read, &data, sizeof(data)) == 0);
+
+    data.ticks = 43;
+    data.cards[0].temp = 56;
+    telemetry_publish(&data);
+    fand_assert(telemetry_read(page, &read) == 0);
+    fand_assert(read.ticks == 43);
+    fand_assert(read.cards[0].temp == 56);
+
+    fand_assert(telemetry_unmap(page) == 0);
+    fand_assert(telemetry_destroy() == 0);
+
+    fand_assert(telemetry_map(&page) == -ENOENT);
+}
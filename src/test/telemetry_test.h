@@ -0,0 +1,6 @@
+#ifndef TELEMETRY_TEST_H
+#define TELEMETRY_TEST_H
+
+void test_telemetry_publish_read(void);
+
+#endif /* TELEMETRY_TEST_H */
@@ -0,0 +1,31 @@
+#include "tick.h"
+#include "tick_test.h"
+#include "test.h"
+
+#include <time.h>
+
+void test_tick_missed(void) {
+    struct tick_stats before;
+    struct tick_stats after;
+    struct timespec delay = {
+        .tv_sec = 0,
+        .tv_nsec = 20000000
+    };
+
+    tick_get_stats(&before);
+
+    /* An interval of 0 yields a 1 ms period */
+    fand_assert(tick_init(0) == 0);
+
+    nanosleep(&delay, 0);
+
+    fand_assert(tick_consume() == 1);
+    tick_get_stats(&after);
+
+    fand_assert(after.ticks == before.ticks + 1);
+    /* At least 20 periods elapsed while only one tick was handled */
+    fand_assert(after.missed >= before.missed + 19);
+    fand_assert(after.max_lateness > 0);
+
+    fand_assert(tick_close() == 0);
+}
@@ -0,0 +1,6 @@
+#ifndef TICK_TEST_H
+#define TICK_TEST_H
+
+void test_tick_missed(void);
+
+#endif /* TICK_TEST_H */